@@ -108,6 +108,10 @@ static void bdrv_reopen_abort(BDRVReopenState *reopen_state);
 
 static bool bdrv_backing_overridden(BlockDriverState *bs);
 
+static BdrvChainCache *bdrv_chain_cache_new(void);
+static void bdrv_chain_cache_free(BdrvChainCache *cache);
+static void bdrv_chain_cache_invalidate_all(void);
+
 /* If non-zero, use only whitelisted block drivers */
 static int use_bdrv_whitelist;
 
@@ -1404,6 +1408,10 @@ static void bdrv_inherited_options(BdrvChildRole role, bool parent_is_format,
     qdict_copy_default(child_options, parent_options, BDRV_OPT_FORCE_SHARE);
 
     if (role & BDRV_CHILD_COW) {
+        /* The whole chain profits from the allocation cache */
+        qdict_copy_default(child_options, parent_options,
+                           BDRV_OPT_CHAIN_CACHE);
+
         /* backing files are opened read-only by default */
         qdict_set_default_str(child_options, BDRV_OPT_READ_ONLY, "on");
         qdict_set_default_str(child_options, BDRV_OPT_AUTO_READ_ONLY, "off");
@@ -1768,6 +1776,12 @@ QemuOptsList bdrv_runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "always accept other writers (default: off)",
         },
+        {
+            .name = BDRV_OPT_CHAIN_CACHE,
+            .type = QEMU_OPT_BOOL,
+            .help = "cache which layer of the read-only backing chain "
+                    "owns each range (default: off)",
+        },
         { /* end of list */ }
     },
 };
@@ -1834,6 +1848,10 @@ static int bdrv_open_common(BlockDriverState *bs, BlockBackend *file,
         goto fail_opts;
     }
 
+    if (qemu_opt_get_bool(opts, BDRV_OPT_CHAIN_CACHE, false)) {
+        bs->chain_cache = bdrv_chain_cache_new();
+    }
+
     if (file != NULL) {
         bdrv_refresh_filename(blk_bs(file));
         filename = blk_bs(file)->filename;
@@ -2878,6 +2896,7 @@ static void bdrv_replace_child_noperm(BdrvChild **childp,
     if (!new_bs) {
         *childp = NULL;
     }
+    bdrv_chain_cache_invalidate_all();
 
     if (new_bs) {
         assert_bdrv_graph_writable(new_bs);
@@ -4882,6 +4901,9 @@ static void bdrv_reopen_commit(BDRVReopenState *reopen_state)
     bs->open_flags         = reopen_state->flags;
     bs->detect_zeroes      = reopen_state->detect_zeroes;
 
+    /* Whether the chain is read-only may have changed */
+    bdrv_chain_cache_invalidate_all();
+
     /* Remove child references from bs->options and bs->explicit_options.
      * Child options were already removed in bdrv_reopen_queue_child() */
     QLIST_FOREACH(child, &bs->children, next) {
@@ -4956,6 +4978,8 @@ static void bdrv_close(BlockDriverState *bs)
     bs->full_open_options = NULL;
     g_free(bs->block_status_cache);
     bs->block_status_cache = NULL;
+    bdrv_chain_cache_free(bs->chain_cache);
+    bs->chain_cache = NULL;
 
     bdrv_release_named_dirty_bitmaps(bs);
     assert(QLIST_EMPTY(&bs->dirty_bitmaps));
@@ -6687,6 +6711,9 @@ int coroutine_fn bdrv_co_invalidate_cache(BlockDriverState *bs, Error **errp)
 
     assert(!(bs->open_flags & BDRV_O_INACTIVE));
 
+    /* The image may have been changed while we were inactive */
+    bdrv_chain_cache_invalidate_all();
+
     if (bs->drv->bdrv_co_invalidate_cache) {
         bs->drv->bdrv_co_invalidate_cache(bs, &local_err);
         if (local_err) {
@@ -8240,3 +8267,206 @@ void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes)
         g_free_rcu(old_bsc, rcu);
     }
 }
+
+/*
+ * Bumped whenever the backing chain of any node may have changed, i.e. on
+ * graph changes, reopens and (in)activation.  This is not frequent enough
+ * to warrant finding the affected caches.
+ */
+static unsigned int bdrv_chain_cache_generation;
+
+/* Drop a cache when it holds this many entries, it is refilled on demand */
+#define BDRV_CHAIN_CACHE_MAX_ENTRIES 65536
+
+typedef struct BdrvChainCacheEntry {
+    int64_t offset;
+    int64_t bytes;
+    BlockDriverState *target;
+    BdrvChild *child;   /* leads to @target, NULL if it is the cache's node */
+    int skip;
+} BdrvChainCacheEntry;
+
+static void bdrv_chain_cache_invalidate_all(void)
+{
+    qatomic_inc(&bdrv_chain_cache_generation);
+}
+
+static BdrvChainCache *bdrv_chain_cache_new(void)
+{
+    BdrvChainCache *cache = g_new0(BdrvChainCache, 1);
+    int i;
+
+    qemu_mutex_init(&cache->lock);
+    cache->generation = qatomic_read(&bdrv_chain_cache_generation);
+    for (i = 0; i < ARRAY_SIZE(cache->entries); i++) {
+        cache->entries[i] = g_array_new(false, false,
+                                        sizeof(BdrvChainCacheEntry));
+    }
+    return cache;
+}
+
+static void bdrv_chain_cache_free(BdrvChainCache *cache)
+{
+    int i;
+
+    if (!cache) {
+        return;
+    }
+    for (i = 0; i < ARRAY_SIZE(cache->entries); i++) {
+        g_array_free(cache->entries[i], true);
+    }
+    qemu_mutex_destroy(&cache->lock);
+    g_free(cache);
+}
+
+/* Return the entries for @want_zero; call with the cache locked */
+static GArray *bdrv_chain_cache_entries(BdrvChainCache *cache, bool want_zero)
+{
+    unsigned int generation = qatomic_read(&bdrv_chain_cache_generation);
+    int i;
+
+    if (cache->generation != generation) {
+        for (i = 0; i < ARRAY_SIZE(cache->entries); i++) {
+            g_array_set_size(cache->entries[i], 0);
+        }
+        cache->generation = generation;
+    }
+    return cache->entries[want_zero];
+}
+
+/* Index of the first entry that ends after @offset */
+static guint bdrv_chain_cache_find(GArray *entries, int64_t offset)
+{
+    guint lo = 0, hi = entries->len;
+
+    while (lo < hi) {
+        guint mid = lo + (hi - lo) / 2;
+        BdrvChainCacheEntry *e =
+            &g_array_index(entries, BdrvChainCacheEntry, mid);
+
+        if (e->offset + e->bytes <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * See block_int.h for this function's documentation.
+ */
+BlockDriverState *bdrv_chain_cache_lookup(BlockDriverState *bs,
+                                          bool want_zero, int64_t offset,
+                                          int64_t bytes, int64_t *pnum,
+                                          int *skip, BdrvChild **child)
+{
+    BdrvChainCache *cache = bs->chain_cache;
+    BlockDriverState *target = NULL;
+    GArray *entries;
+    guint i;
+    IO_CODE();
+
+    if (!cache) {
+        return NULL;
+    }
+
+    QEMU_LOCK_GUARD(&cache->lock);
+
+    entries = bdrv_chain_cache_entries(cache, want_zero);
+    i = bdrv_chain_cache_find(entries, offset);
+    if (i < entries->len) {
+        BdrvChainCacheEntry *e = &g_array_index(entries, BdrvChainCacheEntry,
+                                                i);
+
+        if (e->offset <= offset) {
+            target = e->target;
+            *pnum = MIN(bytes, e->offset + e->bytes - offset);
+            *skip = e->skip;
+            if (child) {
+                *child = e->child;
+            }
+        }
+    }
+
+    return target;
+}
+
+/**
+ * See block_int.h for this function's documentation.
+ */
+void bdrv_chain_cache_insert(BlockDriverState *bs, bool want_zero,
+                             int64_t offset, int64_t bytes,
+                             BlockDriverState *target, int skip)
+{
+    BdrvChainCache *cache = bs->chain_cache;
+    BdrvChainCacheEntry new_entry, *prev, *next;
+    BlockDriverState *p = bs;
+    BdrvChild *child = NULL;
+    GArray *entries;
+    int64_t end = offset + bytes;
+    guint i;
+    int n;
+    IO_CODE();
+
+    if (!cache) {
+        return;
+    }
+
+    /* Writes or filters on the way would invalidate the shortcut */
+    for (n = 0; ; n++) {
+        if (!p->drv || p->drv->is_filter || !bdrv_is_read_only(p)) {
+            return;
+        }
+        if (n == skip) {
+            break;
+        }
+        child = bdrv_cow_child(p);
+        if (!child) {
+            return;
+        }
+        p = child->bs;
+    }
+    assert(p == target);
+
+    QEMU_LOCK_GUARD(&cache->lock);
+
+    entries = bdrv_chain_cache_entries(cache, want_zero);
+    if (entries->len >= BDRV_CHAIN_CACHE_MAX_ENTRIES) {
+        g_array_set_size(entries, 0);
+    }
+
+    /* Only fill the gap between the neighbours, they are just as valid */
+    i = bdrv_chain_cache_find(entries, offset);
+    prev = i > 0 ? &g_array_index(entries, BdrvChainCacheEntry, i - 1) : NULL;
+    next = i < entries->len ?
+           &g_array_index(entries, BdrvChainCacheEntry, i) : NULL;
+    if (next && next->offset <= offset) {
+        offset = MIN(next->offset + next->bytes, end);
+        prev = next;
+        i++;
+        next = i < entries->len ?
+               &g_array_index(entries, BdrvChainCacheEntry, i) : NULL;
+    }
+    if (next) {
+        end = MIN(end, next->offset);
+    }
+    if (offset >= end) {
+        return;
+    }
+
+    if (prev && prev->target == target &&
+        prev->offset + prev->bytes == offset) {
+        prev->bytes = end - prev->offset;
+        return;
+    }
+
+    new_entry = (BdrvChainCacheEntry) {
+        .offset = offset,
+        .bytes = end - offset,
+        .target = target,
+        .child = child,
+        .skip = skip,
+    };
+    g_array_insert_val(entries, i, new_entry);
+}
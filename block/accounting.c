@@ -182,6 +182,40 @@ void block_latency_histograms_clear(BlockAcctStats *stats)
     }
 }
 
+/* block_latency_histogram_percentile:
+ * Return an upper bound for the @percentile'th percentile of the latencies
+ * in @hist, i.e. the end of the interval it falls into.  For the last,
+ * unbounded interval, its start is returned instead.  Return 0 if @hist is
+ * disabled or empty.
+ */
+uint64_t block_latency_histogram_percentile(const BlockLatencyHistogram *hist,
+                                            double percentile)
+{
+    uint64_t total = 0, sum = 0;
+    double target;
+    int i;
+
+    if (hist->bins == NULL || hist->nbins < 2) {
+        return 0;
+    }
+
+    for (i = 0; i < hist->nbins; i++) {
+        total += hist->bins[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    target = total * percentile / 100;
+    for (i = 0; i < hist->nbins - 1; i++) {
+        sum += hist->bins[i];
+        if (sum >= target) {
+            return hist->boundaries[i];
+        }
+    }
+    return hist->boundaries[hist->nbins - 2];
+}
+
 static void block_account_one_io(BlockAcctStats *stats, BlockAcctCookie *cookie,
                                  bool failed)
 {
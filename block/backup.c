@@ -327,6 +327,14 @@ static void coroutine_fn backup_set_speed(BlockJob *job, int64_t speed)
     }
 }
 
+static void backup_query(BlockJob *job, BlockJobInfo *info)
+{
+    BackupBlockJob *s = container_of(job, BackupBlockJob, common);
+
+    info->has_throughput = true;
+    info->throughput = block_copy_throughput(s->bcs);
+}
+
 static bool backup_cancel(Job *job, bool force)
 {
     BackupBlockJob *s = container_of(job, BackupBlockJob, common.job);
@@ -349,6 +357,7 @@ static const BlockJobDriver backup_job_driver = {
         .cancel                 = backup_cancel,
     },
     .set_speed = backup_set_speed,
+    .query = backup_query,
 };
 
 BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
@@ -486,7 +495,10 @@ BlockJob *backup_job_create(const char *job_id, BlockDriverState *bs,
     job->len = len;
     job->perf = *perf;
 
-    block_copy_set_copy_opts(bcs, perf->use_copy_range, compress);
+    block_copy_set_copy_opts(bcs, perf->has_use_copy_range ?
+                             perf->use_copy_range :
+                             block_copy_copy_range_supported(bcs),
+                             compress);
     block_copy_set_progress_meter(bcs, &job->common.job.progress);
     block_copy_set_speed(bcs, speed);
 
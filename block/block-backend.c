@@ -2517,6 +2517,16 @@ void blk_io_limits_enable(BlockBackend *blk, const char *group)
                                 group, blk_get_aio_context(blk));
 }
 
+/*
+ * Whether I/O limits are set on @blk.  Callers that bypass the BlockBackend
+ * for I/O must not do so while this is true.
+ */
+bool blk_io_limits_enabled(BlockBackend *blk)
+{
+    IO_CODE();
+    return blk->public.throttle_group_member.throttle_state != NULL;
+}
+
 void blk_io_limits_update_group(BlockBackend *blk, const char *group)
 {
     GLOBAL_STATE_CODE();
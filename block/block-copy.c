@@ -24,11 +24,16 @@
 #include "block/aio_task.h"
 #include "qemu/error-report.h"
 #include "qemu/memalign.h"
+#include "qemu/timer.h"
+#include "qemu/stats64.h"
 
 #define BLOCK_COPY_MAX_COPY_RANGE (16 * MiB)
 #define BLOCK_COPY_MAX_BUFFER (1 * MiB)
+#define BLOCK_COPY_MAX_ADAPTIVE_BUFFER (16 * MiB)
 #define BLOCK_COPY_MAX_MEM (128 * MiB)
 #define BLOCK_COPY_MAX_WORKERS 64
+#define BLOCK_COPY_INITIAL_WORKERS 16
+#define BLOCK_COPY_ADAPT_INTERVAL 500000000LL /* ns */
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
@@ -155,6 +160,19 @@ typedef struct BlockCopyState {
     ProgressMeter *progress;
     SharedResource *mem;
     RateLimit rate_limit;
+
+    /*
+     * Adaptive tuning of request size and parallelism for buffered copying,
+     * based on the throughput observed in intervals of
+     * BLOCK_COPY_ADAPT_INTERVAL. Protected by lock.
+     */
+    int64_t adapt_chunk;
+    int64_t adapt_min_chunk;
+    int adapt_workers;
+    int64_t adapt_window_start;
+    uint64_t adapt_window_bytes;
+    uint64_t adapt_last_throughput;
+    Stat64 throughput; /* bytes per second */
 } BlockCopyState;
 
 /* Called with lock held */
@@ -164,6 +182,7 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     case COPY_READ_WRITE_CLUSTER:
         return s->cluster_size;
     case COPY_READ_WRITE:
+        return MIN(MAX(s->cluster_size, s->adapt_chunk), s->max_transfer);
     case COPY_RANGE_SMALL:
         return MIN(MAX(s->cluster_size, BLOCK_COPY_MAX_BUFFER),
                    s->max_transfer);
@@ -176,6 +195,56 @@ static int64_t block_copy_chunk_size(BlockCopyState *s)
     }
 }
 
+/*
+ * Account @bytes of successfully copied data and, once per interval, adjust
+ * chunk size and number of workers: grow both while throughput keeps
+ * improving and step back when it drops noticeably.
+ *
+ * Called with lock held.
+ */
+static void block_copy_adapt(BlockCopyState *s, int64_t bytes)
+{
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    int64_t elapsed;
+    uint64_t throughput, last;
+
+    if (!s->adapt_window_start) {
+        s->adapt_window_start = now;
+    }
+    s->adapt_window_bytes += bytes;
+
+    elapsed = now - s->adapt_window_start;
+    if (elapsed < BLOCK_COPY_ADAPT_INTERVAL) {
+        return;
+    }
+
+    throughput = s->adapt_window_bytes * 1000 / (elapsed / SCALE_MS);
+    last = s->adapt_last_throughput;
+
+    if (throughput > last + last / 10) {
+        s->adapt_chunk = MIN(s->adapt_chunk * 2,
+                             BLOCK_COPY_MAX_ADAPTIVE_BUFFER);
+        s->adapt_workers = MIN(s->adapt_workers * 2, BLOCK_COPY_MAX_WORKERS);
+    } else if (throughput < last - last / 5) {
+        s->adapt_chunk = MAX(s->adapt_chunk / 2, s->adapt_min_chunk);
+        s->adapt_workers = MAX(s->adapt_workers / 2, 1);
+    }
+
+    trace_block_copy_adapt(s, throughput, s->adapt_chunk, s->adapt_workers);
+
+    s->adapt_last_throughput = throughput;
+    s->adapt_window_start = now;
+    s->adapt_window_bytes = 0;
+    stat64_set(&s->throughput, throughput);
+}
+
+/* Called with lock held */
+static int block_copy_workers(BlockCopyState *s,
+                              BlockCopyCallState *call_state)
+{
+    return MIN(s->adapt_workers, call_state->max_workers);
+}
+
 /*
  * Search for the first dirty area in offset/bytes range and create task at
  * the beginning of it.
@@ -277,6 +346,41 @@ static uint32_t block_copy_max_transfer(BdrvChild *source, BdrvChild *target)
                                      target->bs->bl.max_transfer));
 }
 
+/*
+ * Follow the primary children of @bs down to the protocol node, as
+ * copy_range requests are passed on by format and filter drivers. Returns
+ * NULL if any node on the way does not implement the callback for the
+ * respective direction.
+ */
+static BlockDriverState *block_copy_range_leaf(BlockDriverState *bs,
+                                               bool is_source)
+{
+    while (bs) {
+        BlockDriver *drv = bs->drv;
+        BlockDriverState *child;
+
+        if (!drv || !(is_source ? drv->bdrv_co_copy_range_from
+                                : drv->bdrv_co_copy_range_to)) {
+            return NULL;
+        }
+        child = bdrv_primary_bs(bs);
+        if (!child) {
+            return bs;
+        }
+        bs = child;
+    }
+    return NULL;
+}
+
+bool block_copy_copy_range_supported(BlockCopyState *s)
+{
+    BlockDriverState *src = block_copy_range_leaf(s->source->bs, true);
+    BlockDriverState *dst = block_copy_range_leaf(s->target->bs, false);
+
+    /* Offloading only works between nodes of the same protocol driver */
+    return src && dst && src->drv == dst->drv;
+}
+
 void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
                               bool compress)
 {
@@ -350,6 +454,7 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
     int64_t cluster_size;
     BdrvDirtyBitmap *copy_bitmap;
     bool is_fleecing;
+    int64_t min_chunk;
 
     cluster_size = block_copy_calculate_cluster_size(target->bs, errp);
     if (cluster_size < 0) {
@@ -390,6 +495,11 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
      */
     is_fleecing = bdrv_chain_contains(target->bs, source->bs);
 
+    /* Start with the optimal transfer size of the target if it has one */
+    min_chunk = QEMU_ALIGN_UP(MAX(BLOCK_COPY_MAX_BUFFER,
+                                  target->bs->bl.opt_transfer),
+                              cluster_size);
+
     s = g_new(BlockCopyState, 1);
     *s = (BlockCopyState) {
         .source = source,
@@ -402,6 +512,9 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
+        .adapt_chunk = min_chunk,
+        .adapt_min_chunk = min_chunk,
+        .adapt_workers = BLOCK_COPY_INITIAL_WORKERS,
     };
 
     block_copy_set_copy_opts(s, false, false);
@@ -567,8 +680,13 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
                 t->call_state->ret = ret;
                 t->call_state->error_is_read = error_is_read;
             }
-        } else if (s->progress) {
-            progress_work_done(s->progress, t->req.bytes);
+        } else {
+            if (t->method != COPY_WRITE_ZEROES) {
+                block_copy_adapt(s, t->req.bytes);
+            }
+            if (s->progress) {
+                progress_work_done(s->progress, t->req.bytes);
+            }
         }
     }
     co_put_to_shres(s->mem, t->req.bytes);
@@ -580,9 +698,10 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
 static int block_copy_block_status(BlockCopyState *s, int64_t offset,
                                    int64_t bytes, int64_t *pnum)
 {
-    int64_t num;
+    const int mask = BDRV_BLOCK_ALLOCATED | BDRV_BLOCK_ZERO | BDRV_BLOCK_DATA;
+    int64_t num, next_num;
     BlockDriverState *base;
-    int ret;
+    int ret, next_ret;
 
     if (qatomic_read(&s->skip_unallocated)) {
         base = bdrv_backing_chain_next(s->source->bs);
@@ -592,6 +711,22 @@ static int block_copy_block_status(BlockCopyState *s, int64_t offset,
 
     ret = bdrv_block_status_above(s->source->bs, base, offset, bytes, &num,
                                   NULL, NULL);
+
+    /*
+     * Formats report one extent per contiguous host area, so adjacent data
+     * extents would end up as separate small requests. Merge extents that
+     * are handled the same way into one request.
+     */
+    while (ret >= 0 && num > 0 && num < bytes) {
+        next_ret = bdrv_block_status_above(s->source->bs, base, offset + num,
+                                           bytes - num, &next_num, NULL, NULL);
+        if (next_ret < 0 || next_num == 0 ||
+            (next_ret & mask) != (ret & mask)) {
+            break;
+        }
+        num += next_num;
+    }
+
     if (ret < 0 || num < s->cluster_size) {
         /*
          * On error or if failed to obtain large enough chunk just fallback to
@@ -778,6 +913,14 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
         }
+        if (aio) {
+            int workers;
+
+            WITH_QEMU_LOCK_GUARD(&s->lock) {
+                workers = block_copy_workers(s, call_state);
+            }
+            aio_task_pool_set_max_busy_tasks(aio, workers);
+        }
 
         ret = block_copy_task_run(aio, task);
         if (ret < 0) {
@@ -990,6 +1133,11 @@ int64_t block_copy_cluster_size(BlockCopyState *s)
     return s->cluster_size;
 }
 
+uint64_t block_copy_throughput(BlockCopyState *s)
+{
+    return stat64_get(&s->throughput);
+}
+
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
 {
     qatomic_set(&s->skip_unallocated, skip);
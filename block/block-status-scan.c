@@ -0,0 +1,353 @@
+/*
+ * Parallel block status scanning
+ *
+ * Walking an image with one bdrv_block_status_above() call after the other
+ * is slow when each call is expensive, e.g. on long backing chains or remote
+ * images.  A BlockStatusScan splits the range into chunks that are walked by
+ * several coroutines at once, and hands the results to its user in offset
+ * order.  Only a bounded window of chunks ahead of the user is kept.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qemu/coroutine.h"
+#include "qemu/queue.h"
+#include "qemu/units.h"
+#include "block/block_int.h"
+#include "block/block-status-scan.h"
+#include "block/coroutines.h"
+#include "trace.h"
+
+/*
+ * Chunks start small so that the first results come in quickly, and double
+ * in size while the image turns out to be uniform.
+ */
+#define BLOCK_STATUS_SCAN_MIN_CHUNK (64 * MiB)
+#define BLOCK_STATUS_SCAN_MAX_CHUNK (16 * GiB)
+
+typedef struct BlockStatusChunk {
+    int64_t offset;
+    int64_t bytes;
+    GArray *extents;    /* BlockStatusExtent, in offset order */
+    guint pos;          /* first extent the user may still ask for */
+    int ret;            /* error that stopped the walk after the extents */
+    bool done;
+    QSIMPLEQ_ENTRY(BlockStatusChunk) next;
+} BlockStatusChunk;
+
+struct BlockStatusScan {
+    BlockDriverState *bs;
+    BlockDriverState *base;
+    bool include_base;
+    bool want_zero;
+    BlockStatusScanFunc func;
+    void *opaque;
+
+    int64_t end;
+    int64_t next_offset;    /* start of the part no worker has claimed yet */
+    int64_t chunk_size;
+    int max_workers;
+    int workers;
+    int nb_chunks;
+    bool stopping;
+
+    /* Claimed chunks, in offset order */
+    QSIMPLEQ_HEAD(, BlockStatusChunk) chunks;
+    /* The user, if it waits for a worker in coroutine context */
+    Coroutine *waiting_co;
+};
+
+static int coroutine_fn block_status_scan_above(void *opaque, int64_t offset,
+                                                int64_t bytes,
+                                                BlockStatusExtent *ext)
+{
+    BlockStatusScan *scan = opaque;
+    int ret;
+
+    ext->map = 0;
+    ext->file = NULL;
+    ret = bdrv_co_common_block_status_above(scan->bs, scan->base,
+                                            scan->include_base,
+                                            scan->want_zero, offset, bytes,
+                                            &ext->bytes, &ext->map,
+                                            &ext->file, &ext->depth);
+    if (ret < 0) {
+        return ret;
+    }
+
+    ext->offset = offset;
+    ext->status = ret;
+    return 0;
+}
+
+static bool extent_mergeable(const BlockStatusExtent *a,
+                             const BlockStatusExtent *b)
+{
+    return a->offset + a->bytes == b->offset &&
+           a->status == b->status &&
+           a->depth == b->depth &&
+           a->file == b->file &&
+           (!(a->status & BDRV_BLOCK_OFFSET_VALID) ||
+            a->map + a->bytes == b->map);
+}
+
+static void block_status_scan_wake(BlockStatusScan *scan)
+{
+    Coroutine *co = scan->waiting_co;
+
+    if (co) {
+        scan->waiting_co = NULL;
+        aio_co_wake(co);
+    }
+}
+
+static bool block_status_scan_can_claim(BlockStatusScan *scan)
+{
+    return !scan->stopping && scan->next_offset < scan->end &&
+           scan->nb_chunks < scan->max_workers * 2;
+}
+
+static void coroutine_fn block_status_scan_walk(BlockStatusScan *scan,
+                                                BlockStatusChunk *chunk)
+{
+    int64_t end = chunk->offset + chunk->bytes;
+    int64_t offset = chunk->offset;
+
+    while (offset < end && !scan->stopping) {
+        BlockStatusExtent ext;
+        BlockStatusExtent *last;
+        int ret;
+
+        ret = scan->func(scan->opaque, offset, end - offset, &ext);
+        if (ret < 0) {
+            chunk->ret = ret;
+            break;
+        }
+
+        assert(ext.bytes > 0);
+        ext.offset = offset;
+        ext.bytes = MIN(ext.bytes, end - offset);
+
+        last = chunk->extents->len ?
+               &g_array_index(chunk->extents, BlockStatusExtent,
+                              chunk->extents->len - 1) : NULL;
+        if (last && extent_mergeable(last, &ext)) {
+            last->bytes += ext.bytes;
+        } else {
+            g_array_append_val(chunk->extents, ext);
+        }
+        offset += ext.bytes;
+    }
+}
+
+static void coroutine_fn block_status_scan_worker(void *opaque)
+{
+    BlockStatusScan *scan = opaque;
+
+    /* Always claim one chunk, the user may be waiting for it */
+    do {
+        BlockStatusChunk *chunk = g_new0(BlockStatusChunk, 1);
+
+        chunk->offset = scan->next_offset;
+        chunk->bytes = MIN(scan->chunk_size, scan->end - chunk->offset);
+        chunk->extents = g_array_new(FALSE, FALSE, sizeof(BlockStatusExtent));
+        scan->next_offset += chunk->bytes;
+        QSIMPLEQ_INSERT_TAIL(&scan->chunks, chunk, next);
+        scan->nb_chunks++;
+
+        block_status_scan_walk(scan, chunk);
+        chunk->done = true;
+        trace_block_status_scan_chunk(scan, chunk->offset, chunk->bytes,
+                                      chunk->extents->len, chunk->ret);
+
+        if (chunk->extents->len == 1 && chunk->ret == 0) {
+            scan->chunk_size = MIN(scan->chunk_size * 2,
+                                   BLOCK_STATUS_SCAN_MAX_CHUNK);
+        } else {
+            scan->chunk_size = BLOCK_STATUS_SCAN_MIN_CHUNK;
+        }
+
+        block_status_scan_wake(scan);
+    } while (block_status_scan_can_claim(scan) &&
+             !qatomic_read(&scan->bs->quiesce_counter));
+
+    scan->workers--;
+    block_status_scan_wake(scan);
+    bdrv_dec_in_flight(scan->bs);
+}
+
+static void block_status_scan_spawn(BlockStatusScan *scan)
+{
+    Coroutine *co = qemu_coroutine_create(block_status_scan_worker, scan);
+
+    scan->workers++;
+    bdrv_inc_in_flight(scan->bs);
+    aio_co_enter(bdrv_get_aio_context(scan->bs), co);
+}
+
+/* Start workers for the window ahead of the user, unless @bs is drained */
+static void block_status_scan_kick(BlockStatusScan *scan)
+{
+    while (scan->workers < scan->max_workers &&
+           block_status_scan_can_claim(scan) &&
+           !qatomic_read(&scan->bs->quiesce_counter))
+    {
+        block_status_scan_spawn(scan);
+    }
+}
+
+BlockStatusScan *block_status_scan_new(BlockDriverState *bs,
+                                       BlockDriverState *base,
+                                       bool include_base, bool want_zero,
+                                       int64_t offset, int64_t bytes,
+                                       int max_workers,
+                                       BlockStatusScanFunc func, void *opaque)
+{
+    BlockStatusScan *scan = g_new0(BlockStatusScan, 1);
+
+    assert(max_workers > 0);
+    assert(offset >= 0 && bytes >= 0);
+
+    *scan = (BlockStatusScan) {
+        .bs = bs,
+        .base = base,
+        .include_base = include_base,
+        .want_zero = want_zero,
+        .func = func ?: block_status_scan_above,
+        .opaque = func ? opaque : scan,
+        .end = offset + bytes,
+        .next_offset = offset,
+        .chunk_size = BLOCK_STATUS_SCAN_MIN_CHUNK,
+        .max_workers = max_workers,
+    };
+    QSIMPLEQ_INIT(&scan->chunks);
+
+    return scan;
+}
+
+static void block_status_scan_wait(BlockStatusScan *scan, bool *cond)
+{
+    if (qemu_in_coroutine()) {
+        while (!*cond) {
+            scan->waiting_co = qemu_coroutine_self();
+            qemu_coroutine_yield();
+        }
+    } else {
+        BDRV_POLL_WHILE(scan->bs, !*cond);
+    }
+}
+
+static void block_status_chunk_free(BlockStatusChunk *chunk)
+{
+    g_array_free(chunk->extents, TRUE);
+    g_free(chunk);
+}
+
+int block_status_scan_get(BlockStatusScan *scan, int64_t offset,
+                          BlockStatusExtent *ext)
+{
+    BlockStatusChunk *chunk;
+    BlockStatusExtent *e;
+    int64_t delta;
+
+    assert(offset < scan->end);
+
+    for (;;) {
+        /* Drop what the user has moved past */
+        while ((chunk = QSIMPLEQ_FIRST(&scan->chunks)) && chunk->done &&
+               chunk->offset + chunk->bytes <= offset)
+        {
+            QSIMPLEQ_REMOVE_HEAD(&scan->chunks, next);
+            scan->nb_chunks--;
+            block_status_chunk_free(chunk);
+        }
+
+        if (!chunk) {
+            /* Nothing claimed at @offset, don't scan what was skipped */
+            scan->next_offset = MAX(scan->next_offset, offset);
+            block_status_scan_kick(scan);
+            if (QSIMPLEQ_EMPTY(&scan->chunks)) {
+                /* @bs is drained, but the user needs this one */
+                block_status_scan_spawn(scan);
+            }
+            continue;
+        }
+
+        block_status_scan_kick(scan);
+        if (chunk->done) {
+            break;
+        }
+        block_status_scan_wait(scan, &chunk->done);
+    }
+
+    assert(chunk->offset <= offset);
+    while (chunk->pos < chunk->extents->len) {
+        e = &g_array_index(chunk->extents, BlockStatusExtent, chunk->pos);
+        if (e->offset + e->bytes > offset) {
+            break;
+        }
+        chunk->pos++;
+    }
+    if (chunk->pos == chunk->extents->len) {
+        assert(chunk->ret < 0);
+        return chunk->ret;
+    }
+
+    *ext = g_array_index(chunk->extents, BlockStatusExtent, chunk->pos);
+    delta = offset - ext->offset;
+    ext->offset = offset;
+    ext->bytes -= delta;
+    if (ext->status & BDRV_BLOCK_OFFSET_VALID) {
+        ext->map += delta;
+    }
+
+    /*
+     * Extents within one chunk are merged by the worker already, so only
+     * the following chunks can continue this extent.
+     */
+    if (chunk->pos + 1 < chunk->extents->len) {
+        return 0;
+    }
+    while (chunk->ret == 0 && (chunk = QSIMPLEQ_NEXT(chunk, next)) &&
+           chunk->done)
+    {
+        guint i;
+
+        for (i = 0; i < chunk->extents->len; i++) {
+            e = &g_array_index(chunk->extents, BlockStatusExtent, i);
+            if (!extent_mergeable(ext, e)) {
+                return 0;
+            }
+            ext->bytes += e->bytes;
+        }
+    }
+
+    return 0;
+}
+
+void block_status_scan_free(BlockStatusScan *scan)
+{
+    BlockStatusChunk *chunk, *next;
+
+    if (!scan) {
+        return;
+    }
+
+    scan->stopping = true;
+    if (qemu_in_coroutine()) {
+        while (scan->workers) {
+            scan->waiting_co = qemu_coroutine_self();
+            qemu_coroutine_yield();
+        }
+    } else {
+        BDRV_POLL_WHILE(scan->bs, scan->workers > 0);
+    }
+
+    QSIMPLEQ_FOREACH_SAFE(chunk, &scan->chunks, next, next) {
+        block_status_chunk_free(chunk);
+    }
+    g_free(scan);
+}
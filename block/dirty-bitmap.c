@@ -879,6 +879,14 @@ bool bdrv_dirty_bitmap_next_dirty_area(BdrvDirtyBitmap *bitmap,
                                    dirty_start, dirty_count);
 }
 
+size_t bdrv_dirty_bitmap_get_dirty_extents(BdrvDirtyBitmap *bitmap,
+        int64_t start, int64_t end, HBitmapExtent *extents,
+        size_t max_extents)
+{
+    return hbitmap_get_dirty_extents(bitmap->bitmap, start, end, extents,
+                                     max_extents);
+}
+
 bool bdrv_dirty_bitmap_status(BdrvDirtyBitmap *bitmap, int64_t offset,
                               int64_t bytes, int64_t *count)
 {
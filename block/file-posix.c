@@ -157,6 +157,9 @@ typedef struct BDRVRawState {
     bool discard_zeroes:1;
     bool use_linux_aio:1;
     bool use_linux_io_uring:1;
+    /* fallocate() modes that io_uring takes as IORING_OP_FALLOCATE */
+    bool luring_punch_hole:1;
+    bool luring_zero_range:1;
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -167,8 +170,20 @@ typedef struct BDRVRawState {
         uint64_t discard_nb_ok;
         uint64_t discard_nb_failed;
         uint64_t discard_bytes_ok;
+        uint64_t discard_nb_coalesced;
+        uint64_t write_zeroes_nb_coalesced;
     } stats;
 
+    /*
+     * Discard and write zeroes requests that wait for adjacent requests to
+     * be merged with, if coalescing is enabled, and the number of merged
+     * requests that have been submitted and not completed yet.
+     */
+    bool coalesce;
+    int64_t coalesce_window_ns;
+    QLIST_HEAD(, RawCoalesceBatch) coalesce_batches;
+    int coalesce_in_flight;
+
     PRManager *pr_mgr;
 } BDRVRawState;
 
@@ -550,6 +565,12 @@ static QemuOptsList raw_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "AIO max batch size (0 = auto handled by AIO backend, default: 0)",
         },
+        {
+            .name = "coalesce-window",
+            .type = QEMU_OPT_NUMBER,
+            .help = "microseconds that discard and write zeroes requests wait "
+                    "for adjacent ones to merge with (default: no merging)",
+        },
         {
             .name = "locking",
             .type = QEMU_OPT_STRING,
@@ -627,10 +648,25 @@ static int raw_open_common(BlockDriverState *bs, QDict *options,
     s->use_linux_aio = (aio == BLOCKDEV_AIO_OPTIONS_NATIVE);
 #ifdef CONFIG_LINUX_IO_URING
     s->use_linux_io_uring = (aio == BLOCKDEV_AIO_OPTIONS_IO_URING);
+    s->luring_punch_hole = s->use_linux_io_uring;
+    s->luring_zero_range = s->use_linux_io_uring;
 #endif
 
     s->aio_max_batch = qemu_opt_get_number(opts, "aio-max-batch", 0);
 
+    QLIST_INIT(&s->coalesce_batches);
+    if (qemu_opt_get(opts, "coalesce-window")) {
+        uint64_t window_us = qemu_opt_get_number(opts, "coalesce-window", 0);
+
+        if (window_us > INT64_MAX / SCALE_US) {
+            error_setg(errp, "coalesce-window is too large");
+            ret = -EINVAL;
+            goto fail;
+        }
+        s->coalesce = true;
+        s->coalesce_window_ns = window_us * SCALE_US;
+    }
+
     locking = qapi_enum_parse(&OnOffAuto_lookup,
                               qemu_opt_get(opts, "locking"),
                               ON_OFF_AUTO_AUTO, &local_err);
@@ -2958,27 +2994,241 @@ static void raw_account_discard(BDRVRawState *s, uint64_t nbytes, int ret)
     }
 }
 
-static coroutine_fn int
-raw_do_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes,
-                bool blkdev)
+#ifdef CONFIG_LINUX_IO_URING
+/*
+ * Submit a discard or write zeroes request on a regular file to io_uring as
+ * IORING_OP_FALLOCATE.  Return -ENOTSUP if it has to go through the thread
+ * pool, whose handlers know all the fallbacks.
+ *
+ * Support is tracked per fallocate() mode: a file system may punch holes
+ * but not zero ranges, and the thread pool handlers then clear
+ * has_write_zeroes or has_discard for good.
+ */
+static int coroutine_fn raw_co_luring_fallocate(BlockDriverState *bs,
+                                                int type, int64_t offset,
+                                                int64_t bytes)
 {
     BDRVRawState *s = bs->opaque;
-    RawPosixAIOData acb;
+    LuringState *aio = aio_get_linux_io_uring(bdrv_get_aio_context(bs));
+    int luring_type;
+    int mode;
     int ret;
 
+    if (type & QEMU_AIO_DISCARD) {
+        /* Discard, or write zeroes that may unmap */
+#ifdef CONFIG_FALLOCATE_PUNCH_HOLE
+        if (!s->has_discard || !s->luring_punch_hole) {
+            return -ENOTSUP;
+        }
+        mode = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+#else
+        return -ENOTSUP;
+#endif
+    } else {
+#ifdef CONFIG_FALLOCATE_ZERO_RANGE
+        if (!s->has_write_zeroes || !s->luring_zero_range) {
+            return -ENOTSUP;
+        }
+        mode = FALLOC_FL_ZERO_RANGE;
+#else
+        return -ENOTSUP;
+#endif
+    }
+
+    assert(aio);
+    luring_type = type & QEMU_AIO_WRITE_ZEROES ? QEMU_AIO_WRITE_ZEROES :
+                                                 QEMU_AIO_DISCARD;
+    ret = luring_co_submit_fallocate(bs, aio, s->fd, luring_type, mode,
+                                     offset, bytes);
+    switch (ret) {
+    case -EINVAL:
+        /*
+         * Kernels before 5.6 don't know the opcode and return EINVAL.  Stop
+         * using io_uring for this mode only; if the other one is affected
+         * too, it will find out on its first request.
+         */
+        if (type & QEMU_AIO_DISCARD) {
+            s->luring_punch_hole = false;
+        } else {
+            s->luring_zero_range = false;
+        }
+        return -ENOTSUP;
+    case -EOPNOTSUPP:
+    case -EBUSY:
+        /* For a missing mode, the thread pool handlers update has_* */
+        return -ENOTSUP;
+    default:
+        return ret;
+    }
+}
+#endif
+
+/* Submit a discard or write zeroes request of the given QEMU_AIO_* type */
+static int coroutine_fn raw_co_submit_discard_zeroes(BlockDriverState *bs,
+                                                     int type, int64_t offset,
+                                                     int64_t bytes)
+{
+    BDRVRawState *s = bs->opaque;
+    RawPosixAIOData acb;
+    ThreadPoolFunc *handler;
+
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring && !(type & QEMU_AIO_BLKDEV)) {
+        int ret = raw_co_luring_fallocate(bs, type, offset, bytes);
+        if (ret != -ENOTSUP) {
+            return ret;
+        }
+    }
+#endif
+
     acb = (RawPosixAIOData) {
         .bs             = bs,
         .aio_fildes     = s->fd,
-        .aio_type       = QEMU_AIO_DISCARD,
+        .aio_type       = type,
         .aio_offset     = offset,
         .aio_nbytes     = bytes,
     };
 
+    if (!(type & QEMU_AIO_WRITE_ZEROES)) {
+        handler = handle_aiocb_discard;
+    } else if (type & QEMU_AIO_DISCARD) {
+        handler = handle_aiocb_write_zeroes_unmap;
+    } else {
+        handler = handle_aiocb_write_zeroes;
+    }
+
+    return raw_thread_pool_submit(bs, handler, &acb);
+}
+
+/* Do not let merged requests grow without bounds */
+#define RAW_COALESCE_MAX_BYTES (1 * GiB)
+
+/*
+ * Adjacent discard or write zeroes requests of the same type, submitted as
+ * one request by the first of them (the leader).
+ */
+typedef struct RawCoalesceBatch {
+    int type;
+    int64_t offset;
+    int64_t bytes;
+    int nb_reqs;
+    int refcnt;
+    int ret;
+    CoQueue waiters;
+    QemuCoSleep sleep;
+    QLIST_ENTRY(RawCoalesceBatch) next;
+} RawCoalesceBatch;
+
+static void raw_coalesce_batch_unref(RawCoalesceBatch *batch)
+{
+    if (--batch->refcnt == 0) {
+        g_free(batch);
+    }
+}
+
+/*
+ * Merge a discard or write zeroes request with adjacent ones that are
+ * submitted within the coalescing window, and submit them as one.  Every
+ * request that is part of a batch gets the result of the batch.
+ *
+ * The window only applies while other merged requests are in flight, like
+ * Nagle's algorithm: a request that finds nothing in flight, or whose
+ * predecessors complete early, is submitted right away.
+ */
+static int coroutine_fn raw_co_coalesce(BlockDriverState *bs, int type,
+                                        int64_t offset, int64_t bytes)
+{
+    BDRVRawState *s = bs->opaque;
+    RawCoalesceBatch *batch;
+    int ret;
+
+    QLIST_FOREACH(batch, &s->coalesce_batches, next) {
+        if (batch->type != type ||
+            batch->bytes + bytes > RAW_COALESCE_MAX_BYTES) {
+            continue;
+        }
+        if (offset == batch->offset + batch->bytes) {
+            batch->bytes += bytes;
+        } else if (offset + bytes == batch->offset) {
+            batch->offset = offset;
+            batch->bytes += bytes;
+        } else {
+            continue;
+        }
+
+        batch->nb_reqs++;
+        batch->refcnt++;
+        if (type & QEMU_AIO_WRITE_ZEROES) {
+            s->stats.write_zeroes_nb_coalesced++;
+        } else {
+            s->stats.discard_nb_coalesced++;
+        }
+
+        qemu_co_queue_wait(&batch->waiters, NULL);
+        ret = batch->ret;
+        raw_coalesce_batch_unref(batch);
+        return ret;
+    }
+
+    batch = g_new(RawCoalesceBatch, 1);
+    *batch = (RawCoalesceBatch) {
+        .type = type,
+        .offset = offset,
+        .bytes = bytes,
+        .nb_reqs = 1,
+        .refcnt = 1,
+    };
+    qemu_co_queue_init(&batch->waiters);
+    QLIST_INSERT_HEAD(&s->coalesce_batches, batch, next);
+
+    if (s->coalesce_window_ns && s->coalesce_in_flight) {
+        qemu_co_sleep_ns_wakeable(&batch->sleep, QEMU_CLOCK_REALTIME,
+                                  s->coalesce_window_ns);
+    } else {
+        /* Let the requests that are being submitted right now join */
+        aio_co_schedule(bdrv_get_aio_context(bs), qemu_coroutine_self());
+        qemu_coroutine_yield();
+    }
+    QLIST_REMOVE(batch, next);
+
+    trace_file_coalesce(bs, type, batch->offset, batch->bytes,
+                        batch->nb_reqs);
+    s->coalesce_in_flight++;
+    ret = raw_co_submit_discard_zeroes(bs, type, batch->offset,
+                                      batch->bytes);
+
+    /* Nothing left to wait for, so flush the pending batches */
+    if (--s->coalesce_in_flight == 0) {
+        RawCoalesceBatch *pending;
+
+        QLIST_FOREACH(pending, &s->coalesce_batches, next) {
+            qemu_co_sleep_wake(&pending->sleep);
+        }
+    }
+
+    batch->ret = ret;
+    qemu_co_queue_restart_all(&batch->waiters);
+    raw_coalesce_batch_unref(batch);
+    return ret;
+}
+
+static coroutine_fn int
+raw_do_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                bool blkdev)
+{
+    BDRVRawState *s = bs->opaque;
+    int type = QEMU_AIO_DISCARD;
+    int ret;
+
     if (blkdev) {
-        acb.aio_type |= QEMU_AIO_BLKDEV;
+        type |= QEMU_AIO_BLKDEV;
     }
 
-    ret = raw_thread_pool_submit(bs, handle_aiocb_discard, &acb);
+    if (s->coalesce) {
+        ret = raw_co_coalesce(bs, type, offset, bytes);
+    } else {
+        ret = raw_co_submit_discard_zeroes(bs, type, offset, bytes);
+    }
     raw_account_discard(s, bytes, ret);
     return ret;
 }
@@ -2994,8 +3244,7 @@ raw_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
                      BdrvRequestFlags flags, bool blkdev)
 {
     BDRVRawState *s = bs->opaque;
-    RawPosixAIOData acb;
-    ThreadPoolFunc *handler;
+    int type;
 
 #ifdef CONFIG_FALLOCATE
     if (offset + bytes > bs->total_sectors * BDRV_SECTOR_SIZE) {
@@ -3031,29 +3280,22 @@ raw_do_pwrite_zeroes(BlockDriverState *bs, int64_t offset, int64_t bytes,
     }
 #endif
 
-    acb = (RawPosixAIOData) {
-        .bs             = bs,
-        .aio_fildes     = s->fd,
-        .aio_type       = QEMU_AIO_WRITE_ZEROES,
-        .aio_offset     = offset,
-        .aio_nbytes     = bytes,
-    };
-
+    type = QEMU_AIO_WRITE_ZEROES;
     if (blkdev) {
-        acb.aio_type |= QEMU_AIO_BLKDEV;
+        type |= QEMU_AIO_BLKDEV;
     }
     if (flags & BDRV_REQ_NO_FALLBACK) {
-        acb.aio_type |= QEMU_AIO_NO_FALLBACK;
+        type |= QEMU_AIO_NO_FALLBACK;
     }
-
     if (flags & BDRV_REQ_MAY_UNMAP) {
-        acb.aio_type |= QEMU_AIO_DISCARD;
-        handler = handle_aiocb_write_zeroes_unmap;
-    } else {
-        handler = handle_aiocb_write_zeroes;
+        type |= QEMU_AIO_DISCARD;
     }
 
-    return raw_thread_pool_submit(bs, handler, &acb);
+    /* Requests that extend the file are serialised, see above */
+    if (s->coalesce && offset + bytes <= bs->total_sectors * BDRV_SECTOR_SIZE) {
+        return raw_co_coalesce(bs, type, offset, bytes);
+    }
+    return raw_co_submit_discard_zeroes(bs, type, offset, bytes);
 }
 
 static int coroutine_fn raw_co_pwrite_zeroes(
@@ -3075,6 +3317,8 @@ static BlockStatsSpecificFile get_blockstats_specific_file(BlockDriverState *bs)
         .discard_nb_ok = s->stats.discard_nb_ok,
         .discard_nb_failed = s->stats.discard_nb_failed,
         .discard_bytes_ok = s->stats.discard_bytes_ok,
+        .discard_nb_coalesced = s->stats.discard_nb_coalesced,
+        .write_zeroes_nb_coalesced = s->stats.write_zeroes_nb_coalesced,
     };
 }
 
@@ -3267,6 +3511,20 @@ static int coroutine_fn raw_co_copy_range_to(BlockDriverState *bs,
     return raw_thread_pool_submit(bs, handle_aiocb_copy_range, &acb);
 }
 
+static int raw_get_host_fd(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+
+    /*
+     * O_DIRECT users expect the page cache to stay out of the way, and
+     * sendfile() would go through it.
+     */
+    if (s->type != FTYPE_FILE || (s->open_flags & O_DIRECT)) {
+        return -ENOTSUP;
+    }
+    return s->fd;
+}
+
 BlockDriver bdrv_file = {
     .format_name = "file",
     .protocol_name = "file",
@@ -3293,6 +3551,7 @@ BlockDriver bdrv_file = {
     .bdrv_co_pdiscard       = raw_co_pdiscard,
     .bdrv_co_copy_range_from = raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = raw_co_copy_range_to,
+    .bdrv_get_host_fd       = raw_get_host_fd,
     .bdrv_refresh_limits = raw_refresh_limits,
     .bdrv_io_plug = raw_aio_plug,
     .bdrv_io_unplug = raw_aio_unplug,
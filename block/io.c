@@ -44,6 +44,11 @@
 static void bdrv_parent_cb_resize(BlockDriverState *bs);
 static int coroutine_fn bdrv_co_do_pwrite_zeroes(BlockDriverState *bs,
     int64_t offset, int64_t bytes, BdrvRequestFlags flags);
+static int coroutine_fn
+bdrv_co_block_status_chain(BlockDriverState *p, BlockDriverState *base,
+                           bool include_base, bool want_zero, int ret,
+                           int64_t offset, int64_t bytes, int64_t *pnum,
+                           int64_t *map, BlockDriverState **file, int *depth);
 
 static void bdrv_parent_drained_begin(BlockDriverState *bs, BdrvChild *ignore,
                                       bool ignore_bds_parents)
@@ -1830,6 +1835,49 @@ int coroutine_fn bdrv_co_preadv(BdrvChild *child,
     return bdrv_co_preadv_part(child, offset, bytes, qiov, 0, flags);
 }
 
+/*
+ * Return the child through which the layer of the backing chain of @bs that
+ * owns all of [@offset, @offset + @bytes) can be read directly, or NULL if
+ * that is @bs itself, or the range has several owners.  Fills the chain
+ * cache of @bs on a miss.
+ */
+static BdrvChild * coroutine_fn
+bdrv_co_chain_cache_redirect(BlockDriverState *bs, int64_t offset,
+                             int64_t bytes)
+{
+    BlockDriverState *target;
+    BdrvChild *child;
+    int64_t pnum;
+    int skip;
+
+    target = bdrv_chain_cache_lookup(bs, false, offset, bytes, &pnum, &skip,
+                                     &child);
+    if (!target) {
+        int64_t pos = offset;
+        int depth = 0;
+
+        while (pos < offset + bytes) {
+            int ret = bdrv_co_block_status_chain(bs, NULL, false, false, 0,
+                                                 pos, offset + bytes - pos,
+                                                 &pnum, NULL, NULL, &depth);
+            if (ret < 0 || pnum == 0) {
+                return NULL;
+            }
+            pos += pnum;
+        }
+        target = bdrv_chain_cache_lookup(bs, false, offset, bytes, &pnum,
+                                         &skip, &child);
+    }
+
+    /* Zeroes past the end of a short layer are not the target's to read */
+    if (!target || !child || pnum < bytes ||
+        offset + bytes > target->total_sectors * BDRV_SECTOR_SIZE)
+    {
+        return NULL;
+    }
+    return child;
+}
+
 int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
     int64_t offset, int64_t bytes,
     QEMUIOVector *qiov, size_t qiov_offset,
@@ -1864,6 +1912,25 @@ int coroutine_fn bdrv_co_preadv_part(BdrvChild *child,
         return 0;
     }
 
+    /* Only read-only nodes ever get chain cache entries */
+    if (bs->chain_cache && bdrv_is_read_only(bs) &&
+        !qatomic_read(&bs->copy_on_read) &&
+        !(flags & (BDRV_REQ_COPY_ON_READ | BDRV_REQ_PREFETCH)))
+    {
+        BdrvChild *owner;
+
+        bdrv_inc_in_flight(bs);
+        owner = bdrv_co_chain_cache_redirect(bs, offset, bytes);
+        if (owner) {
+            trace_bdrv_co_preadv_chain_cache(bs, owner->bs, offset, bytes);
+            ret = bdrv_co_preadv_part(owner, offset, bytes, qiov, qiov_offset,
+                                      flags);
+            bdrv_dec_in_flight(bs);
+            return ret;
+        }
+        bdrv_dec_in_flight(bs);
+    }
+
     bdrv_inc_in_flight(bs);
 
     /* Don't do copy-on-read if we read data before write operation */
@@ -2661,52 +2728,66 @@ early_out:
     return ret;
 }
 
-int coroutine_fn
-bdrv_co_common_block_status_above(BlockDriverState *bs,
-                                  BlockDriverState *base,
-                                  bool include_base,
-                                  bool want_zero,
-                                  int64_t offset,
-                                  int64_t bytes,
-                                  int64_t *pnum,
-                                  int64_t *map,
-                                  BlockDriverState **file,
-                                  int *depth)
+/*
+ * Whether a chain cache hit @skip layers below @p can be used, i.e. the
+ * layers skipped do not include @base, and @base does not end the chain
+ * above the owner.
+ */
+static bool bdrv_chain_cache_usable(BlockDriverState *p, int skip,
+                                    BlockDriverState *base, bool include_base)
 {
-    int ret;
-    BlockDriverState *p;
-    int64_t eof = 0;
-    int dummy;
-    IO_CODE();
-
-    assert(!include_base || base); /* Can't include NULL base */
-
-    if (!depth) {
-        depth = &dummy;
+    if (!base) {
+        return true;
     }
-    *depth = 0;
-
-    if (!include_base && bs == base) {
-        *pnum = bytes;
-        return 0;
+    for (; skip > 0; skip--) {
+        if (p == base) {
+            return false;
+        }
+        p = bdrv_filter_or_cow_bs(p);
     }
+    return include_base || p != base;
+}
 
-    ret = bdrv_co_block_status(bs, want_zero, offset, bytes, pnum, map, file);
-    ++*depth;
-    if (ret < 0 || *pnum == 0 || ret & BDRV_BLOCK_ALLOCATED || bs == base) {
-        return ret;
-    }
+/*
+ * Continue a block status query in the layers from @p down to @base, after
+ * the layers above @p have reported @ret for [@offset, @offset + @bytes)
+ * without allocating it.  Return the status of the first layer that has it
+ * allocated (or of the last layer), or @ret if there are no layers to ask.
+ *
+ * Results are kept in the chain cache of @p, if it has one, so that later
+ * queries skip straight to the owning layer.
+ */
+static int coroutine_fn
+bdrv_co_block_status_chain(BlockDriverState *p, BlockDriverState *base,
+                           bool include_base, bool want_zero, int ret,
+                           int64_t offset, int64_t bytes, int64_t *pnum,
+                           int64_t *map, BlockDriverState **file, int *depth)
+{
+    BlockDriverState *cache_bs = NULL;
+    BlockDriverState *last = NULL;
+    int layers = 0;
 
-    if (ret & BDRV_BLOCK_EOF) {
-        eof = offset + *pnum;
+    if (p && p->chain_cache && (include_base || p != base)) {
+        BlockDriverState *target;
+        int64_t cached;
+        int skip;
+
+        target = bdrv_chain_cache_lookup(p, want_zero, offset, bytes, &cached,
+                                         &skip, NULL);
+        if (!target) {
+            cache_bs = p;
+        } else if (bdrv_chain_cache_usable(p, skip, base, include_base)) {
+            /* None of the layers in between has it allocated */
+            *depth += skip;
+            bytes = cached;
+            p = target;
+        }
     }
 
-    assert(*pnum <= bytes);
-    bytes = *pnum;
+    for (; include_base || p != base; p = bdrv_filter_or_cow_bs(p)) {
+        last = p;
+        layers++;
 
-    for (p = bdrv_filter_or_cow_bs(bs); include_base || p != base;
-         p = bdrv_filter_or_cow_bs(p))
-    {
         ret = bdrv_co_block_status(p, want_zero, offset, bytes, pnum, map,
                                    file);
         ++*depth;
@@ -2720,8 +2801,8 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
              * were allocated at this layer.
              *
              * We don't include BDRV_BLOCK_EOF into ret, as upper layer may be
-             * larger. We'll add BDRV_BLOCK_EOF if needed at function end, see
-             * below.
+             * larger. bdrv_co_common_block_status_above() adds BDRV_BLOCK_EOF
+             * if needed.
              */
             assert(ret & BDRV_BLOCK_EOF);
             *pnum = bytes;
@@ -2736,8 +2817,8 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
              * We've found the node and the status, we must break.
              *
              * Drop BDRV_BLOCK_EOF, as it's not for upper layer, which may be
-             * larger. We'll add BDRV_BLOCK_EOF if needed at function end, see
-             * below.
+             * larger. bdrv_co_common_block_status_above() adds
+             * BDRV_BLOCK_EOF if needed.
              */
             ret &= ~BDRV_BLOCK_EOF;
             break;
@@ -2756,6 +2837,66 @@ bdrv_co_common_block_status_above(BlockDriverState *bs,
         bytes = *pnum;
     }
 
+    /* Unless @base cut the search short, the owner is a property of the chain */
+    if (cache_bs && last &&
+        ((ret & BDRV_BLOCK_ALLOCATED) || !bdrv_filter_or_cow_bs(last)))
+    {
+        bdrv_chain_cache_insert(cache_bs, want_zero, offset, *pnum, last,
+                                layers - 1);
+    }
+
+    return ret;
+}
+
+int coroutine_fn
+bdrv_co_common_block_status_above(BlockDriverState *bs,
+                                  BlockDriverState *base,
+                                  bool include_base,
+                                  bool want_zero,
+                                  int64_t offset,
+                                  int64_t bytes,
+                                  int64_t *pnum,
+                                  int64_t *map,
+                                  BlockDriverState **file,
+                                  int *depth)
+{
+    int ret;
+    int64_t eof = 0;
+    int dummy;
+    IO_CODE();
+
+    assert(!include_base || base); /* Can't include NULL base */
+
+    if (!depth) {
+        depth = &dummy;
+    }
+    *depth = 0;
+
+    if (!include_base && bs == base) {
+        *pnum = bytes;
+        return 0;
+    }
+
+    ret = bdrv_co_block_status(bs, want_zero, offset, bytes, pnum, map, file);
+    ++*depth;
+    if (ret < 0 || *pnum == 0 || ret & BDRV_BLOCK_ALLOCATED || bs == base) {
+        return ret;
+    }
+
+    if (ret & BDRV_BLOCK_EOF) {
+        eof = offset + *pnum;
+    }
+
+    assert(*pnum <= bytes);
+    bytes = *pnum;
+
+    ret = bdrv_co_block_status_chain(bdrv_filter_or_cow_bs(bs), base,
+                                     include_base, want_zero, ret, offset,
+                                     bytes, pnum, map, file, depth);
+    if (ret < 0) {
+        return ret;
+    }
+
     if (offset + *pnum == eof) {
         ret |= BDRV_BLOCK_EOF;
     }
@@ -3501,6 +3642,37 @@ int coroutine_fn bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                                    bytes, read_flags, write_flags);
 }
 
+int bdrv_get_host_fd(BlockDriverState *bs)
+{
+    BlockDriverState *node = bs;
+    IO_CODE();
+
+    /*
+     * Reading from the descriptor bypasses every node down to the file, so
+     * all of them must pass the data through unchanged.  Only raw nodes do
+     * (their callback rejects offset and size), and only a plain file-posix
+     * leaf has a descriptor to give out.
+     */
+    for (;;) {
+        if (!node || !node->drv) {
+            return -ENOMEDIUM;
+        }
+        if (!node->drv->bdrv_get_host_fd || node->copy_on_read ||
+            node->encrypted || node->backing) {
+            return -ENOTSUP;
+        }
+        if (!bdrv_primary_child(node)) {
+            break;
+        }
+        node = bdrv_primary_bs(node);
+    }
+    if (strcmp(node->drv->format_name, "file")) {
+        return -ENOTSUP;
+    }
+
+    return bs->drv->bdrv_get_host_fd(bs);
+}
+
 static void bdrv_parent_cb_resize(BlockDriverState *bs)
 {
     BdrvChild *c;
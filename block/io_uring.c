@@ -27,6 +27,9 @@ typedef struct LuringAIOCB {
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
+    /* fallocate() mode and length, for requests without @qiov */
+    int mode;
+    uint64_t nbytes;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
     /*
@@ -165,10 +168,10 @@ static void luring_process_completions(LuringState *s)
 
         if (ret < 0) {
             /*
-             * Only writev/readv/fsync requests on regular files or host block
-             * devices are submitted. Therefore -EAGAIN is not expected but it's
-             * known to happen sometimes with Linux SCSI. Submit again and hope
-             * the request completes successfully.
+             * Only writev/readv/fsync/fallocate requests on regular files or
+             * host block devices are submitted. Therefore -EAGAIN is not
+             * expected but it's known to happen sometimes with Linux SCSI.
+             * Submit again and hope the request completes successfully.
              *
              * For more information, see:
              * https://lore.kernel.org/io-uring/20210727165811.284510-3-axboe@kernel.dk/T/#u
@@ -356,6 +359,11 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     case QEMU_AIO_FLUSH:
         io_uring_prep_fsync(sqes, fd, IORING_FSYNC_DATASYNC);
         break;
+    case QEMU_AIO_DISCARD:
+    case QEMU_AIO_WRITE_ZEROES:
+        io_uring_prep_fallocate(sqes, fd, luringcb->mode, offset,
+                                luringcb->nbytes);
+        break;
     default:
         fprintf(stderr, "%s: invalid AIO request type, aborting 0x%x.\n",
                         __func__, type);
@@ -401,6 +409,33 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
     return luringcb.ret;
 }
 
+int coroutine_fn luring_co_submit_fallocate(BlockDriverState *bs,
+                                            LuringState *s, int fd, int type,
+                                            int mode, uint64_t offset,
+                                            uint64_t bytes)
+{
+    int ret;
+    LuringAIOCB luringcb = {
+        .co         = qemu_coroutine_self(),
+        .ret        = -EINPROGRESS,
+        .mode       = mode,
+        .nbytes     = bytes,
+    };
+
+    assert(type == QEMU_AIO_DISCARD || type == QEMU_AIO_WRITE_ZEROES);
+    trace_luring_co_submit(bs, s, &luringcb, fd, offset, bytes, type);
+    ret = luring_do_submit(fd, &luringcb, s, offset, type);
+
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (luringcb.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return luringcb.ret;
+}
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
     aio_set_fd_handler(old_context, s->ring.ring_fd, false,
@@ -18,6 +18,7 @@
 #include "trace.h"
 #include "block/blockjob_int.h"
 #include "block/block_int.h"
+#include "block/block-status-scan.h"
 #include "sysemu/block-backend.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qerror.h"
@@ -811,8 +812,9 @@ static int coroutine_fn mirror_dirty_init(MirrorBlockJob *s)
     int64_t offset;
     BlockDriverState *bs = s->mirror_top_bs->backing->bs;
     BlockDriverState *target_bs = blk_bs(s->target);
-    int ret;
-    int64_t count;
+    BlockStatusScan *scan;
+    BlockStatusExtent ext;
+    int ret = 0;
 
     if (s->zero_target) {
         if (!bdrv_can_write_zeroes_with_unmap(target_bs)) {
@@ -847,31 +849,34 @@ static int coroutine_fn mirror_dirty_init(MirrorBlockJob *s)
         s->initial_zeroing_ongoing = false;
     }
 
-    /* First part, loop on the sectors and initialize the dirty bitmap.  */
+    /*
+     * First part, loop on the sectors and initialize the dirty bitmap.  The
+     * allocation status is queried ahead in parallel, which matters on long
+     * backing chains.
+     */
+    scan = block_status_scan_new(bs, s->base_overlay, true, false,
+                                 0, s->bdev_length,
+                                 BLOCK_STATUS_SCAN_DEFAULT_WORKERS,
+                                 NULL, NULL);
     for (offset = 0; offset < s->bdev_length; ) {
-        /* Just to make sure we are not exceeding int limit. */
-        int bytes = MIN(s->bdev_length - offset,
-                        QEMU_ALIGN_DOWN(INT_MAX, s->granularity));
-
         mirror_throttle(s);
 
         if (job_is_cancelled(&s->common.job)) {
-            return 0;
+            break;
         }
 
-        ret = bdrv_is_allocated_above(bs, s->base_overlay, true, offset, bytes,
-                                      &count);
+        ret = block_status_scan_get(scan, offset, &ext);
         if (ret < 0) {
-            return ret;
+            break;
         }
 
-        assert(count);
-        if (ret > 0) {
-            bdrv_set_dirty_bitmap(s->dirty_bitmap, offset, count);
+        if (ext.status & BDRV_BLOCK_ALLOCATED) {
+            bdrv_set_dirty_bitmap(s->dirty_bitmap, offset, ext.bytes);
         }
-        offset += count;
+        offset += ext.bytes;
     }
-    return 0;
+    block_status_scan_free(scan);
+    return ret;
 }
 
 /* Called when going out of the streaming phase to flush the bulk of the
@@ -49,9 +49,10 @@
 
 #define EN_OPTSTR ":exportname="
 #define MAX_NBD_REQUESTS    16
+#define MAX_NBD_CONNECTIONS 16
 
-#define HANDLE_TO_INDEX(bs, handle) ((handle) ^ (uint64_t)(intptr_t)(bs))
-#define INDEX_TO_HANDLE(bs, index)  ((index)  ^ (uint64_t)(intptr_t)(bs))
+#define HANDLE_TO_INDEX(cs, handle) ((handle) ^ (uint64_t)(intptr_t)(cs))
+#define INDEX_TO_HANDLE(cs, index)  ((index)  ^ (uint64_t)(intptr_t)(cs))
 
 typedef struct {
     Coroutine *coroutine;
@@ -66,7 +67,16 @@ typedef enum NBDClientState {
     NBD_CLIENT_QUIT
 } NBDClientState;
 
-typedef struct BDRVNBDState {
+typedef struct BDRVNBDState BDRVNBDState;
+
+/*
+ * One connection to the server.  Each connection has its own socket,
+ * request slots and reconnect state machine; the server must have
+ * advertised NBD_FLAG_CAN_MULTI_CONN for more than one to be opened.
+ */
+typedef struct NBDConnState {
+    BDRVNBDState *s;
+
     QIOChannel *ioc; /* The current I/O channel */
     NBDExportInfo info;
 
@@ -91,6 +101,24 @@ typedef struct BDRVNBDState {
     CoMutex receive_mutex;
     NBDReply reply;
 
+    NBDClientConnection *conn;
+
+    /* Removed from BDRVNBDState.conns, see nbd_drop_conn_locked() */
+    bool dropped;
+} NBDConnState;
+
+struct BDRVNBDState {
+    NBDConnState *conns[MAX_NBD_CONNECTIONS];
+    unsigned int num_conns;
+    unsigned int next_conn; /* atomic */
+
+    /* Connections that requests may still reference, freed on close */
+    NBDConnState *dropped_conns[MAX_NBD_CONNECTIONS];
+    unsigned int num_dropped_conns;
+
+    /* Export information negotiated on the first connection */
+    NBDExportInfo info;
+
     QEMUTimer *open_timer;
 
     BlockDriverState *bs;
@@ -98,6 +126,7 @@ typedef struct BDRVNBDState {
     /* Connection parameters */
     uint32_t reconnect_delay;
     uint32_t open_timeout;
+    uint32_t multi_conn;
     SocketAddress *saddr;
     char *export;
     char *tlscredsid;
@@ -105,23 +134,58 @@ typedef struct BDRVNBDState {
     char *tlshostname;
     char *x_dirty_bitmap;
     bool alloc_depth;
-
-    NBDClientConnection *conn;
-} BDRVNBDState;
+};
 
 static void nbd_yank(void *opaque);
 
+static NBDConnState *nbd_conn_state_new(BDRVNBDState *s)
+{
+    NBDConnState *cs = g_new0(NBDConnState, 1);
+
+    cs->s = s;
+    cs->state = NBD_CLIENT_CONNECTING_WAIT;
+    qemu_mutex_init(&cs->requests_lock);
+    qemu_co_queue_init(&cs->free_sema);
+    qemu_co_mutex_init(&cs->send_mutex);
+    qemu_co_mutex_init(&cs->receive_mutex);
+    cs->conn = nbd_client_connection_new(s->saddr, true, s->export,
+                                         s->x_dirty_bitmap, s->tlscreds,
+                                         s->tlshostname);
+
+    return cs;
+}
+
+static void nbd_conn_state_free(NBDConnState *cs)
+{
+    nbd_client_connection_release(cs->conn);
+
+    /* Must not leave timers behind that would access freed data */
+    assert(!cs->reconnect_delay_timer);
+    assert(!cs->ioc);
+
+    qemu_mutex_destroy(&cs->requests_lock);
+    g_free(cs);
+}
+
 static void nbd_clear_bdrvstate(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
 
-    nbd_client_connection_release(s->conn);
-    s->conn = NULL;
+    for (i = 0; i < s->num_conns; i++) {
+        nbd_conn_state_free(s->conns[i]);
+        s->conns[i] = NULL;
+    }
+    s->num_conns = 0;
+    for (i = 0; i < s->num_dropped_conns; i++) {
+        nbd_conn_state_free(s->dropped_conns[i]);
+        s->dropped_conns[i] = NULL;
+    }
+    s->num_dropped_conns = 0;
 
     yank_unregister_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name));
 
     /* Must not leave timers behind that would access freed data */
-    assert(!s->reconnect_delay_timer);
     assert(!s->open_timer);
 
     object_unref(OBJECT(s->tlscreds));
@@ -137,7 +201,7 @@ static void nbd_clear_bdrvstate(BlockDriverState *bs)
     s->x_dirty_bitmap = NULL;
 }
 
-/* Called with s->receive_mutex taken.  */
+/* Called with cs->receive_mutex taken.  */
 static bool coroutine_fn nbd_recv_coroutine_wake_one(NBDClientRequest *req)
 {
     if (req->receiving) {
@@ -149,89 +213,88 @@ static bool coroutine_fn nbd_recv_coroutine_wake_one(NBDClientRequest *req)
     return false;
 }
 
-static void coroutine_fn nbd_recv_coroutines_wake(BDRVNBDState *s)
+static void coroutine_fn nbd_recv_coroutines_wake(NBDConnState *cs)
 {
     int i;
 
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    QEMU_LOCK_GUARD(&cs->receive_mutex);
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (nbd_recv_coroutine_wake_one(&s->requests[i])) {
+        if (nbd_recv_coroutine_wake_one(&cs->requests[i])) {
             return;
         }
     }
 }
 
-/* Called with s->requests_lock held.  */
-static void coroutine_fn nbd_channel_error_locked(BDRVNBDState *s, int ret)
+/* Called with cs->requests_lock held.  */
+static void coroutine_fn nbd_channel_error_locked(NBDConnState *cs, int ret)
 {
-    if (s->state == NBD_CLIENT_CONNECTED) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    if (cs->state == NBD_CLIENT_CONNECTED) {
+        qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
     }
 
     if (ret == -EIO) {
-        if (s->state == NBD_CLIENT_CONNECTED) {
-            s->state = s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
-                                            NBD_CLIENT_CONNECTING_NOWAIT;
+        if (cs->state == NBD_CLIENT_CONNECTED) {
+            cs->state = cs->s->reconnect_delay ? NBD_CLIENT_CONNECTING_WAIT :
+                                                 NBD_CLIENT_CONNECTING_NOWAIT;
         }
     } else {
-        s->state = NBD_CLIENT_QUIT;
+        cs->state = NBD_CLIENT_QUIT;
     }
 }
 
-static void coroutine_fn nbd_channel_error(BDRVNBDState *s, int ret)
+static void coroutine_fn nbd_channel_error(NBDConnState *cs, int ret)
 {
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    nbd_channel_error_locked(s, ret);
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    nbd_channel_error_locked(cs, ret);
 }
 
-static void reconnect_delay_timer_del(BDRVNBDState *s)
+static void reconnect_delay_timer_del(NBDConnState *cs)
 {
-    if (s->reconnect_delay_timer) {
-        timer_free(s->reconnect_delay_timer);
-        s->reconnect_delay_timer = NULL;
+    if (cs->reconnect_delay_timer) {
+        timer_free(cs->reconnect_delay_timer);
+        cs->reconnect_delay_timer = NULL;
     }
 }
 
 static void reconnect_delay_timer_cb(void *opaque)
 {
-    BDRVNBDState *s = opaque;
+    NBDConnState *cs = opaque;
 
-    reconnect_delay_timer_del(s);
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        if (s->state != NBD_CLIENT_CONNECTING_WAIT) {
+    reconnect_delay_timer_del(cs);
+    WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+        if (cs->state != NBD_CLIENT_CONNECTING_WAIT) {
             return;
         }
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
     }
-    nbd_co_establish_connection_cancel(s->conn);
+    nbd_co_establish_connection_cancel(cs->conn);
 }
 
-static void reconnect_delay_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
+static void reconnect_delay_timer_init(NBDConnState *cs,
+                                       uint64_t expire_time_ns)
 {
-    assert(!s->reconnect_delay_timer);
-    s->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(s->bs),
-                                             QEMU_CLOCK_REALTIME,
-                                             SCALE_NS,
-                                             reconnect_delay_timer_cb, s);
-    timer_mod(s->reconnect_delay_timer, expire_time_ns);
+    assert(!cs->reconnect_delay_timer);
+    cs->reconnect_delay_timer = aio_timer_new(bdrv_get_aio_context(cs->s->bs),
+                                              QEMU_CLOCK_REALTIME,
+                                              SCALE_NS,
+                                              reconnect_delay_timer_cb, cs);
+    timer_mod(cs->reconnect_delay_timer, expire_time_ns);
 }
 
-static void nbd_teardown_connection(BlockDriverState *bs)
+static void nbd_teardown_connection(NBDConnState *cs)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
-
-    assert(!s->in_flight);
+    assert(!cs->in_flight);
 
-    if (s->ioc) {
-        qio_channel_shutdown(s->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+    if (cs->ioc) {
+        qio_channel_shutdown(cs->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+        yank_unregister_function(BLOCKDEV_YANK_INSTANCE(cs->s->bs->node_name),
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
     }
 
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        s->state = NBD_CLIENT_QUIT;
+    WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+        cs->state = NBD_CLIENT_QUIT;
     }
 }
 
@@ -247,7 +310,7 @@ static void open_timer_cb(void *opaque)
 {
     BDRVNBDState *s = opaque;
 
-    nbd_co_establish_connection_cancel(s->conn);
+    nbd_co_establish_connection_cancel(s->conns[0]->conn);
     open_timer_del(s);
 }
 
@@ -261,13 +324,13 @@ static void open_timer_init(BDRVNBDState *s, uint64_t expire_time_ns)
     timer_mod(s->open_timer, expire_time_ns);
 }
 
-static bool nbd_client_will_reconnect(BDRVNBDState *s)
+static bool nbd_client_will_reconnect(NBDConnState *cs)
 {
     /*
      * Called only after a socket error, so this is not performance sensitive.
      */
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    return s->state == NBD_CLIENT_CONNECTING_WAIT;
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    return cs->state == NBD_CLIENT_CONNECTING_WAIT;
 }
 
 /*
@@ -315,24 +378,53 @@ static int nbd_handle_updated_info(BlockDriverState *bs, Error **errp)
     return 0;
 }
 
-int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
-                                                bool blocking, Error **errp)
+/*
+ * With a single connection, each negotiation updates the node.  Once there
+ * are several, requests on the other connections rely on the export looking
+ * the same, so a (re)connection must agree with what the first negotiation
+ * returned.
+ */
+static int nbd_handle_updated_conn_info(NBDConnState *cs, Error **errp)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    BDRVNBDState *s = cs->s;
+
+    if (s->num_conns == 1) {
+        assert(cs == s->conns[0]);
+        s->info = cs->info;
+        return nbd_handle_updated_info(s->bs, errp);
+    }
+
+    if (cs->info.size != s->info.size ||
+        cs->info.flags != s->info.flags ||
+        cs->info.structured_reply != s->info.structured_reply ||
+        cs->info.base_allocation != s->info.base_allocation ||
+        cs->info.min_block != s->info.min_block ||
+        cs->info.max_block != s->info.max_block) {
+        error_setg(errp, "Server reported different export parameters on "
+                   "another connection");
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn nbd_co_do_establish_conn(NBDConnState *cs,
+                                                 bool blocking, Error **errp)
+{
+    BDRVNBDState *s = cs->s;
     int ret;
-    IO_CODE();
 
-    assert(!s->ioc);
+    assert(!cs->ioc);
 
-    s->ioc = nbd_co_establish_connection(s->conn, &s->info, blocking, errp);
-    if (!s->ioc) {
+    cs->ioc = nbd_co_establish_connection(cs->conn, &cs->info, blocking, errp);
+    if (!cs->ioc) {
         return -ECONNREFUSED;
     }
 
     yank_register_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name), nbd_yank,
-                           bs);
+                           cs);
 
-    ret = nbd_handle_updated_info(s->bs, NULL);
+    ret = nbd_handle_updated_conn_info(cs, errp);
     if (ret < 0) {
         /*
          * We have connected, but must fail for other reasons.
@@ -340,101 +432,188 @@ int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
          */
         NBDRequest request = { .type = NBD_CMD_DISC };
 
-        nbd_send_request(s->ioc, &request);
+        nbd_send_request(cs->ioc, &request);
 
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
 
         return ret;
     }
 
-    qio_channel_set_blocking(s->ioc, false, NULL);
-    qio_channel_attach_aio_context(s->ioc, bdrv_get_aio_context(bs));
+    qio_channel_set_blocking(cs->ioc, false, NULL);
+    qio_channel_attach_aio_context(cs->ioc, bdrv_get_aio_context(s->bs));
 
     /* successfully connected */
-    WITH_QEMU_LOCK_GUARD(&s->requests_lock) {
-        s->state = NBD_CLIENT_CONNECTED;
+    WITH_QEMU_LOCK_GUARD(&cs->requests_lock) {
+        cs->state = NBD_CLIENT_CONNECTED;
     }
 
     return 0;
 }
 
-/* Called with s->requests_lock held.  */
-static bool nbd_client_connecting(BDRVNBDState *s)
+/*
+ * Open the first connection, and if the server allows it, the further
+ * connections requested with the multi-conn option.  Failing to open the
+ * additional connections is not fatal; we just use fewer of them.
+ */
+int coroutine_fn nbd_co_do_establish_connection(BlockDriverState *bs,
+                                                bool blocking, Error **errp)
 {
-    return s->state == NBD_CLIENT_CONNECTING_WAIT ||
-        s->state == NBD_CLIENT_CONNECTING_NOWAIT;
+    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    int ret;
+    IO_CODE();
+
+    assert(s->num_conns == 1);
+
+    ret = nbd_co_do_establish_conn(s->conns[0], blocking, errp);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (s->multi_conn > 1 && !(s->info.flags & NBD_FLAG_CAN_MULTI_CONN)) {
+        trace_nbd_client_multi_conn_unsupported(s->export);
+        return 0;
+    }
+
+    while (s->num_conns < s->multi_conn) {
+        NBDConnState *cs = nbd_conn_state_new(s);
+        Error *local_err = NULL;
+
+        /*
+         * Make the connection visible first, so that it is validated
+         * against the first one.
+         */
+        s->conns[s->num_conns++] = cs;
+        ret = nbd_co_do_establish_conn(cs, true, &local_err);
+        if (ret < 0) {
+            trace_nbd_client_multi_conn_fail(s->num_conns - 1,
+                local_err ? error_get_pretty(local_err) : strerror(-ret));
+            error_free(local_err);
+            s->conns[--s->num_conns] = NULL;
+            nbd_conn_state_free(cs);
+            break;
+        }
+        nbd_client_connection_enable_retry(cs->conn);
+    }
+
+    return 0;
+}
+
+/* Called with cs->requests_lock held.  */
+static bool nbd_client_connecting(NBDConnState *cs)
+{
+    return cs->state == NBD_CLIENT_CONNECTING_WAIT ||
+        cs->state == NBD_CLIENT_CONNECTING_NOWAIT;
+}
+
+/*
+ * Stop using a connection that came back with different export parameters.
+ * Requests that are still waiting for it fail over to the other ones; the
+ * NBDConnState itself is only freed on close.
+ *
+ * Called with cs->requests_lock held.
+ */
+static void nbd_drop_conn_locked(NBDConnState *cs, Error *err)
+{
+    BDRVNBDState *s = cs->s;
+    unsigned int i;
+
+    for (i = 0; i < s->num_conns; i++) {
+        if (s->conns[i] == cs) {
+            break;
+        }
+    }
+    assert(i < s->num_conns && s->num_conns > 1);
+
+    trace_nbd_client_conn_drop(i, err ? error_get_pretty(err) : "");
+
+    memmove(&s->conns[i], &s->conns[i + 1],
+            (s->num_conns - i - 1) * sizeof(s->conns[0]));
+    s->conns[--s->num_conns] = NULL;
+    s->dropped_conns[s->num_dropped_conns++] = cs;
+
+    cs->state = NBD_CLIENT_QUIT;
+    cs->dropped = true;
 }
 
-/* Called with s->requests_lock taken.  */
-static coroutine_fn void nbd_reconnect_attempt(BDRVNBDState *s)
+/* Called with cs->requests_lock taken.  */
+static coroutine_fn void nbd_reconnect_attempt(NBDConnState *cs)
 {
-    bool blocking = s->state == NBD_CLIENT_CONNECTING_WAIT;
+    BDRVNBDState *s = cs->s;
+    bool blocking = cs->state == NBD_CLIENT_CONNECTING_WAIT;
+    Error *local_err = NULL;
+    int ret;
 
     /*
      * Now we are sure that nobody is accessing the channel, and no one will
      * try until we set the state to CONNECTED.
      */
-    assert(nbd_client_connecting(s));
-    assert(s->in_flight == 1);
+    assert(nbd_client_connecting(cs));
+    assert(cs->in_flight == 1);
 
-    if (blocking && !s->reconnect_delay_timer) {
+    if (blocking && !cs->reconnect_delay_timer) {
         /*
          * It's the first reconnect attempt after switching to
          * NBD_CLIENT_CONNECTING_WAIT
          */
         g_assert(s->reconnect_delay);
-        reconnect_delay_timer_init(s,
+        reconnect_delay_timer_init(cs,
             qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
             s->reconnect_delay * NANOSECONDS_PER_SECOND);
     }
 
     /* Finalize previous connection if any */
-    if (s->ioc) {
-        qio_channel_detach_aio_context(QIO_CHANNEL(s->ioc));
+    if (cs->ioc) {
+        qio_channel_detach_aio_context(QIO_CHANNEL(cs->ioc));
         yank_unregister_function(BLOCKDEV_YANK_INSTANCE(s->bs->node_name),
-                                 nbd_yank, s->bs);
-        object_unref(OBJECT(s->ioc));
-        s->ioc = NULL;
+                                 nbd_yank, cs);
+        object_unref(OBJECT(cs->ioc));
+        cs->ioc = NULL;
     }
 
-    qemu_mutex_unlock(&s->requests_lock);
-    nbd_co_do_establish_connection(s->bs, blocking, NULL);
-    qemu_mutex_lock(&s->requests_lock);
+    qemu_mutex_unlock(&cs->requests_lock);
+    ret = nbd_co_do_establish_conn(cs, blocking, &local_err);
+    qemu_mutex_lock(&cs->requests_lock);
+
+    /* Connected, but the export does not match what the others see */
+    if (ret == -EINVAL && s->num_conns > 1) {
+        nbd_drop_conn_locked(cs, local_err);
+    }
+    error_free(local_err);
 
     /*
      * The reconnect attempt is done (maybe successfully, maybe not), so
      * we no longer need this timer.  Delete it so it will not outlive
      * this I/O request (so draining removes all timers).
      */
-    reconnect_delay_timer_del(s);
+    reconnect_delay_timer_del(cs);
 }
 
-static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
+static coroutine_fn int nbd_receive_replies(NBDConnState *cs, uint64_t handle)
 {
     int ret;
-    uint64_t ind = HANDLE_TO_INDEX(s, handle), ind2;
-    QEMU_LOCK_GUARD(&s->receive_mutex);
+    uint64_t ind = HANDLE_TO_INDEX(cs, handle), ind2;
+    QEMU_LOCK_GUARD(&cs->receive_mutex);
 
     while (true) {
-        if (s->reply.handle == handle) {
+        if (cs->reply.handle == handle) {
             /* We are done */
             return 0;
         }
 
-        if (s->reply.handle != 0) {
+        if (cs->reply.handle != 0) {
             /*
              * Some other request is being handled now. It should already be
-             * woken by whoever set s->reply.handle (or never wait in this
+             * woken by whoever set cs->reply.handle (or never wait in this
              * yield). So, we should not wake it here.
              */
-            ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-            assert(!s->requests[ind2].receiving);
+            ind2 = HANDLE_TO_INDEX(cs, cs->reply.handle);
+            assert(!cs->requests[ind2].receiving);
 
-            s->requests[ind].receiving = true;
-            qemu_co_mutex_unlock(&s->receive_mutex);
+            cs->requests[ind].receiving = true;
+            qemu_co_mutex_unlock(&cs->receive_mutex);
 
             qemu_coroutine_yield();
             /*
@@ -442,109 +621,166 @@ static coroutine_fn int nbd_receive_replies(BDRVNBDState *s, uint64_t handle)
              * 1. From this function, executing in parallel coroutine, when our
              *    handle is received.
              * 2. From nbd_co_receive_one_chunk(), when previous request is
-             *    finished and s->reply.handle set to 0.
+             *    finished and cs->reply.handle set to 0.
              * Anyway, it's OK to lock the mutex and go to the next iteration.
              */
 
-            qemu_co_mutex_lock(&s->receive_mutex);
-            assert(!s->requests[ind].receiving);
+            qemu_co_mutex_lock(&cs->receive_mutex);
+            assert(!cs->requests[ind].receiving);
             continue;
         }
 
         /* We are under mutex and handle is 0. We have to do the dirty work. */
-        assert(s->reply.handle == 0);
-        ret = nbd_receive_reply(s->bs, s->ioc, &s->reply, NULL);
+        assert(cs->reply.handle == 0);
+        ret = nbd_receive_reply(cs->s->bs, cs->ioc, &cs->reply, NULL);
         if (ret <= 0) {
             ret = ret ? ret : -EIO;
-            nbd_channel_error(s, ret);
+            nbd_channel_error(cs, ret);
             return ret;
         }
-        if (nbd_reply_is_structured(&s->reply) && !s->info.structured_reply) {
-            nbd_channel_error(s, -EINVAL);
+        if (nbd_reply_is_structured(&cs->reply) &&
+            !cs->info.structured_reply) {
+            nbd_channel_error(cs, -EINVAL);
             return -EINVAL;
         }
-        ind2 = HANDLE_TO_INDEX(s, s->reply.handle);
-        if (ind2 >= MAX_NBD_REQUESTS || !s->requests[ind2].coroutine) {
-            nbd_channel_error(s, -EINVAL);
+        ind2 = HANDLE_TO_INDEX(cs, cs->reply.handle);
+        if (ind2 >= MAX_NBD_REQUESTS || !cs->requests[ind2].coroutine) {
+            nbd_channel_error(cs, -EINVAL);
             return -EINVAL;
         }
-        if (s->reply.handle == handle) {
+        if (cs->reply.handle == handle) {
             /* We are done */
             return 0;
         }
-        nbd_recv_coroutine_wake_one(&s->requests[ind2]);
+        nbd_recv_coroutine_wake_one(&cs->requests[ind2]);
     }
 }
 
-static int coroutine_fn nbd_co_send_request(BlockDriverState *bs,
+/*
+ * Pick the connection for a new request: go round-robin over the
+ * connections that are connected and have a free request slot.  If all of
+ * them are full, wait on the least loaded one.  Only if none is connected,
+ * go for one that reconnects.
+ */
+static NBDConnState *nbd_choose_conn(BDRVNBDState *s)
+{
+    NBDConnState *least_loaded = NULL;
+    int least_in_flight = INT_MAX;
+    unsigned int start, i;
+
+    if (s->num_conns == 1) {
+        return s->conns[0];
+    }
+
+    start = qatomic_fetch_inc(&s->next_conn);
+    for (i = 0; i < s->num_conns; i++) {
+        NBDConnState *cs = s->conns[(start + i) % s->num_conns];
+
+        QEMU_LOCK_GUARD(&cs->requests_lock);
+        if (cs->state != NBD_CLIENT_CONNECTED) {
+            continue;
+        }
+        if (cs->in_flight < MAX_NBD_REQUESTS) {
+            return cs;
+        }
+        if (cs->in_flight < least_in_flight) {
+            least_loaded = cs;
+            least_in_flight = cs->in_flight;
+        }
+    }
+
+    if (least_loaded) {
+        return least_loaded;
+    }
+    return s->conns[start % s->num_conns];
+}
+
+/*
+ * Called after a request failed on *@cs.  Retry on the same connection if it
+ * is about to reconnect, or on another one if it has been dropped.
+ */
+static bool nbd_client_will_retry(BDRVNBDState *s, NBDConnState **cs)
+{
+    if (nbd_client_will_reconnect(*cs)) {
+        return true;
+    }
+
+    if ((*cs)->dropped) {
+        *cs = nbd_choose_conn(s);
+        return true;
+    }
+
+    return false;
+}
+
+static int coroutine_fn nbd_co_send_request(NBDConnState *cs,
                                             NBDRequest *request,
                                             QEMUIOVector *qiov)
 {
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     int rc, i = -1;
 
-    qemu_mutex_lock(&s->requests_lock);
-    while (s->in_flight == MAX_NBD_REQUESTS ||
-           (s->state != NBD_CLIENT_CONNECTED && s->in_flight > 0)) {
-        qemu_co_queue_wait(&s->free_sema, &s->requests_lock);
+    qemu_mutex_lock(&cs->requests_lock);
+    while (cs->in_flight == MAX_NBD_REQUESTS ||
+           (cs->state != NBD_CLIENT_CONNECTED && cs->in_flight > 0)) {
+        qemu_co_queue_wait(&cs->free_sema, &cs->requests_lock);
     }
 
-    s->in_flight++;
-    if (s->state != NBD_CLIENT_CONNECTED) {
-        if (nbd_client_connecting(s)) {
-            nbd_reconnect_attempt(s);
-            qemu_co_queue_restart_all(&s->free_sema);
+    cs->in_flight++;
+    if (cs->state != NBD_CLIENT_CONNECTED) {
+        if (nbd_client_connecting(cs)) {
+            nbd_reconnect_attempt(cs);
+            qemu_co_queue_restart_all(&cs->free_sema);
         }
-        if (s->state != NBD_CLIENT_CONNECTED) {
+        if (cs->state != NBD_CLIENT_CONNECTED) {
             rc = -EIO;
             goto err;
         }
     }
 
     for (i = 0; i < MAX_NBD_REQUESTS; i++) {
-        if (s->requests[i].coroutine == NULL) {
+        if (cs->requests[i].coroutine == NULL) {
             break;
         }
     }
 
     assert(i < MAX_NBD_REQUESTS);
-    s->requests[i].coroutine = qemu_coroutine_self();
-    s->requests[i].offset = request->from;
-    s->requests[i].receiving = false;
-    qemu_mutex_unlock(&s->requests_lock);
+    cs->requests[i].coroutine = qemu_coroutine_self();
+    cs->requests[i].offset = request->from;
+    cs->requests[i].receiving = false;
+    qemu_mutex_unlock(&cs->requests_lock);
 
-    qemu_co_mutex_lock(&s->send_mutex);
-    request->handle = INDEX_TO_HANDLE(s, i);
+    qemu_co_mutex_lock(&cs->send_mutex);
+    request->handle = INDEX_TO_HANDLE(cs, i);
 
-    assert(s->ioc);
+    assert(cs->ioc);
 
     if (qiov) {
-        qio_channel_set_cork(s->ioc, true);
-        rc = nbd_send_request(s->ioc, request);
+        qio_channel_set_cork(cs->ioc, true);
+        rc = nbd_send_request(cs->ioc, request);
         if (rc >= 0) {
-            if (qio_channel_writev_all(s->ioc, qiov->iov, qiov->niov,
+            if (qio_channel_writev_all(cs->ioc, qiov->iov, qiov->niov,
                                        NULL) < 0) {
                 rc = -EIO;
             }
         } else if (rc >= 0) {
             rc = -EIO;
         }
-        qio_channel_set_cork(s->ioc, false);
+        qio_channel_set_cork(cs->ioc, false);
     } else {
-        rc = nbd_send_request(s->ioc, request);
+        rc = nbd_send_request(cs->ioc, request);
     }
-    qemu_co_mutex_unlock(&s->send_mutex);
+    qemu_co_mutex_unlock(&cs->send_mutex);
 
     if (rc < 0) {
-        qemu_mutex_lock(&s->requests_lock);
+        qemu_mutex_lock(&cs->requests_lock);
 err:
-        nbd_channel_error_locked(s, rc);
+        nbd_channel_error_locked(cs, rc);
         if (i != -1) {
-            s->requests[i].coroutine = NULL;
+            cs->requests[i].coroutine = NULL;
         }
-        s->in_flight--;
-        qemu_co_queue_next(&s->free_sema);
-        qemu_mutex_unlock(&s->requests_lock);
+        cs->in_flight--;
+        qemu_co_queue_next(&cs->free_sema);
+        qemu_mutex_unlock(&cs->requests_lock);
     }
     return rc;
 }
@@ -605,11 +841,12 @@ static int nbd_parse_offset_hole_payload(BDRVNBDState *s,
  * Based on our request, we expect only one extent in reply, for the
  * base:allocation context.
  */
-static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
+static int nbd_parse_blockstatus_payload(NBDConnState *cs,
                                          NBDStructuredReplyChunk *chunk,
                                          uint8_t *payload, uint64_t orig_length,
                                          NBDExtent *extent, Error **errp)
 {
+    BDRVNBDState *s = cs->s;
     uint32_t context_id;
 
     /* The server succeeded, so it must have sent [at least] one extent */
@@ -620,11 +857,11 @@ static int nbd_parse_blockstatus_payload(BDRVNBDState *s,
     }
 
     context_id = payload_advance32(&payload);
-    if (s->info.context_id != context_id) {
+    if (cs->info.context_id != context_id) {
         error_setg(errp, "Protocol error: unexpected context id %d for "
                          "NBD_REPLY_TYPE_BLOCK_STATUS, when negotiated context "
                          "id is %d", context_id,
-                         s->info.context_id);
+                         cs->info.context_id);
         return -EINVAL;
     }
 
@@ -733,16 +970,17 @@ static int nbd_parse_error_payload(NBDStructuredReplyChunk *chunk,
 }
 
 static int coroutine_fn
-nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
+nbd_co_receive_offset_data_payload(NBDConnState *cs, uint64_t orig_offset,
                                    QEMUIOVector *qiov, Error **errp)
 {
+    BDRVNBDState *s = cs->s;
     QEMUIOVector sub_qiov;
     uint64_t offset;
     size_t data_size;
     int ret;
-    NBDStructuredReplyChunk *chunk = &s->reply.structured;
+    NBDStructuredReplyChunk *chunk = &cs->reply.structured;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
     /* The NBD spec requires at least one byte of payload */
     if (chunk->length <= sizeof(offset)) {
@@ -751,7 +989,7 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
         return -EINVAL;
     }
 
-    if (nbd_read64(s->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
+    if (nbd_read64(cs->ioc, &offset, "OFFSET_DATA offset", errp) < 0) {
         return -EIO;
     }
 
@@ -769,7 +1007,7 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
 
     qemu_iovec_init(&sub_qiov, qiov->niov);
     qemu_iovec_concat(&sub_qiov, qiov, offset - orig_offset, data_size);
-    ret = qio_channel_readv_all(s->ioc, sub_qiov.iov, sub_qiov.niov, errp);
+    ret = qio_channel_readv_all(cs->ioc, sub_qiov.iov, sub_qiov.niov, errp);
     qemu_iovec_destroy(&sub_qiov);
 
     return ret < 0 ? -EIO : 0;
@@ -777,14 +1015,14 @@ nbd_co_receive_offset_data_payload(BDRVNBDState *s, uint64_t orig_offset,
 
 #define NBD_MAX_MALLOC_PAYLOAD 1000
 static coroutine_fn int nbd_co_receive_structured_payload(
-        BDRVNBDState *s, void **payload, Error **errp)
+        NBDConnState *cs, void **payload, Error **errp)
 {
     int ret;
     uint32_t len;
 
-    assert(nbd_reply_is_structured(&s->reply));
+    assert(nbd_reply_is_structured(&cs->reply));
 
-    len = s->reply.structured.length;
+    len = cs->reply.structured.length;
 
     if (len == 0) {
         return 0;
@@ -801,7 +1039,7 @@ static coroutine_fn int nbd_co_receive_structured_payload(
     }
 
     *payload = g_new(char, len);
-    ret = nbd_read(s->ioc, *payload, len, "structured payload", errp);
+    ret = nbd_read(cs->ioc, *payload, len, "structured payload", errp);
     if (ret < 0) {
         g_free(*payload);
         *payload = NULL;
@@ -827,11 +1065,11 @@ static coroutine_fn int nbd_co_receive_structured_payload(
  * corresponding to the server's error reply), and errp is unchanged.
  */
 static coroutine_fn int nbd_co_do_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *cs, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, void **payload, Error **errp)
 {
     int ret;
-    int i = HANDLE_TO_INDEX(s, handle);
+    int i = HANDLE_TO_INDEX(cs, handle);
     void *local_payload = NULL;
     NBDStructuredReplyChunk *chunk;
 
@@ -840,34 +1078,34 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
     }
     *request_ret = 0;
 
-    ret = nbd_receive_replies(s, handle);
+    ret = nbd_receive_replies(cs, handle);
     if (ret < 0) {
         error_setg(errp, "Connection closed");
         return -EIO;
     }
-    assert(s->ioc);
+    assert(cs->ioc);
 
-    assert(s->reply.handle == handle);
+    assert(cs->reply.handle == handle);
 
-    if (nbd_reply_is_simple(&s->reply)) {
+    if (nbd_reply_is_simple(&cs->reply)) {
         if (only_structured) {
             error_setg(errp, "Protocol error: simple reply when structured "
                              "reply chunk was expected");
             return -EINVAL;
         }
 
-        *request_ret = -nbd_errno_to_system_errno(s->reply.simple.error);
+        *request_ret = -nbd_errno_to_system_errno(cs->reply.simple.error);
         if (*request_ret < 0 || !qiov) {
             return 0;
         }
 
-        return qio_channel_readv_all(s->ioc, qiov->iov, qiov->niov,
+        return qio_channel_readv_all(cs->ioc, qiov->iov, qiov->niov,
                                      errp) < 0 ? -EIO : 0;
     }
 
     /* handle structured reply chunk */
-    assert(s->info.structured_reply);
-    chunk = &s->reply.structured;
+    assert(cs->info.structured_reply);
+    chunk = &cs->reply.structured;
 
     if (chunk->type == NBD_REPLY_TYPE_NONE) {
         if (!(chunk->flags & NBD_REPLY_FLAG_DONE)) {
@@ -889,7 +1127,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
             return -EINVAL;
         }
 
-        return nbd_co_receive_offset_data_payload(s, s->requests[i].offset,
+        return nbd_co_receive_offset_data_payload(cs, cs->requests[i].offset,
                                                   qiov, errp);
     }
 
@@ -897,7 +1135,7 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
         payload = &local_payload;
     }
 
-    ret = nbd_co_receive_structured_payload(s, payload, errp);
+    ret = nbd_co_receive_structured_payload(cs, payload, errp);
     if (ret < 0) {
         return ret;
     }
@@ -917,23 +1155,23 @@ static coroutine_fn int nbd_co_do_receive_one_chunk(
  * Return value is a fatal error code or normal nbd reply error code
  */
 static coroutine_fn int nbd_co_receive_one_chunk(
-        BDRVNBDState *s, uint64_t handle, bool only_structured,
+        NBDConnState *cs, uint64_t handle, bool only_structured,
         int *request_ret, QEMUIOVector *qiov, NBDReply *reply, void **payload,
         Error **errp)
 {
-    int ret = nbd_co_do_receive_one_chunk(s, handle, only_structured,
+    int ret = nbd_co_do_receive_one_chunk(cs, handle, only_structured,
                                           request_ret, qiov, payload, errp);
 
     if (ret < 0) {
         memset(reply, 0, sizeof(*reply));
-        nbd_channel_error(s, ret);
+        nbd_channel_error(cs, ret);
     } else {
         /* For assert at loop start in nbd_connection_entry */
-        *reply = s->reply;
+        *reply = cs->reply;
     }
-    s->reply.handle = 0;
+    cs->reply.handle = 0;
 
-    nbd_recv_coroutines_wake(s);
+    nbd_recv_coroutines_wake(cs);
 
     return ret;
 }
@@ -974,16 +1212,16 @@ static void nbd_iter_request_error(NBDReplyChunkIter *iter, int ret)
  * NBD_FOREACH_REPLY_CHUNK
  * The pointer stored in @payload requires g_free() to free it.
  */
-#define NBD_FOREACH_REPLY_CHUNK(s, iter, handle, structured, \
+#define NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, structured, \
                                 qiov, reply, payload) \
     for (iter = (NBDReplyChunkIter) { .only_structured = structured }; \
-         nbd_reply_chunk_iter_receive(s, &iter, handle, qiov, reply, payload);)
+         nbd_reply_chunk_iter_receive(cs, &iter, handle, qiov, reply, payload);)
 
 /*
  * nbd_reply_chunk_iter_receive
  * The pointer stored in @payload requires g_free() to free it.
  */
-static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
+static bool nbd_reply_chunk_iter_receive(NBDConnState *cs,
                                          NBDReplyChunkIter *iter,
                                          uint64_t handle,
                                          QEMUIOVector *qiov, NBDReply *reply,
@@ -1003,7 +1241,7 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
         reply = &local_reply;
     }
 
-    ret = nbd_co_receive_one_chunk(s, handle, iter->only_structured,
+    ret = nbd_co_receive_one_chunk(cs, handle, iter->only_structured,
                                    &request_ret, qiov, reply, payload,
                                    &local_err);
     if (ret < 0) {
@@ -1035,21 +1273,21 @@ static bool nbd_reply_chunk_iter_receive(BDRVNBDState *s,
     return true;
 
 break_loop:
-    qemu_mutex_lock(&s->requests_lock);
-    s->requests[HANDLE_TO_INDEX(s, handle)].coroutine = NULL;
-    s->in_flight--;
-    qemu_co_queue_next(&s->free_sema);
-    qemu_mutex_unlock(&s->requests_lock);
+    qemu_mutex_lock(&cs->requests_lock);
+    cs->requests[HANDLE_TO_INDEX(cs, handle)].coroutine = NULL;
+    cs->in_flight--;
+    qemu_co_queue_next(&cs->free_sema);
+    qemu_mutex_unlock(&cs->requests_lock);
 
     return false;
 }
 
-static int coroutine_fn nbd_co_receive_return_code(BDRVNBDState *s, uint64_t handle,
+static int coroutine_fn nbd_co_receive_return_code(NBDConnState *cs, uint64_t handle,
                                                    int *request_ret, Error **errp)
 {
     NBDReplyChunkIter iter;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, NULL, NULL) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, false, NULL, NULL, NULL) {
         /* nbd_reply_chunk_iter_receive does all the work */
     }
 
@@ -1058,7 +1296,7 @@ static int coroutine_fn nbd_co_receive_return_code(BDRVNBDState *s, uint64_t han
     return iter.ret;
 }
 
-static int coroutine_fn nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t handle,
+static int coroutine_fn nbd_co_receive_cmdread_reply(NBDConnState *cs, uint64_t handle,
                                                      uint64_t offset, QEMUIOVector *qiov,
                                                      int *request_ret, Error **errp)
 {
@@ -1067,7 +1305,7 @@ static int coroutine_fn nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t h
     void *payload = NULL;
     Error *local_err = NULL;
 
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, s->info.structured_reply,
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, cs->info.structured_reply,
                             qiov, &reply, &payload)
     {
         int ret;
@@ -1083,17 +1321,18 @@ static int coroutine_fn nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t h
              */
             break;
         case NBD_REPLY_TYPE_OFFSET_HOLE:
-            ret = nbd_parse_offset_hole_payload(s, &reply.structured, payload,
-                                                offset, qiov, &local_err);
+            ret = nbd_parse_offset_hole_payload(cs->s, &reply.structured,
+                                                payload, offset, qiov,
+                                                &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
                 /* not allowed reply type */
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) for CMD_READ",
                            chunk->type, nbd_reply_type_lookup(chunk->type));
@@ -1110,7 +1349,7 @@ static int coroutine_fn nbd_co_receive_cmdread_reply(BDRVNBDState *s, uint64_t h
     return iter.ret;
 }
 
-static int coroutine_fn nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
+static int coroutine_fn nbd_co_receive_blockstatus_reply(NBDConnState *cs,
                                                          uint64_t handle, uint64_t length,
                                                          NBDExtent *extent,
                                                          int *request_ret, Error **errp)
@@ -1122,7 +1361,7 @@ static int coroutine_fn nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
     bool received = false;
 
     assert(!extent->length);
-    NBD_FOREACH_REPLY_CHUNK(s, iter, handle, false, NULL, &reply, &payload) {
+    NBD_FOREACH_REPLY_CHUNK(cs, iter, handle, false, NULL, &reply, &payload) {
         int ret;
         NBDStructuredReplyChunk *chunk = &reply.structured;
 
@@ -1131,23 +1370,23 @@ static int coroutine_fn nbd_co_receive_blockstatus_reply(BDRVNBDState *s,
         switch (chunk->type) {
         case NBD_REPLY_TYPE_BLOCK_STATUS:
             if (received) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err, "Several BLOCK_STATUS chunks in reply");
                 nbd_iter_channel_error(&iter, -EINVAL, &local_err);
             }
             received = true;
 
-            ret = nbd_parse_blockstatus_payload(s, &reply.structured,
+            ret = nbd_parse_blockstatus_payload(cs, &reply.structured,
                                                 payload, length, extent,
                                                 &local_err);
             if (ret < 0) {
-                nbd_channel_error(s, ret);
+                nbd_channel_error(cs, ret);
                 nbd_iter_channel_error(&iter, ret, &local_err);
             }
             break;
         default:
             if (!nbd_reply_type_is_error(chunk->type)) {
-                nbd_channel_error(s, -EINVAL);
+                nbd_channel_error(cs, -EINVAL);
                 error_setg(&local_err,
                            "Unexpected reply type: %d (%s) "
                            "for CMD_BLOCK_STATUS",
@@ -1176,6 +1415,7 @@ static int coroutine_fn nbd_co_request(BlockDriverState *bs, NBDRequest *request
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs = nbd_choose_conn(s);
 
     assert(request->type != NBD_CMD_READ);
     if (write_qiov) {
@@ -1186,12 +1426,12 @@ static int coroutine_fn nbd_co_request(BlockDriverState *bs, NBDRequest *request
     }
 
     do {
-        ret = nbd_co_send_request(bs, request, write_qiov);
+        ret = nbd_co_send_request(cs, request, write_qiov);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_return_code(s, request->handle,
+        ret = nbd_co_receive_return_code(cs, request->handle,
                                          &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request->from, request->len,
@@ -1202,7 +1442,7 @@ static int coroutine_fn nbd_co_request(BlockDriverState *bs, NBDRequest *request
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_retry(s, &cs));
 
     return ret ? ret : request_ret;
 }
@@ -1214,6 +1454,7 @@ static int coroutine_fn nbd_client_co_preadv(BlockDriverState *bs, int64_t offse
     int ret, request_ret;
     Error *local_err = NULL;
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     NBDRequest request = {
         .type = NBD_CMD_READ,
         .from = offset,
@@ -1245,13 +1486,14 @@ static int coroutine_fn nbd_client_co_preadv(BlockDriverState *bs, int64_t offse
         request.len -= slop;
     }
 
+    cs = nbd_choose_conn(s);
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        ret = nbd_co_send_request(cs, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_cmdread_reply(s, request.handle, offset, qiov,
+        ret = nbd_co_receive_cmdread_reply(cs, request.handle, offset, qiov,
                                            &request_ret, &local_err);
         if (local_err) {
             trace_nbd_co_request_fail(request.from, request.len, request.handle,
@@ -1261,7 +1503,7 @@ static int coroutine_fn nbd_client_co_preadv(BlockDriverState *bs, int64_t offse
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_retry(s, &cs));
 
     return ret ? ret : request_ret;
 }
@@ -1368,6 +1610,7 @@ static int coroutine_fn nbd_client_co_block_status(
     int ret, request_ret;
     NBDExtent extent = { 0 };
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs;
     Error *local_err = NULL;
 
     NBDRequest request = {
@@ -1402,13 +1645,14 @@ static int coroutine_fn nbd_client_co_block_status(
     if (s->info.min_block) {
         assert(QEMU_IS_ALIGNED(request.len, s->info.min_block));
     }
+    cs = nbd_choose_conn(s);
     do {
-        ret = nbd_co_send_request(bs, &request, NULL);
+        ret = nbd_co_send_request(cs, &request, NULL);
         if (ret < 0) {
             continue;
         }
 
-        ret = nbd_co_receive_blockstatus_reply(s, request.handle, bytes,
+        ret = nbd_co_receive_blockstatus_reply(cs, request.handle, bytes,
                                                &extent, &request_ret,
                                                &local_err);
         if (local_err) {
@@ -1419,7 +1663,7 @@ static int coroutine_fn nbd_client_co_block_status(
             error_free(local_err);
             local_err = NULL;
         }
-    } while (ret < 0 && nbd_client_will_reconnect(s));
+    } while (ret < 0 && nbd_client_will_retry(s, &cs));
 
     if (ret < 0 || request_ret < 0) {
         return ret ? ret : request_ret;
@@ -1448,24 +1692,28 @@ static int nbd_client_reopen_prepare(BDRVReopenState *state,
 
 static void nbd_yank(void *opaque)
 {
-    BlockDriverState *bs = opaque;
-    BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    NBDConnState *cs = opaque;
 
-    QEMU_LOCK_GUARD(&s->requests_lock);
-    qio_channel_shutdown(QIO_CHANNEL(s->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
-    s->state = NBD_CLIENT_QUIT;
+    QEMU_LOCK_GUARD(&cs->requests_lock);
+    qio_channel_shutdown(QIO_CHANNEL(cs->ioc), QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
+    cs->state = NBD_CLIENT_QUIT;
 }
 
 static void nbd_client_close(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
     NBDRequest request = { .type = NBD_CMD_DISC };
+    unsigned int i;
 
-    if (s->ioc) {
-        nbd_send_request(s->ioc, &request);
-    }
+    for (i = 0; i < s->num_conns; i++) {
+        NBDConnState *cs = s->conns[i];
 
-    nbd_teardown_connection(bs);
+        if (cs->ioc) {
+            nbd_send_request(cs->ioc, &request);
+        }
+
+        nbd_teardown_connection(cs);
+    }
 }
 
 
@@ -1803,6 +2051,12 @@ static QemuOptsList nbd_runtime_opts = {
                     "attempts until successful or until @open-timeout seconds "
                     "have elapsed. Default 0",
         },
+        {
+            .name = "multi-conn",
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of connections to open to the server if it "
+                    "allows several, at most 16. Default 1",
+        },
         { /* end of list */ }
     },
 };
@@ -1859,6 +2113,13 @@ static int nbd_process_options(BlockDriverState *bs, QDict *options,
     s->reconnect_delay = qemu_opt_get_number(opts, "reconnect-delay", 0);
     s->open_timeout = qemu_opt_get_number(opts, "open-timeout", 0);
 
+    s->multi_conn = qemu_opt_get_number(opts, "multi-conn", 1);
+    if (s->multi_conn < 1 || s->multi_conn > MAX_NBD_CONNECTIONS) {
+        error_setg(errp, "multi-conn must be between 1 and %d",
+                   MAX_NBD_CONNECTIONS);
+        goto error;
+    }
+
     ret = 0;
 
  error:
@@ -1873,10 +2134,6 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
 
     s->bs = bs;
-    qemu_mutex_init(&s->requests_lock);
-    qemu_co_queue_init(&s->free_sema);
-    qemu_co_mutex_init(&s->send_mutex);
-    qemu_co_mutex_init(&s->receive_mutex);
 
     if (!yank_register_instance(BLOCKDEV_YANK_INSTANCE(bs->node_name), errp)) {
         return -EEXIST;
@@ -1887,17 +2144,15 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
         goto fail;
     }
 
-    s->conn = nbd_client_connection_new(s->saddr, true, s->export,
-                                        s->x_dirty_bitmap, s->tlscreds,
-                                        s->tlshostname);
+    s->conns[0] = nbd_conn_state_new(s);
+    s->num_conns = 1;
 
     if (s->open_timeout) {
-        nbd_client_connection_enable_retry(s->conn);
+        nbd_client_connection_enable_retry(s->conns[0]->conn);
         open_timer_init(s, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
                         s->open_timeout * NANOSECONDS_PER_SECOND);
     }
 
-    s->state = NBD_CLIENT_CONNECTING_WAIT;
     ret = nbd_do_establish_connection(bs, true, errp);
     if (ret < 0) {
         goto fail;
@@ -1910,7 +2165,7 @@ static int nbd_open(BlockDriverState *bs, QDict *options, int flags,
      */
     open_timer_del(s);
 
-    nbd_client_connection_enable_retry(s->conn);
+    nbd_client_connection_enable_retry(s->conns[0]->conn);
 
     return 0;
 
@@ -2059,22 +2314,28 @@ static const char *const nbd_strong_runtime_opts[] = {
 static void nbd_cancel_in_flight(BlockDriverState *bs)
 {
     BDRVNBDState *s = (BDRVNBDState *)bs->opaque;
+    unsigned int i;
 
-    reconnect_delay_timer_del(s);
+    for (i = 0; i < s->num_conns; i++) {
+        NBDConnState *cs = s->conns[i];
 
-    qemu_mutex_lock(&s->requests_lock);
-    if (s->state == NBD_CLIENT_CONNECTING_WAIT) {
-        s->state = NBD_CLIENT_CONNECTING_NOWAIT;
-    }
-    qemu_mutex_unlock(&s->requests_lock);
+        reconnect_delay_timer_del(cs);
 
-    nbd_co_establish_connection_cancel(s->conn);
+        qemu_mutex_lock(&cs->requests_lock);
+        if (cs->state == NBD_CLIENT_CONNECTING_WAIT) {
+            cs->state = NBD_CLIENT_CONNECTING_NOWAIT;
+        }
+        qemu_mutex_unlock(&cs->requests_lock);
+
+        nbd_co_establish_connection_cancel(cs->conn);
+    }
 }
 
 static void nbd_attach_aio_context(BlockDriverState *bs,
                                    AioContext *new_context)
 {
     BDRVNBDState *s = bs->opaque;
+    unsigned int i;
 
     /* The open_timer is used only during nbd_open() */
     assert(!s->open_timer);
@@ -2088,22 +2349,32 @@ static void nbd_attach_aio_context(BlockDriverState *bs,
      * Since the AioContext can only be changed when a node is drained,
      * the reconnect_delay_timer cannot be active here.
      */
-    assert(!s->reconnect_delay_timer);
+    for (i = 0; i < s->num_conns; i++) {
+        NBDConnState *cs = s->conns[i];
+
+        assert(!cs->reconnect_delay_timer);
 
-    if (s->ioc) {
-        qio_channel_attach_aio_context(s->ioc, new_context);
+        if (cs->ioc) {
+            qio_channel_attach_aio_context(cs->ioc, new_context);
+        }
     }
 }
 
 static void nbd_detach_aio_context(BlockDriverState *bs)
 {
     BDRVNBDState *s = bs->opaque;
+    unsigned int i;
 
     assert(!s->open_timer);
-    assert(!s->reconnect_delay_timer);
 
-    if (s->ioc) {
-        qio_channel_detach_aio_context(s->ioc);
+    for (i = 0; i < s->num_conns; i++) {
+        NBDConnState *cs = s->conns[i];
+
+        assert(!cs->reconnect_delay_timer);
+
+        if (cs->ioc) {
+            qio_channel_detach_aio_context(cs->ioc);
+        }
     }
 }
 
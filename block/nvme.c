@@ -63,6 +63,7 @@ typedef struct {
 typedef struct {
     BlockCompletionFunc *cb;
     void *opaque;
+    uint32_t *result; /* if non-NULL, receives dword 0 of the completion */
     int cid;
     void *prp_list_page;
     uint64_t prp_list_iova;
@@ -107,6 +108,7 @@ struct BDRVNVMeState {
      */
     NVMeQueuePair **queues;
     unsigned queue_count;
+    unsigned next_io_queue; /* round-robin I/O queue selection */
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -141,6 +143,7 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_IO_QUEUES "io-queues"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -158,6 +161,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_IO_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs to create (default: 1)",
+        },
         { /* end of list */ }
     },
 };
@@ -346,6 +354,25 @@ static void nvme_put_free_req_and_wake(NVMeQueuePair *q, NVMeRequest *req)
     qemu_mutex_unlock(&q->lock);
 }
 
+/*
+ * Spread requests across the I/O queue pairs, so that the controller sees
+ * several submission queues that it can work on in parallel.
+ *
+ * All requests are still submitted and completed by the node's single
+ * AioContext, so this does not spread the work on the host across threads.
+ * It only helps controllers whose throughput is limited per queue.
+ */
+static NVMeQueuePair *nvme_get_io_queue(BDRVNVMeState *s)
+{
+    unsigned nr_io_queues = s->queue_count - INDEX_IO(0);
+
+    assert(nr_io_queues > 0);
+    if (nr_io_queues == 1) {
+        return s->queues[INDEX_IO(0)];
+    }
+    return s->queues[INDEX_IO(s->next_io_queue++ % nr_io_queues)];
+}
+
 static inline int nvme_translate_error(const NvmeCqe *c)
 {
     uint16_t status = (le16_to_cpu(c->status) >> 1) & 0xFF;
@@ -421,8 +448,12 @@ static bool nvme_process_completion(NVMeQueuePair *q)
         req = *preq;
         assert(req.cid == cid);
         assert(req.cb);
+        if (req.result) {
+            *req.result = le32_to_cpu(c->result);
+        }
         nvme_put_free_req_locked(q, preq);
         preq->cb = preq->opaque = NULL;
+        preq->result = NULL;
         q->inflight--;
         qemu_mutex_unlock(&q->lock);
         req.cb(req.opaque, ret);
@@ -499,7 +530,12 @@ static void nvme_admin_cmd_sync_cb(void *opaque, int ret)
     aio_wait_kick();
 }
 
-static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+/*
+ * Run an admin command and wait for it to complete. If @result is non-NULL,
+ * dword 0 of the completion queue entry is stored there.
+ */
+static int nvme_admin_cmd_sync_result(BlockDriverState *bs, NvmeCmd *cmd,
+                                      uint32_t *result)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q = s->queues[INDEX_ADMIN];
@@ -510,12 +546,18 @@ static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
     if (!req) {
         return -EBUSY;
     }
+    req->result = result;
     nvme_submit_command(q, req, cmd, nvme_admin_cmd_sync_cb, &ret);
 
     AIO_WAIT_WHILE(aio_context, ret == -EINPROGRESS);
     return ret;
 }
 
+static int nvme_admin_cmd_sync(BlockDriverState *bs, NvmeCmd *cmd)
+{
+    return nvme_admin_cmd_sync_result(bs, cmd, NULL);
+}
+
 /* Returns true on success, false on failure. */
 static bool nvme_identify(BlockDriverState *bs, int namespace, Error **errp)
 {
@@ -679,12 +721,25 @@ static bool nvme_add_io_queue(BlockDriverState *bs, Error **errp)
     };
     if (nvme_admin_cmd_sync(bs, &cmd)) {
         error_setg(errp, "Failed to create SQ io queue [%u]", n);
-        goto out_error;
+        goto out_delete_cq;
     }
     s->queues = g_renew(NVMeQueuePair *, s->queues, n + 1);
     s->queues[n] = q;
     s->queue_count++;
     return true;
+out_delete_cq:
+    cmd = (NvmeCmd) {
+        .opcode = NVME_ADM_CMD_DELETE_CQ,
+        .cdw10 = cpu_to_le32(n),
+    };
+    if (nvme_admin_cmd_sync(bs, &cmd)) {
+        /*
+         * The controller may still post completions to the CQ, so its
+         * memory must stay mapped. Leak the queue pair.
+         */
+        error_append_hint(errp, "Failed to delete CQ io queue [%u]\n", n);
+        return false;
+    }
 out_error:
     nvme_free_queue_pair(q);
     return false;
@@ -721,8 +776,36 @@ static void nvme_poll_ready(EventNotifier *e)
     nvme_poll_queues(s);
 }
 
+/*
+ * Ask the controller for @nr_io_queues I/O queue pairs. Returns the number of
+ * queue pairs that the controller allocated, which may be fewer.
+ */
+static unsigned nvme_set_num_queues(BlockDriverState *bs,
+                                    unsigned nr_io_queues)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+        .cdw11 = cpu_to_le32(((nr_io_queues - 1) << 16) | (nr_io_queues - 1)),
+    };
+    uint32_t result;
+    unsigned nsqa, ncqa;
+
+    if (nvme_admin_cmd_sync_result(bs, &cmd, &result)) {
+        /* Every controller supports at least one I/O queue pair */
+        trace_nvme_set_num_queues_failed(bs->opaque, nr_io_queues);
+        return 1;
+    }
+
+    /* Both counts are zero-based */
+    nsqa = (result & 0xffff) + 1;
+    ncqa = (result >> 16) + 1;
+    trace_nvme_set_num_queues(bs->opaque, nr_io_queues, nsqa, ncqa);
+    return MIN(nsqa, ncqa);
+}
+
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned nr_io_queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
@@ -782,6 +865,12 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
 
     s->page_size = 1u << (12 + NVME_CAP_MPSMIN(cap));
     s->doorbell_scale = (4 << NVME_CAP_DSTRD(cap)) / sizeof(uint32_t);
+    if (nr_io_queues >
+        NVME_DOORBELL_SIZE / (sizeof(*s->doorbells) * s->doorbell_scale) - 1) {
+        error_setg(errp, "Too many I/O queues requested (%u)", nr_io_queues);
+        ret = -EINVAL;
+        goto out;
+    }
     bs->bl.opt_mem_alignment = s->page_size;
     bs->bl.request_alignment = s->page_size;
     timeout_ms = MIN(500 * NVME_CAP_TO(cap), 30000);
@@ -862,8 +951,20 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
-    if (!nvme_add_io_queue(bs, errp)) {
-        ret = -EIO;
+    if (nr_io_queues > 1) {
+        unsigned granted = nvme_set_num_queues(bs, nr_io_queues);
+
+        if (granted < nr_io_queues) {
+            warn_report("NVMe: controller allocated %u of %u I/O queues",
+                        granted, nr_io_queues);
+            nr_io_queues = granted;
+        }
+    }
+    while (s->queue_count - INDEX_IO(0) < nr_io_queues) {
+        if (!nvme_add_io_queue(bs, errp)) {
+            ret = -EIO;
+            goto out;
+        }
     }
 out:
     if (regs) {
@@ -954,6 +1055,7 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t nr_io_queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -969,7 +1071,14 @@ static int nvme_file_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    nr_io_queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_IO_QUEUES, 1);
+    if (nr_io_queues < 1 || nr_io_queues > UINT16_MAX) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_IO_QUEUES "' must be between 1 "
+                   "and %u", UINT16_MAX);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, nr_io_queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1169,7 +1278,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1288,7 +1397,7 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
@@ -1319,7 +1428,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1382,7 +1491,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_io_queue(s);
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
@@ -1609,6 +1718,7 @@ static BlockStatsSpecific *nvme_get_specific_stats(BlockDriverState *bs)
         .completion_errors = s->stats.completion_errors,
         .aligned_accesses = s->stats.aligned_accesses,
         .unaligned_accesses = s->stats.unaligned_accesses,
+        .io_queues = s->queue_count - INDEX_IO(0),
     };
 
     return stats;
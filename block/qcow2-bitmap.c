@@ -28,8 +28,11 @@
 #include "qemu/osdep.h"
 #include "qapi/error.h"
 #include "qemu/cutils.h"
+#include "qemu/bitmap.h"
+#include "qemu/hbitmap.h"
 
 #include "qcow2.h"
+#include "trace.h"
 
 /* NOTICE: BME here means Bitmaps Extension and used as a namespace for
  * _internal_ constants. Please do not use this _internal_ abbreviation for
@@ -937,6 +940,618 @@ fail:
     return ret;
 }
 
+/*
+ * Bitmap journal
+ *
+ * A persistent bitmap is normally marked IN_USE in the image for as long as
+ * it is loaded read-write, and only written back on close.  If QEMU does not
+ * get that far, the bitmap is inconsistent on the next open and has to be
+ * thrown away, together with the incremental backups based on it.
+ *
+ * With the bitmap-journal option, enabled bitmaps are instead kept consistent
+ * in the image.  Each of them gets a bitmap table with all data clusters
+ * allocated, so that changes can be written in place:
+ *
+ * - Before a write request touches an area whose bits are not set in the
+ *   image yet, the affected bitmap clusters are rewritten and flushed.  So the
+ *   on-disk bitmap covers every write that may have reached the image.
+ *
+ * - Bits that are cleared in memory, or set without a write request (e.g. by
+ *   a merge), are written back every bitmap-journal-interval seconds when no
+ *   requests are in flight.
+ *
+ * Either way, only the bitmap clusters that changed are written.  The bitmap
+ * directory keeps IN_USE cleared for these bitmaps, so they survive an
+ * unclean shutdown, at worst with some bits set that are already clean in
+ * memory.
+ */
+
+struct Qcow2BitmapJournal {
+    BdrvDirtyBitmap *bitmap;
+
+    /* Bitmap contents as they are (or are about to be) in the image */
+    HBitmap *bits;
+    /* Bitmap clusters that differ between @bits and the image */
+    unsigned long *dirty;
+
+    uint64_t size;     /* bitmap size in bytes of guest data */
+    uint64_t coverage; /* bytes of guest data covered by one bitmap cluster */
+    uint64_t *table;   /* data cluster offsets, all allocated */
+    uint32_t table_size;
+    uint64_t table_offset;
+
+    /* The table that was replaced, only needed while setting up */
+    uint64_t *old_table;
+    uint64_t old_table_offset;
+
+    QSIMPLEQ_ENTRY(Qcow2BitmapJournal) entry;
+};
+typedef struct Qcow2BitmapJournalList Qcow2BitmapJournalList;
+
+static void bitmap_journal_free(Qcow2BitmapJournal *jb)
+{
+    hbitmap_free(jb->bits);
+    g_free(jb->dirty);
+    g_free(jb->table);
+    g_free(jb->old_table);
+    g_free(jb);
+}
+
+static void bitmap_journal_list_free(Qcow2BitmapJournalList *list)
+{
+    Qcow2BitmapJournal *jb, *next;
+
+    QSIMPLEQ_FOREACH_SAFE(jb, list, entry, next) {
+        bitmap_journal_free(jb);
+    }
+    QSIMPLEQ_INIT(list);
+}
+
+static Qcow2BitmapJournal *bitmap_journal_find(Qcow2BitmapJournalList *list,
+                                               BdrvDirtyBitmap *bitmap)
+{
+    Qcow2BitmapJournal *jb;
+
+    QSIMPLEQ_FOREACH(jb, list, entry) {
+        if (jb->bitmap == bitmap) {
+            return jb;
+        }
+    }
+
+    return NULL;
+}
+
+/* Free the clusters that bitmap_journal_new() did not take over */
+static void bitmap_journal_free_new_clusters(BlockDriverState *bs,
+                                             Qcow2BitmapJournal *jb)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint32_t i;
+
+    for (i = 0; jb->table && i < jb->table_size; i++) {
+        if (jb->table[i] &&
+            jb->table[i] != (jb->old_table[i] & BME_TABLE_ENTRY_OFFSET_MASK))
+        {
+            qcow2_free_clusters(bs, jb->table[i], s->cluster_size,
+                                QCOW2_DISCARD_ALWAYS);
+        }
+    }
+
+    if (jb->table_offset) {
+        qcow2_free_clusters(bs, jb->table_offset,
+                            jb->table_size * BME_TABLE_ENTRY_SIZE,
+                            QCOW2_DISCARD_OTHER);
+    }
+}
+
+/*
+ * Write the current contents of @bitmap to the image, reusing the data
+ * clusters of @bm and allocating the missing ones, and write a new bitmap
+ * table for them.  The bitmap directory is left alone.
+ */
+static Qcow2BitmapJournal *bitmap_journal_new(BlockDriverState *bs,
+                                              Qcow2Bitmap *bm,
+                                              BdrvDirtyBitmap *bitmap,
+                                              Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2BitmapJournal *jb;
+    uint8_t *buf = NULL;
+    uint64_t *tb = NULL;
+    uint64_t offset;
+    int64_t off;
+    uint32_t i;
+    int ret;
+
+    jb = g_new0(Qcow2BitmapJournal, 1);
+    jb->bitmap = bitmap;
+    jb->size = bdrv_dirty_bitmap_size(bitmap);
+    jb->coverage = bdrv_dirty_bitmap_serialization_coverage(s->cluster_size,
+                                                           bitmap);
+    jb->table_size = bm->table.size;
+    jb->old_table_offset = bm->table.offset;
+    jb->bits = hbitmap_alloc(jb->size, bm->granularity_bits);
+    jb->dirty = bitmap_new(jb->table_size);
+
+    ret = bitmap_table_load(bs, &bm->table, &jb->old_table);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Could not read bitmap table for "
+                         "bitmap '%s'", bm->name);
+        goto fail;
+    }
+
+    jb->table = g_new0(uint64_t, jb->table_size);
+    buf = g_malloc(s->cluster_size);
+
+    for (i = 0, offset = 0; i < jb->table_size; i++, offset += jb->coverage) {
+        uint64_t count = MIN(jb->size - offset, jb->coverage);
+        uint64_t write_size =
+            bdrv_dirty_bitmap_serialization_size(bitmap, offset, count);
+
+        off = jb->old_table[i] & BME_TABLE_ENTRY_OFFSET_MASK;
+        if (off == 0) {
+            off = qcow2_alloc_clusters(bs, s->cluster_size);
+            if (off < 0) {
+                error_setg_errno(errp, -off, "Failed to allocate clusters "
+                                 "for bitmap '%s'", bm->name);
+                goto fail;
+            }
+        }
+        jb->table[i] = off;
+
+        bdrv_dirty_bitmap_serialize_part(bitmap, buf, offset, count);
+        if (write_size < s->cluster_size) {
+            memset(buf + write_size, 0, s->cluster_size - write_size);
+        }
+        hbitmap_deserialize_part(jb->bits, buf, offset, count, false);
+
+        ret = qcow2_pre_write_overlap_check(bs, 0, off, s->cluster_size,
+                                            false);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+            goto fail;
+        }
+
+        ret = bdrv_pwrite(bs->file, off, buf, s->cluster_size);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                             bm->name);
+            goto fail;
+        }
+    }
+    hbitmap_deserialize_finish(jb->bits);
+
+    off = qcow2_alloc_clusters(bs, jb->table_size * BME_TABLE_ENTRY_SIZE);
+    if (off < 0) {
+        error_setg_errno(errp, -off, "Failed to allocate clusters for "
+                         "bitmap '%s'", bm->name);
+        goto fail;
+    }
+    jb->table_offset = off;
+
+    ret = qcow2_pre_write_overlap_check(bs, 0, jb->table_offset,
+                                        jb->table_size * BME_TABLE_ENTRY_SIZE,
+                                        false);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Qcow2 overlap check failed");
+        goto fail;
+    }
+
+    tb = g_memdup(jb->table, jb->table_size * BME_TABLE_ENTRY_SIZE);
+    bitmap_table_to_be(tb, jb->table_size);
+    ret = bdrv_pwrite(bs->file, jb->table_offset, tb,
+                      jb->table_size * BME_TABLE_ENTRY_SIZE);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to write bitmap '%s' to file",
+                         bm->name);
+        goto fail;
+    }
+
+    g_free(tb);
+    g_free(buf);
+
+    return jb;
+
+fail:
+    bitmap_journal_free_new_clusters(bs, jb);
+    bitmap_journal_free(jb);
+    g_free(tb);
+    g_free(buf);
+
+    return NULL;
+}
+
+static void bitmap_journal_timer_cb(void *opaque);
+
+void qcow2_bitmap_journal_attach_aio_context(BlockDriverState *bs,
+                                             AioContext *new_context)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->bitmap_journal_interval > 0 &&
+        !QSIMPLEQ_EMPTY(&s->bitmap_journals))
+    {
+        s->bitmap_journal_timer =
+            aio_timer_new_with_attrs(new_context, QEMU_CLOCK_REALTIME,
+                                     SCALE_MS, QEMU_TIMER_ATTR_EXTERNAL,
+                                     bitmap_journal_timer_cb, bs);
+        timer_mod(s->bitmap_journal_timer,
+                  qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+                  (int64_t) s->bitmap_journal_interval * 1000);
+    }
+}
+
+void qcow2_bitmap_journal_detach_aio_context(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (s->bitmap_journal_timer) {
+        timer_free(s->bitmap_journal_timer);
+        s->bitmap_journal_timer = NULL;
+    }
+}
+
+/*
+ * Take the journals off @bs, so that the bitmaps can be stored the usual way.
+ * The caller must make sure that no requests are in flight.
+ */
+static void bitmap_journal_take(BlockDriverState *bs,
+                                Qcow2BitmapJournalList *list)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    qcow2_bitmap_journal_detach_aio_context(bs);
+    QSIMPLEQ_INIT(list);
+    QSIMPLEQ_CONCAT(list, &s->bitmap_journals);
+}
+
+/* Undo bitmap_journal_take() */
+static void bitmap_journal_restore(BlockDriverState *bs,
+                                   Qcow2BitmapJournalList *list)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    if (QSIMPLEQ_EMPTY(list)) {
+        return;
+    }
+
+    QSIMPLEQ_CONCAT(&s->bitmap_journals, list);
+    qcow2_bitmap_journal_attach_aio_context(bs, bdrv_get_aio_context(bs));
+}
+
+void qcow2_bitmap_journal_close(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+
+    qcow2_bitmap_journal_detach_aio_context(bs);
+    bitmap_journal_list_free(&s->bitmap_journals);
+}
+
+/*
+ * Switch the enabled persistent bitmaps of @bs that are marked IN_USE in the
+ * image, but consistent in memory, over to journaled updates.
+ */
+static int bitmap_journal_start(BlockDriverState *bs, Error **errp)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2BitmapJournalList new_journals =
+        QSIMPLEQ_HEAD_INITIALIZER(new_journals);
+    Qcow2BitmapJournal *jb, *next;
+    Qcow2BitmapList *bm_list;
+    Qcow2Bitmap *bm;
+    int nb_bitmaps = 0;
+    int ret = 0;
+
+    if (!s->bitmap_journal || s->nb_bitmaps == 0 || !can_write(bs)) {
+        return 0;
+    }
+
+    bm_list = bitmap_list_load(bs, s->bitmap_directory_offset,
+                               s->bitmap_directory_size, errp);
+    if (bm_list == NULL) {
+        return -EINVAL;
+    }
+
+    QSIMPLEQ_FOREACH(bm, bm_list, entry) {
+        BdrvDirtyBitmap *bitmap = bdrv_find_dirty_bitmap(bs, bm->name);
+
+        if (!bitmap || !(bm->flags & BME_FLAG_IN_USE) ||
+            !bdrv_dirty_bitmap_get_persistence(bitmap) ||
+            !bdrv_dirty_bitmap_enabled(bitmap) ||
+            bdrv_dirty_bitmap_readonly(bitmap) ||
+            bdrv_dirty_bitmap_inconsistent(bitmap) ||
+            bdrv_dirty_bitmap_granularity(bitmap) !=
+                1U << bm->granularity_bits ||
+            bitmap_journal_find(&s->bitmap_journals, bitmap))
+        {
+            continue;
+        }
+
+        /* The data clusters are reused, so the table must fit the bitmap */
+        if (bm->table.size == 0 || bm->table.size !=
+            size_to_clusters(s, bdrv_dirty_bitmap_serialization_size(
+                bitmap, 0, bdrv_dirty_bitmap_size(bitmap))))
+        {
+            continue;
+        }
+
+        jb = bitmap_journal_new(bs, bm, bitmap, errp);
+        if (jb == NULL) {
+            ret = -EINVAL;
+            goto fail;
+        }
+        QSIMPLEQ_INSERT_TAIL(&new_journals, jb, entry);
+        nb_bitmaps++;
+
+        bm->table.offset = jb->table_offset;
+        bm->flags &= ~BME_FLAG_IN_USE;
+    }
+
+    if (nb_bitmaps == 0) {
+        goto out;
+    }
+
+    /* The new clusters must be accounted for before the directory uses them */
+    ret = qcow2_flush_caches(bs);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to flush metadata caches");
+        goto fail;
+    }
+
+    ret = update_ext_header_and_dir_in_place(bs, bm_list);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Cannot update bitmap directory");
+        goto fail;
+    }
+
+    QSIMPLEQ_FOREACH(jb, &new_journals, entry) {
+        /* Only the table itself is dropped, the data clusters live on */
+        qcow2_free_clusters(bs, jb->old_table_offset,
+                            jb->table_size * BME_TABLE_ENTRY_SIZE,
+                            QCOW2_DISCARD_OTHER);
+        g_free(jb->old_table);
+        jb->old_table = NULL;
+    }
+
+    trace_qcow2_bitmap_journal_start(bs, nb_bitmaps);
+
+    qcow2_bitmap_journal_detach_aio_context(bs);
+    QSIMPLEQ_CONCAT(&s->bitmap_journals, &new_journals);
+    qcow2_bitmap_journal_attach_aio_context(bs, bdrv_get_aio_context(bs));
+
+out:
+    bitmap_list_free(bm_list);
+    return ret;
+
+fail:
+    QSIMPLEQ_FOREACH_SAFE(jb, &new_journals, entry, next) {
+        bitmap_journal_free_new_clusters(bs, jb);
+        bitmap_journal_free(jb);
+    }
+    bitmap_list_free(bm_list);
+    return ret;
+}
+
+/*
+ * Write all bitmap clusters that changed since the last sync, and flush them.
+ * Called with bitmap_journal_lock held.
+ */
+static int coroutine_fn bitmap_journal_co_sync(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t seq = s->bitmap_journal_seq;
+    uint64_t nb_clusters = 0;
+    Qcow2BitmapJournal *jb;
+    uint8_t *buf;
+    int ret = 0;
+
+    buf = g_malloc(s->cluster_size);
+
+    QSIMPLEQ_FOREACH(jb, &s->bitmap_journals, entry) {
+        unsigned long i;
+
+        for (i = find_first_bit(jb->dirty, jb->table_size);
+             i < jb->table_size;
+             i = find_next_bit(jb->dirty, jb->table_size, i + 1))
+        {
+            uint64_t offset = i * jb->coverage;
+            uint64_t count = MIN(jb->size - offset, jb->coverage);
+            uint64_t write_size =
+                hbitmap_serialization_size(jb->bits, offset, count);
+
+            /* Changes made while the write is in flight go in the next sync */
+            clear_bit(i, jb->dirty);
+            hbitmap_serialize_part(jb->bits, buf, offset, count);
+            if (write_size < s->cluster_size) {
+                memset(buf + write_size, 0, s->cluster_size - write_size);
+            }
+
+            ret = qcow2_pre_write_overlap_check(bs, 0, jb->table[i],
+                                                s->cluster_size, false);
+            if (ret >= 0) {
+                ret = bdrv_co_pwrite(bs->file, jb->table[i], s->cluster_size,
+                                     buf, 0);
+            }
+            if (ret < 0) {
+                set_bit(i, jb->dirty);
+                goto out;
+            }
+            nb_clusters++;
+        }
+    }
+
+    ret = bdrv_co_flush(bs->file->bs);
+    if (ret == 0) {
+        s->bitmap_journal_synced_seq = seq;
+    }
+
+out:
+    trace_qcow2_bitmap_journal_sync(bs, seq, nb_clusters, ret);
+    g_free(buf);
+    return ret;
+}
+
+/*
+ * Make sure that the bitmaps in the image cover [@offset, @offset + @bytes)
+ * before the caller writes there.
+ */
+int coroutine_fn qcow2_co_bitmap_journal_write_intent(BlockDriverState *bs,
+                                                     int64_t offset,
+                                                     int64_t bytes)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2BitmapJournal *jb;
+    uint64_t seq;
+    int ret = 0;
+
+    if (QSIMPLEQ_EMPTY(&s->bitmap_journals)) {
+        return 0;
+    }
+
+    QSIMPLEQ_FOREACH(jb, &s->bitmap_journals, entry) {
+        uint64_t end = MIN(offset + bytes, jb->size);
+        uint64_t first, last;
+
+        /* A bitmap with a successor gets the bits back if the job fails */
+        if (!bdrv_dirty_bitmap_enabled(jb->bitmap) &&
+            !bdrv_dirty_bitmap_has_successor(jb->bitmap))
+        {
+            continue;
+        }
+
+        if (offset >= end ||
+            hbitmap_next_zero(jb->bits, offset, end - offset) < 0)
+        {
+            continue;
+        }
+
+        hbitmap_set(jb->bits, offset, end - offset);
+        first = offset / jb->coverage;
+        last = (end - 1) / jb->coverage;
+        bitmap_set(jb->dirty, first, last - first + 1);
+        s->bitmap_journal_seq++;
+    }
+
+    seq = s->bitmap_journal_seq;
+    if (s->bitmap_journal_synced_seq >= seq) {
+        return 0;
+    }
+
+    trace_qcow2_bitmap_journal_write_intent(bs, offset, bytes);
+
+    /* Concurrent writers share one sync */
+    qemu_co_mutex_lock(&s->bitmap_journal_lock);
+    if (s->bitmap_journal_synced_seq < seq) {
+        ret = bitmap_journal_co_sync(bs);
+    }
+    qemu_co_mutex_unlock(&s->bitmap_journal_lock);
+
+    return ret;
+}
+
+/*
+ * Pick up the bits that were cleared in memory, or set without a write
+ * request.  This must only run while no requests are in flight: a write may
+ * already be in the image before its bits are set in memory.
+ */
+static bool bitmap_journal_update(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    Qcow2BitmapJournal *jb;
+    uint8_t *buf, *disk_buf;
+    bool changed = false;
+
+    buf = g_malloc(s->cluster_size);
+    disk_buf = g_malloc(s->cluster_size);
+
+    QSIMPLEQ_FOREACH(jb, &s->bitmap_journals, entry) {
+        bool bitmap_changed = false;
+        uint64_t offset;
+        uint32_t i;
+
+        /*
+         * A disabled bitmap does not see new writes, in particular while a
+         * backup job has handed them to a successor.  Its image copy may only
+         * lose bits once it is enabled again.
+         */
+        if (!bdrv_dirty_bitmap_enabled(jb->bitmap)) {
+            continue;
+        }
+
+        for (i = 0, offset = 0; i < jb->table_size;
+             i++, offset += jb->coverage)
+        {
+            uint64_t count = MIN(jb->size - offset, jb->coverage);
+            uint64_t size;
+
+            if (bdrv_dirty_bitmap_next_dirty(jb->bitmap, offset, count) < 0 &&
+                hbitmap_next_dirty(jb->bits, offset, count) < 0)
+            {
+                continue;
+            }
+
+            size = hbitmap_serialization_size(jb->bits, offset, count);
+            bdrv_dirty_bitmap_serialize_part(jb->bitmap, buf, offset, count);
+            hbitmap_serialize_part(jb->bits, disk_buf, offset, count);
+            if (memcmp(buf, disk_buf, size) != 0) {
+                hbitmap_deserialize_part(jb->bits, buf, offset, count, false);
+                set_bit(i, jb->dirty);
+                bitmap_changed = true;
+            }
+        }
+
+        if (bitmap_changed) {
+            hbitmap_deserialize_finish(jb->bits);
+            changed = true;
+        }
+    }
+
+    if (changed) {
+        s->bitmap_journal_seq++;
+    }
+
+    g_free(disk_buf);
+    g_free(buf);
+    return changed;
+}
+
+static void coroutine_fn bitmap_journal_co_entry(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+
+    qemu_co_mutex_lock(&s->bitmap_journal_lock);
+    if (s->bitmap_journal_synced_seq < s->bitmap_journal_seq) {
+        /* On error, the clusters stay dirty for the next attempt */
+        bitmap_journal_co_sync(bs);
+    }
+    qemu_co_mutex_unlock(&s->bitmap_journal_lock);
+
+    bdrv_dec_in_flight(bs);
+}
+
+static void bitmap_journal_timer_cb(void *opaque)
+{
+    BlockDriverState *bs = opaque;
+    BDRVQcow2State *s = bs->opaque;
+
+    if (qatomic_read(&bs->in_flight) == 0 &&
+        qatomic_read(&bs->quiesce_counter) == 0)
+    {
+        bitmap_journal_update(bs);
+        if (s->bitmap_journal_synced_seq < s->bitmap_journal_seq) {
+            Coroutine *co = qemu_coroutine_create(bitmap_journal_co_entry, bs);
+
+            bdrv_inc_in_flight(bs);
+            aio_co_enter(bdrv_get_aio_context(bs), co);
+        }
+    }
+
+    timer_mod(s->bitmap_journal_timer,
+              qemu_clock_get_ms(QEMU_CLOCK_REALTIME) +
+              (int64_t) s->bitmap_journal_interval * 1000);
+}
+
 /* for g_slist_foreach for GSList of BdrvDirtyBitmap* elements */
 static void release_dirty_bitmap_helper(gpointer bitmap,
                                         gpointer bs)
@@ -1034,6 +1649,14 @@ bool qcow2_load_dirty_bitmaps(BlockDriverState *bs, bool *header_updated,
     if (!can_write(bs)) {
         g_slist_foreach(created_dirty_bitmaps, set_readonly_helper,
                         (gpointer)true);
+    } else {
+        Error *local_err = NULL;
+
+        /* Not fatal, the bitmaps just stay IN_USE in the image */
+        if (bitmap_journal_start(bs, &local_err) < 0) {
+            warn_reportf_err(local_err, "%s: Cannot journal dirty bitmaps: ",
+                             bdrv_get_node_name(bs));
+        }
     }
 
     g_slist_free(created_dirty_bitmaps);
@@ -1126,6 +1749,7 @@ int qcow2_reopen_bitmaps_rw(BlockDriverState *bs, Error **errp)
     Qcow2BitmapList *bm_list;
     Qcow2Bitmap *bm;
     GSList *ro_dirty_bitmaps = NULL;
+    Error *local_err = NULL;
     int ret = -EINVAL;
     bool need_header_update = false;
 
@@ -1149,6 +1773,11 @@ int qcow2_reopen_bitmaps_rw(BlockDriverState *bs, Error **errp)
             goto out;
         }
 
+        if (bitmap_journal_find(&s->bitmap_journals, bitmap)) {
+            /* Journaled bitmaps are consistent without IN_USE */
+            continue;
+        }
+
         if (!(bm->flags & BME_FLAG_IN_USE)) {
             if (!bdrv_dirty_bitmap_readonly(bitmap)) {
                 error_setg(errp, "Corruption: bitmap '%s' is not marked IN_USE "
@@ -1211,6 +1840,11 @@ int qcow2_reopen_bitmaps_rw(BlockDriverState *bs, Error **errp)
     g_slist_foreach(ro_dirty_bitmaps, set_readonly_helper, false);
     ret = 0;
 
+    if (bitmap_journal_start(bs, &local_err) < 0) {
+        warn_reportf_err(local_err, "%s: Cannot journal dirty bitmaps: ",
+                         bdrv_get_node_name(bs));
+    }
+
 out:
     g_slist_free(ro_dirty_bitmaps);
     bitmap_list_free(bm_list);
@@ -1218,12 +1852,18 @@ out:
     return ret;
 }
 
-/* Checks to see if it's safe to resize bitmaps */
-int qcow2_truncate_bitmaps_check(BlockDriverState *bs, Error **errp)
+/*
+ * Checks to see if it's safe to resize bitmaps.  Journaled bitmaps go back
+ * to being stored on close, because their tables in the image are sized for
+ * the old length.
+ */
+int coroutine_fn qcow2_truncate_bitmaps_check(BlockDriverState *bs,
+                                              Error **errp)
 {
     BDRVQcow2State *s = bs->opaque;
     Qcow2BitmapList *bm_list;
     Qcow2Bitmap *bm;
+    int nb_journaled = 0;
     int ret = 0;
 
     if (s->nb_bitmaps == 0) {
@@ -1257,6 +1897,24 @@ int qcow2_truncate_bitmaps_check(BlockDriverState *bs, Error **errp)
             ret = -ENOTSUP;
             goto out;
         }
+
+        if (bitmap_journal_find(&s->bitmap_journals, bitmap)) {
+            bm->flags |= BME_FLAG_IN_USE;
+            nb_journaled++;
+        }
+    }
+
+    if (nb_journaled > 0) {
+        /* Wait for a sync in flight, its clusters are about to be dropped */
+        qemu_co_mutex_lock(&s->bitmap_journal_lock);
+        ret = update_ext_header_and_dir_in_place(bs, bm_list);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "Cannot update bitmap directory");
+        } else {
+            trace_qcow2_bitmap_journal_stop(bs, nb_journaled);
+            qcow2_bitmap_journal_close(bs);
+        }
+        qemu_co_mutex_unlock(&s->bitmap_journal_lock);
     }
 
 out:
@@ -1451,6 +2109,7 @@ int coroutine_fn qcow2_co_remove_persistent_dirty_bitmap(BlockDriverState *bs,
     BDRVQcow2State *s = bs->opaque;
     Qcow2Bitmap *bm = NULL;
     Qcow2BitmapList *bm_list;
+    Qcow2BitmapJournal *jb;
 
     if (s->nb_bitmaps == 0) {
         /*
@@ -1484,6 +2143,16 @@ int coroutine_fn qcow2_co_remove_persistent_dirty_bitmap(BlockDriverState *bs,
         goto out;
     }
 
+    /* Stop writing to the clusters before they are freed */
+    qemu_co_mutex_lock(&s->bitmap_journal_lock);
+    jb = bitmap_journal_find(&s->bitmap_journals,
+                             bdrv_find_dirty_bitmap(bs, name));
+    if (jb) {
+        QSIMPLEQ_REMOVE(&s->bitmap_journals, jb, Qcow2BitmapJournal, entry);
+        bitmap_journal_free(jb);
+    }
+    qemu_co_mutex_unlock(&s->bitmap_journal_lock);
+
     free_bitmap_clusters(bs, &bm->table);
 
 out:
@@ -1532,6 +2201,7 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
     Qcow2Bitmap *bm;
     QSIMPLEQ_HEAD(, Qcow2BitmapTable) drop_tables;
     Qcow2BitmapTable *tb, *tb_next;
+    Qcow2BitmapJournalList journals;
     bool need_write = false;
 
     QSIMPLEQ_INIT(&drop_tables);
@@ -1546,6 +2216,9 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
         }
     }
 
+    /* Journaled bitmaps are stored like the others, and their clusters freed */
+    bitmap_journal_take(bs, &journals);
+
     /* check constraints and names */
     FOR_EACH_DIRTY_BITMAP(bs, bitmap) {
         const char *name = bdrv_dirty_bitmap_name(bitmap);
@@ -1594,7 +2267,9 @@ bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
             bm->name = g_strdup(name);
             QSIMPLEQ_INSERT_TAIL(bm_list, bm, entry);
         } else {
-            if (!(bm->flags & BME_FLAG_IN_USE)) {
+            if (!(bm->flags & BME_FLAG_IN_USE) &&
+                !bitmap_journal_find(&journals, bitmap))
+            {
                 error_setg(errp, "Bitmap '%s' already exists in the image",
                            name);
                 goto fail;
@@ -1656,6 +2331,7 @@ success:
         }
     }
 
+    bitmap_journal_list_free(&journals);
     bitmap_list_free(bm_list);
     return true;
 
@@ -1674,6 +2350,8 @@ fail:
         g_free(tb);
     }
 
+    /* The image still has the journaled bitmaps in place */
+    bitmap_journal_restore(bs, &journals);
     bitmap_list_free(bm_list);
     return false;
 }
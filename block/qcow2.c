@@ -698,6 +698,8 @@ static const char *const mutable_opts[] = {
     QCOW2_OPT_L2_CACHE_ENTRY_SIZE,
     QCOW2_OPT_REFCOUNT_CACHE_SIZE,
     QCOW2_OPT_CACHE_CLEAN_INTERVAL,
+    QCOW2_OPT_BITMAP_JOURNAL,
+    QCOW2_OPT_BITMAP_JOURNAL_INTERVAL,
     NULL
 };
 
@@ -809,6 +811,18 @@ static QemuOptsList qcow2_runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "Clean unused cache entries after this time (in seconds)",
         },
+        {
+            .name = QCOW2_OPT_BITMAP_JOURNAL,
+            .type = QEMU_OPT_BOOL,
+            .help = "Keep persistent dirty bitmaps consistent in the image "
+                    "while it is in use",
+        },
+        {
+            .name = QCOW2_OPT_BITMAP_JOURNAL_INTERVAL,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Write cleared bits of journaled dirty bitmaps to the "
+                    "image after this time (in seconds)",
+        },
         BLOCK_CRYPTO_OPT_DEF_KEY_SECRET("encrypt.",
             "ID of secret providing qcow2 AES key or LUKS passphrase"),
         { /* end of list */ }
@@ -862,12 +876,14 @@ static void cache_clean_timer_del(BlockDriverState *bs)
 static void qcow2_detach_aio_context(BlockDriverState *bs)
 {
     cache_clean_timer_del(bs);
+    qcow2_bitmap_journal_detach_aio_context(bs);
 }
 
 static void qcow2_attach_aio_context(BlockDriverState *bs,
                                      AioContext *new_context)
 {
     cache_clean_timer_init(bs, new_context);
+    qcow2_bitmap_journal_attach_aio_context(bs, new_context);
 }
 
 static bool read_cache_sizes(BlockDriverState *bs, QemuOpts *opts,
@@ -970,6 +986,8 @@ typedef struct Qcow2ReopenState {
     int overlap_check;
     bool discard_passthrough[QCOW2_DISCARD_MAX];
     uint64_t cache_clean_interval;
+    bool bitmap_journal;
+    uint64_t bitmap_journal_interval;
     QCryptoBlockOpenOptions *crypto_opts; /* Disk encryption runtime options */
 } Qcow2ReopenState;
 
@@ -1071,6 +1089,26 @@ static int qcow2_update_options_prepare(BlockDriverState *bs,
         goto fail;
     }
 
+    r->bitmap_journal = qemu_opt_get_bool(opts, QCOW2_OPT_BITMAP_JOURNAL,
+                                          false);
+    if (!r->bitmap_journal && !QSIMPLEQ_EMPTY(&s->bitmap_journals) &&
+        (flags & BDRV_O_RDWR))
+    {
+        error_setg(errp, "Cannot disable " QCOW2_OPT_BITMAP_JOURNAL
+                   " while the image is writable");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    r->bitmap_journal_interval =
+        qemu_opt_get_number(opts, QCOW2_OPT_BITMAP_JOURNAL_INTERVAL,
+                            DEFAULT_BITMAP_JOURNAL_INTERVAL);
+    if (r->bitmap_journal_interval > UINT_MAX) {
+        error_setg(errp, "Bitmap journal interval too big");
+        ret = -EINVAL;
+        goto fail;
+    }
+
     /* lazy-refcounts; flush if going from enabled to disabled */
     r->use_lazy_refcounts = qemu_opt_get_bool(opts, QCOW2_OPT_LAZY_REFCOUNTS,
         (s->compatible_features & QCOW2_COMPAT_LAZY_REFCOUNTS));
@@ -1226,6 +1264,13 @@ static void qcow2_update_options_commit(BlockDriverState *bs,
         cache_clean_timer_init(bs, bdrv_get_aio_context(bs));
     }
 
+    s->bitmap_journal = r->bitmap_journal;
+    if (s->bitmap_journal_interval != r->bitmap_journal_interval) {
+        qcow2_bitmap_journal_detach_aio_context(bs);
+        s->bitmap_journal_interval = r->bitmap_journal_interval;
+        qcow2_bitmap_journal_attach_aio_context(bs, bdrv_get_aio_context(bs));
+    }
+
     qapi_free_QCryptoBlockOpenOptions(s->crypto_opts);
     s->crypto_opts = r->crypto_opts;
 }
@@ -1606,6 +1651,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
 
     QLIST_INIT(&s->cluster_allocs);
     QTAILQ_INIT(&s->discards);
+    QSIMPLEQ_INIT(&s->bitmap_journals);
 
     /* read qcow2 extensions */
     if (qcow2_read_extensions(bs, header.header_length, ext_end, NULL,
@@ -1851,6 +1897,7 @@ static int coroutine_fn qcow2_do_open(BlockDriverState *bs, QDict *options,
     /* else pre-write overlap checks in cache_destroy may crash */
     s->l1_table = NULL;
     cache_clean_timer_del(bs);
+    qcow2_bitmap_journal_close(bs);
     if (s->l2_table_cache) {
         qcow2_cache_destroy(s->l2_table_cache);
     }
@@ -1900,6 +1947,7 @@ static int qcow2_open(BlockDriverState *bs, QDict *options, int flags,
 
     /* Initialise locks */
     qemu_co_mutex_init(&s->lock);
+    qemu_co_mutex_init(&s->bitmap_journal_lock);
 
     if (qemu_in_coroutine()) {
         /* From bdrv_co_create.  */
@@ -2611,6 +2659,11 @@ static coroutine_fn int qcow2_co_pwritev_part(
 
     trace_qcow2_writev_start_req(qemu_coroutine_self(), offset, bytes);
 
+    ret = qcow2_co_bitmap_journal_write_intent(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
     while (bytes != 0 && aio_task_pool_status(aio) == 0) {
 
         l2meta = NULL;
@@ -2726,6 +2779,7 @@ static void qcow2_close(BlockDriverState *bs)
     }
 
     cache_clean_timer_del(bs);
+    qcow2_bitmap_journal_close(bs);
     qcow2_cache_destroy(s->l2_table_cache);
     qcow2_cache_destroy(s->refcount_block_cache);
 
@@ -3956,6 +4010,11 @@ static coroutine_fn int qcow2_co_pwrite_zeroes(BlockDriverState *bs,
         tail = 0;
     }
 
+    ret = qcow2_co_bitmap_journal_write_intent(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
     if (head || tail) {
         uint64_t off;
         unsigned int nr;
@@ -4018,6 +4077,11 @@ static coroutine_fn int qcow2_co_pdiscard(BlockDriverState *bs,
         }
     }
 
+    ret = qcow2_co_bitmap_journal_write_intent(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
     qemu_co_mutex_lock(&s->lock);
     ret = qcow2_cluster_discard(bs, offset, bytes, QCOW2_DISCARD_REQUEST,
                                 false);
@@ -4123,6 +4187,11 @@ qcow2_co_copy_range_to(BlockDriverState *bs,
 
     assert(!bs->encrypted);
 
+    ret = qcow2_co_bitmap_journal_write_intent(bs, dst_offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
     qemu_co_mutex_lock(&s->lock);
 
     while (bytes != 0) {
@@ -4665,6 +4734,11 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
         return -EINVAL;
     }
 
+    ret = qcow2_co_bitmap_journal_write_intent(bs, offset, bytes);
+    if (ret < 0) {
+        return ret;
+    }
+
     while (bytes && aio_task_pool_status(aio) == 0) {
         uint64_t chunk_size = MIN(bytes, s->cluster_size);
 
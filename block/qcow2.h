@@ -128,6 +128,8 @@
 
 #define DEFAULT_CLUSTER_SIZE 65536
 
+#define DEFAULT_BITMAP_JOURNAL_INTERVAL 5 /* seconds */
+
 #define QCOW2_OPT_DATA_FILE "data-file"
 #define QCOW2_OPT_LAZY_REFCOUNTS "lazy-refcounts"
 #define QCOW2_OPT_DISCARD_REQUEST "pass-discard-request"
@@ -149,6 +151,8 @@
 #define QCOW2_OPT_L2_CACHE_ENTRY_SIZE "l2-cache-entry-size"
 #define QCOW2_OPT_REFCOUNT_CACHE_SIZE "refcount-cache-size"
 #define QCOW2_OPT_CACHE_CLEAN_INTERVAL "cache-clean-interval"
+#define QCOW2_OPT_BITMAP_JOURNAL "bitmap-journal"
+#define QCOW2_OPT_BITMAP_JOURNAL_INTERVAL "bitmap-journal-interval"
 
 typedef struct QCowHeader {
     uint32_t magic;
@@ -323,6 +327,8 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+typedef struct Qcow2BitmapJournal Qcow2BitmapJournal;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -373,6 +379,20 @@ typedef struct BDRVQcow2State {
     uint64_t bitmap_directory_size;
     uint64_t bitmap_directory_offset;
 
+    /*
+     * Persistent bitmaps that are kept consistent in the image while it is
+     * in use (see qcow2-bitmap.c).  bitmap_journal_seq counts changes to
+     * the on-disk copies, bitmap_journal_synced_seq is the last one that
+     * is known to be stable.
+     */
+    bool bitmap_journal;
+    unsigned bitmap_journal_interval;
+    QSIMPLEQ_HEAD(Qcow2BitmapJournalList, Qcow2BitmapJournal) bitmap_journals;
+    QEMUTimer *bitmap_journal_timer;
+    CoMutex bitmap_journal_lock;
+    uint64_t bitmap_journal_seq;
+    uint64_t bitmap_journal_synced_seq;
+
     int flags;
     int qcow_version;
     bool use_lazy_refcounts;
@@ -986,7 +1006,8 @@ bool qcow2_load_dirty_bitmaps(BlockDriverState *bs, bool *header_updated,
 bool qcow2_get_bitmap_info_list(BlockDriverState *bs,
                                 Qcow2BitmapInfoList **info_list, Error **errp);
 int qcow2_reopen_bitmaps_rw(BlockDriverState *bs, Error **errp);
-int qcow2_truncate_bitmaps_check(BlockDriverState *bs, Error **errp);
+int coroutine_fn qcow2_truncate_bitmaps_check(BlockDriverState *bs,
+                                              Error **errp);
 bool qcow2_store_persistent_dirty_bitmaps(BlockDriverState *bs,
                                           bool release_stored, Error **errp);
 int qcow2_reopen_bitmaps_ro(BlockDriverState *bs, Error **errp);
@@ -998,6 +1019,13 @@ int qcow2_co_remove_persistent_dirty_bitmap(BlockDriverState *bs,
                                             const char *name,
                                             Error **errp);
 bool qcow2_supports_persistent_dirty_bitmap(BlockDriverState *bs);
+int coroutine_fn qcow2_co_bitmap_journal_write_intent(BlockDriverState *bs,
+                                                     int64_t offset,
+                                                     int64_t bytes);
+void qcow2_bitmap_journal_attach_aio_context(BlockDriverState *bs,
+                                             AioContext *new_context);
+void qcow2_bitmap_journal_detach_aio_context(BlockDriverState *bs);
+void qcow2_bitmap_journal_close(BlockDriverState *bs);
 uint64_t qcow2_get_persistent_dirty_bitmap_size(BlockDriverState *bs,
                                                 uint32_t cluster_size);
 
@@ -569,6 +569,17 @@ static int coroutine_fn raw_co_copy_range_to(BlockDriverState *bs,
                                  read_flags, write_flags);
 }
 
+static int raw_get_host_fd(BlockDriverState *bs)
+{
+    BDRVRawState *s = bs->opaque;
+
+    if (s->offset || s->has_size) {
+        return -ENOTSUP;
+    }
+    /* bdrv_get_host_fd() has already checked the rest of the chain */
+    return bs->file->bs->drv->bdrv_get_host_fd(bs->file->bs);
+}
+
 static const char *const raw_strong_runtime_opts[] = {
     "offset",
     "size",
@@ -617,6 +628,7 @@ BlockDriver bdrv_raw = {
     .bdrv_co_block_status = &raw_co_block_status,
     .bdrv_co_copy_range_from = &raw_co_copy_range_from,
     .bdrv_co_copy_range_to  = &raw_co_copy_range_to,
+    .bdrv_get_host_fd     = &raw_get_host_fd,
     .bdrv_co_truncate     = &raw_co_truncate,
     .bdrv_getlength       = &raw_getlength,
     .is_format            = true,
@@ -0,0 +1,711 @@
+/*
+ * Read cache filter driver
+ *
+ * The driver keeps a bounded cache of recently read clusters of its child in
+ * host memory (or in a local file), so that repeated reads of slow or remote
+ * images (NBD, NFS, HTTP, ...) are served without going to the child again.
+ *
+ * The cache is split into shards, each with its own lock, LRU list and share
+ * of the cache slots, so that requests from several iothreads rarely contend.
+ * Writes, write-zeroes, discards and truncates are passed through to the
+ * child and invalidate the clusters they touch.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qemu/memalign.h"
+#include "qemu/module.h"
+#include "qemu/option.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
+#include "qemu/units.h"
+#include "block/block_int.h"
+
+#define READ_CACHE_OPT_SIZE         "size"
+#define READ_CACHE_OPT_CLUSTER_SIZE "cluster-size"
+#define READ_CACHE_OPT_SHARDS       "shards"
+#define READ_CACHE_OPT_CACHE_FILE   "cache-file"
+
+#define READ_CACHE_DEFAULT_SIZE         (64 * MiB)
+#define READ_CACHE_DEFAULT_CLUSTER_SIZE (64 * KiB)
+#define READ_CACHE_DEFAULT_SHARDS       16
+
+/* Upper bound for a single read of consecutive missing clusters */
+#define READ_CACHE_MAX_MISS_RUN         (1 * MiB)
+
+typedef struct ReadCacheEntry {
+    int64_t cluster;                /* hash table key */
+    uint8_t *data;                  /* cluster_size bytes in the cache area */
+    QTAILQ_ENTRY(ReadCacheEntry) next; /* in the LRU list or the free list */
+} ReadCacheEntry;
+
+typedef struct ReadCacheShard {
+    QemuMutex lock;
+
+    /* Protected by @lock */
+    GHashTable *entries;            /* cluster index -> ReadCacheEntry */
+    QTAILQ_HEAD(, ReadCacheEntry) lru;  /* most recently used first */
+    QTAILQ_HEAD(, ReadCacheEntry) free;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+
+    ReadCacheEntry *slots;
+    unsigned nr_slots;
+} ReadCacheShard;
+
+typedef struct ReadCacheOpts {
+    uint64_t size;
+    uint64_t cluster_size;
+    uint64_t nr_shards;
+    char *cache_file;
+} ReadCacheOpts;
+
+typedef struct BDRVReadCacheState {
+    ReadCacheOpts opts;
+
+    uint8_t *area;                  /* backing memory of all cache slots */
+    size_t area_size;
+    int cache_fd;                   /* -1 unless the area is a mapped file */
+
+    ReadCacheShard *shards;
+
+    /*
+     * A cluster that was read from the child may only be inserted if no
+     * write to the child overlapped the read, otherwise it may hold stale
+     * data. Writers bump @write_gen before and after their request and keep
+     * @writes_in_flight elevated; readers compare both against the values
+     * they sampled before reading.
+     */
+    unsigned write_gen;             /* atomic */
+    unsigned writes_in_flight;      /* atomic */
+} BDRVReadCacheState;
+
+static QemuOptsList runtime_opts = {
+    .name = "read-cache",
+    .head = QTAILQ_HEAD_INITIALIZER(runtime_opts.head),
+    .desc = {
+        {
+            .name = READ_CACHE_OPT_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "maximum amount of cached data, default 64M",
+        },
+        {
+            .name = READ_CACHE_OPT_CLUSTER_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "caching granularity, default 64k",
+        },
+        {
+            .name = READ_CACHE_OPT_SHARDS,
+            .type = QEMU_OPT_NUMBER,
+            .help = "number of independently locked parts, default 16",
+        },
+        {
+            .name = READ_CACHE_OPT_CACHE_FILE,
+            .type = QEMU_OPT_STRING,
+            .help = "keep cached data in this local file instead of RAM",
+        },
+        { /* end of list */ }
+    },
+};
+
+static bool read_cache_absorb_opts(ReadCacheOpts *dest, QDict *options,
+                                   BlockDriverState *child_bs, Error **errp)
+{
+    QemuOpts *opts = qemu_opts_create(&runtime_opts, NULL, 0, &error_abort);
+
+    if (!qemu_opts_absorb_qdict(opts, options, errp)) {
+        qemu_opts_del(opts);
+        return false;
+    }
+
+    dest->size = qemu_opt_get_size(opts, READ_CACHE_OPT_SIZE,
+                                   READ_CACHE_DEFAULT_SIZE);
+    dest->cluster_size = qemu_opt_get_size(opts, READ_CACHE_OPT_CLUSTER_SIZE,
+                                           READ_CACHE_DEFAULT_CLUSTER_SIZE);
+    dest->nr_shards = qemu_opt_get_number(opts, READ_CACHE_OPT_SHARDS,
+                                          READ_CACHE_DEFAULT_SHARDS);
+    dest->cache_file = g_strdup(qemu_opt_get(opts, READ_CACHE_OPT_CACHE_FILE));
+
+    qemu_opts_del(opts);
+
+    if (!is_power_of_2(dest->cluster_size) ||
+        dest->cluster_size < BDRV_SECTOR_SIZE ||
+        dest->cluster_size > BDRV_MAX_ALIGNMENT) {
+        error_setg(errp, "cluster-size of read-cache filter must be a power "
+                   "of two between %llu and %ld", BDRV_SECTOR_SIZE,
+                   BDRV_MAX_ALIGNMENT);
+        goto fail;
+    }
+
+    if (!QEMU_IS_ALIGNED(dest->cluster_size,
+                         child_bs->bl.request_alignment)) {
+        error_setg(errp, "cluster-size of read-cache filter is not aligned "
+                   "to underlying node request alignment (%" PRIu32 ")",
+                   child_bs->bl.request_alignment);
+        goto fail;
+    }
+
+    if (dest->nr_shards < 1 || dest->nr_shards > 1024) {
+        error_setg(errp, "shards of read-cache filter must be between 1 "
+                   "and 1024");
+        goto fail;
+    }
+
+    if (dest->size < dest->cluster_size * dest->nr_shards) {
+        error_setg(errp, "size of read-cache filter must hold at least one "
+                   "cluster per shard (%" PRIu64 " bytes)",
+                   dest->cluster_size * dest->nr_shards);
+        goto fail;
+    }
+
+    if (dest->size > SIZE_MAX) {
+        error_setg(errp, "size of read-cache filter is too large");
+        goto fail;
+    }
+
+    return true;
+
+fail:
+    g_free(dest->cache_file);
+    dest->cache_file = NULL;
+    return false;
+}
+
+static bool read_cache_alloc_area(BDRVReadCacheState *s, Error **errp)
+{
+    s->cache_fd = -1;
+    s->area_size = s->opts.size;
+
+    if (!s->opts.cache_file) {
+        s->area = qemu_try_memalign(qemu_real_host_page_size(), s->area_size);
+        if (!s->area) {
+            error_setg(errp, "Could not allocate %zu bytes for read-cache",
+                       s->area_size);
+            return false;
+        }
+        return true;
+    }
+
+    s->cache_fd = qemu_create(s->opts.cache_file, O_RDWR, 0600, errp);
+    if (s->cache_fd < 0) {
+        return false;
+    }
+    if (ftruncate(s->cache_fd, s->area_size) < 0) {
+        error_setg_errno(errp, errno, "Could not resize read-cache file '%s'",
+                         s->opts.cache_file);
+        goto fail;
+    }
+    s->area = mmap(NULL, s->area_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+                   s->cache_fd, 0);
+    if (s->area == MAP_FAILED) {
+        s->area = NULL;
+        error_setg_errno(errp, errno, "Could not map read-cache file '%s'",
+                         s->opts.cache_file);
+        goto fail;
+    }
+    return true;
+
+fail:
+    qemu_close(s->cache_fd);
+    s->cache_fd = -1;
+    return false;
+}
+
+static void read_cache_free_area(BDRVReadCacheState *s)
+{
+    if (!s->area) {
+        return;
+    }
+    if (s->cache_fd >= 0) {
+        munmap(s->area, s->area_size);
+        qemu_close(s->cache_fd);
+        s->cache_fd = -1;
+    } else {
+        qemu_vfree(s->area);
+    }
+    s->area = NULL;
+}
+
+static void read_cache_init_shards(BDRVReadCacheState *s)
+{
+    uint64_t nr_slots = s->area_size / s->opts.cluster_size;
+    uint64_t first = 0;
+    unsigned i, j;
+
+    s->shards = g_new0(ReadCacheShard, s->opts.nr_shards);
+    for (i = 0; i < s->opts.nr_shards; i++) {
+        ReadCacheShard *shard = &s->shards[i];
+
+        qemu_mutex_init(&shard->lock);
+        shard->entries = g_hash_table_new(g_int64_hash, g_int64_equal);
+        QTAILQ_INIT(&shard->lru);
+        QTAILQ_INIT(&shard->free);
+
+        /* Spread the remainder over the first shards */
+        shard->nr_slots = nr_slots / s->opts.nr_shards +
+                          (i < nr_slots % s->opts.nr_shards);
+        shard->slots = g_new0(ReadCacheEntry, shard->nr_slots);
+        for (j = 0; j < shard->nr_slots; j++) {
+            ReadCacheEntry *entry = &shard->slots[j];
+
+            entry->data = s->area + (first + j) * s->opts.cluster_size;
+            QTAILQ_INSERT_TAIL(&shard->free, entry, next);
+        }
+        first += shard->nr_slots;
+    }
+}
+
+static void read_cache_free_shards(BDRVReadCacheState *s)
+{
+    unsigned i;
+
+    if (!s->shards) {
+        return;
+    }
+    for (i = 0; i < s->opts.nr_shards; i++) {
+        ReadCacheShard *shard = &s->shards[i];
+
+        g_hash_table_destroy(shard->entries);
+        g_free(shard->slots);
+        qemu_mutex_destroy(&shard->lock);
+    }
+    g_free(s->shards);
+    s->shards = NULL;
+}
+
+static ReadCacheShard *read_cache_shard(BDRVReadCacheState *s,
+                                        int64_t cluster)
+{
+    return &s->shards[cluster % s->opts.nr_shards];
+}
+
+/* With shard->lock */
+static void read_cache_drop_entry(ReadCacheShard *shard,
+                                  ReadCacheEntry *entry)
+{
+    g_hash_table_remove(shard->entries, &entry->cluster);
+    QTAILQ_REMOVE(&shard->lru, entry, next);
+    QTAILQ_INSERT_HEAD(&shard->free, entry, next);
+}
+
+/*
+ * Copy @bytes at @offset_in_cluster of @cluster into @qiov if the cluster is
+ * cached. Returns true on a hit.
+ */
+static bool read_cache_lookup(BDRVReadCacheState *s, int64_t cluster,
+                              int64_t offset_in_cluster, int64_t bytes,
+                              QEMUIOVector *qiov, size_t qiov_offset)
+{
+    ReadCacheShard *shard = read_cache_shard(s, cluster);
+    ReadCacheEntry *entry;
+
+    QEMU_LOCK_GUARD(&shard->lock);
+
+    entry = g_hash_table_lookup(shard->entries, &cluster);
+    if (!entry) {
+        return false;
+    }
+
+    qemu_iovec_from_buf(qiov, qiov_offset, entry->data + offset_in_cluster,
+                        bytes);
+    if (entry != QTAILQ_FIRST(&shard->lru)) {
+        QTAILQ_REMOVE(&shard->lru, entry, next);
+        QTAILQ_INSERT_HEAD(&shard->lru, entry, next);
+    }
+    shard->hits++;
+    return true;
+}
+
+static bool read_cache_contains(BDRVReadCacheState *s, int64_t cluster)
+{
+    ReadCacheShard *shard = read_cache_shard(s, cluster);
+
+    QEMU_LOCK_GUARD(&shard->lock);
+    return g_hash_table_contains(shard->entries, &cluster);
+}
+
+/*
+ * Insert a full cluster that was read from the child, unless a write raced
+ * with the read (see BDRVReadCacheState.write_gen).
+ */
+static void read_cache_insert(BDRVReadCacheState *s, int64_t cluster,
+                              const uint8_t *buf, unsigned write_gen)
+{
+    ReadCacheShard *shard = read_cache_shard(s, cluster);
+    ReadCacheEntry *entry;
+
+    QEMU_LOCK_GUARD(&shard->lock);
+
+    shard->misses++;
+
+    if (qatomic_read(&s->writes_in_flight) ||
+        qatomic_read(&s->write_gen) != write_gen) {
+        return;
+    }
+    if (g_hash_table_contains(shard->entries, &cluster)) {
+        return;
+    }
+
+    entry = QTAILQ_FIRST(&shard->free);
+    if (entry) {
+        QTAILQ_REMOVE(&shard->free, entry, next);
+    } else {
+        entry = QTAILQ_LAST(&shard->lru);
+        QTAILQ_REMOVE(&shard->lru, entry, next);
+        g_hash_table_remove(shard->entries, &entry->cluster);
+        shard->evictions++;
+    }
+
+    entry->cluster = cluster;
+    memcpy(entry->data, buf, s->opts.cluster_size);
+    g_hash_table_insert(shard->entries, &entry->cluster, entry);
+    QTAILQ_INSERT_HEAD(&shard->lru, entry, next);
+}
+
+/* Drop all cached clusters that overlap [@offset, @offset + @bytes) */
+static void read_cache_invalidate(BDRVReadCacheState *s, int64_t offset,
+                                  int64_t bytes)
+{
+    int64_t first = offset / s->opts.cluster_size;
+    int64_t last = (offset + bytes - 1) / s->opts.cluster_size;
+    int64_t nr_slots = s->area_size / s->opts.cluster_size;
+    int64_t cluster;
+    unsigned i;
+
+    if (bytes <= 0) {
+        return;
+    }
+
+    if (last - first < nr_slots) {
+        for (cluster = first; cluster <= last; cluster++) {
+            ReadCacheShard *shard = read_cache_shard(s, cluster);
+            ReadCacheEntry *entry;
+
+            QEMU_LOCK_GUARD(&shard->lock);
+            entry = g_hash_table_lookup(shard->entries, &cluster);
+            if (entry) {
+                read_cache_drop_entry(shard, entry);
+            }
+        }
+        return;
+    }
+
+    /* Large range, walking the cached entries is cheaper */
+    for (i = 0; i < s->opts.nr_shards; i++) {
+        ReadCacheShard *shard = &s->shards[i];
+        ReadCacheEntry *entry, *next_entry;
+
+        QEMU_LOCK_GUARD(&shard->lock);
+        QTAILQ_FOREACH_SAFE(entry, &shard->lru, next, next_entry) {
+            if (entry->cluster >= first && entry->cluster <= last) {
+                read_cache_drop_entry(shard, entry);
+            }
+        }
+    }
+}
+
+static void read_cache_invalidate_all(BDRVReadCacheState *s)
+{
+    read_cache_invalidate(s, 0, INT64_MAX);
+}
+
+static void read_cache_write_begin(BDRVReadCacheState *s)
+{
+    qatomic_inc(&s->writes_in_flight);
+    qatomic_inc(&s->write_gen);
+}
+
+static void read_cache_write_end(BDRVReadCacheState *s, int64_t offset,
+                                 int64_t bytes)
+{
+    read_cache_invalidate(s, offset, bytes);
+    qatomic_inc(&s->write_gen);
+    qatomic_dec(&s->writes_in_flight);
+}
+
+static int read_cache_open(BlockDriverState *bs, QDict *options, int flags,
+                           Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    s->cache_fd = -1;
+
+    bs->file = bdrv_open_child(NULL, options, "file", bs, &child_of_bds,
+                               BDRV_CHILD_FILTERED | BDRV_CHILD_PRIMARY,
+                               false, errp);
+    if (!bs->file) {
+        return -EINVAL;
+    }
+
+    if (!read_cache_absorb_opts(&s->opts, options, bs->file->bs, errp)) {
+        return -EINVAL;
+    }
+
+    if (!read_cache_alloc_area(s, errp)) {
+        g_free(s->opts.cache_file);
+        s->opts.cache_file = NULL;
+        return -ENOMEM;
+    }
+    read_cache_init_shards(s);
+
+    bs->supported_write_flags = BDRV_REQ_WRITE_UNCHANGED |
+        (BDRV_REQ_FUA & bs->file->bs->supported_write_flags);
+
+    bs->supported_zero_flags = BDRV_REQ_WRITE_UNCHANGED |
+        ((BDRV_REQ_FUA | BDRV_REQ_MAY_UNMAP | BDRV_REQ_NO_FALLBACK) &
+            bs->file->bs->supported_zero_flags);
+
+    return 0;
+}
+
+static void read_cache_close(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+
+    read_cache_free_shards(s);
+    read_cache_free_area(s);
+    g_free(s->opts.cache_file);
+    s->opts.cache_file = NULL;
+}
+
+static int read_cache_reopen_prepare(BDRVReopenState *reopen_state,
+                                     BlockReopenQueue *queue, Error **errp)
+{
+    BDRVReadCacheState *s = reopen_state->bs->opaque;
+    ReadCacheOpts opts = {};
+    bool changed;
+
+    if (!read_cache_absorb_opts(&opts, reopen_state->options,
+                                reopen_state->bs->file->bs, errp)) {
+        return -EINVAL;
+    }
+
+    changed = opts.size != s->opts.size ||
+              opts.cluster_size != s->opts.cluster_size ||
+              opts.nr_shards != s->opts.nr_shards ||
+              g_strcmp0(opts.cache_file, s->opts.cache_file);
+    g_free(opts.cache_file);
+
+    if (changed) {
+        error_setg(errp, "Cannot change read-cache options");
+        return -EINVAL;
+    }
+    return 0;
+}
+
+static void read_cache_child_perm(BlockDriverState *bs, BdrvChild *c,
+                                  BdrvChildRole role,
+                                  BlockReopenQueue *reopen_queue,
+                                  uint64_t perm, uint64_t shared,
+                                  uint64_t *nperm, uint64_t *nshared)
+{
+    bdrv_default_perms(bs, c, role, reopen_queue, perm, shared, nperm, nshared);
+
+    /* Writes that bypass us would leave stale data in the cache */
+    *nshared &= ~BLK_PERM_WRITE;
+}
+
+static int64_t read_cache_getlength(BlockDriverState *bs)
+{
+    return bdrv_getlength(bs->file->bs);
+}
+
+static int coroutine_fn read_cache_co_preadv_part(BlockDriverState *bs,
+                                                  int64_t offset,
+                                                  int64_t bytes,
+                                                  QEMUIOVector *qiov,
+                                                  size_t qiov_offset,
+                                                  BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    const int64_t cluster_size = s->opts.cluster_size;
+    const int64_t max_run = MAX(READ_CACHE_MAX_MISS_RUN / cluster_size, 1);
+    const int64_t end = offset + bytes;
+    QEMU_AUTO_VFREE uint8_t *buf = NULL;
+    int64_t pos = offset;
+
+    while (pos < end) {
+        int64_t cluster = pos / cluster_size;
+        int64_t in_cluster = pos - cluster * cluster_size;
+        int64_t n = MIN(end - pos, cluster_size - in_cluster);
+        int64_t run_start, run_end, run_bytes, copy_bytes;
+        unsigned write_gen;
+        int64_t i;
+        int ret;
+
+        if (read_cache_lookup(s, cluster, in_cluster, n, qiov,
+                              qiov_offset + (pos - offset))) {
+            pos += n;
+            continue;
+        }
+
+        /* Read a run of consecutive missing clusters in one request */
+        run_start = cluster;
+        run_end = cluster + 1;
+        while (run_end * cluster_size < end && run_end - run_start < max_run &&
+               !read_cache_contains(s, run_end)) {
+            run_end++;
+        }
+        run_bytes = (run_end - run_start) * cluster_size;
+
+        if (!buf) {
+            buf = qemu_try_blockalign(bs->file->bs, max_run * cluster_size);
+            if (!buf) {
+                return -ENOMEM;
+            }
+        }
+
+        write_gen = qatomic_read(&s->write_gen);
+        ret = bdrv_co_pread(bs->file, run_start * cluster_size, run_bytes,
+                            buf, 0);
+        if (ret < 0) {
+            return ret;
+        }
+
+        for (i = run_start; i < run_end; i++) {
+            read_cache_insert(s, i, buf + (i - run_start) * cluster_size,
+                              write_gen);
+        }
+
+        copy_bytes = MIN(end, run_end * cluster_size) - pos;
+        qemu_iovec_from_buf(qiov, qiov_offset + (pos - offset),
+                            buf + in_cluster, copy_bytes);
+        pos += copy_bytes;
+    }
+
+    return 0;
+}
+
+static int coroutine_fn read_cache_co_pwritev_part(BlockDriverState *bs,
+                                                   int64_t offset,
+                                                   int64_t bytes,
+                                                   QEMUIOVector *qiov,
+                                                   size_t qiov_offset,
+                                                   BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s);
+    ret = bdrv_co_pwritev_part(bs->file, offset, bytes, qiov, qiov_offset,
+                               flags);
+    read_cache_write_end(s, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_pwrite_zeroes(BlockDriverState *bs,
+                                                    int64_t offset,
+                                                    int64_t bytes,
+                                                    BdrvRequestFlags flags)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s);
+    ret = bdrv_co_pwrite_zeroes(bs->file, offset, bytes, flags);
+    read_cache_write_end(s, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_pdiscard(BlockDriverState *bs,
+                                               int64_t offset, int64_t bytes)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s);
+    ret = bdrv_co_pdiscard(bs->file, offset, bytes);
+    read_cache_write_end(s, offset, bytes);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_truncate(BlockDriverState *bs,
+                                               int64_t offset, bool exact,
+                                               PreallocMode prealloc,
+                                               BdrvRequestFlags flags,
+                                               Error **errp)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    int ret;
+
+    read_cache_write_begin(s);
+    ret = bdrv_co_truncate(bs->file, offset, exact, prealloc, flags, errp);
+    read_cache_write_end(s, 0, INT64_MAX);
+    return ret;
+}
+
+static int coroutine_fn read_cache_co_flush(BlockDriverState *bs)
+{
+    return bdrv_co_flush(bs->file->bs);
+}
+
+static void coroutine_fn read_cache_co_invalidate_cache(BlockDriverState *bs,
+                                                        Error **errp)
+{
+    read_cache_invalidate_all(bs->opaque);
+}
+
+static BlockStatsSpecific *read_cache_get_specific_stats(BlockDriverState *bs)
+{
+    BDRVReadCacheState *s = bs->opaque;
+    BlockStatsSpecific *stats = g_new0(BlockStatsSpecific, 1);
+    BlockStatsSpecificReadCache *rc = &stats->u.read_cache;
+    unsigned i;
+
+    stats->driver = BLOCKDEV_DRIVER_READ_CACHE;
+    for (i = 0; i < s->opts.nr_shards; i++) {
+        ReadCacheShard *shard = &s->shards[i];
+
+        QEMU_LOCK_GUARD(&shard->lock);
+        rc->hits += shard->hits;
+        rc->misses += shard->misses;
+        rc->evictions += shard->evictions;
+        rc->cached_bytes += g_hash_table_size(shard->entries) *
+                            s->opts.cluster_size;
+    }
+    rc->size = s->area_size;
+
+    return stats;
+}
+
+static const char *const read_cache_strong_runtime_opts[] = {
+    NULL
+};
+
+static BlockDriver bdrv_read_cache = {
+    .format_name                    = "read-cache",
+    .instance_size                  = sizeof(BDRVReadCacheState),
+
+    .bdrv_open                      = read_cache_open,
+    .bdrv_close                     = read_cache_close,
+    .bdrv_reopen_prepare            = read_cache_reopen_prepare,
+    .bdrv_child_perm                = read_cache_child_perm,
+
+    .bdrv_getlength                 = read_cache_getlength,
+
+    .bdrv_co_preadv_part            = read_cache_co_preadv_part,
+    .bdrv_co_pwritev_part           = read_cache_co_pwritev_part,
+    .bdrv_co_pwrite_zeroes          = read_cache_co_pwrite_zeroes,
+    .bdrv_co_pdiscard               = read_cache_co_pdiscard,
+    .bdrv_co_truncate               = read_cache_co_truncate,
+    .bdrv_co_flush                  = read_cache_co_flush,
+    .bdrv_co_invalidate_cache       = read_cache_co_invalidate_cache,
+
+    .bdrv_get_specific_stats        = read_cache_get_specific_stats,
+    .strong_runtime_opts            = read_cache_strong_runtime_opts,
+
+    .has_variable_length            = true,
+    .is_filter                      = true,
+};
+
+static void bdrv_read_cache_init(void)
+{
+    bdrv_register(&bdrv_read_cache);
+}
+
+block_init(bdrv_read_cache_init);
@@ -70,12 +70,20 @@ struct ThrottleGroup {
     bool is_initialized;
     char *name; /* This is constant during the lifetime of the group */
 
-    QemuMutex lock; /* This lock protects the following four fields */
+    /* Members may do I/O without taking the lock for this long at a time,
+     * see throttle_group_refill_credit().  0 if credits are disabled.
+     * This is constant once the group is initialized. */
+    int64_t credit_period_ns;
+
+    QemuMutex lock; /* This lock protects the following fields */
     ThrottleState ts;
     QLIST_HEAD(, ThrottleGroupMember) head;
+    unsigned nb_members;
     ThrottleGroupMember *tokens[2];
     bool any_timer_armed[2];
     QEMUClockType clock_type;
+    /* Bumped when the limits change, which invalidates all credits */
+    unsigned credit_generation;
 
     /* This field is protected by the global QEMU mutex */
     QTAILQ_ENTRY(ThrottleGroup) list;
@@ -349,6 +357,103 @@ static void schedule_next_request(ThrottleGroupMember *tgm, bool is_write)
     }
 }
 
+/* Spend the local credit of a ThrottleGroupMember on an I/O request, which
+ * does not need to take the group lock then.  Return whether there was
+ * enough credit left.
+ *
+ * This is called in the ThrottleGroupMember's AioContext, without tg->lock.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @is_write:  the type of operation (read/write)
+ */
+static bool throttle_group_spend_credit(ThrottleGroupMember *tgm,
+                                        int64_t bytes, bool is_write)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    ThrottleGroupCredit *credit = &tgm->credit[is_write];
+    double units = 1.0;
+
+    /* Queued requests go first */
+    if (!tg->credit_period_ns ||
+        qatomic_read(&tgm->pending_reqs[is_write]) ||
+        credit->generation != qatomic_read(&tg->credit_generation) ||
+        qemu_clock_get_ns(tg->clock_type) >= credit->expiry) {
+        return false;
+    }
+
+    /* Same as throttle_account() */
+    if (credit->op_size && bytes > credit->op_size) {
+        units = (double) bytes / credit->op_size;
+    }
+    if (credit->bytes < bytes || credit->units < units) {
+        return false;
+    }
+
+    if (credit->bytes != UINT64_MAX) {
+        credit->bytes -= bytes;
+    }
+    credit->units -= units;
+    return true;
+}
+
+/* Give the unused part of a ThrottleGroupMember's credit back to the group.
+ *
+ * This assumes that tg->lock is held.
+ */
+static void throttle_group_return_credit(ThrottleGroupMember *tgm,
+                                         bool is_write)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupCredit *credit = &tgm->credit[is_write];
+
+    /* Credits from before a configuration change were not accounted */
+    if (credit->expiry && credit->generation == tg->credit_generation) {
+        throttle_refund_credit(ts, is_write, credit->bytes, credit->units);
+    }
+    *credit = (ThrottleGroupCredit) { 0 };
+}
+
+/* Hand a ThrottleGroupMember its share of the group's limits for the next
+ * credit period.  The credit is accounted in the group's buckets up front,
+ * so the member can spend it without the lock; whatever it has not spent
+ * when it next comes back to the group is returned.  Credits are only
+ * handed out while no member is throttled, so under contention all requests
+ * go through the round-robin scheduling.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @is_write:  the type of operation (read/write)
+ */
+static void throttle_group_refill_credit(ThrottleGroupMember *tgm,
+                                         bool is_write)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupCredit *credit = &tgm->credit[is_write];
+
+    if (!tg->credit_period_ns) {
+        return;
+    }
+
+    throttle_group_return_credit(tgm, is_write);
+
+    if (qatomic_read(&tgm->io_limits_disabled) ||
+        tg->any_timer_armed[is_write] ||
+        next_throttle_token(tgm, is_write) != tgm) {
+        return;
+    }
+
+    throttle_compute_credit(ts, is_write, tg->credit_period_ns,
+                            tg->nb_members, &credit->bytes, &credit->units);
+    throttle_account_credit(ts, is_write, credit->bytes, credit->units);
+    credit->op_size = ts->cfg.op_size;
+    credit->generation = tg->credit_generation;
+    credit->expiry = qemu_clock_get_ns(tg->clock_type) + tg->credit_period_ns;
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
@@ -367,6 +472,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     assert(bytes >= 0);
 
+    if (throttle_group_spend_credit(tgm, bytes, is_write)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -388,6 +497,9 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* The I/O will be executed, so do the accounting */
     throttle_account(tgm->throttle_state, is_write, bytes);
 
+    /* Let the following requests skip the lock if possible */
+    throttle_group_refill_credit(tgm, is_write);
+
     /* Schedule the next request */
     schedule_next_request(tgm, is_write);
 
@@ -475,6 +587,7 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
     qemu_mutex_lock(&tg->lock);
     throttle_config(ts, tg->clock_type, cfg);
+    qatomic_set(&tg->credit_generation, tg->credit_generation + 1);
     qemu_mutex_unlock(&tg->lock);
 
     throttle_group_restart_tgm(tgm);
@@ -558,6 +671,8 @@ void throttle_group_register_tgm(ThrottleGroupMember *tgm,
     }
 
     QLIST_INSERT_HEAD(&tg->head, tgm, round_robin);
+    tg->nb_members++;
+    memset(tgm->credit, 0, sizeof(tgm->credit));
 
     throttle_timers_init(&tgm->throttle_timers,
                          tgm->aio_context,
@@ -600,6 +715,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
             assert(tgm->pending_reqs[i] == 0);
             assert(qemu_co_queue_empty(&tgm->throttled_reqs[i]));
             assert(!timer_pending(tgm->throttle_timers.timers[i]));
+            throttle_group_return_credit(tgm, i);
             if (tg->tokens[i] == tgm) {
                 token = throttle_group_next_tgm(tgm);
                 /* Take care of the case where this is the last tgm in the group */
@@ -612,6 +728,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
 
         /* remove the current tgm from the list */
         QLIST_REMOVE(tgm, round_robin);
+        tg->nb_members--;
         throttle_timers_destroy(&tgm->throttle_timers);
     }
 
@@ -900,6 +1017,7 @@ static void throttle_group_set_limits(Object *obj, Visitor *v,
         goto unlock;
     }
     throttle_config(&tg->ts, tg->clock_type, &cfg);
+    qatomic_set(&tg->credit_generation, tg->credit_generation + 1);
 
 unlock:
     qemu_mutex_unlock(&tg->lock);
@@ -926,6 +1044,35 @@ static void throttle_group_get_limits(Object *obj, Visitor *v,
     visit_type_ThrottleLimits(v, name, &argp, errp);
 }
 
+static void throttle_group_set_credit_period(Object *obj, Visitor *v,
+                                             const char *name, void *opaque,
+                                             Error **errp)
+{
+    ThrottleGroup *tg = THROTTLE_GROUP(obj);
+    uint32_t value;
+
+    /* Members spend credits without the lock, so this cannot change */
+    if (tg->is_initialized) {
+        error_setg(errp, "Property cannot be set after initialization");
+        return;
+    }
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    tg->credit_period_ns = (int64_t) value * SCALE_MS;
+}
+
+static void throttle_group_get_credit_period(Object *obj, Visitor *v,
+                                             const char *name, void *opaque,
+                                             Error **errp)
+{
+    ThrottleGroup *tg = THROTTLE_GROUP(obj);
+    uint32_t value = tg->credit_period_ns / SCALE_MS;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
 static bool throttle_group_can_be_deleted(UserCreatable *uc)
 {
     return OBJECT(uc)->ref == 1;
@@ -955,6 +1102,12 @@ static void throttle_group_obj_class_init(ObjectClass *klass, void *class_data)
                               throttle_group_get_limits,
                               throttle_group_set_limits,
                               NULL, NULL);
+
+    object_class_property_add(klass,
+                              "credit-period", "uint32",
+                              throttle_group_get_credit_period,
+                              throttle_group_set_credit_period,
+                              NULL, NULL);
 }
 
 static const TypeInfo throttle_group_info = {
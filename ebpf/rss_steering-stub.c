@@ -0,0 +1,32 @@
+/*
+ * Built-in RSS steering program stub file
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "ebpf/rss_steering.h"
+
+void rss_steering_init(struct RSSSteeringContext *ctx)
+{
+
+}
+
+bool rss_steering_is_loaded(struct RSSSteeringContext *ctx)
+{
+    return false;
+}
+
+bool rss_steering_set_all(struct RSSSteeringContext *ctx,
+                          struct EBPFRSSConfig *config,
+                          uint16_t *indirections_table,
+                          uint8_t *toeplitz_key)
+{
+    return false;
+}
+
+void rss_steering_unload(struct RSSSteeringContext *ctx)
+{
+
+}
@@ -0,0 +1,396 @@
+/*
+ * Built-in RSS steering program for tap
+ *
+ * The program computes the same Toeplitz hash as the eBPF RSS object and
+ * software RSS, and picks the queue from the guest's indirection table, so
+ * that each frame is read from the tap queue of the virtqueue it belongs
+ * to.  Instead of being compiled from C it is generated for the current
+ * configuration: the hash types, table size and default queue become
+ * immediates, and the key is expanded into one 256-entry lookup table per
+ * input byte, so the hash is a chain of table lookups and XORs.
+ *
+ * IPv6 extension headers are not parsed; such frames are hashed on their
+ * addresses only.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/eth.h"
+
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+
+#include "hw/virtio/virtio-net.h" /* VIRTIO_NET_RSS_MAX_TABLE_LEN */
+
+#include "ebpf/rss_steering.h"
+#include "trace.h"
+
+/* IPv6 source and destination address, source and destination port */
+#define RSS_STEERING_INPUT_LEN      36
+
+/* Map value: the per-byte hash tables followed by the indirection table */
+#define RSS_STEERING_HASH_SIZE      (RSS_STEERING_INPUT_LEN * 256 * 4)
+#define RSS_STEERING_VALUE_SIZE     (RSS_STEERING_HASH_SIZE + \
+                                     VIRTIO_NET_RSS_MAX_TABLE_LEN * 2)
+
+#define RSS_STEERING_MAX_INSNS      1024
+
+/* Registers that survive packet loads and helper calls */
+#define R_CTX   BPF_REG_6
+#define R_HASH  BPF_REG_7
+#define R_MAP   BPF_REG_8
+#define R_L4    BPF_REG_9
+
+enum {
+    L_IPV4,
+    L_IPV4_ADDRS,
+    L_IPV4_PORTS,
+    L_IPV6,
+    L_IPV6_PORTS,
+    L_FINISH,
+    L_DEFAULT,
+    L_MAX
+};
+
+typedef struct RSSSteeringProg {
+    struct bpf_insn insns[RSS_STEERING_MAX_INSNS];
+    int target[RSS_STEERING_MAX_INSNS];
+    int label[L_MAX];
+    int len;
+} RSSSteeringProg;
+
+static void rss_steering_emit(RSSSteeringProg *p, uint8_t code, uint8_t dst,
+                              uint8_t src, int16_t off, int32_t imm)
+{
+    assert(p->len < RSS_STEERING_MAX_INSNS);
+    p->target[p->len] = -1;
+    p->insns[p->len++] = (struct bpf_insn) {
+        .code = code, .dst_reg = dst, .src_reg = src, .off = off, .imm = imm,
+    };
+}
+
+/* Jump to @label if @dst compares true with @imm, or always for BPF_JA */
+static void rss_steering_jump(RSSSteeringProg *p, uint8_t op, uint8_t dst,
+                              int32_t imm, int label)
+{
+    rss_steering_emit(p, BPF_JMP | op | BPF_K, dst, 0, 0, imm);
+    p->target[p->len - 1] = label;
+}
+
+static void rss_steering_label(RSSSteeringProg *p, int label)
+{
+    p->label[label] = p->len;
+}
+
+static void rss_steering_resolve(RSSSteeringProg *p)
+{
+    int i;
+
+    for (i = 0; i < p->len; i++) {
+        if (p->target[i] >= 0) {
+            assert(p->label[p->target[i]] > i);
+            p->insns[i].off = p->label[p->target[i]] - i - 1;
+        }
+    }
+}
+
+/*
+ * hash ^= table[@pos][packet byte at @off], where @off is relative to the
+ * L4 header if @l4 and to the Ethernet header otherwise.
+ */
+static void rss_steering_hash_byte(RSSSteeringProg *p, bool l4, int off,
+                                   int pos)
+{
+    if (l4) {
+        rss_steering_emit(p, BPF_LD | BPF_IND | BPF_B, 0, R_L4, 0, off);
+    } else {
+        rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, off);
+    }
+    rss_steering_emit(p, BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0, 0xff);
+    rss_steering_emit(p, BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_0, 0, 0, 2);
+    rss_steering_emit(p, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_0, 0, 0,
+                      pos * 256 * 4);
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_1, R_MAP, 0, 0);
+    rss_steering_emit(p, BPF_ALU64 | BPF_ADD | BPF_X, BPF_REG_1, BPF_REG_0,
+                      0, 0);
+    rss_steering_emit(p, BPF_LDX | BPF_MEM | BPF_W, BPF_REG_0, BPF_REG_1,
+                      0, 0);
+    rss_steering_emit(p, BPF_ALU64 | BPF_XOR | BPF_X, R_HASH, BPF_REG_0,
+                      0, 0);
+}
+
+static void rss_steering_hash_bytes(RSSSteeringProg *p, bool l4, int off,
+                                    int pos, int len)
+{
+    int i;
+
+    for (i = 0; i < len; i++) {
+        rss_steering_hash_byte(p, l4, off + i, pos + i);
+    }
+}
+
+static void rss_steering_gen(RSSSteeringProg *p, struct EBPFRSSConfig *config,
+                             int map_fd)
+{
+    uint32_t types = config->hash_types;
+    bool ports4 = types & (VIRTIO_NET_RSS_HASH_TYPE_TCPv4 |
+                           VIRTIO_NET_RSS_HASH_TYPE_UDPv4);
+    bool ports6 = types & (VIRTIO_NET_RSS_HASH_TYPE_TCPv6 |
+                           VIRTIO_NET_RSS_HASH_TYPE_UDPv6);
+    bool ip4 = ports4 || (types & VIRTIO_NET_RSS_HASH_TYPE_IPv4);
+    bool ip6 = ports6 || (types & VIRTIO_NET_RSS_HASH_TYPE_IPv6);
+
+    p->len = 0;
+
+    if (!config->redirect || (!ip4 && !ip6)) {
+        rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0,
+                          config->default_queue);
+        rss_steering_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+        return;
+    }
+
+    /* R_MAP = bpf_map_lookup_elem(map, &(u32){0}) */
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, R_CTX, BPF_REG_1, 0, 0);
+    rss_steering_emit(p, BPF_ST | BPF_MEM | BPF_W, BPF_REG_10, 0, -4, 0);
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_2, BPF_REG_10,
+                      0, 0);
+    rss_steering_emit(p, BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_2, 0, 0, -4);
+    rss_steering_emit(p, BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1,
+                      BPF_PSEUDO_MAP_FD, 0, map_fd);
+    rss_steering_emit(p, 0, 0, 0, 0, 0);
+    rss_steering_emit(p, BPF_JMP | BPF_CALL, 0, 0, 0,
+                      BPF_FUNC_map_lookup_elem);
+    rss_steering_jump(p, BPF_JEQ, BPF_REG_0, 0, L_DEFAULT);
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, R_MAP, BPF_REG_0, 0, 0);
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_K, R_HASH, 0, 0, 0);
+
+    rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_H, 0, 0, 0, 12);
+    if (ip4) {
+        rss_steering_jump(p, BPF_JEQ, BPF_REG_0, ETH_P_IP, L_IPV4);
+    }
+    if (ip6) {
+        rss_steering_jump(p, BPF_JEQ, BPF_REG_0, ETH_P_IPV6, L_IPV6);
+    }
+    rss_steering_jump(p, BPF_JA, 0, 0, L_DEFAULT);
+
+    if (ip4) {
+        rss_steering_label(p, L_IPV4);
+        if (ports4) {
+            /* Fragments are hashed on their addresses */
+            rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_H, 0, 0, 0, 20);
+            rss_steering_emit(p, BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0,
+                              0x3fff);
+            rss_steering_jump(p, BPF_JNE, BPF_REG_0, 0, L_IPV4_ADDRS);
+
+            rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, 14);
+            rss_steering_emit(p, BPF_ALU64 | BPF_AND | BPF_K, BPF_REG_0, 0, 0,
+                              0xf);
+            rss_steering_emit(p, BPF_ALU64 | BPF_LSH | BPF_K, BPF_REG_0, 0, 0,
+                              2);
+            rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_X, R_L4, BPF_REG_0,
+                              0, 0);
+
+            rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, 23);
+            if (types & VIRTIO_NET_RSS_HASH_TYPE_TCPv4) {
+                rss_steering_jump(p, BPF_JEQ, BPF_REG_0, IP_PROTO_TCP,
+                                  L_IPV4_PORTS);
+            }
+            if (types & VIRTIO_NET_RSS_HASH_TYPE_UDPv4) {
+                rss_steering_jump(p, BPF_JEQ, BPF_REG_0, IP_PROTO_UDP,
+                                  L_IPV4_PORTS);
+            }
+        }
+        rss_steering_label(p, L_IPV4_ADDRS);
+        if (types & VIRTIO_NET_RSS_HASH_TYPE_IPv4) {
+            rss_steering_hash_bytes(p, false, 26, 0, 8);
+            rss_steering_jump(p, BPF_JA, 0, 0, L_FINISH);
+        } else {
+            rss_steering_jump(p, BPF_JA, 0, 0, L_DEFAULT);
+        }
+        if (ports4) {
+            rss_steering_label(p, L_IPV4_PORTS);
+            rss_steering_hash_bytes(p, false, 26, 0, 8);
+            rss_steering_hash_bytes(p, true, 14, 8, 4);
+            rss_steering_jump(p, BPF_JA, 0, 0, L_FINISH);
+        }
+    }
+
+    if (ip6) {
+        rss_steering_label(p, L_IPV6);
+        if (ports6) {
+            rss_steering_emit(p, BPF_LD | BPF_ABS | BPF_B, 0, 0, 0, 20);
+            if (types & VIRTIO_NET_RSS_HASH_TYPE_TCPv6) {
+                rss_steering_jump(p, BPF_JEQ, BPF_REG_0, IP_PROTO_TCP,
+                                  L_IPV6_PORTS);
+            }
+            if (types & VIRTIO_NET_RSS_HASH_TYPE_UDPv6) {
+                rss_steering_jump(p, BPF_JEQ, BPF_REG_0, IP_PROTO_UDP,
+                                  L_IPV6_PORTS);
+            }
+        }
+        if (types & VIRTIO_NET_RSS_HASH_TYPE_IPv6) {
+            rss_steering_hash_bytes(p, false, 22, 0, 32);
+            rss_steering_jump(p, BPF_JA, 0, 0, L_FINISH);
+        } else {
+            rss_steering_jump(p, BPF_JA, 0, 0, L_DEFAULT);
+        }
+        if (ports6) {
+            rss_steering_label(p, L_IPV6_PORTS);
+            rss_steering_hash_bytes(p, false, 22, 0, 36);
+            rss_steering_jump(p, BPF_JA, 0, 0, L_FINISH);
+        }
+    }
+
+    /* return indirections_table[hash & (len - 1)] */
+    rss_steering_label(p, L_FINISH);
+    rss_steering_jump(p, BPF_JEQ, R_HASH, 0, L_DEFAULT);
+    rss_steering_emit(p, BPF_ALU64 | BPF_AND | BPF_K, R_HASH, 0, 0,
+                      config->indirections_len - 1);
+    rss_steering_emit(p, BPF_ALU64 | BPF_LSH | BPF_K, R_HASH, 0, 0, 1);
+    rss_steering_emit(p, BPF_ALU64 | BPF_ADD | BPF_K, R_HASH, 0, 0,
+                      RSS_STEERING_HASH_SIZE);
+    rss_steering_emit(p, BPF_ALU64 | BPF_ADD | BPF_X, R_MAP, R_HASH, 0, 0);
+    rss_steering_emit(p, BPF_LDX | BPF_MEM | BPF_H, BPF_REG_0, R_MAP, 0, 0);
+    rss_steering_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    rss_steering_label(p, L_DEFAULT);
+    rss_steering_emit(p, BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0,
+                      config->default_queue);
+    rss_steering_emit(p, BPF_JMP | BPF_EXIT, 0, 0, 0, 0);
+
+    rss_steering_resolve(p);
+}
+
+/*
+ * Expand the key: entry [pos][byte] is the XOR of the 32-bit key windows
+ * selected by the bits of @byte at input position @pos.
+ */
+static void rss_steering_fill(uint8_t *value, uint16_t *indirections_table,
+                              size_t len, uint8_t *toeplitz_key)
+{
+    uint32_t windows[RSS_STEERING_INPUT_LEN * 8];
+    uint32_t *hash = (uint32_t *)value;
+    int i, j, pos, byte;
+
+    for (i = 0; i < ARRAY_SIZE(windows); i++) {
+        uint32_t w = 0;
+
+        for (j = 0; j < 32; j++) {
+            int bit = i + j;
+
+            w = (w << 1) | ((toeplitz_key[bit / 8] >> (7 - bit % 8)) & 1);
+        }
+        windows[i] = w;
+    }
+
+    for (pos = 0; pos < RSS_STEERING_INPUT_LEN; pos++) {
+        for (byte = 0; byte < 256; byte++) {
+            uint32_t h = 0;
+
+            for (j = 0; j < 8; j++) {
+                if (byte & (0x80 >> j)) {
+                    h ^= windows[pos * 8 + j];
+                }
+            }
+            hash[pos * 256 + byte] = h;
+        }
+    }
+
+    memcpy(value + RSS_STEERING_HASH_SIZE, indirections_table,
+           len * sizeof(uint16_t));
+}
+
+static int rss_steering_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof(*attr));
+}
+
+void rss_steering_init(struct RSSSteeringContext *ctx)
+{
+    ctx->program_fd = -1;
+    ctx->map_fd = -1;
+}
+
+bool rss_steering_is_loaded(struct RSSSteeringContext *ctx)
+{
+    return ctx->program_fd >= 0;
+}
+
+bool rss_steering_set_all(struct RSSSteeringContext *ctx,
+                          struct EBPFRSSConfig *config,
+                          uint16_t *indirections_table,
+                          uint8_t *toeplitz_key)
+{
+    g_autofree RSSSteeringProg *prog = NULL;
+    g_autofree uint8_t *value = NULL;
+    union bpf_attr attr;
+    uint32_t map_key = 0;
+    int fd;
+
+    if (config->indirections_len > VIRTIO_NET_RSS_MAX_TABLE_LEN) {
+        return false;
+    }
+
+    if (ctx->map_fd < 0) {
+        memset(&attr, 0, sizeof(attr));
+        attr.map_type = BPF_MAP_TYPE_ARRAY;
+        attr.key_size = sizeof(map_key);
+        attr.value_size = RSS_STEERING_VALUE_SIZE;
+        attr.max_entries = 1;
+        ctx->map_fd = rss_steering_bpf(BPF_MAP_CREATE, &attr);
+        if (ctx->map_fd < 0) {
+            trace_ebpf_error("RSS steering", strerror(errno));
+            return false;
+        }
+    }
+
+    value = g_malloc0(RSS_STEERING_VALUE_SIZE);
+    rss_steering_fill(value, indirections_table, config->indirections_len,
+                      toeplitz_key);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.map_fd = ctx->map_fd;
+    attr.key = (uintptr_t)&map_key;
+    attr.value = (uintptr_t)value;
+    attr.flags = BPF_ANY;
+    if (rss_steering_bpf(BPF_MAP_UPDATE_ELEM, &attr) < 0) {
+        trace_ebpf_error("RSS steering", strerror(errno));
+        return false;
+    }
+
+    prog = g_new0(RSSSteeringProg, 1);
+    rss_steering_gen(prog, config, ctx->map_fd);
+
+    memset(&attr, 0, sizeof(attr));
+    attr.prog_type = BPF_PROG_TYPE_SOCKET_FILTER;
+    attr.insns = (uintptr_t)prog->insns;
+    attr.insn_cnt = prog->len;
+    attr.license = (uintptr_t)"GPL";
+    fd = rss_steering_bpf(BPF_PROG_LOAD, &attr);
+    if (fd < 0) {
+        trace_ebpf_error("RSS steering", strerror(errno));
+        return false;
+    }
+    trace_rss_steering_load(fd, prog->len);
+
+    /* The backend keeps a reference to the program it runs */
+    if (ctx->program_fd >= 0) {
+        close(ctx->program_fd);
+    }
+    ctx->program_fd = fd;
+
+    return true;
+}
+
+void rss_steering_unload(struct RSSSteeringContext *ctx)
+{
+    if (ctx->program_fd >= 0) {
+        close(ctx->program_fd);
+    }
+    if (ctx->map_fd >= 0) {
+        close(ctx->map_fd);
+    }
+    rss_steering_init(ctx);
+}
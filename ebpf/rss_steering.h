@@ -0,0 +1,39 @@
+/*
+ * Built-in RSS steering program for tap
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2.  See
+ * the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_RSS_STEERING_H
+#define QEMU_RSS_STEERING_H
+
+#include "ebpf/ebpf_rss.h"
+
+/*
+ * A steering program generated at run time from the guest's RSS
+ * configuration, for hosts where the eBPF RSS object can not be used.
+ * It needs neither libbpf nor a compiled BPF object, only the bpf()
+ * system call.
+ */
+struct RSSSteeringContext {
+    int program_fd;
+    int map_fd;
+};
+
+void rss_steering_init(struct RSSSteeringContext *ctx);
+
+bool rss_steering_is_loaded(struct RSSSteeringContext *ctx);
+
+/*
+ * (Re)build the program for @config.  On success, the new program is in
+ * ctx->program_fd and has to be attached to the backend again.
+ */
+bool rss_steering_set_all(struct RSSSteeringContext *ctx,
+                          struct EBPFRSSConfig *config,
+                          uint16_t *indirections_table,
+                          uint8_t *toeplitz_key);
+
+void rss_steering_unload(struct RSSSteeringContext *ctx);
+
+#endif /* QEMU_RSS_STEERING_H */
@@ -88,10 +88,29 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     VirtIOBlockDataPlane *s;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    IOThread *iothread = conf->iothread;
 
     *dataplane = NULL;
 
-    if (conf->iothread) {
+    if (conf->iothread_vq_mapping) {
+        /*
+         * The block layer only takes requests from the AioContext of the
+         * BlockBackend, so all virtqueues have to be serviced by the same
+         * IOThread for now.
+         */
+        if (conf->iothread_vq_mapping->next) {
+            error_setg(errp, "iothread-vq-mapping supports only one IOThread");
+            return false;
+        }
+        iothread = iothread_by_id(conf->iothread_vq_mapping->value);
+        if (!iothread) {
+            error_setg(errp, "IOThread '%s' in iothread-vq-mapping not found",
+                       conf->iothread_vq_mapping->value);
+            return false;
+        }
+    }
+
+    if (iothread) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -120,8 +139,8 @@ bool virtio_blk_data_plane_create(VirtIODevice *vdev, VirtIOBlkConf *conf,
     s->vdev = vdev;
     s->conf = conf;
 
-    if (conf->iothread) {
-        s->iothread = conf->iothread;
+    if (iothread) {
+        s->iothread = iothread;
         object_ref(OBJECT(s->iothread));
         s->ctx = iothread_get_aio_context(s->iothread);
     } else {
@@ -57,6 +57,16 @@ static void virtio_blk_set_config_size(VirtIOBlock *s, uint64_t host_features)
     assert(s->config_size <= sizeof(struct virtio_blk_config));
 }
 
+/*
+ * Requests with up to this many segments are recycled through the
+ * virtqueue's element pool; that covers the header, the status byte and
+ * 2 MiB of data in 64 KiB segments.
+ */
+#define VIRTIO_BLK_ELEM_POOL_SG 34
+
+/* Number of requests that virtio_blk_handle_vq() pops at a time */
+#define VIRTIO_BLK_POP_BATCH 16
+
 static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
                                     VirtIOBlockReq *req)
 {
@@ -70,24 +80,65 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_element_free(&req->elem);
 }
 
-static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+static void virtio_blk_req_set_status(VirtIOBlockReq *req,
+                                      unsigned char status)
 {
-    VirtIOBlock *s = req->dev;
-    VirtIODevice *vdev = VIRTIO_DEVICE(s);
-
-    trace_virtio_blk_req_complete(vdev, req, status);
+    trace_virtio_blk_req_complete(VIRTIO_DEVICE(req->dev), req, status);
 
     stb_p(&req->in->status, status);
     iov_discard_undo(&req->inhdr_undo);
     iov_discard_undo(&req->outhdr_undo);
-    virtqueue_push(req->vq, &req->elem, req->in_len);
+}
+
+static void virtio_blk_notify(VirtIOBlock *s, VirtQueue *vq)
+{
     if (s->dataplane_started && !s->dataplane_disabled) {
-        virtio_blk_data_plane_notify(s->dataplane, req->vq);
+        virtio_blk_data_plane_notify(s->dataplane, vq);
     } else {
-        virtio_notify(vdev, req->vq);
+        virtio_notify(VIRTIO_DEVICE(s), vq);
+    }
+}
+
+static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+{
+    virtio_blk_req_set_status(req, status);
+    virtqueue_push(req->vq, &req->elem, req->in_len);
+    virtio_blk_notify(req->dev, req->vq);
+}
+
+/*
+ * Complete @count successful requests from the same virtqueue, publishing
+ * them to the guest with a single used index update and notification.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int count)
+{
+    VirtIOBlock *s;
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i;
+
+    if (!count) {
+        return;
+    }
+
+    assert(count <= VIRTIO_BLK_MAX_MERGE_REQS);
+    s = reqs[0]->dev;
+    for (i = 0; i < count; i++) {
+        assert(reqs[i]->vq == reqs[0]->vq);
+        virtio_blk_req_set_status(reqs[i], VIRTIO_BLK_S_OK);
+        elems[i] = &reqs[i]->elem;
+        lens[i] = reqs[i]->in_len;
+    }
+    virtqueue_fill_batch(reqs[0]->vq, elems, lens, count);
+    virtio_blk_notify(s, reqs[0]->vq);
+
+    for (i = 0; i < count; i++) {
+        block_acct_done(blk_get_stats(s->blk), &reqs[i]->acct);
+        virtio_blk_free_request(reqs[i]);
     }
 }
 
@@ -120,6 +171,8 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int nb_done = 0;
 
     aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
     while (next) {
@@ -150,10 +203,18 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
-        block_acct_done(blk_get_stats(s->blk), &req->acct);
-        virtio_blk_free_request(req);
+        /*
+         * Requests that were queued after a stop error can come from
+         * different virtqueues.
+         */
+        if (nb_done == ARRAY_SIZE(done) ||
+            (nb_done && done[0]->vq != req->vq)) {
+            virtio_blk_req_complete_batch(done, nb_done);
+            nb_done = 0;
+        }
+        done[nb_done++] = req;
     }
+    virtio_blk_req_complete_batch(done, nb_done);
     aio_context_release(blk_get_aio_context(s->conf.conf.blk));
 }
 
@@ -254,16 +315,6 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
-{
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
-
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
-    }
-    return req;
-}
-
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
 {
     int status = VIRTIO_BLK_S_OK;
@@ -770,7 +821,8 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
+    unsigned int i, nb_reqs;
     MultiReqBuffer mrb = {};
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
@@ -782,10 +834,21 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
+        while ((nb_reqs = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                              (void **)reqs,
+                                              ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < nb_reqs; i++) {
+                virtio_blk_init_request(s, vq, reqs[i]);
+                if (virtio_blk_handle_request(reqs[i], &mrb)) {
+                    break;
+                }
+            }
+            if (i < nb_reqs) {
+                /* The device is broken, drop the rest of the batch */
+                for (; i < nb_reqs; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                }
                 break;
             }
         }
@@ -1158,6 +1221,11 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         error_setg(errp, "num-queues property must be larger than 0");
         return;
     }
+    if (conf->iothread && conf->iothread_vq_mapping) {
+        error_setg(errp, "iothread and iothread-vq-mapping properties "
+                   "cannot be set at the same time");
+        return;
+    }
     if (conf->queue_size <= 2) {
         error_setg(errp, "invalid queue-size property (%" PRIu16 "), "
                    "must be > 2", conf->queue_size);
@@ -1213,7 +1281,10 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
 
     for (i = 0; i < conf->num_queues; i++) {
-        virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
+        VirtQueue *vq = virtio_add_queue(vdev, conf->queue_size,
+                                         virtio_blk_handle_output);
+        virtio_queue_enable_element_pool(vq, sizeof(VirtIOBlockReq),
+                                         VIRTIO_BLK_ELEM_POOL_SG);
     }
     qemu_coroutine_increase_pool_batch_size(conf->num_queues * conf->queue_size
                                             / 2);
@@ -1298,6 +1369,8 @@ static Property virtio_blk_properties[] = {
     DEFINE_PROP_BOOL("seg-max-adjust", VirtIOBlock, conf.seg_max_adjust, true),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIOBlock,
+                                         conf.iothread_vq_mapping),
     DEFINE_PROP_BIT64("discard", VirtIOBlock, host_features,
                       VIRTIO_BLK_F_DISCARD, true),
     DEFINE_PROP_BOOL("report-discard-granularity", VirtIOBlock,
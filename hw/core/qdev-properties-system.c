@@ -15,6 +15,7 @@
 #include "hw/qdev-properties-system.h"
 #include "qapi/error.h"
 #include "qapi/visitor.h"
+#include "qapi/qapi-builtin-visit.h"
 #include "qapi/qapi-types-block.h"
 #include "qapi/qapi-types-machine.h"
 #include "qapi/qapi-types-migration.h"
@@ -1119,3 +1120,61 @@ const PropertyInfo qdev_prop_uuid = {
     .set   = set_uuid,
     .set_default_value = set_default_uuid_auto,
 };
+
+/* --- list of IOThread ids --- */
+
+static void get_iothread_vq_mapping_list(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    strList **prop_ptr = object_field_prop_ptr(obj, opaque);
+
+    visit_type_strList(v, name, prop_ptr, errp);
+}
+
+static void set_iothread_vq_mapping_list(Object *obj, Visitor *v,
+                                         const char *name, void *opaque,
+                                         Error **errp)
+{
+    strList **prop_ptr = object_field_prop_ptr(obj, opaque);
+    strList *list;
+
+    if (!visit_type_strList(v, name, &list, errp)) {
+        return;
+    }
+
+    qapi_free_strList(*prop_ptr);
+    *prop_ptr = list;
+}
+
+static void release_iothread_vq_mapping_list(Object *obj,
+                                             const char *name, void *opaque)
+{
+    strList **prop_ptr = object_field_prop_ptr(obj, opaque);
+
+    qapi_free_strList(*prop_ptr);
+    *prop_ptr = NULL;
+}
+
+static int print_iothread_vq_mapping_list(Object *obj, Property *prop,
+                                          char *dest, size_t len)
+{
+    strList **prop_ptr = object_field_prop_ptr(obj, prop);
+    g_autoptr(GString) str = g_string_new(NULL);
+    strList *node;
+
+    for (node = *prop_ptr; node; node = node->next) {
+        g_string_append_printf(str, "%s%s", node->value, node->next ? "," : "");
+    }
+    return snprintf(dest, len, "%s", str->str);
+}
+
+const PropertyInfo qdev_prop_iothread_vq_mapping_list = {
+    .name = "IOThreadVirtQueueMappingList",
+    .description = "IOThread ids that service the virtqueues "
+                   "(currently at most one), example: [\"iothread0\"]",
+    .get = get_iothread_vq_mapping_list,
+    .set = set_iothread_vq_mapping_list,
+    .print = print_iothread_vq_mapping_list,
+    .release = release_iothread_vq_mapping_list,
+};
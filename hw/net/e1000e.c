@@ -261,10 +261,18 @@ static const uint16_t e1000e_eeprom_template[64] = {
     0xffff, 0xffff, 0xffff, 0xffff, 0x0000, 0x0120, 0xffff, 0x0000,
 };
 
+static void e1000e_nc_tx_sent(NetClientState *nc, ssize_t len)
+{
+    E1000EState *s = qemu_get_nic_opaque(nc);
+
+    e1000e_tx_sent(&s->core, nc->queue_index);
+}
+
 static void e1000e_core_realize(E1000EState *s)
 {
     s->core.owner = &s->parent_obj;
     s->core.owner_nic = s->nic;
+    s->core.owner_tx_sent = e1000e_nc_tx_sent;
 }
 
 static void
@@ -656,7 +656,8 @@ e1000e_tx_pkt_send(E1000ECore *core, struct e1000e_tx *tx, int queue_index)
         ((core->mac[RCTL] & E1000_RCTL_LBM_MAC) == E1000_RCTL_LBM_MAC)) {
         return net_tx_pkt_send_loopback(tx->tx_pkt, queue);
     } else {
-        return net_tx_pkt_send(tx->tx_pkt, queue);
+        return net_tx_pkt_send_async(tx->tx_pkt, queue,
+                                     core->owner_tx_sent, &tx->busy);
     }
 }
 
@@ -916,6 +917,12 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
         return;
     }
 
+    /* Resumed from e1000e_tx_sent() once the backend drains */
+    if (txr->tx->busy) {
+        trace_e1000e_tx_busy(txi->idx);
+        return;
+    }
+
     while (!e1000e_ring_empty(core, txi)) {
         base = e1000e_ring_head_descr(core, txi);
 
@@ -928,6 +935,12 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
         cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
 
         e1000e_ring_advance(core, txi, 1);
+
+        if (txr->tx->busy) {
+            trace_e1000e_tx_busy(txi->idx);
+            cause &= ~E1000_ICS_TXQE;
+            break;
+        }
     }
 
     if (!ide || !e1000e_intrmgr_delay_tx_causes(core, &cause)) {
@@ -935,6 +948,28 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
     }
 }
 
+void
+e1000e_tx_sent(E1000ECore *core, int queue_index)
+{
+    static const int tarc_regs[E1000E_NUM_QUEUES] = { TARC0, TARC1 };
+    E1000E_TxRing txr;
+    int i;
+
+    for (i = 0; i < E1000E_NUM_QUEUES; i++) {
+        if (!core->tx[i].busy ||
+            MIN(core->max_queue_num, i) != queue_index) {
+            continue;
+        }
+
+        core->tx[i].busy = false;
+
+        if (core->mac[tarc_regs[i]] & E1000_TARC_ENABLE) {
+            e1000e_tx_ring_init(core, &txr, i);
+            e1000e_start_xmit(core, &txr);
+        }
+    }
+}
+
 static bool
 e1000e_has_rxbufs(E1000ECore *core, const E1000E_RingInfo *r,
                   size_t total_size)
@@ -3473,6 +3508,7 @@ e1000e_core_reset(E1000ECore *core)
         net_tx_pkt_reset(core->tx[i].tx_pkt);
         memset(&core->tx[i].props, 0, sizeof(core->tx[i].props));
         core->tx[i].skip_cp = false;
+        core->tx[i].busy = false;
     }
 }
 
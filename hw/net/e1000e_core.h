@@ -76,6 +76,7 @@ struct E1000Core {
         bool skip_cp;
         unsigned char sum_needed;
         bool cptse;
+        bool busy;
         struct NetTxPkt *tx_pkt;
     } tx[E1000E_NUM_QUEUES];
 
@@ -112,6 +113,7 @@ struct E1000Core {
     NICState *owner_nic;
     PCIDevice *owner;
     void (*owner_start_recv)(PCIDevice *d);
+    NetPacketSent *owner_tx_sent;
 
     uint32_t msi_causes_pending;
 };
@@ -155,4 +157,7 @@ e1000e_receive_iov(E1000ECore *core, const struct iovec *iov, int iovcnt);
 void
 e1000e_start_recv(E1000ECore *core);
 
+void
+e1000e_tx_sent(E1000ECore *core, int queue_index);
+
 #endif
@@ -56,6 +56,9 @@ struct NetTxPkt {
     uint8_t l4proto;
 
     bool is_loopback;
+
+    NetPacketSent *sent_cb;
+    bool busy;
 };
 
 void net_tx_pkt_init(struct NetTxPkt **pkt, PCIDevice *pci_dev,
@@ -556,6 +559,10 @@ static inline void net_tx_pkt_sendv(struct NetTxPkt *pkt,
 {
     if (pkt->is_loopback) {
         qemu_receive_packet_iov(nc, iov, iov_cnt);
+    } else if (pkt->sent_cb) {
+        if (!qemu_sendv_packet_async(nc, iov, iov_cnt, pkt->sent_cb)) {
+            pkt->busy = true;
+        }
     } else {
         qemu_sendv_packet(nc, iov, iov_cnt);
     }
@@ -651,6 +658,20 @@ bool net_tx_pkt_send_loopback(struct NetTxPkt *pkt, NetClientState *nc)
     return res;
 }
 
+bool net_tx_pkt_send_async(struct NetTxPkt *pkt, NetClientState *nc,
+    NetPacketSent *sent_cb, bool *busy)
+{
+    bool res;
+
+    pkt->sent_cb = sent_cb;
+    pkt->busy = false;
+    res = net_tx_pkt_send(pkt, nc);
+    pkt->sent_cb = NULL;
+
+    *busy = pkt->busy;
+    return res;
+}
+
 void net_tx_pkt_fix_ip6_payload_len(struct NetTxPkt *pkt)
 {
     struct iovec *l2 = &pkt->vec[NET_TX_PKT_L2HDR_FRAG];
@@ -19,6 +19,7 @@
 #define NET_TX_PKT_H
 
 #include "net/eth.h"
+#include "net/queue.h"
 #include "exec/hwaddr.h"
 
 /* define to enable packet dump functions */
@@ -160,6 +161,22 @@ void net_tx_pkt_reset(struct NetTxPkt *pkt);
  */
 bool net_tx_pkt_send(struct NetTxPkt *pkt, NetClientState *nc);
 
+/**
+ * Send packet to qemu without blocking on a busy backend.
+ * If the backend can not take the packet now, it is queued, @busy is set
+ * and @sent_cb is called once the queue drains.  The caller should stop
+ * transmitting until then.
+ *
+ * @pkt:            packet
+ * @nc:             NetClientState
+ * @sent_cb:        completion callback for queued packets
+ * @busy:           set if the packet had to be queued
+ * @ret:            operation result
+ *
+ */
+bool net_tx_pkt_send_async(struct NetTxPkt *pkt, NetClientState *nc,
+    NetPacketSent *sent_cb, bool *busy);
+
 /**
 * Redirect packet directly to receive path (emulate loopback phy).
 * Handles sw offloads if vhdr is not supported.
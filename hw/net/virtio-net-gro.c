@@ -0,0 +1,491 @@
+/*
+ * Generic receive offload for virtio-net
+ *
+ * In-order TCP segments of the same flow are merged into one large frame
+ * that is handed to the guest as a GSO packet with a partial checksum, the
+ * same way the host kernel passes GRO packets to a tap device.  This lets
+ * backends without offloads, or that see wire-sized segments, feed the
+ * guest as efficiently as a vhost-net/tap setup.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/queue.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "hw/virtio/virtio-net-gro.h"
+#include "trace.h"
+
+#define VIRTIO_NET_GRO_MAX_FLOWS    8
+#define VIRTIO_NET_GRO_MAX_IP_LEN   0xffff
+#define VIRTIO_NET_GRO_MAX_FRAME    (sizeof(struct eth_header) + \
+                                     sizeof(struct ip6_header) + \
+                                     VIRTIO_NET_GRO_MAX_IP_LEN)
+#define VIRTIO_NET_GRO_MAX_SEGS     64
+
+/* Any of these ends the flow; the frame itself is not coalesced */
+#define VIRTIO_NET_GRO_TCP_FINAL    (TH_FIN | TH_SYN | TH_RST | TH_URG | \
+                                     TH_ECE | TH_CWR)
+
+typedef struct VirtioNetGroFlow {
+    uint8_t *buf;               /* Frame, starting at the Ethernet header */
+    size_t size;
+    uint16_t proto;             /* ETH_P_IP or ETH_P_IPV6 */
+    uint16_t l4_off;            /* Offset of the TCP header */
+    uint16_t l4_hlen;           /* Length of the TCP header */
+    uint16_t mss;               /* Payload of the first segment */
+    uint16_t segs;
+    uint32_t next_seq;
+    bool partial;               /* Some segment had no checksum yet */
+    QTAILQ_ENTRY(VirtioNetGroFlow) next;
+} VirtioNetGroFlow;
+
+struct VirtioNetGro {
+    VirtioNetGroDeliver *deliver;
+    void *opaque;
+    bool tso4;
+    bool tso6;
+
+    /* Held flows in arrival order, and the unused slots */
+    QTAILQ_HEAD(, VirtioNetGroFlow) flows;
+    QTAILQ_HEAD(, VirtioNetGroFlow) free_flows;
+    VirtioNetGroFlow slots[VIRTIO_NET_GRO_MAX_FLOWS];
+
+    VirtioNetGroStats stats;
+};
+
+/* Parsed view of a TCP frame that is a candidate for coalescing */
+typedef struct VirtioNetGroUnit {
+    uint16_t proto;
+    uint16_t l4_off;
+    uint16_t l4_hlen;
+    uint16_t payload;
+    const struct tcp_header *tcp;
+    uint8_t flags;
+} VirtioNetGroUnit;
+
+VirtioNetGro *virtio_net_gro_new(VirtioNetGroDeliver *deliver, void *opaque)
+{
+    VirtioNetGro *gro = g_new0(VirtioNetGro, 1);
+    int i;
+
+    gro->deliver = deliver;
+    gro->opaque = opaque;
+    QTAILQ_INIT(&gro->flows);
+    QTAILQ_INIT(&gro->free_flows);
+    for (i = 0; i < VIRTIO_NET_GRO_MAX_FLOWS; i++) {
+        QTAILQ_INSERT_TAIL(&gro->free_flows, &gro->slots[i], next);
+    }
+
+    return gro;
+}
+
+void virtio_net_gro_free(VirtioNetGro *gro)
+{
+    int i;
+
+    if (!gro) {
+        return;
+    }
+
+    for (i = 0; i < VIRTIO_NET_GRO_MAX_FLOWS; i++) {
+        g_free(gro->slots[i].buf);
+    }
+    g_free(gro);
+}
+
+static void virtio_net_gro_release(VirtioNetGro *gro, VirtioNetGroFlow *flow)
+{
+    QTAILQ_REMOVE(&gro->flows, flow, next);
+    QTAILQ_INSERT_HEAD(&gro->free_flows, flow, next);
+}
+
+void virtio_net_gro_purge(VirtioNetGro *gro)
+{
+    VirtioNetGroFlow *flow, *next;
+
+    QTAILQ_FOREACH_SAFE(flow, &gro->flows, next, next) {
+        gro->stats.dropped += flow->segs;
+        virtio_net_gro_release(gro, flow);
+    }
+}
+
+bool virtio_net_gro_pending(VirtioNetGro *gro)
+{
+    return !QTAILQ_EMPTY(&gro->flows);
+}
+
+void virtio_net_gro_set_offloads(VirtioNetGro *gro, bool tso4, bool tso6)
+{
+    if (gro->tso4 != tso4 || gro->tso6 != tso6) {
+        virtio_net_gro_purge(gro);
+        gro->tso4 = tso4;
+        gro->tso6 = tso6;
+    }
+}
+
+void virtio_net_gro_get_stats(VirtioNetGro *gro, VirtioNetGroStats *stats)
+{
+    *stats = gro->stats;
+}
+
+/*
+ * Turn a held flow into a frame for the guest.  A single segment keeps its
+ * original checksum state; a coalesced one gets fixed up IP lengths and a
+ * TCP checksum that the guest completes, or trusts, as CHECKSUM_PARTIAL.
+ */
+static bool virtio_net_gro_deliver_flow(VirtioNetGro *gro,
+                                        VirtioNetGroFlow *flow)
+{
+    struct virtio_net_hdr hdr = {
+        .flags = VIRTIO_NET_HDR_F_DATA_VALID,
+        .gso_type = VIRTIO_NET_HDR_GSO_NONE,
+    };
+    uint8_t *l3 = flow->buf + sizeof(struct eth_header);
+    struct tcp_header *tcp = (struct tcp_header *)(flow->buf + flow->l4_off);
+    uint16_t tcp_len = flow->size - flow->l4_off;
+    uint32_t cso, sum;
+    ssize_t ret;
+
+    if (flow->segs > 1) {
+        if (flow->proto == ETH_P_IP) {
+            struct ip_header *ip = (struct ip_header *)l3;
+
+            ip->ip_len = cpu_to_be16(flow->size - sizeof(struct eth_header));
+            eth_fix_ip4_checksum(ip, flow->l4_off - sizeof(struct eth_header));
+            sum = eth_calc_ip4_pseudo_hdr_csum(ip, tcp_len, &cso);
+            hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV4;
+        } else {
+            struct ip6_header *ip6 = (struct ip6_header *)l3;
+
+            ip6->ip6_ctlun.ip6_un1.ip6_un1_plen = cpu_to_be16(tcp_len);
+            sum = eth_calc_ip6_pseudo_hdr_csum(ip6, tcp_len, IPPROTO_TCP, &cso);
+            hdr.gso_type = VIRTIO_NET_HDR_GSO_TCPV6;
+        }
+        tcp->th_sum = cpu_to_be16(~net_checksum_finish(sum));
+        hdr.gso_size = flow->mss;
+        hdr.hdr_len = flow->l4_off + flow->l4_hlen;
+    }
+
+    if (flow->segs > 1 || flow->partial) {
+        hdr.flags = VIRTIO_NET_HDR_F_NEEDS_CSUM;
+        hdr.csum_start = flow->l4_off;
+        hdr.csum_offset = offsetof(struct tcp_header, th_sum);
+    }
+
+    ret = gro->deliver(gro->opaque, &hdr, flow->buf, flow->size);
+    if (ret == 0) {
+        gro->stats.blocked++;
+        return false;
+    }
+
+    trace_virtio_net_gro_flush(gro, flow->segs, flow->size);
+    gro->stats.flushed++;
+    virtio_net_gro_release(gro, flow);
+    return true;
+}
+
+bool virtio_net_gro_flush(VirtioNetGro *gro, bool timeout)
+{
+    VirtioNetGroFlow *flow, *next;
+
+    if (timeout && virtio_net_gro_pending(gro)) {
+        gro->stats.timer_flushes++;
+    }
+
+    QTAILQ_FOREACH_SAFE(flow, &gro->flows, next, next) {
+        if (!virtio_net_gro_deliver_flow(gro, flow)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Check that the frame is a TCP segment without IP options, extension
+ * headers or fragmentation, and that the lengths in its headers are sane.
+ */
+static bool virtio_net_gro_parse(VirtioNetGro *gro, const uint8_t *buf,
+                                 size_t size, VirtioNetGroUnit *unit)
+{
+    const uint8_t *l3 = buf + sizeof(struct eth_header);
+    size_t l3_size;
+    uint16_t l4_len;
+
+    if (size < sizeof(struct eth_header) + sizeof(struct ip_header) +
+               sizeof(struct tcp_header)) {
+        return false;
+    }
+    l3_size = size - sizeof(struct eth_header);
+
+    unit->proto = lduw_be_p(&PKT_GET_ETH_HDR(buf)->h_proto);
+    switch (unit->proto) {
+    case ETH_P_IP: {
+        const struct ip_header *ip = (const struct ip_header *)l3;
+        uint16_t ip_len = be16_to_cpu(ip->ip_len);
+
+        if (!gro->tso4 ||
+            ip->ip_ver_len != ((IP_HEADER_VERSION_4 << 4) |
+                               (sizeof(struct ip_header) >> 2)) ||
+            ip->ip_p != IPPROTO_TCP || IP4_IS_FRAGMENT(ip) ||
+            ip_len > l3_size ||
+            ip_len < sizeof(struct ip_header) + sizeof(struct tcp_header)) {
+            return false;
+        }
+        unit->l4_off = sizeof(struct eth_header) + sizeof(struct ip_header);
+        l4_len = ip_len - sizeof(struct ip_header);
+        break;
+    }
+    case ETH_P_IPV6: {
+        const struct ip6_header *ip6 = (const struct ip6_header *)l3;
+        uint16_t plen = be16_to_cpu(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen);
+
+        if (!gro->tso6 || l3_size < sizeof(struct ip6_header) ||
+            (ip6->ip6_ctlun.ip6_un2_vfc >> 4) != IP_HEADER_VERSION_6 ||
+            ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt != IPPROTO_TCP ||
+            plen > l3_size - sizeof(struct ip6_header) ||
+            plen < sizeof(struct tcp_header)) {
+            return false;
+        }
+        unit->l4_off = sizeof(struct eth_header) + sizeof(struct ip6_header);
+        l4_len = plen;
+        break;
+    }
+    default:
+        return false;
+    }
+
+    unit->tcp = (const struct tcp_header *)(buf + unit->l4_off);
+    unit->l4_hlen = TCP_HEADER_DATA_OFFSET(unit->tcp);
+    if (unit->l4_hlen < sizeof(struct tcp_header) || unit->l4_hlen > l4_len) {
+        return false;
+    }
+    unit->payload = l4_len - unit->l4_hlen;
+    unit->flags = be16_to_cpu(unit->tcp->th_offset_flags) & 0xff;
+
+    return true;
+}
+
+static bool virtio_net_gro_csum_ok(const uint8_t *buf, VirtioNetGroUnit *unit)
+{
+    uint8_t *l3 = (uint8_t *)buf + sizeof(struct eth_header);
+    uint16_t tcp_len = unit->l4_hlen + unit->payload;
+    uint32_t cso, sum;
+
+    if (unit->proto == ETH_P_IP) {
+        sum = eth_calc_ip4_pseudo_hdr_csum((struct ip_header *)l3,
+                                           tcp_len, &cso);
+    } else {
+        sum = eth_calc_ip6_pseudo_hdr_csum((struct ip6_header *)l3,
+                                           tcp_len, IPPROTO_TCP, &cso);
+    }
+    sum += net_checksum_add(tcp_len, (uint8_t *)unit->tcp);
+
+    return net_checksum_finish(sum) == 0;
+}
+
+/*
+ * Does the frame belong to the flow?  Besides addresses and ports, the
+ * IP fields that GRO cannot merge and the TCP options must match too.
+ */
+static bool virtio_net_gro_match(VirtioNetGroFlow *flow, const uint8_t *buf,
+                                 VirtioNetGroUnit *unit)
+{
+    const uint8_t *l3 = buf + sizeof(struct eth_header);
+    const uint8_t *f_l3 = flow->buf + sizeof(struct eth_header);
+    const struct tcp_header *f_tcp;
+
+    if (flow->proto != unit->proto || flow->l4_off != unit->l4_off) {
+        return false;
+    }
+
+    if (unit->proto == ETH_P_IP) {
+        const struct ip_header *ip = (const struct ip_header *)l3;
+        const struct ip_header *f_ip = (const struct ip_header *)f_l3;
+
+        if (ip->ip_src != f_ip->ip_src || ip->ip_dst != f_ip->ip_dst) {
+            return false;
+        }
+    } else {
+        const struct ip6_header *ip6 = (const struct ip6_header *)l3;
+        const struct ip6_header *f_ip6 = (const struct ip6_header *)f_l3;
+
+        if (memcmp(&ip6->ip6_src, &f_ip6->ip6_src, 2 * sizeof(ip6->ip6_src))) {
+            return false;
+        }
+    }
+
+    f_tcp = (const struct tcp_header *)(flow->buf + flow->l4_off);
+    return unit->tcp->th_sport == f_tcp->th_sport &&
+           unit->tcp->th_dport == f_tcp->th_dport;
+}
+
+static bool virtio_net_gro_can_merge(VirtioNetGroFlow *flow,
+                                     const uint8_t *buf,
+                                     VirtioNetGroUnit *unit)
+{
+    const uint8_t *l3 = buf + sizeof(struct eth_header);
+    const uint8_t *f_l3 = flow->buf + sizeof(struct eth_header);
+    const struct tcp_header *f_tcp =
+        (const struct tcp_header *)(flow->buf + flow->l4_off);
+
+    if (unit->proto == ETH_P_IP) {
+        const struct ip_header *ip = (const struct ip_header *)l3;
+        const struct ip_header *f_ip = (const struct ip_header *)f_l3;
+
+        if (ip->ip_tos != f_ip->ip_tos || ip->ip_ttl != f_ip->ip_ttl) {
+            return false;
+        }
+    } else {
+        const struct ip6_header *ip6 = (const struct ip6_header *)l3;
+        const struct ip6_header *f_ip6 = (const struct ip6_header *)f_l3;
+
+        if (ip6->ip6_ctlun.ip6_un1.ip6_un1_flow !=
+            f_ip6->ip6_ctlun.ip6_un1.ip6_un1_flow ||
+            ip6->ip6_ctlun.ip6_un1.ip6_un1_hlim !=
+            f_ip6->ip6_ctlun.ip6_un1.ip6_un1_hlim) {
+            return false;
+        }
+    }
+
+    /* A short segment ends the super-frame; so does the segment limit */
+    return be32_to_cpu(unit->tcp->th_seq) == flow->next_seq &&
+           unit->payload <= flow->mss &&
+           flow->size + unit->payload - sizeof(struct eth_header) <=
+               VIRTIO_NET_GRO_MAX_IP_LEN &&
+           flow->segs < VIRTIO_NET_GRO_MAX_SEGS &&
+           unit->l4_hlen == flow->l4_hlen &&
+           !memcmp(unit->tcp + 1, f_tcp + 1,
+                   unit->l4_hlen - sizeof(struct tcp_header));
+}
+
+static void virtio_net_gro_merge(VirtioNetGro *gro, VirtioNetGroFlow *flow,
+                                 const uint8_t *buf, VirtioNetGroUnit *unit,
+                                 bool partial)
+{
+    struct tcp_header *f_tcp = (struct tcp_header *)(flow->buf + flow->l4_off);
+
+    memcpy(flow->buf + flow->size,
+           (const uint8_t *)unit->tcp + unit->l4_hlen, unit->payload);
+    flow->size += unit->payload;
+    flow->segs++;
+    flow->next_seq += unit->payload;
+    flow->partial |= partial;
+
+    /* The super-frame carries the latest ACK, window and PSH */
+    f_tcp->th_ack = unit->tcp->th_ack;
+    f_tcp->th_win = unit->tcp->th_win;
+    f_tcp->th_offset_flags |= unit->tcp->th_offset_flags &
+                              cpu_to_be16(TH_PUSH);
+
+    gro->stats.coalesced++;
+}
+
+static void virtio_net_gro_hold(VirtioNetGro *gro, VirtioNetGroFlow *flow,
+                                const uint8_t *buf, VirtioNetGroUnit *unit,
+                                bool partial)
+{
+    size_t size = unit->l4_off + unit->l4_hlen + unit->payload;
+
+    if (!flow->buf) {
+        flow->buf = g_malloc(VIRTIO_NET_GRO_MAX_FRAME);
+    }
+
+    /* Drop the Ethernet padding, if any, which is not part of the data */
+    memcpy(flow->buf, buf, size);
+    flow->size = size;
+    flow->proto = unit->proto;
+    flow->l4_off = unit->l4_off;
+    flow->l4_hlen = unit->l4_hlen;
+    flow->mss = unit->payload;
+    flow->segs = 1;
+    flow->next_seq = be32_to_cpu(unit->tcp->th_seq) + unit->payload;
+    flow->partial = partial;
+
+    QTAILQ_REMOVE(&gro->free_flows, flow, next);
+    QTAILQ_INSERT_TAIL(&gro->flows, flow, next);
+}
+
+VirtioNetGroResult virtio_net_gro_receive(VirtioNetGro *gro,
+                                          const struct virtio_net_hdr *hdr,
+                                          const uint8_t *buf, size_t size)
+{
+    VirtioNetGroFlow *flow;
+    VirtioNetGroUnit unit;
+    bool partial = false;
+
+    gro->stats.received++;
+
+    if (hdr && hdr->gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+        /* Already coalesced by the backend; it may belong to a held flow */
+        if (!virtio_net_gro_flush(gro, false)) {
+            return VIRTIO_NET_GRO_BLOCKED;
+        }
+        goto bypass;
+    }
+
+    if (!virtio_net_gro_parse(gro, buf, size, &unit)) {
+        goto bypass;
+    }
+
+    QTAILQ_FOREACH(flow, &gro->flows, next) {
+        if (virtio_net_gro_match(flow, buf, &unit)) {
+            break;
+        }
+    }
+
+    if (hdr && (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM)) {
+        partial = true;
+    } else if (!(hdr && (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)) &&
+               !virtio_net_gro_csum_ok(buf, &unit)) {
+        /* Let the guest see, and count, the bad checksum */
+        gro->stats.csum_errors++;
+        unit.payload = 0;
+    }
+
+    if (unit.payload == 0 || (unit.flags & VIRTIO_NET_GRO_TCP_FINAL)) {
+        /* Keep the flow in order: flush what is held, then pass through */
+        if (flow && !virtio_net_gro_deliver_flow(gro, flow)) {
+            return VIRTIO_NET_GRO_BLOCKED;
+        }
+        goto bypass;
+    }
+
+    if (flow) {
+        if (virtio_net_gro_can_merge(flow, buf, &unit)) {
+            virtio_net_gro_merge(gro, flow, buf, &unit, partial);
+            if (unit.payload < flow->mss ||
+                (unit.flags & TH_PUSH) ||
+                flow->segs == VIRTIO_NET_GRO_MAX_SEGS) {
+                virtio_net_gro_deliver_flow(gro, flow);
+            }
+            return VIRTIO_NET_GRO_HELD;
+        }
+        if (!virtio_net_gro_deliver_flow(gro, flow)) {
+            return VIRTIO_NET_GRO_BLOCKED;
+        }
+    }
+
+    flow = QTAILQ_FIRST(&gro->free_flows);
+    if (!flow) {
+        /* Evict the oldest flow */
+        gro->stats.evictions++;
+        if (!virtio_net_gro_deliver_flow(gro, QTAILQ_FIRST(&gro->flows))) {
+            return VIRTIO_NET_GRO_BLOCKED;
+        }
+        flow = QTAILQ_FIRST(&gro->free_flows);
+    }
+
+    virtio_net_gro_hold(gro, flow, buf, &unit, partial);
+    if (unit.flags & TH_PUSH) {
+        virtio_net_gro_deliver_flow(gro, flow);
+    }
+    return VIRTIO_NET_GRO_HELD;
+
+bypass:
+    gro->stats.bypassed++;
+    return VIRTIO_NET_GRO_BYPASS;
+}
@@ -13,6 +13,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/atomic.h"
+#include "block/aio-wait.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
@@ -32,6 +33,8 @@
 #include "hw/virtio/virtio-bus.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
+#include "qapi/qapi-visit-net.h"
+#include "qapi/visitor.h"
 #include "hw/qdev-properties.h"
 #include "qapi/qapi-types-migration.h"
 #include "qapi/qapi-events-migration.h"
@@ -59,6 +62,12 @@
 #define VIRTIO_NET_RX_QUEUE_MIN_SIZE VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE
 #define VIRTIO_NET_TX_QUEUE_MIN_SIZE VIRTIO_NET_TX_QUEUE_DEFAULT_SIZE
 
+/* Enough for the header plus a TSO packet split across MAX_SKB_FRAGS pages */
+#define VIRTIO_NET_ELEM_POOL_SG 19
+
+/* Number of tx descriptors that virtio_net_flush_tx() pops at a time */
+#define VIRTIO_NET_TX_BATCH 64
+
 #define VIRTIO_NET_IP4_ADDR_SIZE   8        /* ipv4 saddr + daddr */
 
 #define VIRTIO_NET_TCP_FLAG         0x3F
@@ -80,6 +89,12 @@
    tso/gso/gro 'off'. */
 #define VIRTIO_NET_RSC_DEFAULT_INTERVAL 300000
 
+/*
+ * How long the GRO stage may hold a frame when the backend does not end
+ * its receive batches, e.g. because it hands over one frame at a time.
+ */
+#define VIRTIO_NET_GRO_DEFAULT_INTERVAL 50000 /* 50 us */
+
 #define VIRTIO_NET_RSS_SUPPORTED_HASHES (VIRTIO_NET_RSS_HASH_TYPE_IPv4 | \
                                          VIRTIO_NET_RSS_HASH_TYPE_TCPv4 | \
                                          VIRTIO_NET_RSS_HASH_TYPE_UDPv4 | \
@@ -352,11 +367,39 @@ static void virtio_net_vnet_endian_status(VirtIONet *n, uint8_t status)
     }
 }
 
+/*
+ * The datapath state is protected by the IOThread's AioContext when the
+ * device has one, and by the BQL otherwise.
+ */
+static void virtio_net_datapath_lock(VirtIONet *n)
+{
+    if (n->ctx) {
+        aio_context_acquire(n->ctx);
+    }
+}
+
+static void virtio_net_datapath_unlock(VirtIONet *n)
+{
+    if (n->ctx) {
+        aio_context_release(n->ctx);
+    }
+}
+
+/* Raise an interrupt for a datapath virtqueue, if necessary */
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    if (n->dataplane_started) {
+        virtio_notify_irqfd(VIRTIO_DEVICE(n), vq);
+    } else {
+        virtio_notify(VIRTIO_DEVICE(n), vq);
+    }
+}
+
 static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
     }
 }
 
@@ -370,6 +413,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
 
+    virtio_net_datapath_lock(n);
     for (i = 0; i < n->max_queue_pairs; i++) {
         NetClientState *ncs = qemu_get_subqueue(n->nic, i);
         bool queue_started;
@@ -415,18 +459,22 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+    virtio_net_datapath_unlock(n);
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
-    uint16_t old_status = n->status;
+    uint16_t old_status;
 
+    virtio_net_datapath_lock(n);
+    old_status = n->status;
     if (nc->link_down)
         n->status &= ~VIRTIO_NET_S_LINK_UP;
     else
         n->status |= VIRTIO_NET_S_LINK_UP;
+    virtio_net_datapath_unlock(n);
 
     if (n->status != old_status)
         virtio_notify_config(vdev);
@@ -566,6 +614,16 @@ static void virtio_net_reset(VirtIODevice *vdev)
             assert(!virtio_net_get_subqueue(nc)->async_tx.elem);
         }
     }
+
+    /* Drop whatever the GRO stage still holds */
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        if (q->gro) {
+            timer_del(q->gro_timer);
+            virtio_net_gro_purge(q->gro);
+        }
+    }
 }
 
 static void peer_test_vnet_hdr(VirtIONet *n)
@@ -695,6 +753,8 @@ static void virtio_net_set_queue_pairs(VirtIONet *n)
         return;
     }
 
+    /* tap_enable()/tap_disable() update the fd handlers in the IOThread */
+    virtio_net_datapath_lock(n);
     for (i = 0; i < n->max_queue_pairs; i++) {
         if (i < n->curr_queue_pairs) {
             r = peer_attach(n, i);
@@ -704,6 +764,7 @@ static void virtio_net_set_queue_pairs(VirtIONet *n)
             assert(!r);
         }
     }
+    virtio_net_datapath_unlock(n);
 }
 
 static void virtio_net_set_multiqueue(VirtIONet *n, int multiqueue);
@@ -725,9 +786,12 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO6);
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_ECN);
 
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
-        virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
+        /* The GRO stage builds large frames without help from the peer */
+        if (!n->net_conf.gro) {
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_CSUM);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO4);
+            virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_TSO6);
+        }
         virtio_clear_feature(&features, VIRTIO_NET_F_GUEST_ECN);
 
         virtio_clear_feature(&features, VIRTIO_NET_F_HASH_REPORT);
@@ -771,14 +835,44 @@ static uint64_t virtio_net_bad_features(VirtIODevice *vdev)
     return features;
 }
 
+/*
+ * Coalesce TCP in the GRO stage for the protocols the guest accepts large
+ * frames for.  RSC, when the guest asked for it, takes precedence, and
+ * per-frame hash reports are not supported on coalesced frames.
+ */
+static void virtio_net_update_gro(VirtIONet *n)
+{
+    uint64_t offloads = n->curr_guest_offloads;
+    bool allowed, tso4, tso6;
+    int i;
+
+    allowed = n->net_conf.gro && !n->rss_data.populate_hash &&
+              !n->rsc4_enabled && !n->rsc6_enabled &&
+              (offloads & (1ULL << VIRTIO_NET_F_GUEST_CSUM));
+    tso4 = allowed && (offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO4));
+    tso6 = allowed && (offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO6));
+
+    virtio_net_datapath_lock(n);
+    n->gro_enabled = tso4 || tso6;
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        if (n->vqs[i].gro) {
+            virtio_net_gro_set_offloads(n->vqs[i].gro, tso4, tso6);
+        }
+    }
+    virtio_net_datapath_unlock(n);
+}
+
 static void virtio_net_apply_guest_offloads(VirtIONet *n)
 {
-    qemu_set_offload(qemu_get_queue(n->nic)->peer,
+    if (n->has_vnet_hdr) {
+        qemu_set_offload(qemu_get_queue(n->nic)->peer,
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_CSUM)),
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO4)),
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_TSO6)),
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_ECN)),
             !!(n->curr_guest_offloads & (1ULL << VIRTIO_NET_F_GUEST_UFO)));
+    }
+    virtio_net_update_gro(n);
 }
 
 static uint64_t virtio_net_guest_offloads_by_features(uint32_t features)
@@ -904,7 +998,7 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         virtio_has_feature(features, VIRTIO_NET_F_GUEST_TSO6);
     n->rss_data.redirect = virtio_has_feature(features, VIRTIO_NET_F_RSS);
 
-    if (n->has_vnet_hdr) {
+    if (n->has_vnet_hdr || n->net_conf.gro) {
         n->curr_guest_offloads =
             virtio_net_guest_offloads_by_features(features);
         virtio_net_apply_guest_offloads(n);
@@ -993,7 +1087,7 @@ static int virtio_net_handle_offloads(VirtIONet *n, uint8_t cmd,
 
         offloads = virtio_ldq_p(vdev, &offloads);
 
-        if (!n->has_vnet_hdr) {
+        if (!n->has_vnet_hdr && !n->net_conf.gro) {
             return VIRTIO_NET_ERR;
         }
 
@@ -1190,22 +1284,35 @@ static void rss_data_to_rss_config(struct VirtioNetRssData *data,
     config->default_queue = data->default_queue;
 }
 
+/*
+ * Without the eBPF RSS object, e.g. when QEMU is built without libbpf,
+ * fall back to a steering program generated for the current configuration
+ * so that frames are still read from the tap queue they belong to.
+ */
 static bool virtio_net_attach_epbf_rss(VirtIONet *n)
 {
     struct EBPFRSSConfig config = {};
-
-    if (!ebpf_rss_is_loaded(&n->ebpf_rss)) {
-        return false;
-    }
+    int prog_fd;
 
     rss_data_to_rss_config(&n->rss_data, &config);
 
-    if (!ebpf_rss_set_all(&n->ebpf_rss, &config,
-                          n->rss_data.indirections_table, n->rss_data.key)) {
-        return false;
+    if (ebpf_rss_is_loaded(&n->ebpf_rss)) {
+        if (!ebpf_rss_set_all(&n->ebpf_rss, &config,
+                              n->rss_data.indirections_table,
+                              n->rss_data.key)) {
+            return false;
+        }
+        prog_fd = n->ebpf_rss.program_fd;
+    } else {
+        if (!rss_steering_set_all(&n->rss_steering, &config,
+                                  n->rss_data.indirections_table,
+                                  n->rss_data.key)) {
+            return false;
+        }
+        prog_fd = n->rss_steering.program_fd;
     }
 
-    if (!virtio_net_attach_ebpf_to_backend(n->nic, n->ebpf_rss.program_fd)) {
+    if (!virtio_net_attach_ebpf_to_backend(n->nic, prog_fd)) {
         return false;
     }
 
@@ -1231,6 +1338,7 @@ static void virtio_net_unload_ebpf(VirtIONet *n)
 {
     virtio_net_attach_ebpf_to_backend(n->nic, -1);
     ebpf_rss_unload(&n->ebpf_rss);
+    rss_steering_unload(&n->rss_steering);
 }
 
 static uint16_t virtio_net_handle_rss(VirtIONet *n,
@@ -1429,6 +1537,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
     struct iovec *iov, *iov2;
     unsigned int iov_cnt;
 
+    virtio_net_datapath_lock(n);
     for (;;) {
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
@@ -1438,7 +1547,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             iov_size(elem->out_sg, elem->out_num) < sizeof(ctrl)) {
             virtio_error(vdev, "virtio-net ctrl missing headers");
             virtqueue_detach_element(vq, elem, 0);
-            g_free(elem);
+            virtqueue_element_free(elem);
             break;
         }
 
@@ -1468,18 +1577,24 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
         virtqueue_push(vq, elem, sizeof(status));
         virtio_notify(vdev, vq);
         g_free(iov2);
-        g_free(elem);
+        virtqueue_element_free(elem);
     }
+    virtio_net_datapath_unlock(n);
 }
 
 /* RX */
 
+static void virtio_net_gro_flush_queue(VirtIONetQueue *q, bool timeout);
+
 static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
 
+    virtio_net_datapath_lock(n);
+    virtio_net_gro_flush_queue(&n->vqs[queue_index], false);
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
+    virtio_net_datapath_unlock(n);
 }
 
 static bool virtio_net_can_receive(NetClientState *nc)
@@ -1563,9 +1678,19 @@ static void work_around_broken_dhclient(struct virtio_net_hdr *hdr,
 }
 
 static void receive_header(VirtIONet *n, const struct iovec *iov, int iov_cnt,
+                           const struct virtio_net_hdr *hdr,
                            const void *buf, size_t size)
 {
-    if (n->has_vnet_hdr) {
+    if (hdr) {
+        VirtIODevice *vdev = VIRTIO_DEVICE(n);
+        struct virtio_net_hdr ghdr = *hdr;
+
+        virtio_tswap16s(vdev, &ghdr.hdr_len);
+        virtio_tswap16s(vdev, &ghdr.gso_size);
+        virtio_tswap16s(vdev, &ghdr.csum_start);
+        virtio_tswap16s(vdev, &ghdr.csum_offset);
+        iov_from_buf(iov, iov_cnt, 0, &ghdr, sizeof(ghdr));
+    } else if (n->has_vnet_hdr) {
         /* FIXME this cast is evil */
         void *wbuf = (void *)buf;
         work_around_broken_dhclient(wbuf, wbuf + n->host_hdr_len,
@@ -1594,8 +1719,6 @@ static int receive_filter(VirtIONet *n, const uint8_t *buf, int size)
     if (n->promisc)
         return 1;
 
-    ptr += n->host_hdr_len;
-
     if (!memcmp(&ptr[12], vlan, sizeof(vlan))) {
         int vid = lduw_be_p(ptr + 14) & 0xfff;
         if (!(n->vlans[vid >> 5] & (1U << (vid & 0x1f))))
@@ -1734,14 +1857,25 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     return (index == new_index) ? -1 : new_index;
 }
 
-static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
-                                      size_t size, bool no_rss)
+/*
+ * If @hdr is not NULL, @buf is a bare frame and @hdr, in host byte order,
+ * is the header the guest gets for it.
+ *
+ * If @pending is not NULL, the used elements are filled after the *@pending
+ * ones already filled by the caller, who is then responsible for flushing
+ * them and notifying the guest.
+ */
+static ssize_t virtio_net_receive_rcu(NetClientState *nc,
+                                      const struct virtio_net_hdr *hdr,
+                                      const uint8_t *buf, size_t size,
+                                      bool no_rss, unsigned int *pending)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    size_t host_hdr_len = hdr ? 0 : n->host_hdr_len;
     VirtQueueElement *elems[VIRTQUEUE_MAX_SIZE];
-    size_t lens[VIRTQUEUE_MAX_SIZE];
+    unsigned int lens[VIRTQUEUE_MAX_SIZE];
     struct iovec mhdr_sg[VIRTQUEUE_MAX_SIZE];
     struct virtio_net_hdr_mrg_rxbuf mhdr;
     unsigned mhdr_cnt = 0;
@@ -1756,16 +1890,16 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         int index = virtio_net_process_rss(nc, buf, size);
         if (index >= 0) {
             NetClientState *nc2 = qemu_get_subqueue(n->nic, index);
-            return virtio_net_receive_rcu(nc2, buf, size, true);
+            return virtio_net_receive_rcu(nc2, hdr, buf, size, true, NULL);
         }
     }
 
     /* hdr_len refers to the header we supply to the guest */
-    if (!virtio_net_has_buffers(q, size + n->guest_hdr_len - n->host_hdr_len)) {
+    if (!virtio_net_has_buffers(q, size + n->guest_hdr_len - host_hdr_len)) {
         return 0;
     }
 
-    if (!receive_filter(n, buf, size))
+    if (!receive_filter(n, buf + host_hdr_len, size - host_hdr_len))
         return size;
 
     offset = i = 0;
@@ -1802,7 +1936,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
             virtio_error(vdev,
                          "virtio-net receive queue contains no in buffers");
             virtqueue_detach_element(q->rx_vq, elem, 0);
-            g_free(elem);
+            virtqueue_element_free(elem);
             err = -1;
             goto err;
         }
@@ -1817,13 +1951,13 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                                     sizeof(mhdr.num_buffers));
             }
 
-            receive_header(n, sg, elem->in_num, buf, size);
-            if (n->rss_data.populate_hash) {
+            receive_header(n, sg, elem->in_num, hdr, buf, size);
+            if (n->rss_data.populate_hash && !hdr) {
                 offset = sizeof(mhdr);
                 iov_from_buf(sg, elem->in_num, offset,
                              buf + offset, n->host_hdr_len - sizeof(mhdr));
             }
-            offset = n->host_hdr_len;
+            offset = host_hdr_len;
             total += n->guest_hdr_len;
             guest_offset = n->guest_hdr_len;
         } else {
@@ -1840,7 +1974,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
          * Otherwise, drop it. */
         if (!n->mergeable_rx_bufs && offset < size) {
             virtqueue_unpop(q->rx_vq, elem, total);
-            g_free(elem);
+            virtqueue_element_free(elem);
             err = size;
             goto err;
         }
@@ -1857,21 +1991,26 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                      &mhdr.num_buffers, sizeof mhdr.num_buffers);
     }
 
-    for (j = 0; j < i; j++) {
+    if (pending) {
+        for (j = 0; j < i; j++) {
+            virtqueue_fill(q->rx_vq, elems[j], lens[j], *pending + j);
+        }
+        *pending += i;
+    } else {
         /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
-        g_free(elems[j]);
+        virtqueue_fill_batch(q->rx_vq, elems, lens, i);
+        virtio_net_notify(n, q->rx_vq);
+    }
+    for (j = 0; j < i; j++) {
+        virtqueue_element_free(elems[j]);
     }
-
-    virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
 
     return size;
 
 err:
     for (j = 0; j < i; j++) {
         virtqueue_detach_element(q->rx_vq, elems[j], lens[j]);
-        g_free(elems[j]);
+        virtqueue_element_free(elems[j]);
     }
 
     return err;
@@ -1882,7 +2021,93 @@ static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
 {
     RCU_READ_LOCK_GUARD();
 
-    return virtio_net_receive_rcu(nc, buf, size, false);
+    return virtio_net_receive_rcu(nc, NULL, buf, size, false, NULL);
+}
+
+static ssize_t virtio_net_gro_deliver(void *opaque,
+                                      const struct virtio_net_hdr *hdr,
+                                      const uint8_t *buf, size_t size)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+
+    return virtio_net_receive_rcu(nc, hdr, buf, size, true, q->gro_pending);
+}
+
+/* Hand over what the GRO stage of @q holds before newer frames */
+static void virtio_net_gro_flush_queue(VirtIONetQueue *q, bool timeout)
+{
+    if (q->gro && virtio_net_gro_pending(q->gro)) {
+        /*
+         * If the guest is out of buffers, the rest is flushed from
+         * virtio_net_handle_rx() once it adds more.
+         */
+        timer_del(q->gro_timer);
+        WITH_RCU_READ_LOCK_GUARD() {
+            virtio_net_gro_flush(q->gro, timeout);
+        }
+    }
+}
+
+static void virtio_net_gro_timer(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+
+    virtio_net_datapath_lock(q->n);
+    virtio_net_gro_flush_queue(q, true);
+    virtio_net_datapath_unlock(q->n);
+}
+
+static ssize_t virtio_net_gro_receive_rcu(NetClientState *nc,
+                                          const uint8_t *buf, size_t size,
+                                          bool no_rss)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    const struct virtio_net_hdr *hdr = NULL;
+    VirtIONetQueue *q;
+
+    if (!virtio_net_can_receive(nc)) {
+        return -1;
+    }
+
+    if (!no_rss && n->rss_data.enabled && n->rss_data.enabled_software_rss) {
+        int index = virtio_net_process_rss(nc, buf, size);
+        if (index >= 0) {
+            nc = qemu_get_subqueue(n->nic, index);
+        }
+    }
+
+    q = virtio_net_get_subqueue(nc);
+    if (size < n->host_hdr_len) {
+        return virtio_net_receive_rcu(nc, NULL, buf, size, true,
+                                      q->gro_pending);
+    }
+    if (n->host_hdr_len) {
+        hdr = (const struct virtio_net_hdr *)buf;
+    }
+
+    switch (virtio_net_gro_receive(q->gro, hdr, buf + n->host_hdr_len,
+                                   size - n->host_hdr_len)) {
+    case VIRTIO_NET_GRO_HELD:
+        if (!timer_pending(q->gro_timer)) {
+            timer_mod(q->gro_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                      n->net_conf.gro_interval);
+        }
+        return size;
+    case VIRTIO_NET_GRO_BLOCKED:
+        return 0;
+    default:
+        return virtio_net_receive_rcu(nc, NULL, buf, size, true,
+                                      q->gro_pending);
+    }
+}
+
+static ssize_t virtio_net_gro_do_receive(NetClientState *nc,
+                                         const uint8_t *buf, size_t size)
+{
+    RCU_READ_LOCK_GUARD();
+
+    return virtio_net_gro_receive_rcu(nc, buf, size, false);
 }
 
 static void virtio_net_rsc_extract_unit4(VirtioNetRscChain *chain,
@@ -2482,11 +2707,87 @@ static ssize_t virtio_net_receive(NetClientState *nc, const uint8_t *buf,
                                   size_t size)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
+    ssize_t ret;
+
+    virtio_net_datapath_lock(n);
     if ((n->rsc4_enabled || n->rsc6_enabled)) {
-        return virtio_net_rsc_receive(nc, buf, size);
+        ret = virtio_net_rsc_receive(nc, buf, size);
+    } else if (n->gro_enabled) {
+        ret = virtio_net_gro_do_receive(nc, buf, size);
     } else {
-        return virtio_net_do_receive(nc, buf, size);
+        ret = virtio_net_do_receive(nc, buf, size);
     }
+    virtio_net_datapath_unlock(n);
+    return ret;
+}
+
+/*
+ * Receive a batch of frames with a single used index update and a single
+ * guest notification.  RSC and software RSS need to look at each frame on
+ * its own, and fall back to one publish per frame.  The GRO stage is
+ * flushed at the end of each batch rather than waiting for its timer.
+ */
+static int virtio_net_receive_batch(NetClientState *nc,
+                                    const struct iovec *pkts, int count)
+{
+    VirtIONet *n = qemu_get_nic_opaque(nc);
+    VirtIONetQueue *q = virtio_net_get_subqueue(nc);
+    unsigned int pending = 0;
+    ssize_t ret;
+    int i, j;
+
+    virtio_net_datapath_lock(n);
+    if (n->rsc4_enabled || n->rsc6_enabled ||
+        (n->rss_data.enabled && n->rss_data.enabled_software_rss)) {
+        for (i = 0; i < count; i++) {
+            if (n->rsc4_enabled || n->rsc6_enabled) {
+                ret = virtio_net_rsc_receive(nc, pkts[i].iov_base,
+                                             pkts[i].iov_len);
+            } else if (n->gro_enabled) {
+                ret = virtio_net_gro_do_receive(nc, pkts[i].iov_base,
+                                                pkts[i].iov_len);
+            } else {
+                ret = virtio_net_do_receive(nc, pkts[i].iov_base,
+                                            pkts[i].iov_len);
+            }
+            if (ret == 0) {
+                break;
+            }
+        }
+        /* Software RSS may have spread the batch over all queues */
+        if (n->gro_enabled) {
+            for (j = 0; j < n->curr_queue_pairs; j++) {
+                virtio_net_gro_flush_queue(&n->vqs[j], false);
+            }
+        }
+    } else {
+        RCU_READ_LOCK_GUARD();
+
+        q->gro_pending = &pending;
+        for (i = 0; i < count; i++) {
+            if (n->gro_enabled) {
+                ret = virtio_net_gro_receive_rcu(nc, pkts[i].iov_base,
+                                                 pkts[i].iov_len, true);
+            } else {
+                ret = virtio_net_receive_rcu(nc, NULL, pkts[i].iov_base,
+                                             pkts[i].iov_len, true, &pending);
+            }
+            if (ret == 0) {
+                break;
+            }
+        }
+        if (n->gro_enabled) {
+            virtio_net_gro_flush_queue(q, false);
+        }
+        q->gro_pending = NULL;
+        if (pending) {
+            virtqueue_flush(q->rx_vq, pending);
+            virtio_net_notify(n, q->rx_vq);
+        }
+    }
+    virtio_net_datapath_unlock(n);
+
+    return i;
 }
 
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q);
@@ -2495,25 +2796,48 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
+    virtio_net_datapath_lock(n);
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
-    g_free(q->async_tx.elem);
+    virtqueue_element_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
 
     virtio_queue_set_notification(q->tx_vq, 1);
     virtio_net_flush_tx(q);
+    virtio_net_datapath_unlock(n);
 }
 
 /* TX */
+
+/* Complete sent packets with a single used index update and notification */
+static void virtio_net_tx_complete_batch(VirtIONetQueue *q,
+                                         VirtQueueElement **elems,
+                                         unsigned int count)
+{
+    static const unsigned int lens[VIRTIO_NET_TX_BATCH];
+    unsigned int i;
+
+    if (!count) {
+        return;
+    }
+
+    virtqueue_fill_batch(q->tx_vq, elems, lens, count);
+    virtio_net_notify(q->n, q->tx_vq);
+    for (i = 0; i < count; i++) {
+        virtqueue_element_free(elems[i]);
+    }
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
-    VirtQueueElement *elem;
+    VirtQueueElement *elems[VIRTIO_NET_TX_BATCH];
+    unsigned int i = 0, j, nb_elems = 0;
     int32_t num_packets = 0;
+    int32_t err;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
         return num_packets;
@@ -2525,32 +2849,42 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
     }
 
     for (;;) {
+        VirtQueueElement *elem;
         ssize_t ret;
         unsigned int out_num;
         struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
         struct virtio_net_hdr_mrg_rxbuf mhdr;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
-            break;
+        if (i == nb_elems) {
+            virtio_net_tx_complete_batch(q, elems, nb_elems);
+            i = nb_elems = 0;
+            if (num_packets >= n->tx_burst) {
+                break;
+            }
+            nb_elems = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                           (void **)elems,
+                                           MIN(ARRAY_SIZE(elems),
+                                               n->tx_burst - num_packets));
+            if (!nb_elems) {
+                break;
+            }
         }
+        elem = elems[i];
 
         out_num = elem->out_num;
         out_sg = elem->out_sg;
         if (out_num < 1) {
             virtio_error(vdev, "virtio-net header not in first element");
-            virtqueue_detach_element(q->tx_vq, elem, 0);
-            g_free(elem);
-            return -EINVAL;
+            err = -EINVAL;
+            goto fail;
         }
 
         if (n->has_vnet_hdr) {
             if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
                 n->guest_hdr_len) {
                 virtio_error(vdev, "virtio-net header incorrect");
-                virtqueue_detach_element(q->tx_vq, elem, 0);
-                g_free(elem);
-                return -EINVAL;
+                err = -EINVAL;
+                goto fail;
             }
             if (n->needs_vnet_hdr_swap) {
                 virtio_net_hdr_swap(vdev, (void *) &mhdr);
@@ -2588,19 +2922,32 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         if (ret == 0) {
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
-            return -EBUSY;
+            err = -EBUSY;
+            goto fail;
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
+        i++;
+        num_packets++;
+    }
+    return num_packets;
 
-        if (++num_packets >= n->tx_burst) {
-            break;
+fail:
+    /* elems[i] stopped the batch, the ones before it have been sent */
+    virtio_net_tx_complete_batch(q, elems, i);
+    if (err == -EBUSY) {
+        /* Let the next flush pop the rest again, newest first */
+        for (j = nb_elems; j-- > i + 1;) {
+            virtqueue_unpop(q->tx_vq, elems[j], 0);
+            virtqueue_element_free(elems[j]);
+        }
+    } else {
+        for (j = i; j < nb_elems; j++) {
+            virtqueue_detach_element(q->tx_vq, elems[j], 0);
+            virtqueue_element_free(elems[j]);
         }
     }
-    return num_packets;
+    return err;
 }
 
 static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
@@ -2634,7 +2981,7 @@ static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
-static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_net_handle_tx_bh_locked(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
@@ -2656,6 +3003,15 @@ static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
     qemu_bh_schedule(q->tx_bh);
 }
 
+static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+
+    virtio_net_datapath_lock(n);
+    virtio_net_handle_tx_bh_locked(vdev, vq);
+    virtio_net_datapath_unlock(n);
+}
+
 static void virtio_net_tx_timer(void *opaque)
 {
     VirtIONetQueue *q = opaque;
@@ -2679,9 +3035,8 @@ static void virtio_net_tx_timer(void *opaque)
     virtio_net_flush_tx(q);
 }
 
-static void virtio_net_tx_bh(void *opaque)
+static void virtio_net_tx_bh_locked(VirtIONetQueue *q)
 {
-    VirtIONetQueue *q = opaque;
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int32_t ret;
@@ -2728,12 +3083,24 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+static void virtio_net_tx_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+
+    virtio_net_datapath_lock(q->n);
+    virtio_net_tx_bh_locked(q);
+    virtio_net_datapath_unlock(q->n);
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
     n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
                                            virtio_net_handle_rx);
+    virtio_queue_enable_element_pool(n->vqs[index].rx_vq,
+                                     sizeof(VirtQueueElement),
+                                     VIRTIO_NET_ELEM_POOL_SG);
 
     if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
         n->vqs[index].tx_vq =
@@ -2749,6 +3116,18 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh, &n->vqs[index]);
     }
 
+    virtio_queue_enable_element_pool(n->vqs[index].tx_vq,
+                                     sizeof(VirtQueueElement),
+                                     VIRTIO_NET_ELEM_POOL_SG);
+
+    if (n->net_conf.gro) {
+        n->vqs[index].gro = virtio_net_gro_new(virtio_net_gro_deliver,
+                                               &n->vqs[index]);
+        n->vqs[index].gro_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                               virtio_net_gro_timer,
+                                               &n->vqs[index]);
+    }
+
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
 }
@@ -2771,6 +3150,13 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     }
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
+
+    if (q->gro) {
+        timer_free(q->gro_timer);
+        q->gro_timer = NULL;
+        virtio_net_gro_free(q->gro);
+        q->gro = NULL;
+    }
 }
 
 static void virtio_net_change_num_queue_pairs(VirtIONet *n, int new_max_queue_pairs)
@@ -2910,7 +3296,7 @@ static int virtio_net_post_load_virtio(VirtIODevice *vdev)
      * Restore it back and apply the desired offloads.
      */
     n->curr_guest_offloads = n->saved_guest_offloads;
-    if (peer_has_vnet_hdr(n)) {
+    if (peer_has_vnet_hdr(n) || n->net_conf.gro) {
         virtio_net_apply_guest_offloads(n);
     }
 
@@ -3162,6 +3548,7 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_batch = virtio_net_receive_batch,
     .link_status_changed = virtio_net_set_link_status,
     .query_rx_filter = virtio_net_query_rxfilter,
     .announce = virtio_net_announce,
@@ -3171,6 +3558,13 @@ static bool virtio_net_guest_notifier_pending(VirtIODevice *vdev, int idx)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     NetClientState *nc = qemu_get_subqueue(n->nic, vq2q(idx));
+
+    if (n->dataplane_started) {
+        VirtQueue *vq = virtio_get_queue(vdev, idx);
+
+        return event_notifier_test_and_clear(
+            virtio_queue_get_guest_notifier(vq));
+    }
     assert(n->vhost_started);
     return vhost_net_virtqueue_pending(get_vhost_net(nc->peer), idx);
 }
@@ -3185,6 +3579,209 @@ static void virtio_net_guest_notifier_mask(VirtIODevice *vdev, int idx,
                              vdev, idx, mask);
 }
 
+static int virtio_net_dataplane_queue_pairs(VirtIONet *n)
+{
+    return n->multiqueue ? n->max_queue_pairs : 1;
+}
+
+/* Context: BH in IOThread */
+static void virtio_net_dataplane_stop_bh(void *opaque)
+{
+    VirtIONet *n = opaque;
+    int i;
+
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        virtio_queue_aio_detach_host_notifier(q->rx_vq, n->ctx);
+        virtio_queue_aio_detach_host_notifier(q->tx_vq, n->ctx);
+
+        /* Nothing else runs the tx BH now, move it back to the main loop */
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = qemu_bh_new(virtio_net_tx_bh, q);
+        if (q->tx_waiting) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+    }
+}
+
+/*
+ * Move the rx/tx virtqueues and their backends into the IOThread.  The
+ * ioeventfds have already been set up for the main loop by
+ * virtio_device_start_ioeventfd_impl().
+ *
+ * Context: QEMU global mutex held
+ */
+static void virtio_net_dataplane_start(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = virtio_get_num_queues(vdev);
+    int i, r;
+
+    /* Filters hot-added after realize only run in the main loop */
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        if (nc->peer && !QTAILQ_EMPTY(&nc->peer->filters)) {
+            error_report("virtio-net: netdev '%s' has filters, "
+                         "falling back to the main loop", nc->peer->name);
+            return;
+        }
+    }
+
+    /* Guest notifier masking is only implemented by vhost */
+    vdev->use_guest_notifier_mask = false;
+    r = k->set_guest_notifiers(qbus->parent, nvqs, true);
+    if (r != 0) {
+        error_report("virtio-net failed to set guest notifier (%d), "
+                     "falling back to the main loop", r);
+        vdev->use_guest_notifier_mask = true;
+        return;
+    }
+
+    trace_virtio_net_data_plane_start(n);
+    n->dataplane_started = true;
+
+    aio_context_acquire(n->ctx);
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        nc->aio_context = n->ctx;
+        if (nc->peer && !n->nic->peer_deleted) {
+            qemu_set_net_aio_context(nc->peer, n->ctx);
+        }
+
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = aio_bh_new(n->ctx, virtio_net_tx_bh, q);
+        if (q->tx_waiting) {
+            qemu_bh_schedule(q->tx_bh);
+        }
+
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   NULL);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   NULL);
+        virtio_queue_aio_attach_host_notifier(q->rx_vq, n->ctx);
+        virtio_queue_aio_attach_host_notifier(q->tx_vq, n->ctx);
+
+        /* Kick right away to begin processing buffers already in vring */
+        event_notifier_set(virtio_queue_get_host_notifier(q->rx_vq));
+        event_notifier_set(virtio_queue_get_host_notifier(q->tx_vq));
+    }
+    aio_context_release(n->ctx);
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_net_dataplane_stop(VirtIONet *n)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    trace_virtio_net_data_plane_stop(n);
+
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        if (nc->peer) {
+            qemu_set_net_aio_context(nc->peer, NULL);
+        }
+        nc->aio_context = NULL;
+    }
+
+    aio_context_acquire(n->ctx);
+    aio_wait_bh_oneshot(n->ctx, virtio_net_dataplane_stop_bh, n);
+    aio_context_release(n->ctx);
+
+    /* Hand the ioeventfds back to virtio_device_stop_ioeventfd_impl() */
+    for (i = 0; i < virtio_net_dataplane_queue_pairs(n); i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   virtio_queue_host_notifier_read);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   virtio_queue_host_notifier_read);
+    }
+
+    n->dataplane_started = false;
+    k->set_guest_notifiers(qbus->parent, virtio_get_num_queues(vdev), false);
+    vdev->use_guest_notifier_mask = true;
+}
+
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    int r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r < 0) {
+        return r;
+    }
+
+    if (n->ctx && !n->vhost_started) {
+        virtio_net_dataplane_start(n);
+    }
+    return 0;
+}
+
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+
+    if (n->dataplane_started) {
+        virtio_net_dataplane_stop(n);
+    }
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
+/* Check that the datapath can leave the BQL and bind it to the IOThread */
+static bool virtio_net_dataplane_init(VirtIONet *n, Error **errp)
+{
+    BusState *qbus = qdev_get_parent_bus(DEVICE(n));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    if (!n->iothread) {
+        return true;
+    }
+
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp, "device is incompatible with iothread "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
+        error_setg(errp, "iothread requires tx=bh");
+        return false;
+    }
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT)) {
+        error_setg(errp, "iothread is incompatible with guest_rsc_ext");
+        return false;
+    }
+    for (i = 0; i < n->nic_conf.peers.queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (peer && !qemu_can_set_net_aio_context(peer)) {
+            error_setg(errp, "netdev '%s' does not support iothread",
+                       peer->name);
+            return false;
+        }
+        if (peer && !QTAILQ_EMPTY(&peer->filters)) {
+            error_setg(errp, "iothread is incompatible with filters on "
+                       "netdev '%s'", peer->name);
+            return false;
+        }
+    }
+
+    object_ref(OBJECT(n->iothread));
+    n->ctx = iothread_get_aio_context(n->iothread);
+    return true;
+}
+
 static void virtio_net_set_config_size(VirtIONet *n, uint64_t host_features)
 {
     virtio_add_feature(&host_features, VIRTIO_NET_F_MAC);
@@ -3455,6 +4052,13 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         error_printf("Defaulting to \"bh\"");
     }
 
+    if (!virtio_net_dataplane_init(n, errp)) {
+        g_free(n->vqs);
+        n->vqs = NULL;
+        virtio_cleanup(vdev);
+        return;
+    }
+
     n->net_conf.tx_queue_size = MIN(virtio_net_max_tx_queue_size(n),
                                     n->net_conf.tx_queue_size);
 
@@ -3567,9 +4171,39 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
     net_rx_pkt_uninit(n->rx_pkt);
+    if (n->iothread) {
+        object_unref(OBJECT(n->iothread));
+    }
     virtio_cleanup(vdev);
 }
 
+static void virtio_net_get_gro_stats(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    VirtIONet *n = VIRTIO_NET(obj);
+    VirtioNetGroInfo *info = g_new0(VirtioNetGroInfo, 1);
+    VirtioNetGroStatsList **tail = &info->queues;
+    int i;
+
+    virtio_net_datapath_lock(n);
+    for (i = 0; n->vqs && i < n->max_queue_pairs; i++) {
+        VirtioNetGroStats *stats;
+
+        if (!n->vqs[i].gro) {
+            continue;
+        }
+        stats = g_new0(VirtioNetGroStats, 1);
+        virtio_net_gro_get_stats(n->vqs[i].gro, stats);
+        stats->queue = i;
+        QAPI_LIST_APPEND(tail, stats);
+    }
+    virtio_net_datapath_unlock(n);
+
+    visit_type_VirtioNetGroInfo(v, name, &info, errp);
+    qapi_free_VirtioNetGroInfo(info);
+}
+
 static void virtio_net_instance_init(Object *obj)
 {
     VirtIONet *n = VIRTIO_NET(obj);
@@ -3584,6 +4218,10 @@ static void virtio_net_instance_init(Object *obj)
                                   DEVICE(n));
 
     ebpf_rss_init(&n->ebpf_rss);
+    rss_steering_init(&n->rss_steering);
+
+    object_property_add(obj, "gro-stats", "VirtioNetGroInfo",
+                        virtio_net_get_gro_stats, NULL, NULL, NULL);
 }
 
 static int virtio_net_pre_save(void *opaque)
@@ -3680,11 +4318,16 @@ static Property virtio_net_properties[] = {
                     VIRTIO_NET_F_RSC_EXT, false),
     DEFINE_PROP_UINT32("rsc_interval", VirtIONet, rsc_timeout,
                        VIRTIO_NET_RSC_DEFAULT_INTERVAL),
+    DEFINE_PROP_BOOL("gro", VirtIONet, net_conf.gro, false),
+    DEFINE_PROP_UINT32("gro_interval", VirtIONet, net_conf.gro_interval,
+                       VIRTIO_NET_GRO_DEFAULT_INTERVAL),
     DEFINE_NIC_PROPERTIES(VirtIONet, nic_conf),
     DEFINE_PROP_UINT32("x-txtimer", VirtIONet, net_conf.txtimer,
                        TX_TIMER_INTERVAL),
     DEFINE_PROP_INT32("x-txburst", VirtIONet, net_conf.txburst, TX_BURST),
     DEFINE_PROP_STRING("tx", VirtIONet, net_conf.tx),
+    DEFINE_PROP_LINK("iothread", VirtIONet, iothread, TYPE_IOTHREAD,
+                     IOThread *),
     DEFINE_PROP_UINT16("rx_queue_size", VirtIONet, net_conf.rx_queue_size,
                        VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE),
     DEFINE_PROP_UINT16("tx_queue_size", VirtIONet, net_conf.tx_queue_size,
@@ -3716,6 +4359,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->reset = virtio_net_reset;
     vdc->set_status = virtio_net_set_status;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
     vdc->post_load = virtio_net_post_load_virtio;
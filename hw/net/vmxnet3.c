@@ -609,6 +609,8 @@ vmxnet3_pop_next_tx_descr(VMXNET3State *s,
     return false;
 }
 
+static void vmxnet3_tx_sent(NetClientState *nc, ssize_t len);
+
 static bool
 vmxnet3_send_packet(VMXNET3State *s, uint32_t qidx)
 {
@@ -623,7 +625,8 @@ vmxnet3_send_packet(VMXNET3State *s, uint32_t qidx)
     vmxnet3_dump_virt_hdr(net_tx_pkt_get_vhdr(s->tx_pkt));
     net_tx_pkt_dump(s->tx_pkt);
 
-    if (!net_tx_pkt_send(s->tx_pkt, qemu_get_queue(s->nic))) {
+    if (!net_tx_pkt_send_async(s->tx_pkt, qemu_get_queue(s->nic),
+                               vmxnet3_tx_sent, &s->tx_busy)) {
         status = VMXNET3_PKT_STATUS_DISCARD;
         goto func_exit;
     }
@@ -640,7 +643,8 @@ static void vmxnet3_process_tx_queue(VMXNET3State *s, int qidx)
     uint32_t data_len;
     hwaddr data_pa;
 
-    for (;;) {
+    /* Resumed from vmxnet3_tx_sent() once the backend drains */
+    while (!s->tx_busy) {
         if (!vmxnet3_pop_next_tx_descr(s, qidx, &txd, &txd_idx)) {
             break;
         }
@@ -683,6 +687,26 @@ static void vmxnet3_process_tx_queue(VMXNET3State *s, int qidx)
     }
 }
 
+static void vmxnet3_tx_sent(NetClientState *nc, ssize_t len)
+{
+    VMXNET3State *s = qemu_get_nic_opaque(nc);
+    int i;
+
+    if (!s->tx_busy) {
+        return;
+    }
+
+    s->tx_busy = false;
+
+    if (!s->device_active) {
+        return;
+    }
+
+    for (i = 0; i < s->txq_num; i++) {
+        vmxnet3_process_tx_queue(s, i);
+    }
+}
+
 static inline void
 vmxnet3_read_next_rx_descr(VMXNET3State *s, int qidx, int ridx,
                            struct Vmxnet3_RxDesc *dbuf, uint32_t *didx)
@@ -1177,6 +1201,7 @@ static void vmxnet3_reset(VMXNET3State *s)
     s->drv_shmem = 0;
     s->tx_sop = true;
     s->skip_current_tx_pkt = false;
+    s->tx_busy = false;
 }
 
 static void vmxnet3_update_rx_mode(VMXNET3State *s)
@@ -2085,6 +2110,7 @@ static void vmxnet3_net_init(VMXNET3State *s)
     s->peer_has_vhdr = vmxnet3_peer_has_vnet_hdr(s);
     s->tx_sop = true;
     s->skip_current_tx_pkt = false;
+    s->tx_busy = false;
     s->tx_pkt = NULL;
     s->rx_pkt = NULL;
     s->rx_vlan_stripping = false;
@@ -116,6 +116,7 @@ struct VMXNET3State {
 
         bool tx_sop;
         bool skip_current_tx_pkt;
+        bool tx_busy;
 
         uint32_t device_active;
         uint32_t last_command;
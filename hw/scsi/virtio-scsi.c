@@ -29,6 +29,9 @@
 #include "hw/virtio/virtio-access.h"
 #include "trace.h"
 
+/* Command requests with up to this many segments use the element pool */
+#define VIRTIO_SCSI_ELEM_POOL_SG 34
+
 static inline int virtio_scsi_get_lun(uint8_t *lun)
 {
     return ((lun[2] << 8) | lun[3]) & 0x3FFF;
@@ -62,7 +65,7 @@ void virtio_scsi_free_req(VirtIOSCSIReq *req)
 {
     qemu_iovec_destroy(&req->resp_iov);
     qemu_sglist_destroy(&req->qsgl);
-    g_free(req);
+    virtqueue_element_free(&req->elem);
 }
 
 static void virtio_scsi_complete_req(VirtIOSCSIReq *req)
@@ -1000,6 +1003,10 @@ void virtio_scsi_common_realize(DeviceState *dev,
     s->event_vq = virtio_add_queue(vdev, s->conf.virtqueue_size, evt);
     for (i = 0; i < s->conf.num_queues; i++) {
         s->cmd_vqs[i] = virtio_add_queue(vdev, s->conf.virtqueue_size, cmd);
+        virtio_queue_enable_element_pool(s->cmd_vqs[i],
+                                         sizeof(VirtIOSCSIReq) +
+                                         VIRTIO_SCSI_CDB_DEFAULT_SIZE,
+                                         VIRTIO_SCSI_ELEM_POOL_SG);
     }
 }
 
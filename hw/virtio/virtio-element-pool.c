@@ -0,0 +1,121 @@
+/*
+ * Virtqueue element pools
+ *
+ * Device models pop and complete a descriptor chain for every request, so
+ * the element allocation is on the hot path.  The sizes of the elements are
+ * dominated by the device's request struct and vary only with the number of
+ * scatter/gather entries, which makes them easy to recycle.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include "qemu/thread.h"
+#include "hw/virtio/virtio-element-pool.h"
+
+typedef struct VirtQueueElementSlot {
+    struct VirtQueueElementSlot *next;
+} VirtQueueElementSlot;
+
+struct VirtQueueElementPool {
+    /* Protects the free list; slots can be freed from any thread */
+    QemuSpin lock;
+    VirtQueueElementSlot *free_list;
+    unsigned int nr_free;
+    unsigned int max_free;
+    size_t slot_size;
+    bool dead;
+
+    /* One reference for the owner plus one for every slot in use */
+    unsigned int refcnt;
+};
+
+VirtQueueElementPool *virtqueue_element_pool_new(size_t slot_size,
+                                                 unsigned int max_free)
+{
+    VirtQueueElementPool *pool = g_new0(VirtQueueElementPool, 1);
+
+    assert(slot_size >= sizeof(VirtQueueElementSlot));
+    qemu_spin_init(&pool->lock);
+    pool->slot_size = slot_size;
+    pool->max_free = max_free;
+    pool->refcnt = 1;
+    return pool;
+}
+
+static void virtqueue_element_pool_drain(VirtQueueElementPool *pool)
+{
+    VirtQueueElementSlot *slot, *next;
+
+    qemu_spin_lock(&pool->lock);
+    slot = pool->free_list;
+    pool->free_list = NULL;
+    pool->nr_free = 0;
+    qemu_spin_unlock(&pool->lock);
+
+    for (; slot; slot = next) {
+        next = slot->next;
+        g_free(slot);
+    }
+}
+
+static void virtqueue_element_pool_put(VirtQueueElementPool *pool)
+{
+    if (qatomic_fetch_dec(&pool->refcnt) == 1) {
+        virtqueue_element_pool_drain(pool);
+        g_free(pool);
+    }
+}
+
+void *virtqueue_element_pool_alloc(VirtQueueElementPool *pool, size_t size)
+{
+    VirtQueueElementSlot *slot;
+
+    if (size > pool->slot_size) {
+        return NULL;
+    }
+
+    qemu_spin_lock(&pool->lock);
+    slot = pool->free_list;
+    if (slot) {
+        pool->free_list = slot->next;
+        pool->nr_free--;
+    }
+    qemu_spin_unlock(&pool->lock);
+
+    if (!slot) {
+        slot = g_malloc(pool->slot_size);
+    }
+    qatomic_inc(&pool->refcnt);
+    return slot;
+}
+
+void virtqueue_element_pool_free(VirtQueueElementPool *pool, void *p)
+{
+    VirtQueueElementSlot *slot = p;
+
+    qemu_spin_lock(&pool->lock);
+    if (!pool->dead && pool->nr_free < pool->max_free) {
+        slot->next = pool->free_list;
+        pool->free_list = slot;
+        pool->nr_free++;
+        slot = NULL;
+    }
+    qemu_spin_unlock(&pool->lock);
+
+    g_free(slot);
+    virtqueue_element_pool_put(pool);
+}
+
+void virtqueue_element_pool_unref(VirtQueueElementPool *pool)
+{
+    qemu_spin_lock(&pool->lock);
+    pool->dead = true;
+    qemu_spin_unlock(&pool->lock);
+
+    virtqueue_element_pool_drain(pool);
+    virtqueue_element_pool_put(pool);
+}
@@ -123,6 +123,9 @@ struct VirtQueue
 
     unsigned int inuse;
 
+    /* Recycled elements, see virtio_queue_enable_element_pool() */
+    VirtQueueElementPool *elem_pool;
+
     uint16_t vector;
     VirtIOHandleOutput handle_output;
     VirtIODevice *vdev;
@@ -726,9 +729,9 @@ static void virtqueue_packed_rewind(VirtQueue *vq, unsigned int num)
 void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
                      unsigned int len)
 {
-
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        virtqueue_packed_rewind(vq, 1);
+        /* Chains that are not indirect take up one slot per descriptor */
+        virtqueue_packed_rewind(vq, elem->ndescs);
     } else {
         virtqueue_split_rewind(vq, 1);
     }
@@ -910,6 +913,27 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     virtqueue_flush(vq, 1);
 }
 
+/*
+ * Fill the used ring with @count elements and their lengths, then publish
+ * them all with a single barrier and used index update.  The caller still
+ * decides whether to notify the guest, once for the whole batch.
+ */
+void virtqueue_fill_batch(VirtQueue *vq, VirtQueueElement *const *elems,
+                          const unsigned int *lens, unsigned int count)
+{
+    unsigned int i;
+
+    if (!count) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < count; i++) {
+        virtqueue_fill(vq, elems[i], lens[i], i);
+    }
+    virtqueue_flush(vq, count);
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -1376,7 +1400,8 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
                                                                         false);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+static size_t virtqueue_element_size(size_t sz, unsigned out_num,
+                                     unsigned in_num)
 {
     VirtQueueElement *elem;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
@@ -1384,11 +1409,33 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
     size_t in_sg_ofs = QEMU_ALIGN_UP(out_addr_end, __alignof__(elem->in_sg[0]));
     size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
-    size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
+
+    return out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
+}
+
+static void *virtqueue_alloc_element(VirtQueue *vq, size_t sz,
+                                     unsigned out_num, unsigned in_num)
+{
+    VirtQueueElement *elem = NULL;
+    VirtQueueElementPool *pool = vq ? vq->elem_pool : NULL;
+    size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
+    size_t out_addr_ofs = in_addr_ofs + in_num * sizeof(elem->in_addr[0]);
+    size_t out_addr_end = out_addr_ofs + out_num * sizeof(elem->out_addr[0]);
+    size_t in_sg_ofs = QEMU_ALIGN_UP(out_addr_end, __alignof__(elem->in_sg[0]));
+    size_t out_sg_ofs = in_sg_ofs + in_num * sizeof(elem->in_sg[0]);
+    size_t out_sg_end = virtqueue_element_size(sz, out_num, in_num);
 
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    if (pool) {
+        elem = virtqueue_element_pool_alloc(pool, out_sg_end);
+    }
+    if (!elem) {
+        /* Too many descriptors for a pool slot */
+        pool = NULL;
+        elem = g_malloc(out_sg_end);
+    }
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
+    elem->pool = pool;
     elem->out_num = out_num;
     elem->in_num = in_num;
     elem->in_addr = (void *)elem + in_addr_ofs;
@@ -1398,10 +1445,15 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/*
+ * Called within rcu_read_lock(), after the caller has made sure that the
+ * avail ring has a head at vq->last_avail_idx.  The caller also updates
+ * the avail event.
+ */
+static void *virtqueue_split_pop_head(VirtQueue *vq, size_t sz,
+                                      VRingMemoryRegionCaches *caches)
 {
     unsigned int i, head, max;
-    VRingMemoryRegionCaches *caches;
     MemoryRegionCache indirect_desc_cache = MEMORY_REGION_CACHE_INVALID;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1413,14 +1465,6 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     VRingDesc desc;
     int rc;
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
@@ -1435,18 +1479,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
     if (caches->desc.len < max * sizeof(VRingDesc)) {
         virtio_error(vdev, "Cannot map descriptor ring");
         goto done;
@@ -1510,7 +1544,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     elem->index = head;
     elem->ndescs = 1;
     for (i = 0; i < out_num; i++) {
@@ -1535,6 +1569,76 @@ err_undo_map:
     goto done;
 }
 
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+{
+    VRingMemoryRegionCaches *caches;
+    void *elem;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_empty_rcu(vq)) {
+        return NULL;
+    }
+    /* Needed after virtio_queue_empty(), see comment in
+     * virtqueue_num_heads(). */
+    smp_rmb();
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        virtio_error(vq->vdev, "Region caches not initialized");
+        return NULL;
+    }
+
+    elem = virtqueue_split_pop_head(vq, sz, caches);
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return elem;
+}
+
+/*
+ * Read the avail index and the region caches once for the whole batch,
+ * and only move the avail event after the last head.
+ */
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
+{
+    VRingMemoryRegionCaches *caches;
+    unsigned int n = 0;
+    int num_heads;
+
+    RCU_READ_LOCK_GUARD();
+    if (unlikely(!vq->vring.avail)) {
+        return 0;
+    }
+
+    /* Also orders the descriptor reads after the avail index read */
+    num_heads = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (num_heads <= 0) {
+        return 0;
+    }
+
+    caches = vring_get_region_caches(vq);
+    if (!caches) {
+        virtio_error(vq->vdev, "Region caches not initialized");
+        return 0;
+    }
+
+    max = MIN(max, num_heads);
+    while (n < max) {
+        elems[n] = virtqueue_split_pop_head(vq, sz, caches);
+        if (!elems[n]) {
+            break;
+        }
+        n++;
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return n;
+}
+
 static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 {
     unsigned int i, max;
@@ -1636,7 +1740,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(vq, sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1683,6 +1787,63 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 }
 
+/*
+ * Pop up to @max elements of size @sz into @elems and return how many were
+ * popped.  This is equivalent to calling virtqueue_pop() in a loop, but
+ * for split rings the avail index, the region caches and the avail event
+ * are only accessed once per batch.
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int n = 0;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
+    }
+
+    RCU_READ_LOCK_GUARD();
+    while (n < max) {
+        elems[n] = virtqueue_packed_pop(vq, sz);
+        if (!elems[n]) {
+            break;
+        }
+        n++;
+    }
+    return n;
+}
+
+/*
+ * Recycle the elements that virtqueue_pop(vq, sz) returns instead of
+ * allocating a new one for every descriptor chain.  Up to one element per
+ * queue entry is cached; chains with more than @max_sg descriptors are
+ * still allocated individually.
+ *
+ * The device model must free all elements popped from @vq with
+ * virtqueue_element_free().
+ */
+void virtio_queue_enable_element_pool(VirtQueue *vq, size_t sz,
+                                      unsigned int max_sg)
+{
+    assert(!vq->elem_pool && vq->vring.num_default);
+    vq->elem_pool =
+        virtqueue_element_pool_new(virtqueue_element_size(sz, max_sg, 0),
+                                   vq->vring.num_default);
+}
+
+void virtqueue_element_free(VirtQueueElement *elem)
+{
+    if (elem && elem->pool) {
+        virtqueue_element_pool_free(elem->pool, elem);
+    } else {
+        g_free(elem);
+    }
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -1818,7 +1979,7 @@ void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz)
     assert(ARRAY_SIZE(data.in_addr) >= data.in_num);
     assert(ARRAY_SIZE(data.out_addr) >= data.out_num);
 
-    elem = virtqueue_alloc_element(sz, data.out_num, data.in_num);
+    elem = virtqueue_alloc_element(NULL, sz, data.out_num, data.in_num);
     elem->index = data.index;
 
     for (i = 0; i < elem->in_num; i++) {
@@ -2392,6 +2553,10 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    if (vq->elem_pool) {
+        virtqueue_element_pool_unref(vq->elem_pool);
+        vq->elem_pool = NULL;
+    }
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -3688,7 +3853,7 @@ static Property virtio_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -3758,7 +3923,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
@@ -119,5 +119,7 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+uint64_t block_latency_histogram_percentile(const BlockLatencyHistogram *hist,
+                                            double percentile);
 
 #endif
@@ -39,6 +39,13 @@ struct AioTask {
 AioTaskPool *coroutine_fn aio_task_pool_new(int max_busy_tasks);
 void aio_task_pool_free(AioTaskPool *);
 
+/*
+ * Change the number of tasks that may run in parallel. Lowering the limit
+ * does not affect running tasks, but new ones are only started once enough
+ * of them have finished.
+ */
+void aio_task_pool_set_max_busy_tasks(AioTaskPool *pool, int max_busy_tasks);
+
 /* error code of failed task or 0 if all is OK */
 int aio_task_pool_status(AioTaskPool *pool);
 
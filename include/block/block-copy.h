@@ -31,6 +31,8 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
 /* Function should be called prior any actual copy request */
 void block_copy_set_copy_opts(BlockCopyState *s, bool use_copy_range,
                               bool compress);
+/* Whether source and target can both handle copy offloading */
+bool block_copy_copy_range_supported(BlockCopyState *s);
 void block_copy_set_progress_meter(BlockCopyState *s, ProgressMeter *pm);
 
 void block_copy_state_free(BlockCopyState *s);
@@ -93,6 +95,8 @@ void block_copy_call_cancel(BlockCopyCallState *call_state);
 
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
+/* Copy rate measured over the last tuning interval, in bytes per second */
+uint64_t block_copy_throughput(BlockCopyState *s);
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
 
 #endif /* BLOCK_COPY_H */
@@ -226,6 +226,21 @@ int coroutine_fn bdrv_co_copy_range(BdrvChild *src, int64_t src_offset,
                                     int64_t bytes, BdrvRequestFlags read_flags,
                                     BdrvRequestFlags write_flags);
 
+/**
+ * bdrv_get_host_fd:
+ *
+ * Return a host file descriptor that holds the data of @bs at the same
+ * offsets, so that callers may read from it directly (e.g. with sendfile(2)).
+ * Only a plain file-posix node provides one, possibly below raw nodes
+ * without offset or size; any other node in the chain (filters, formats
+ * with metadata, encryption, copy-on-read, ...) makes this fail.
+ *
+ * The caller must keep @bs in flight for as long as it uses the descriptor.
+ *
+ * Returns: the descriptor on success; -ENOTSUP or -ENOMEDIUM otherwise.
+ **/
+int bdrv_get_host_fd(BlockDriverState *bs);
+
 /**
  * bdrv_drained_end_no_poll:
  *
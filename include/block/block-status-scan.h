@@ -0,0 +1,61 @@
+/*
+ * Parallel block status scanning
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef BLOCK_STATUS_SCAN_H
+#define BLOCK_STATUS_SCAN_H
+
+#include "block/block.h"
+
+typedef struct BlockStatusScan BlockStatusScan;
+
+typedef struct BlockStatusExtent {
+    int64_t offset;
+    int64_t bytes;
+    int status;                 /* BDRV_BLOCK_* flags */
+    int64_t map;                /* valid if BDRV_BLOCK_OFFSET_VALID is set */
+    BlockDriverState *file;
+    int depth;
+} BlockStatusExtent;
+
+/*
+ * Query the status of [@offset, @offset + @bytes) and fill in @ext for a
+ * non-empty prefix of it.  Called in coroutine context; several calls for
+ * different ranges run concurrently.  Return 0 on success, -errno on error.
+ */
+typedef int coroutine_fn (*BlockStatusScanFunc)(void *opaque, int64_t offset,
+                                                int64_t bytes,
+                                                BlockStatusExtent *ext);
+
+/* Number of concurrent queries that the tools and jobs use by default */
+#define BLOCK_STATUS_SCAN_DEFAULT_WORKERS 8
+
+/*
+ * Start scanning [@offset, @offset + @bytes) of @bs with up to @max_workers
+ * concurrent queries.  Without @func, the status is that of
+ * bdrv_block_status_above() (or bdrv_is_allocated_above(), depending on
+ * @include_base and @want_zero) for the chain between @bs and @base.
+ */
+BlockStatusScan *block_status_scan_new(BlockDriverState *bs,
+                                       BlockDriverState *base,
+                                       bool include_base, bool want_zero,
+                                       int64_t offset, int64_t bytes,
+                                       int max_workers,
+                                       BlockStatusScanFunc func, void *opaque);
+
+/*
+ * Return the status at @offset in @ext, merged with the following extents of
+ * the same status that are already known.  @ext->offset is @offset.  Offsets
+ * must not decrease between calls.  May poll or yield until the result is
+ * available.  Return 0 on success, -errno if the query failed.
+ */
+int block_status_scan_get(BlockStatusScan *scan, int64_t offset,
+                          BlockStatusExtent *ext);
+
+/* Stop the scan and free it; waits for queries in flight */
+void block_status_scan_free(BlockStatusScan *scan);
+
+#endif /* BLOCK_STATUS_SCAN_H */
@@ -568,6 +568,14 @@ struct BlockDriver {
                                               BdrvRequestFlags read_flags,
                                               BdrvRequestFlags write_flags);
 
+    /*
+     * Return a host file descriptor from which the guest-visible data of
+     * @bs can be read directly, at the same offsets, or -ENOTSUP.  Only
+     * drivers that pass data through unmodified may implement this.  The
+     * descriptor remains owned by the driver.
+     */
+    int (*bdrv_get_host_fd)(BlockDriverState *bs);
+
     /*
      * Building block for bdrv_block_status[_above] and
      * bdrv_is_allocated[_above].  The driver should answer only
@@ -997,6 +1005,23 @@ typedef struct BdrvBlockStatusCache {
     int64_t data_end;
 } BdrvBlockStatusCache;
 
+/*
+ * Remembers which layer of a read-only backing chain owns each range, so
+ * that block status queries and reads need not descend layer by layer.
+ * Entries are dropped whenever the global generation changes, i.e. on
+ * graph changes and reopens.
+ *
+ * @lock: Protects the other fields
+ * @generation: Value of the global generation the entries belong to
+ * @entries: BdrvChainCacheEntry arrays sorted by offset, indexed by the
+ *           @want_zero parameter of the queries that filled them
+ */
+typedef struct BdrvChainCache {
+    QemuMutex lock;
+    unsigned int generation;
+    GArray *entries[2];
+} BdrvChainCache;
+
 struct BlockDriverState {
     /*
      * Protected by big QEMU lock or read-only after opening.  No special
@@ -1182,6 +1207,9 @@ struct BlockDriverState {
     CoMutex bsc_modify_lock;
     /* Always non-NULL, but must only be dereferenced under an RCU read guard */
     BdrvBlockStatusCache *block_status_cache;
+
+    /* Only with the chain-cache option */
+    BdrvChainCache *chain_cache;
 };
 
 struct BlockBackendRootState {
@@ -179,6 +179,29 @@ void bdrv_bsc_invalidate_range(BlockDriverState *bs,
  */
 void bdrv_bsc_fill(BlockDriverState *bs, int64_t offset, int64_t bytes);
 
+/**
+ * Look up which layer of the backing chain starting at @bs owns @offset,
+ * i.e. is the first one to report it as allocated, or is the last layer.
+ *
+ * On a hit, return that layer, set *pnum to how many bytes from @offset
+ * (at most @bytes) it owns, *skip to the number of layers between @bs and
+ * it, and *child (if not NULL) to the child that leads to it, which is
+ * NULL if it is @bs itself.  Return NULL on a miss.
+ */
+BlockDriverState *bdrv_chain_cache_lookup(BlockDriverState *bs,
+                                          bool want_zero, int64_t offset,
+                                          int64_t bytes, int64_t *pnum,
+                                          int *skip, BdrvChild **child);
+
+/**
+ * Record that @target, @skip layers below @bs, owns [offset, offset +
+ * bytes) in the backing chain starting at @bs.  Nothing is recorded
+ * unless all layers down to @target are read-only non-filter nodes.
+ */
+void bdrv_chain_cache_insert(BlockDriverState *bs, bool want_zero,
+                             int64_t offset, int64_t bytes,
+                             BlockDriverState *target, int skip);
+
 
 /*
  * "I/O or GS" API functions. These functions can run without
@@ -66,6 +66,11 @@ LuringState *luring_init(Error **errp);
 void luring_cleanup(LuringState *s);
 int coroutine_fn luring_co_submit(BlockDriverState *bs, LuringState *s, int fd,
                                 uint64_t offset, QEMUIOVector *qiov, int type);
+/* Submit fallocate(@fd, @mode, @offset, @bytes) for a discard or write zeroes */
+int coroutine_fn luring_co_submit_fallocate(BlockDriverState *bs,
+                                            LuringState *s, int fd, int type,
+                                            int mode, uint64_t offset,
+                                            uint64_t bytes);
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 void luring_io_plug(BlockDriverState *bs, LuringState *s);
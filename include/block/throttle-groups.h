@@ -29,6 +29,17 @@
 #include "block/block_int.h"
 #include "qom/object.h"
 
+/* Bytes and operations that a ThrottleGroupMember may use without going
+ * through the group, see throttle_group_spend_credit().
+ */
+typedef struct ThrottleGroupCredit {
+    uint64_t bytes;
+    double units;
+    uint64_t op_size;
+    int64_t expiry;
+    unsigned generation;
+} ThrottleGroupCredit;
+
 /* The ThrottleGroupMember structure indicates membership in a ThrottleGroup
  * and holds related data.
  */
@@ -57,6 +68,10 @@ typedef struct ThrottleGroupMember {
     unsigned       pending_reqs[2];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
+    /* Handed out under the ThrottleGroup lock, but spent without it in
+     * aio_context.  Only used if the group has a credit period. */
+    ThrottleGroupCredit credit[2];
+
 } ThrottleGroupMember;
 
 #define TYPE_THROTTLE_GROUP "throttle-group"
@@ -0,0 +1,56 @@
+/*
+ * Virtqueue element pools
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#ifndef QEMU_VIRTIO_ELEMENT_POOL_H
+#define QEMU_VIRTIO_ELEMENT_POOL_H
+
+typedef struct VirtQueueElementPool VirtQueueElementPool;
+
+/**
+ * virtqueue_element_pool_new:
+ * @slot_size: size of each cached allocation
+ * @max_free: maximum number of freed slots kept for reuse
+ *
+ * Create a pool that recycles fixed-size allocations instead of returning
+ * them to the system allocator.  The pool starts out empty; slots are
+ * allocated on demand and at most @max_free of them are cached once they
+ * are freed.
+ */
+VirtQueueElementPool *virtqueue_element_pool_new(size_t slot_size,
+                                                 unsigned int max_free);
+
+/**
+ * virtqueue_element_pool_alloc:
+ * @pool: the pool
+ * @size: number of bytes needed
+ *
+ * Returns: an allocation of at least @size bytes that must be returned
+ * with virtqueue_element_pool_free(), or NULL if @size does not fit in
+ * a slot.
+ */
+void *virtqueue_element_pool_alloc(VirtQueueElementPool *pool, size_t size);
+
+/**
+ * virtqueue_element_pool_free:
+ * @pool: the pool that @p was allocated from
+ * @p: the allocation
+ *
+ * Return @p to @pool.  This may be called from any thread.
+ */
+void virtqueue_element_pool_free(VirtQueueElementPool *pool, void *p);
+
+/**
+ * virtqueue_element_pool_unref:
+ * @pool: the pool
+ *
+ * Drop the owner's reference to @pool.  Slots that are still in use stay
+ * valid; the pool is destroyed when the last of them is freed.
+ */
+void virtqueue_element_pool_unref(VirtQueueElementPool *pool);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+ * Generic receive offload for virtio-net
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef QEMU_VIRTIO_NET_GRO_H
+#define QEMU_VIRTIO_NET_GRO_H
+
+#include "qapi/qapi-types-net.h"
+#include "standard-headers/linux/virtio_net.h"
+
+typedef struct VirtioNetGro VirtioNetGro;
+
+typedef enum {
+    VIRTIO_NET_GRO_BYPASS,      /* Not held, deliver the frame as usual */
+    VIRTIO_NET_GRO_HELD,        /* Held for coalescing */
+    VIRTIO_NET_GRO_BLOCKED,     /* Older data could not be delivered */
+} VirtioNetGroResult;
+
+/*
+ * Deliver a frame with the header the guest should see.  @hdr is in host
+ * byte order.  Returns like NetReceive: 0 if the guest has no room yet.
+ */
+typedef ssize_t (VirtioNetGroDeliver)(void *opaque,
+                                      const struct virtio_net_hdr *hdr,
+                                      const uint8_t *buf, size_t size);
+
+VirtioNetGro *virtio_net_gro_new(VirtioNetGroDeliver *deliver, void *opaque);
+void virtio_net_gro_free(VirtioNetGro *gro);
+
+/*
+ * Select which of TCPv4 and TCPv6 may be coalesced.  Frames held for a
+ * protocol that is turned off are dropped.
+ */
+void virtio_net_gro_set_offloads(VirtioNetGro *gro, bool tso4, bool tso6);
+
+/*
+ * Offer a frame to the GRO stage.  @hdr is the header supplied by the
+ * backend, or NULL if it has none.
+ */
+VirtioNetGroResult virtio_net_gro_receive(VirtioNetGro *gro,
+                                          const struct virtio_net_hdr *hdr,
+                                          const uint8_t *buf, size_t size);
+
+/*
+ * Deliver all held frames in arrival order.  Returns false if the guest
+ * ran out of buffers; what is left stays held.
+ */
+bool virtio_net_gro_flush(VirtioNetGro *gro, bool timeout);
+void virtio_net_gro_purge(VirtioNetGro *gro);
+bool virtio_net_gro_pending(VirtioNetGro *gro);
+void virtio_net_gro_get_stats(VirtioNetGro *gro, VirtioNetGroStats *stats);
+
+#endif
@@ -20,8 +20,11 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
 
 #include "ebpf/ebpf_rss.h"
+#include "ebpf/rss_steering.h"
+#include "hw/virtio/virtio-net-gro.h"
 
 #define TYPE_VIRTIO_NET "virtio-net-device"
 OBJECT_DECLARE_SIMPLE_TYPE(VirtIONet, VIRTIO_NET)
@@ -47,6 +50,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    bool gro;
+    uint32_t gro_interval;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -151,6 +156,10 @@ typedef struct VirtIONetQueue {
     struct {
         VirtQueueElement *elem;
     } async_tx;
+    VirtioNetGro *gro;
+    QEMUTimer *gro_timer;
+    /* Used elements filled but not yet flushed by the current rx batch */
+    unsigned int *gro_pending;
     struct VirtIONet *n;
 } VirtIONetQueue;
 
@@ -173,6 +182,8 @@ struct VirtIONet {
     uint32_t rsc_timeout;
     uint8_t rsc4_enabled;
     uint8_t rsc6_enabled;
+    /* TCP coalescing is done by the GRO stage for at least one protocol */
+    bool gro_enabled;
     uint8_t has_ufo;
     uint32_t mergeable_rx_bufs;
     uint8_t promisc;
@@ -216,6 +227,15 @@ struct VirtIONet {
     VirtioNetRssData rss_data;
     struct NetRxPkt *rx_pkt;
     struct EBPFRSSContext ebpf_rss;
+    struct RSSSteeringContext rss_steering;
+    /*
+     * With an IOThread, the rx/tx virtqueues and their backends run in
+     * @ctx while ioeventfd is active; the control virtqueue stays in the
+     * main loop and takes @ctx to change datapath state.
+     */
+    IOThread *iothread;
+    AioContext *ctx;
+    bool dataplane_started;
 };
 
 void virtio_net_set_netclient_name(VirtIONet *n, const char *name,
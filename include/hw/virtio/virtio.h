@@ -19,6 +19,7 @@
 #include "net/net.h"
 #include "migration/vmstate.h"
 #include "qemu/event_notifier.h"
+#include "hw/virtio/virtio-element-pool.h"
 #include "standard-headers/linux/virtio_config.h"
 #include "standard-headers/linux/virtio_ring.h"
 #include "qom/object.h"
@@ -61,6 +62,8 @@ typedef struct VirtQueueElement
     hwaddr *out_addr;
     struct iovec *in_sg;
     struct iovec *out_sg;
+    /* Pool the element was allocated from, see virtqueue_element_free() */
+    VirtQueueElementPool *pool;
 } VirtQueueElement;
 
 #define VIRTIO_QUEUE_MAX 1024
@@ -186,6 +189,8 @@ void virtio_delete_queue(VirtQueue *vq);
 void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
                     unsigned int len);
 void virtqueue_flush(VirtQueue *vq, unsigned int count);
+void virtqueue_fill_batch(VirtQueue *vq, VirtQueueElement *const *elems,
+                          const unsigned int *lens, unsigned int count);
 void virtqueue_detach_element(VirtQueue *vq, const VirtQueueElement *elem,
                               unsigned int len);
 void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
@@ -196,6 +201,11 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
 
 void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem);
 void *virtqueue_pop(VirtQueue *vq, size_t sz);
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max);
+void virtio_queue_enable_element_pool(VirtQueue *vq, size_t sz,
+                                      unsigned int max_sg);
+void virtqueue_element_free(VirtQueueElement *elem);
 unsigned int virtqueue_drop_all(VirtQueue *vq);
 void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz);
 void qemu_put_virtqueue_element(VirtIODevice *vdev, QEMUFile *f,
@@ -310,6 +320,8 @@ EventNotifier *virtio_queue_get_guest_notifier(VirtQueue *vq);
 void virtio_queue_set_guest_notifier_fd_handler(VirtQueue *vq, bool assign,
                                                 bool with_irqfd);
 int virtio_device_start_ioeventfd(VirtIODevice *vdev);
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev);
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev);
 int virtio_device_grab_ioeventfd(VirtIODevice *vdev);
 void virtio_device_release_ioeventfd(VirtIODevice *vdev);
 bool virtio_device_ioeventfd_enabled(VirtIODevice *vdev);
@@ -32,6 +32,12 @@ uint16_t net_checksum_tcpudp(uint16_t length, uint16_t proto,
                              uint8_t *addrs, uint8_t *buf);
 void net_checksum_calculate(uint8_t *data, int length, int csum_flag);
 
+/*
+ * Switch net_checksum_add_cont() to the next slower implementation, for
+ * testing.  Returns false once the generic one is selected.
+ */
+bool test_net_checksum_next_accel(void);
+
 static inline uint32_t
 net_checksum_add(int len, uint8_t *buf)
 {
@@ -46,6 +46,7 @@ typedef void (NetPoll)(NetClientState *, bool enable);
 typedef bool (NetCanReceive)(NetClientState *);
 typedef ssize_t (NetReceive)(NetClientState *, const uint8_t *, size_t);
 typedef ssize_t (NetReceiveIOV)(NetClientState *, const struct iovec *, int);
+typedef int (NetReceiveBatch)(NetClientState *, const struct iovec *, int);
 typedef void (NetCleanup) (NetClientState *);
 typedef void (LinkStatusChanged)(NetClientState *);
 typedef void (NetClientDestructor)(NetClientState *);
@@ -63,6 +64,7 @@ typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
+typedef void (NetSetAioContext)(NetClientState *, AioContext *);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -70,6 +72,12 @@ typedef struct NetClientInfo {
     NetReceive *receive;
     NetReceive *receive_raw;
     NetReceiveIOV *receive_iov;
+    /*
+     * Optional: receive several frames, each in a single buffer.  Returns
+     * how many frames were consumed; it stops at the first frame it has
+     * no room for, which is then queued like a zero return from receive.
+     */
+    NetReceiveBatch *receive_batch;
     NetCanReceive *can_receive;
     NetCleanup *cleanup;
     LinkStatusChanged *link_status_changed;
@@ -86,6 +94,7 @@ typedef struct NetClientInfo {
     NetAnnounce *announce;
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
+    NetSetAioContext *set_aio_context;
 } NetClientInfo;
 
 struct NetClientState {
@@ -107,6 +116,8 @@ struct NetClientState {
     bool do_not_pad; /* do not pad to the minimum ethernet frame length */
     bool is_datapath;
     QTAILQ_HEAD(, NetFilterState) filters;
+    /* IOThread that runs the datapath, NULL for the main loop */
+    AioContext *aio_context;
 };
 
 typedef struct NICState {
@@ -168,6 +179,9 @@ ssize_t qemu_receive_packet_iov(NetClientState *nc,
 ssize_t qemu_send_packet_raw(NetClientState *nc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_async(NetClientState *nc, const uint8_t *buf,
                                int size, NetPacketSent *sent_cb);
+bool qemu_send_packet_batch_async(NetClientState *nc,
+                                  const struct iovec *pkts, int count,
+                                  NetPacketSent *sent_cb);
 void qemu_purge_queued_packets(NetClientState *nc);
 void qemu_flush_queued_packets(NetClientState *nc);
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge);
@@ -181,6 +195,10 @@ void qemu_set_offload(NetClientState *nc, int csum, int tso4, int tso6,
 void qemu_set_vnet_hdr_len(NetClientState *nc, int len);
 int qemu_set_vnet_le(NetClientState *nc, bool is_le);
 int qemu_set_vnet_be(NetClientState *nc, bool is_be);
+bool qemu_can_set_net_aio_context(NetClientState *nc);
+void qemu_set_net_aio_context(NetClientState *nc, AioContext *ctx);
+void qemu_net_datapath_lock(NetClientState *nc);
+void qemu_net_datapath_unlock(NetClientState *nc);
 void qemu_macaddr_default_if_unset(MACAddr *macaddr);
 int qemu_show_nic_models(const char *arg, const char *const *models);
 void qemu_check_nic_model(NICInfo *nd, const char *model);
@@ -44,6 +44,12 @@ typedef ssize_t (NetQueueDeliverFunc)(NetClientState *sender,
                                       int iovcnt,
                                       void *opaque);
 
+/* Returns the number of frames accepted, starting from the first one */
+typedef int (NetQueueDeliverBatchFunc)(NetClientState *sender,
+                                       const struct iovec *pkts,
+                                       int count,
+                                       void *opaque);
+
 NetQueue *qemu_new_net_queue(NetQueueDeliverFunc *deliver, void *opaque);
 
 void qemu_net_queue_append_iov(NetQueue *queue,
@@ -77,6 +83,12 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
                                 int iovcnt,
                                 NetPacketSent *sent_cb);
 
+int qemu_net_queue_send_batch(NetQueue *queue,
+                              NetClientState *sender,
+                              const struct iovec *pkts,
+                              int count,
+                              NetQueueDeliverBatchFunc *deliver);
+
 void qemu_net_queue_purge(NetQueue *queue, NetClientState *from);
 bool qemu_net_queue_flush(NetQueue *queue);
 
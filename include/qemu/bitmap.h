@@ -45,6 +45,9 @@
  *                                    *dst = *src (with an offset into src)
  * bitmap_copy_with_dst_offset(dst, src, offset, nbits)
  *                                    *dst = *src (with an offset into dst)
+ * bitmap_find_word_not(src, start, end, pattern)
+ *                                    First word in [start, end) != pattern
+ * bitmap_count_words(src, nr)        Number of set bits in nr whole words
  */
 
 /*
@@ -90,6 +93,16 @@ int slow_bitmap_intersects(const unsigned long *bitmap1,
                            const unsigned long *bitmap2, long bits);
 long slow_bitmap_count_one(const unsigned long *bitmap, long nbits);
 
+/*
+ * Vectorized (where the host supports it) word-granular helpers; see
+ * util/bitmap-accel.c.  bitmap_find_word_not() returns @end if all words
+ * in the range equal @pattern.
+ */
+size_t bitmap_find_word_not(const unsigned long *words, size_t start,
+                            size_t end, unsigned long pattern);
+uint64_t bitmap_count_words(const unsigned long *words, size_t nr);
+bool test_bitmap_accel_next(void);
+
 static inline unsigned long *bitmap_try_new(long nbits)
 {
     long len = BITS_TO_LONGS(nbits) * sizeof(unsigned long);
@@ -17,6 +17,7 @@
 
 typedef struct HBitmap HBitmap;
 typedef struct HBitmapIter HBitmapIter;
+typedef struct HBitmapExtent HBitmapExtent;
 
 #define BITS_PER_LEVEL         (BITS_PER_LONG == 32 ? 5 : 6)
 
@@ -48,6 +49,12 @@ struct HBitmapIter {
     unsigned long cur[HBITMAP_LEVELS];
 };
 
+/* A run of dirty items, as returned by hbitmap_get_dirty_extents().  */
+struct HBitmapExtent {
+    int64_t start;
+    int64_t count;
+};
+
 /**
  * hbitmap_alloc:
  * @size: Number of bits in the bitmap.
@@ -340,6 +347,21 @@ bool hbitmap_next_dirty_area(const HBitmap *hb, int64_t start, int64_t end,
                              int64_t max_dirty_count,
                              int64_t *dirty_start, int64_t *dirty_count);
 
+/* hbitmap_get_dirty_extents:
+ * @hb: The HBitmap to operate on
+ * @start: the offset to start from
+ * @end: end of requested area
+ * @extents: array to store the dirty runs in
+ * @max_extents: number of elements in @extents
+ *
+ * Store the dirty runs found within [@start, @end) into @extents, in
+ * ascending order.  Each run is as long as possible, except that it is
+ * clipped to [@start, @end).  Returns the number of runs stored; if it is
+ * @max_extents, there may be more dirty runs after the last one returned.
+ */
+size_t hbitmap_get_dirty_extents(const HBitmap *hb, int64_t start, int64_t end,
+                                 HBitmapExtent *extents, size_t max_extents);
+
 /*
  * bdrv_dirty_bitmap_status:
  * @hb: The HBitmap to operate on
@@ -152,6 +152,13 @@ bool throttle_schedule_timer(ThrottleState *ts,
                              bool is_write);
 
 void throttle_account(ThrottleState *ts, bool is_write, uint64_t size);
+void throttle_compute_credit(ThrottleState *ts, bool is_write,
+                             int64_t period_ns, unsigned shares,
+                             uint64_t *bytes, double *units);
+void throttle_account_credit(ThrottleState *ts, bool is_write,
+                             uint64_t bytes, double units);
+void throttle_refund_credit(ThrottleState *ts, bool is_write,
+                            uint64_t bytes, double units);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
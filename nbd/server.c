@@ -26,6 +26,11 @@
 #include "nbd-internal.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "block/thread-pool.h"
+
+#ifdef CONFIG_LINUX
+#include <sys/sendfile.h>
+#endif
 
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
@@ -97,6 +102,7 @@ struct NBDExport {
     Notifier eject_notifier;
 
     bool allocation_depth;
+    bool zero_copy;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
 };
@@ -1772,6 +1778,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     }
 
     exp->allocation_depth = arg->allocation_depth;
+    exp->zero_copy = arg->zero_copy;
 
     /*
      * We need to inhibit request queuing in the block layer to ensure we can
@@ -1966,6 +1973,169 @@ static int coroutine_fn nbd_co_send_structured_read(NBDClient *client,
     return nbd_co_send_iov(client, iov, 2, errp);
 }
 
+#ifdef CONFIG_LINUX
+typedef struct NBDSendfileData {
+    int out_fd;
+    int in_fd;
+    off_t pos;
+    size_t count;
+} NBDSendfileData;
+
+/*
+ * Runs in a thread pool worker, so that reading data that is not in the page
+ * cache does not block the export's event loop.
+ */
+static int nbd_sendfile_worker(void *opaque)
+{
+    NBDSendfileData *data = opaque;
+    ssize_t len;
+
+    do {
+        len = sendfile(data->out_fd, data->in_fd, &data->pos,
+                       MIN(data->count, INT_MAX));
+    } while (len < 0 && errno == EINTR);
+
+    return len < 0 ? -errno : len;
+}
+
+/*
+ * Send @iov followed by @size bytes of export data at @offset, letting the
+ * kernel copy the data straight from the image file into the socket.
+ *
+ * Returns -ENOTSUP without sending anything if the export cannot be served
+ * that way (TLS, I/O limits, or an image that is not a plain file), in which
+ * case the caller must read the data itself.  If sendfile() stops working
+ * half-way, the remainder is read through the block layer into @data.  Once
+ * the reply header has gone out, any error is fatal for the connection.
+ */
+static int coroutine_fn nbd_co_send_iov_zero_copy(NBDClient *client,
+                                                  struct iovec *iov,
+                                                  unsigned niov,
+                                                  uint64_t offset,
+                                                  uint8_t *data, size_t size,
+                                                  Error **errp)
+{
+    BlockBackend *blk = client->exp->common.blk;
+    ThreadPool *pool = aio_get_thread_pool(client->exp->common.ctx);
+    size_t done = 0;
+    int fd;
+    int ret = 0;
+
+    if (!client->exp->zero_copy || client->ioc != QIO_CHANNEL(client->sioc)) {
+        return -ENOTSUP;
+    }
+
+    /* Keep the export busy so that a drained section waits for us */
+    blk_inc_in_flight(blk);
+
+    /* sendfile() would bypass the limits */
+    if (blk_io_limits_enabled(blk)) {
+        blk_dec_in_flight(blk);
+        return -ENOTSUP;
+    }
+    fd = bdrv_get_host_fd(blk_bs(blk));
+    if (fd < 0) {
+        blk_dec_in_flight(blk);
+        return -ENOTSUP;
+    }
+
+    qemu_co_mutex_lock(&client->send_lock);
+    client->send_coroutine = qemu_coroutine_self();
+    qio_channel_set_cork(client->ioc, true);
+
+    if (qio_channel_writev_all(client->ioc, iov, niov, errp) < 0) {
+        ret = -EIO;
+        goto out;
+    }
+
+    while (done < size) {
+        NBDSendfileData sf = {
+            .out_fd = client->sioc->fd,
+            .in_fd = fd,
+            .pos = offset + done,
+            .count = size - done,
+        };
+        int len = thread_pool_submit_co(pool, nbd_sendfile_worker, &sf);
+
+        if (len > 0) {
+            done += len;
+            continue;
+        }
+        if (len == -EAGAIN) {
+            qio_channel_yield(client->ioc, G_IO_OUT);
+            continue;
+        }
+
+        /* Short file or an error: use the regular path for the rest */
+        trace_nbd_co_send_zero_copy_fallback(offset + done, size - done,
+                                             len < 0 ? -len : 0);
+        ret = blk_pread(blk, offset + done, data + done, size - done);
+        if (ret < 0) {
+            error_setg_errno(errp, -ret, "reading from file failed");
+            goto out;
+        }
+        ret = qio_channel_write_all(client->ioc, (char *)data + done,
+                                    size - done, errp) < 0 ? -EIO : 0;
+        break;
+    }
+
+out:
+    qio_channel_set_cork(client->ioc, false);
+    client->send_coroutine = NULL;
+    qemu_co_mutex_unlock(&client->send_lock);
+    blk_dec_in_flight(blk);
+
+    return ret;
+}
+#else
+static int coroutine_fn nbd_co_send_iov_zero_copy(NBDClient *client,
+                                                  struct iovec *iov,
+                                                  unsigned niov,
+                                                  uint64_t offset,
+                                                  uint8_t *data, size_t size,
+                                                  Error **errp)
+{
+    return -ENOTSUP;
+}
+#endif
+
+/*
+ * Send a successful read reply for @size bytes at @offset without copying
+ * the data through @data.  Returns -ENOTSUP if nothing was sent and the
+ * caller should fall back to blk_pread().
+ */
+static int coroutine_fn nbd_co_send_read_zero_copy(NBDClient *client,
+                                                   uint64_t handle,
+                                                   uint64_t offset,
+                                                   uint8_t *data,
+                                                   size_t size,
+                                                   bool final,
+                                                   Error **errp)
+{
+    NBDStructuredReadData chunk;
+    NBDSimpleReply reply;
+    struct iovec iov;
+    int ret;
+
+    assert(size);
+    if (client->structured_reply) {
+        set_be_chunk(&chunk.h, final ? NBD_REPLY_FLAG_DONE : 0,
+                     NBD_REPLY_TYPE_OFFSET_DATA, handle,
+                     sizeof(chunk) - sizeof(chunk.h) + size);
+        stq_be_p(&chunk.offset, offset);
+        iov = (struct iovec) { .iov_base = &chunk, .iov_len = sizeof(chunk) };
+    } else {
+        set_be_simple_reply(&reply, 0, handle);
+        iov = (struct iovec) { .iov_base = &reply, .iov_len = sizeof(reply) };
+    }
+
+    ret = nbd_co_send_iov_zero_copy(client, &iov, 1, offset, data, size, errp);
+    if (ret != -ENOTSUP) {
+        trace_nbd_co_send_read_zero_copy(handle, offset, size);
+    }
+    return ret;
+}
+
 static int coroutine_fn nbd_co_send_structured_error(NBDClient *client,
                                                      uint64_t handle,
                                                      uint32_t error,
@@ -2039,15 +2209,21 @@ static int coroutine_fn nbd_co_send_sparse_read(NBDClient *client,
             stl_be_p(&chunk.length, pnum);
             ret = nbd_co_send_iov(client, iov, 1, errp);
         } else {
-            ret = blk_pread(exp->common.blk, offset + progress,
-                            data + progress, pnum);
-            if (ret < 0) {
-                error_setg_errno(errp, -ret, "reading from file failed");
-                break;
+            ret = nbd_co_send_read_zero_copy(client, handle, offset + progress,
+                                             data + progress, pnum, final,
+                                             errp);
+            if (ret == -ENOTSUP) {
+                ret = blk_pread(exp->common.blk, offset + progress,
+                                data + progress, pnum);
+                if (ret < 0) {
+                    error_setg_errno(errp, -ret, "reading from file failed");
+                    break;
+                }
+                ret = nbd_co_send_structured_read(client, handle,
+                                                  offset + progress,
+                                                  data + progress, pnum,
+                                                  final, errp);
             }
-            ret = nbd_co_send_structured_read(client, handle, offset + progress,
-                                              data + progress, pnum, final,
-                                              errp);
         }
 
         if (ret < 0) {
@@ -2248,24 +2424,29 @@ static void bitmap_to_extents(BdrvDirtyBitmap *bitmap,
                               uint64_t offset, uint64_t length,
                               NBDExtentArray *es)
 {
-    int64_t start, dirty_start, dirty_count;
+    HBitmapExtent extents[64];
+    int64_t start = offset;
     int64_t end = offset + length;
     bool full = false;
+    size_t i, n;
 
     bdrv_dirty_bitmap_lock(bitmap);
 
-    for (start = offset;
-         bdrv_dirty_bitmap_next_dirty_area(bitmap, start, end, INT32_MAX,
-                                           &dirty_start, &dirty_count);
-         start = dirty_start + dirty_count)
-    {
-        if ((nbd_extent_array_add(es, dirty_start - start, 0) < 0) ||
-            (nbd_extent_array_add(es, dirty_count, NBD_STATE_DIRTY) < 0))
-        {
-            full = true;
-            break;
+    do {
+        n = bdrv_dirty_bitmap_get_dirty_extents(bitmap, start, end, extents,
+                                                ARRAY_SIZE(extents));
+        for (i = 0; i < n; i++) {
+            /* @length is 32-bit, so the extents always fit */
+            if ((nbd_extent_array_add(es, extents[i].start - start, 0) < 0) ||
+                (nbd_extent_array_add(es, extents[i].count,
+                                      NBD_STATE_DIRTY) < 0))
+            {
+                full = true;
+                break;
+            }
+            start = extents[i].start + extents[i].count;
         }
-    }
+    } while (!full && n == ARRAY_SIZE(extents));
 
     if (!full) {
         /* last non dirty extent, nothing to do if array is now full */
@@ -2444,6 +2625,15 @@ static coroutine_fn int nbd_do_cmd_read(NBDClient *client, NBDRequest *request,
                                        data, request->len, errp);
     }
 
+    if (request->len) {
+        ret = nbd_co_send_read_zero_copy(client, request->handle,
+                                         request->from, data, request->len,
+                                         true, errp);
+        if (ret != -ENOTSUP) {
+            return ret;
+        }
+    }
+
     ret = blk_pread(exp->common.blk, request->from, data, request->len);
     if (ret < 0) {
         return nbd_send_generic_reply(client, request->handle, ret,
@@ -0,0 +1,617 @@
+/*
+ * AF_XDP network backend.
+ *
+ * Guest frames are copied to and from a UMEM area that is shared with the
+ * kernel; with a zero-copy capable driver the NIC DMAs directly into it.
+ * Each queue of the netdev owns one AF_XDP socket bound to one queue of
+ * the host interface, and maps to one queue pair of a multiqueue NIC.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+
+#include "qemu/osdep.h"
+#include <bpf/bpf.h>
+#include <linux/if_link.h>
+#include <net/if.h>
+#include <xdp/xsk.h>
+
+#include "clients.h"
+#include "monitor/monitor.h"
+#include "net/net.h"
+#include "qapi/error.h"
+#include "qemu/cutils.h"
+#include "qemu/error-report.h"
+#include "qemu/main-loop.h"
+#include "qemu/memalign.h"
+#include "qemu/timer.h"
+
+
+typedef struct AFXDPState {
+    NetClientState       nc;
+
+    struct xsk_socket    *xsk;
+    struct xsk_ring_cons rx;
+    struct xsk_ring_prod tx;
+    struct xsk_ring_cons cq;
+    struct xsk_ring_prod fq;
+
+    char                 ifname[IFNAMSIZ];
+    int                  ifindex;
+    bool                 read_poll;
+    bool                 write_poll;
+    uint32_t             outstanding_tx;
+
+    uint64_t             *pool;
+    uint32_t             n_pool;
+    char                 *buffer;
+    struct xsk_umem      *umem;
+
+    uint32_t             n_queues;
+    uint32_t             xdp_flags;
+    bool                 inhibit;
+    bool                 busy_poll;
+    QEMUTimer            *busy_poll_timer;
+    int64_t              busy_poll_ns;
+    int64_t              last_kick;
+} AFXDPState;
+
+#define AF_XDP_BATCH_SIZE 64
+
+static void af_xdp_send(void *opaque);
+static void af_xdp_writable(void *opaque);
+
+/* Set the event-loop handlers for the af-xdp backend. */
+static void af_xdp_update_fd_handler(AFXDPState *s)
+{
+    if (!s->xsk) {
+        return;
+    }
+
+    qemu_set_fd_handler(xsk_socket__fd(s->xsk),
+                        s->read_poll ? af_xdp_send : NULL,
+                        s->write_poll ? af_xdp_writable : NULL,
+                        s);
+}
+
+/* Update the read handler. */
+static void af_xdp_read_poll(AFXDPState *s, bool enable)
+{
+    if (s->read_poll != enable) {
+        s->read_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+/* Update the write handler. */
+static void af_xdp_write_poll(AFXDPState *s, bool enable)
+{
+    if (s->write_poll != enable) {
+        s->write_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+static void af_xdp_poll(NetClientState *nc, bool enable)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    if (s->read_poll != enable || s->write_poll != enable) {
+        s->write_poll = enable;
+        s->read_poll  = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+/*
+ * With busy polling the device interrupts are deferred, and the kernel runs
+ * the NAPI context only when the socket asks for it.  An empty recvfrom()
+ * or sendto() does exactly that.
+ */
+static void af_xdp_kick_rx(AFXDPState *s)
+{
+    recvfrom(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    s->last_kick = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+static void af_xdp_kick_tx(AFXDPState *s)
+{
+    sendto(xsk_socket__fd(s->xsk), NULL, 0, MSG_DONTWAIT, NULL, 0);
+    s->last_kick = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+}
+
+static void af_xdp_complete_tx(AFXDPState *s)
+{
+    uint32_t idx = 0;
+    uint32_t done, i;
+    const uint64_t *addr;
+
+    done = xsk_ring_cons__peek(&s->cq, XSK_RING_CONS__DEFAULT_NUM_DESCS, &idx);
+
+    for (i = 0; i < done; i++) {
+        addr = xsk_ring_cons__comp_addr(&s->cq, idx++);
+        s->pool[s->n_pool++] = *addr;
+        s->outstanding_tx--;
+    }
+
+    if (done) {
+        xsk_ring_cons__release(&s->cq, done);
+    }
+}
+
+/*
+ * The fd_write() callback, invoked if the fd is marked as writable
+ * after a poll.
+ */
+static void af_xdp_writable(void *opaque)
+{
+    AFXDPState *s = opaque;
+
+    /* Try to recover buffers that are already sent. */
+    af_xdp_complete_tx(s);
+
+    /*
+     * Unregister the handler, unless we still have packets to transmit
+     * and the kernel needs a wake up.
+     */
+    if (!s->outstanding_tx || !xsk_ring_prod__needs_wakeup(&s->tx)) {
+        af_xdp_write_poll(s, false);
+    }
+
+    /* Flush any buffered packets. */
+    qemu_flush_queued_packets(&s->nc);
+}
+
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    struct xdp_desc *desc;
+    uint32_t idx;
+    void *data;
+
+    /* Try to recover buffers that are already sent. */
+    af_xdp_complete_tx(s);
+
+    if (size > XSK_UMEM__DEFAULT_FRAME_SIZE) {
+        /* We can't transmit a packet of this size, drop it. */
+        return size;
+    }
+
+    if (!s->n_pool || !xsk_ring_prod__reserve(&s->tx, 1, &idx)) {
+        /*
+         * Out of buffers or space in the Tx ring.  Poll until we can write.
+         * This also kicks the Tx if it was waiting on the completion queue.
+         */
+        af_xdp_write_poll(s, true);
+        return 0;
+    }
+
+    desc = xsk_ring_prod__tx_desc(&s->tx, idx);
+    desc->addr = s->pool[--s->n_pool];
+    desc->len = size;
+
+    data = xsk_umem__get_data(s->buffer, desc->addr);
+    memcpy(data, buf, size);
+
+    xsk_ring_prod__submit(&s->tx, 1);
+    s->outstanding_tx++;
+
+    if (s->busy_poll) {
+        af_xdp_kick_tx(s);
+    } else if (xsk_ring_prod__needs_wakeup(&s->tx)) {
+        af_xdp_write_poll(s, true);
+    }
+
+    return size;
+}
+
+/*
+ * Complete a previous send (backend --> guest) and enable the
+ * fd_read callback.
+ */
+static void af_xdp_send_completed(NetClientState *nc, ssize_t len)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    af_xdp_read_poll(s, true);
+}
+
+static void af_xdp_fq_refill(AFXDPState *s, uint32_t n)
+{
+    uint32_t i, idx = 0;
+
+    /* Leave one buffer for Tx, just in case. */
+    if (s->n_pool < n + 1) {
+        n = s->n_pool ? s->n_pool - 1 : 0;
+    }
+
+    if (!n || !xsk_ring_prod__reserve(&s->fq, n, &idx)) {
+        return;
+    }
+
+    for (i = 0; i < n; i++) {
+        *xsk_ring_prod__fill_addr(&s->fq, idx++) = s->pool[--s->n_pool];
+    }
+    xsk_ring_prod__submit(&s->fq, n);
+
+    if (s->busy_poll) {
+        af_xdp_kick_rx(s);
+    } else if (xsk_ring_prod__needs_wakeup(&s->fq)) {
+        /* Receive was blocked by not having enough buffers.  Wake it up. */
+        af_xdp_read_poll(s, true);
+    }
+}
+
+/*
+ * The fd_read() callback: pass everything the kernel has placed in the
+ * Rx ring to the peer in one batch.
+ */
+static void af_xdp_send(void *opaque)
+{
+    AFXDPState *s = opaque;
+    struct iovec pkts[AF_XDP_BATCH_SIZE];
+    uint32_t i, n_rx, idx = 0;
+
+    n_rx = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
+    if (!n_rx) {
+        return;
+    }
+
+    for (i = 0; i < n_rx; i++) {
+        const struct xdp_desc *desc = xsk_ring_cons__rx_desc(&s->rx, idx++);
+
+        pkts[i].iov_base = xsk_umem__get_data(s->buffer, desc->addr);
+        pkts[i].iov_len = desc->len;
+        s->pool[s->n_pool++] = desc->addr;
+    }
+
+    /*
+     * Frames that the peer cannot take right now are copied into its
+     * queue, so the UMEM buffers can be recycled either way.
+     */
+    if (!qemu_send_packet_batch_async(&s->nc, pkts, n_rx,
+                                      af_xdp_send_completed)) {
+        af_xdp_read_poll(s, false);
+    }
+
+    xsk_ring_cons__release(&s->rx, n_rx);
+    af_xdp_fq_refill(s, AF_XDP_BATCH_SIZE);
+}
+
+/*
+ * Nothing wakes up the fd handlers while the interrupts are deferred and
+ * neither the guest nor the host has a reason to kick the socket, so
+ * frames could sit in the device forever.  Kick it at least once per
+ * busy-poll period and pick up whatever it produced.
+ */
+static void af_xdp_busy_poll_timer(void *opaque)
+{
+    AFXDPState *s = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+
+    if (now - s->last_kick >= s->busy_poll_ns) {
+        if (s->outstanding_tx) {
+            af_xdp_kick_tx(s);
+        }
+        af_xdp_kick_rx(s);
+    }
+
+    if (s->outstanding_tx) {
+        af_xdp_complete_tx(s);
+        qemu_flush_queued_packets(&s->nc);
+    }
+    if (s->read_poll) {
+        af_xdp_send(s);
+    }
+
+    timer_mod(s->busy_poll_timer, s->last_kick + s->busy_poll_ns);
+}
+
+/* Flush and close. */
+static void af_xdp_cleanup(NetClientState *nc)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    timer_free(s->busy_poll_timer);
+    s->busy_poll_timer = NULL;
+
+    qemu_purge_queued_packets(nc);
+
+    af_xdp_poll(nc, false);
+
+    xsk_socket__delete(s->xsk);
+    s->xsk = NULL;
+    g_free(s->pool);
+    s->pool = NULL;
+    xsk_umem__delete(s->umem);
+    s->umem = NULL;
+    qemu_vfree(s->buffer);
+    s->buffer = NULL;
+
+    /* Remove the program when the last queue goes away. */
+    if (!s->inhibit && s->xdp_flags && nc->queue_index == s->n_queues - 1 &&
+        bpf_xdp_detach(s->ifindex, s->xdp_flags, NULL) != 0) {
+        error_report("af-xdp: unable to remove XDP program from '%s', "
+                     "ifindex: %d", s->ifname, s->ifindex);
+    }
+}
+
+static int af_xdp_umem_create(AFXDPState *s, int sock_fd, Error **errp)
+{
+    struct xsk_umem_config config = {
+        .fill_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+        .comp_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+        .frame_size = XSK_UMEM__DEFAULT_FRAME_SIZE,
+        .frame_headroom = 0,
+    };
+    uint64_t n_descs;
+    uint64_t size;
+    int64_t i;
+    int ret;
+
+    /* Number of descriptors if all 4 queues (rx, tx, cq, fq) are full. */
+    n_descs = (XSK_RING_PROD__DEFAULT_NUM_DESCS
+               + XSK_RING_CONS__DEFAULT_NUM_DESCS) * 2;
+    size = n_descs * XSK_UMEM__DEFAULT_FRAME_SIZE;
+
+    s->buffer = qemu_memalign(qemu_real_host_page_size(), size);
+    memset(s->buffer, 0, size);
+
+    if (sock_fd < 0) {
+        ret = xsk_umem__create(&s->umem, s->buffer, size,
+                               &s->fq, &s->cq, &config);
+    } else {
+        ret = xsk_umem__create_with_fd(&s->umem, sock_fd, s->buffer, size,
+                                       &s->fq, &s->cq, &config);
+    }
+
+    if (ret) {
+        qemu_vfree(s->buffer);
+        s->buffer = NULL;
+        error_setg_errno(errp, -ret,
+                         "failed to create umem for %s queue_index: %d",
+                         s->ifname, s->nc.queue_index);
+        return -1;
+    }
+
+    s->pool = g_new(uint64_t, n_descs);
+    /* Fill the pool in the opposite order, because it's a LIFO queue. */
+    for (i = n_descs - 1; i >= 0; i--) {
+        s->pool[i] = i * XSK_UMEM__DEFAULT_FRAME_SIZE;
+    }
+    s->n_pool = n_descs;
+
+    af_xdp_fq_refill(s, XSK_RING_PROD__DEFAULT_NUM_DESCS);
+
+    return 0;
+}
+
+static int af_xdp_socket_create(AFXDPState *s,
+                                const NetdevAFXDPOptions *opts, Error **errp)
+{
+    struct xsk_socket_config cfg = {
+        .rx_size = XSK_RING_CONS__DEFAULT_NUM_DESCS,
+        .tx_size = XSK_RING_PROD__DEFAULT_NUM_DESCS,
+        .libxdp_flags = 0,
+        .bind_flags = XDP_USE_NEED_WAKEUP,
+        .xdp_flags = XDP_FLAGS_UPDATE_IF_NOEXIST,
+    };
+    int queue_id, ret;
+
+    s->inhibit = opts->has_inhibit && opts->inhibit;
+    if (s->inhibit) {
+        cfg.libxdp_flags |= XSK_LIBXDP_FLAGS__INHIBIT_PROG_LOAD;
+    }
+
+    if (opts->has_force_copy && opts->force_copy) {
+        cfg.bind_flags |= XDP_COPY;
+    }
+
+    queue_id = s->nc.queue_index;
+    if (opts->has_start_queue && opts->start_queue > 0) {
+        queue_id += opts->start_queue;
+    }
+
+    if (opts->has_mode) {
+        /* Specific mode requested. */
+        cfg.xdp_flags |= (opts->mode == AFXDP_MODE_NATIVE)
+                         ? XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+        ret = xsk_socket__create(&s->xsk, s->ifname, queue_id,
+                                 s->umem, &s->rx, &s->tx, &cfg);
+    } else {
+        /* No mode requested, try native first. */
+        cfg.xdp_flags |= XDP_FLAGS_DRV_MODE;
+        ret = xsk_socket__create(&s->xsk, s->ifname, queue_id,
+                                 s->umem, &s->rx, &s->tx, &cfg);
+        if (ret) {
+            /* Can't use native mode, try skb. */
+            cfg.xdp_flags &= ~XDP_FLAGS_DRV_MODE;
+            cfg.xdp_flags |= XDP_FLAGS_SKB_MODE;
+            ret = xsk_socket__create(&s->xsk, s->ifname, queue_id,
+                                     s->umem, &s->rx, &s->tx, &cfg);
+        }
+    }
+
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "failed to create AF_XDP socket for %s queue_id: %d",
+                         s->ifname, queue_id);
+        return -1;
+    }
+
+    /* Only the attach mode matters when detaching the program. */
+    s->xdp_flags = cfg.xdp_flags & ~XDP_FLAGS_UPDATE_IF_NOEXIST;
+
+    return 0;
+}
+
+static int af_xdp_set_busy_poll(AFXDPState *s, uint32_t usecs, Error **errp)
+{
+#if defined(SO_PREFER_BUSY_POLL) && defined(SO_BUSY_POLL_BUDGET)
+    int fd = xsk_socket__fd(s->xsk);
+    int prefer = 1;
+    int timeout = usecs;
+    int budget = AF_XDP_BATCH_SIZE;
+
+    if (setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                   &prefer, sizeof(prefer)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL,
+                   &timeout, sizeof(timeout)) ||
+        setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                   &budget, sizeof(budget))) {
+        error_setg_errno(errp, errno,
+                         "failed to enable busy polling for %s", s->ifname);
+        return -1;
+    }
+
+    s->busy_poll = true;
+    s->busy_poll_ns = (int64_t)usecs * SCALE_US;
+    s->busy_poll_timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                      af_xdp_busy_poll_timer, s);
+    af_xdp_kick_rx(s);
+    timer_mod(s->busy_poll_timer, s->last_kick + s->busy_poll_ns);
+    return 0;
+#else
+    error_setg(errp, "busy polling of AF_XDP sockets is not supported "
+               "by this host");
+    return -1;
+#endif
+}
+
+static NetClientInfo net_af_xdp_info = {
+    .type = NET_CLIENT_DRIVER_AF_XDP,
+    .size = sizeof(AFXDPState),
+    .receive = af_xdp_receive,
+    .poll = af_xdp_poll,
+    .cleanup = af_xdp_cleanup,
+};
+
+static int *parse_socket_fds(const char *sock_fds_str,
+                             int64_t n_expected, Error **errp)
+{
+    gchar **substrings = g_strsplit(sock_fds_str, ":", -1);
+    int64_t i, n_sock_fds = g_strv_length(substrings);
+    int *sock_fds = NULL;
+
+    if (n_sock_fds != n_expected) {
+        error_setg(errp, "expected %" PRIi64 " socket fds, got %" PRIi64,
+                   n_expected, n_sock_fds);
+        goto exit;
+    }
+
+    sock_fds = g_new(int, n_sock_fds);
+
+    for (i = 0; i < n_sock_fds; i++) {
+        sock_fds[i] = monitor_fd_param(monitor_cur(), substrings[i], errp);
+        if (sock_fds[i] < 0) {
+            g_free(sock_fds);
+            sock_fds = NULL;
+            goto exit;
+        }
+    }
+
+exit:
+    g_strfreev(substrings);
+    return sock_fds;
+}
+
+/*
+ * The exported init function.
+ *
+ * ... -netdev af-xdp,ifname="..."
+ */
+int net_init_af_xdp(const Netdev *netdev,
+                    const char *name, NetClientState *peer, Error **errp)
+{
+    const NetdevAFXDPOptions *opts = &netdev->u.af_xdp;
+    NetClientState *nc, *nc0 = NULL;
+    unsigned int ifindex;
+    uint32_t prog_id = 0;
+    g_autofree int *sock_fds = NULL;
+    g_autofree AFXDPState **states = NULL;
+    int64_t i, queues;
+    AFXDPState *s;
+
+    ifindex = if_nametoindex(opts->ifname);
+    if (!ifindex) {
+        error_setg_errno(errp, errno, "failed to get ifindex for '%s'",
+                         opts->ifname);
+        return -1;
+    }
+
+    queues = opts->has_queues ? opts->queues : 1;
+    if (queues < 1) {
+        error_setg(errp, "invalid number of queues (%" PRIi64 ") for '%s'",
+                   queues, opts->ifname);
+        return -1;
+    }
+
+    if ((opts->has_inhibit && opts->inhibit) != opts->has_sock_fds) {
+        error_setg(errp, "'inhibit=on' requires 'sock-fds' and vice versa");
+        return -1;
+    }
+
+    if (opts->has_sock_fds) {
+        sock_fds = parse_socket_fds(opts->sock_fds, queues, errp);
+        if (!sock_fds) {
+            return -1;
+        }
+    }
+
+    states = g_new0(AFXDPState *, queues);
+
+    for (i = 0; i < queues; i++) {
+        nc = qemu_new_net_client(&net_af_xdp_info, peer, "af-xdp", name);
+        snprintf(nc->info_str, sizeof(nc->info_str), "af-xdp%" PRIi64
+                 " to %s", i, opts->ifname);
+        nc->queue_index = i;
+
+        if (!nc0) {
+            nc0 = nc;
+        }
+
+        s = DO_UPCAST(AFXDPState, nc, nc);
+        states[i] = s;
+
+        pstrcpy(s->ifname, sizeof(s->ifname), opts->ifname);
+        s->ifindex = ifindex;
+        s->n_queues = queues;
+
+        if (af_xdp_umem_create(s, sock_fds ? sock_fds[i] : -1, errp) ||
+            af_xdp_socket_create(s, opts, errp) ||
+            (opts->has_busy_poll && opts->busy_poll &&
+             af_xdp_set_busy_poll(s, opts->busy_poll, errp))) {
+            /* Make sure the last queue that exists removes the program. */
+            while (i >= 0) {
+                states[i--]->n_queues = s->nc.queue_index + 1;
+            }
+            goto err;
+        }
+    }
+
+    if (nc0) {
+        s = DO_UPCAST(AFXDPState, nc, nc0);
+        if (bpf_xdp_query_id(s->ifindex, s->xdp_flags, &prog_id) || !prog_id) {
+            error_setg_errno(errp, errno,
+                             "no XDP program loaded on '%s', ifindex: %d",
+                             s->ifname, s->ifindex);
+            goto err;
+        }
+    }
+
+    /* Initially only poll for reads. */
+    for (i = 0; i < queues; i++) {
+        af_xdp_read_poll(states[i], true);
+    }
+
+    return 0;
+
+err:
+    if (nc0) {
+        qemu_del_net_client(nc0);
+    }
+
+    return -1;
+}
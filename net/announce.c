@@ -164,12 +164,14 @@ static void qemu_announce_self_iter(NICState *nic, void *opaque)
     if (!skip) {
         len = announce_self_create(buf, nic->conf->macaddr.a);
 
+        qemu_net_datapath_lock(qemu_get_queue(nic));
         qemu_send_packet_raw(qemu_get_queue(nic), buf, len);
 
         /* if the NIC provides it's own announcement support, use it as well */
         if (nic->ncs->info->announce) {
             nic->ncs->info->announce(nic->ncs);
         }
+        qemu_net_datapath_unlock(qemu_get_queue(nic));
     }
 }
 static void qemu_announce_self_once(void *opaque)
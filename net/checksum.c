@@ -19,24 +19,248 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
-uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+/*
+ * The helpers below add up @buf as 16-bit words in host byte order and
+ * return an unfolded sum.  The ones' complement sum does not depend on
+ * the byte order nor on the word size, so it is converted to network
+ * order only once, after folding.
+ */
+
+static uint64_t net_checksum_add_tail(uint64_t sum, const uint8_t *buf,
+                                      size_t len)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    while (len >= 8) {
+        uint64_t v = ldq_he_p(buf);
+
+        sum += (v & 0xffffffff) + (v >> 32);
+        buf += 8;
+        len -= 8;
+    }
+    while (len >= 2) {
+        sum += lduw_he_p(buf);
+        buf += 2;
+        len -= 2;
+    }
+    if (len) {
+        /* The odd byte is the high-order byte of a network order word */
+        uint8_t last[2] = { buf[0], 0 };
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+        sum += lduw_he_p(last);
     }
-    if (i < len) {
-        sum1 += (uint32_t)buf[i];
+    return sum;
+}
+
+static uint64_t net_checksum_add_int(const uint8_t *buf, size_t len)
+{
+    return net_checksum_add_tail(0, buf, len);
+}
+
+#if defined(CONFIG_AVX2_OPT) || defined(__SSE2__)
+/*
+ * Each 16-bit word is widened into a 32-bit lane, which can take 65536
+ * words before it may overflow; the lanes are added up into the scalar
+ * sum after at most that many vectors.
+ */
+#define NET_CHECKSUM_VEC_BATCH  65536
+
+/* Do not use push_options pragmas unnecessarily, because clang
+ * does not support them.
+ */
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("sse2")
+#endif
+#include <emmintrin.h>
+
+static uint64_t net_checksum_add_sse2(const uint8_t *buf, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+
+    while (len >= 16) {
+        size_t n = MIN(len / 16, NET_CHECKSUM_VEC_BATCH);
+        __m128i lo = zero, hi = zero;
+        uint32_t lanes[8];
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)buf);
+
+            lo = _mm_add_epi32(lo, _mm_unpacklo_epi16(v, zero));
+            hi = _mm_add_epi32(hi, _mm_unpackhi_epi16(v, zero));
+            buf += 16;
+        }
+        len -= n * 16;
+
+        _mm_storeu_si128((__m128i *)&lanes[0], lo);
+        _mm_storeu_si128((__m128i *)&lanes[4], hi);
+        for (i = 0; i < ARRAY_SIZE(lanes); i++) {
+            sum += lanes[i];
+        }
     }
 
-    if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+    return net_checksum_add_tail(sum, buf, len);
+}
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC pop_options
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static uint64_t net_checksum_add_avx2(const uint8_t *buf, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+
+    while (len >= 32) {
+        size_t n = MIN(len / 32, NET_CHECKSUM_VEC_BATCH);
+        __m256i lo = zero, hi = zero;
+        uint32_t lanes[16];
+        size_t i;
+
+        for (i = 0; i < n; i++) {
+            __m256i v = _mm256_loadu_si256((const __m256i *)buf);
+
+            lo = _mm256_add_epi32(lo, _mm256_unpacklo_epi16(v, zero));
+            hi = _mm256_add_epi32(hi, _mm256_unpackhi_epi16(v, zero));
+            buf += 32;
+        }
+        len -= n * 32;
+
+        _mm256_storeu_si256((__m256i *)&lanes[0], lo);
+        _mm256_storeu_si256((__m256i *)&lanes[8], hi);
+        for (i = 0; i < ARRAY_SIZE(lanes); i++) {
+            sum += lanes[i];
+        }
     }
+
+    return net_checksum_add_tail(sum, buf, len);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+/* Note that for test_net_checksum_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX2    1
+#define CACHE_SSE2    2
+
+#ifdef CONFIG_AVX2_OPT
+# define INIT_CACHE 0
+# define INIT_ACCEL net_checksum_add_int
+#else
+# define INIT_CACHE CACHE_SSE2
+# define INIT_ACCEL net_checksum_add_sse2
+#endif
+
+static unsigned cpuid_cache = INIT_CACHE;
+static uint64_t (*net_checksum_accel)(const uint8_t *, size_t) = INIT_ACCEL;
+
+/* Below this, the setup of the vector loop does not pay off */
+static size_t length_to_accel = 64;
+
+static void init_accel(unsigned cache)
+{
+    uint64_t (*fn)(const uint8_t *, size_t) = net_checksum_add_int;
+
+    if (cache & CACHE_SSE2) {
+        fn = net_checksum_add_sse2;
+        length_to_accel = 64;
+    }
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = net_checksum_add_avx2;
+        length_to_accel = 128;
+    }
+#endif
+    net_checksum_accel = fn;
+}
+
+#ifdef CONFIG_AVX2_OPT
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (d & bit_SSE2) {
+            cache |= CACHE_SSE2;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX2_OPT */
+
+bool test_net_checksum_next_accel(void)
+{
+    /* If no bits set, we just tested net_checksum_add_int, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+static uint64_t select_accel_fn(const uint8_t *buf, size_t len)
+{
+    if (likely(len >= length_to_accel)) {
+        return net_checksum_accel(buf, len);
+    }
+    return net_checksum_add_int(buf, len);
+}
+
+#else
+#define select_accel_fn  net_checksum_add_int
+bool test_net_checksum_next_accel(void)
+{
+    return false;
+}
+#endif
+
+uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
+{
+    uint64_t sum64;
+    uint32_t sum;
+
+    if (len <= 0) {
+        return 0;
+    }
+
+    sum64 = select_accel_fn(buf, len);
+
+    /* Fold to 16 bits; this keeps a non-zero sum non-zero */
+    sum64 = (sum64 & 0xffffffff) + (sum64 >> 32);
+    sum64 = (sum64 & 0xffffffff) + (sum64 >> 32);
+    sum = (sum64 & 0xffff) + (sum64 >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    /* From host order words to network order words */
+    sum = be16_to_cpu(sum);
+
+    /* A chunk at an odd offset contributes its bytes swapped */
+    return (seq & 1) ? bswap16(sum) : sum;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
@@ -16,6 +16,8 @@
 #include "qemu/error-report.h"
 #include "trace.h"
 #include "qapi/error.h"
+#include "qapi/qapi-visit-net.h"
+#include "qapi/visitor.h"
 #include "net/net.h"
 #include "net/eth.h"
 #include "qom/object_interfaces.h"
@@ -54,6 +56,8 @@ static NotifierList colo_compare_notifiers =
 #define REGULAR_PACKET_CHECK_MS 1000
 #define DEFAULT_TIME_OUT_MS 3000
 
+#define COLO_COMPARE_MAX_WORKERS 64
+
 /* #define DEBUG_COLO_PACKETS */
 
 static QemuMutex colo_compare_mutex;
@@ -102,6 +106,44 @@ typedef struct SendEntry {
     uint8_t *buf;
 } SendEntry;
 
+/* A packet handed over from the iothread to a compare worker */
+typedef struct CompareInput {
+    int mode;
+    Packet *pkt;
+    ConnectionKey key;
+} CompareInput;
+
+/*
+ * Connections are sharded across the workers by connection_key_hash(), so
+ * each connection is only ever compared by one of them.  Without the
+ * "workers" property there is a single worker, which runs in the iothread.
+ */
+typedef struct CompareWorker {
+    struct CompareState *s;
+    bool threaded;
+    QemuThread thread;
+
+    /*
+     * Record the connection that through the NIC
+     * Element type: Connection
+     */
+    GQueue conn_list;
+    /* Record the connection without repetition */
+    GHashTable *connection_track_table;
+
+    /* Protects the fields below, which only threaded workers use */
+    QemuMutex lock;
+    QemuCond cond;
+    /* Element type: CompareInput */
+    GQueue input_list;
+    bool check_old;
+    bool flush;
+    bool quit;
+    uint32_t max_queue_depth;
+    uint64_t packets;
+    uint32_t connections;
+} CompareWorker;
+
 struct CompareState {
     Object parent;
 
@@ -122,13 +164,16 @@ struct CompareState {
     uint64_t compare_timeout;
     uint32_t expired_scan_cycle;
 
-    /*
-     * Record the connection that through the NIC
-     * Element type: Connection
-     */
-    GQueue conn_list;
-    /* Record the connection without repetition */
-    GHashTable *connection_track_table;
+    /* "workers" property, 0 compares in the iothread */
+    uint32_t nr_workers;
+    CompareWorker *workers;
+    int nr_shards;
+
+    /* Primary packets released by threaded workers, sent by the iothread */
+    QemuMutex release_lock;
+    GQueue release_list;
+    bool release_notify;
+    QEMUBH *release_bh;
 
     IOThread *iothread;
     GMainContext *worker_context;
@@ -193,6 +238,21 @@ static void colo_compare_inconsistency_notify(CompareState *s)
     }
 }
 
+static void colo_compare_worker_notify(CompareWorker *w)
+{
+    CompareState *s = w->s;
+
+    if (!w->threaded) {
+        colo_compare_inconsistency_notify(s);
+        return;
+    }
+
+    qemu_mutex_lock(&s->release_lock);
+    s->release_notify = true;
+    qemu_mutex_unlock(&s->release_lock);
+    qemu_bh_schedule(s->release_bh);
+}
+
 /* Use restricted to colo_insert_packet() */
 static gint seq_sorter(Packet *a, Packet *b, gpointer data)
 {
@@ -238,16 +298,54 @@ static int colo_insert_packet(GQueue *queue, Packet *pkt, uint32_t *max_ack)
     return 0;
 }
 
+static void colo_compare_connection(void *opaque, void *user_data);
+
+/*
+ * Called from the worker that owns the connection of @key
+ */
+static void colo_compare_worker_enqueue(CompareWorker *w, int mode,
+                                        Packet *pkt, ConnectionKey *key)
+{
+    Connection *conn;
+    int ret;
+
+    conn = connection_get(w->connection_track_table,
+                          key,
+                          &w->conn_list);
+
+    if (!conn->processing) {
+        g_queue_push_tail(&w->conn_list, conn);
+        conn->processing = true;
+    }
+
+    if (mode == PRIMARY_IN) {
+        ret = colo_insert_packet(&conn->primary_list, pkt, &conn->pack);
+    } else {
+        ret = colo_insert_packet(&conn->secondary_list, pkt, &conn->sack);
+    }
+
+    if (!ret) {
+        trace_colo_compare_drop_packet(colo_mode[mode],
+            "queue size too big, drop packet");
+        packet_destroy(pkt, NULL);
+        pkt = NULL;
+    }
+
+    /* compare packet in the specified connection */
+    colo_compare_connection(conn, w);
+}
+
 /*
  * Return 0 on success, if return -1 means the pkt
  * is unsupported(arp and ipv6) and will be sent later
  */
-static int packet_enqueue(CompareState *s, int mode, Connection **con)
+static int packet_enqueue(CompareState *s, int mode)
 {
     ConnectionKey key;
     Packet *pkt = NULL;
-    Connection *conn;
-    int ret;
+    CompareWorker *w;
+    CompareInput *input;
+    uint32_t depth;
 
     if (mode == PRIMARY_IN) {
         pkt = packet_new(s->pri_rs.buf,
@@ -266,29 +364,24 @@ static int packet_enqueue(CompareState *s, int mode, Connection **con)
     }
     fill_connection_key(pkt, &key, false);
 
-    conn = connection_get(s->connection_track_table,
-                          &key,
-                          &s->conn_list);
-
-    if (!conn->processing) {
-        g_queue_push_tail(&s->conn_list, conn);
-        conn->processing = true;
+    w = &s->workers[connection_key_hash(&key) % s->nr_shards];
+    if (!w->threaded) {
+        colo_compare_worker_enqueue(w, mode, pkt, &key);
+        return 0;
     }
 
-    if (mode == PRIMARY_IN) {
-        ret = colo_insert_packet(&conn->primary_list, pkt, &conn->pack);
-    } else {
-        ret = colo_insert_packet(&conn->secondary_list, pkt, &conn->sack);
-    }
+    input = g_slice_new(CompareInput);
+    input->mode = mode;
+    input->pkt = pkt;
+    input->key = key;
 
-    if (!ret) {
-        trace_colo_compare_drop_packet(colo_mode[mode],
-            "queue size too big, drop packet");
-        packet_destroy(pkt, NULL);
-        pkt = NULL;
-    }
-
-    *con = conn;
+    qemu_mutex_lock(&w->lock);
+    g_queue_push_tail(&w->input_list, input);
+    depth = g_queue_get_length(&w->input_list);
+    w->max_queue_depth = MAX(w->max_queue_depth, depth);
+    w->packets++;
+    qemu_cond_signal(&w->cond);
+    qemu_mutex_unlock(&w->lock);
 
     return 0;
 }
@@ -298,7 +391,8 @@ static inline bool after(uint32_t seq1, uint32_t seq2)
         return (int32_t)(seq1 - seq2) > 0;
 }
 
-static void colo_release_primary_pkt(CompareState *s, Packet *pkt)
+/* Called from the iothread */
+static void colo_send_primary_pkt(CompareState *s, Packet *pkt)
 {
     int ret;
     ret = compare_chr_send(s,
@@ -310,10 +404,30 @@ static void colo_release_primary_pkt(CompareState *s, Packet *pkt)
     if (ret < 0) {
         error_report("colo send primary packet failed");
     }
-    trace_colo_compare_main("packet same and release packet");
     packet_destroy_partial(pkt, NULL);
 }
 
+static void colo_output_primary_pkt(CompareWorker *w, Packet *pkt)
+{
+    CompareState *s = w->s;
+
+    if (!w->threaded) {
+        colo_send_primary_pkt(s, pkt);
+        return;
+    }
+
+    qemu_mutex_lock(&s->release_lock);
+    g_queue_push_tail(&s->release_list, pkt);
+    qemu_mutex_unlock(&s->release_lock);
+    qemu_bh_schedule(s->release_bh);
+}
+
+static void colo_release_primary_pkt(CompareWorker *w, Packet *pkt)
+{
+    trace_colo_compare_main("packet same and release packet");
+    colo_output_primary_pkt(w, pkt);
+}
+
 /*
  * The IP packets sent by primary and secondary
  * will be compared in here
@@ -397,7 +511,7 @@ static bool colo_mark_tcp_pkt(Packet *ppkt, Packet *spkt,
     return false;
 }
 
-static void colo_compare_tcp(CompareState *s, Connection *conn)
+static void colo_compare_tcp(CompareWorker *w, Connection *conn)
 {
     Packet *ppkt = NULL, *spkt = NULL;
     int8_t mark;
@@ -429,13 +543,13 @@ sec:
     spkt = g_queue_pop_tail(&conn->secondary_list);
 
     if (ppkt->tcp_seq == ppkt->seq_end) {
-        colo_release_primary_pkt(s, ppkt);
+        colo_release_primary_pkt(w, ppkt);
         ppkt = NULL;
     }
 
     if (ppkt && conn->compare_seq && !after(ppkt->seq_end, conn->compare_seq)) {
         trace_colo_compare_main("pri: this packet has compared");
-        colo_release_primary_pkt(s, ppkt);
+        colo_release_primary_pkt(w, ppkt);
         ppkt = NULL;
     }
 
@@ -475,7 +589,7 @@ sec:
 
         if (mark == COLO_COMPARE_FREE_PRIMARY) {
             conn->compare_seq = ppkt->seq_end;
-            colo_release_primary_pkt(s, ppkt);
+            colo_release_primary_pkt(w, ppkt);
             g_queue_push_tail(&conn->secondary_list, spkt);
             goto pri;
         } else if (mark == COLO_COMPARE_FREE_SECONDARY) {
@@ -484,7 +598,7 @@ sec:
             goto sec;
         } else if (mark == (COLO_COMPARE_FREE_PRIMARY | COLO_COMPARE_FREE_SECONDARY)) {
             conn->compare_seq = ppkt->seq_end;
-            colo_release_primary_pkt(s, ppkt);
+            colo_release_primary_pkt(w, ppkt);
             packet_destroy(spkt, NULL);
             goto pri;
         }
@@ -497,7 +611,7 @@ sec:
         qemu_hexdump(stderr, "colo-compare spkt", spkt->data, spkt->size);
 #endif
 
-        colo_compare_inconsistency_notify(s);
+        colo_compare_worker_notify(w);
     }
 }
 
@@ -622,8 +736,10 @@ void colo_compare_unregister_notifier(Notifier *notify)
 }
 
 static int colo_old_packet_check_one_conn(Connection *conn,
-                                          CompareState *s)
+                                          CompareWorker *w)
 {
+    CompareState *s = w->s;
+
     if (!g_queue_is_empty(&conn->primary_list)) {
         if (g_queue_find_custom(&conn->primary_list,
                                 &s->compare_timeout,
@@ -642,7 +758,7 @@ static int colo_old_packet_check_one_conn(Connection *conn,
 
 out:
     /* Do checkpoint will flush old packet */
-    colo_compare_inconsistency_notify(s);
+    colo_compare_worker_notify(w);
     return 0;
 }
 
@@ -653,17 +769,17 @@ out:
  */
 static void colo_old_packet_check(void *opaque)
 {
-    CompareState *s = opaque;
+    CompareWorker *w = opaque;
 
     /*
      * If we find one old packet, stop finding job and notify
      * COLO frame do checkpoint.
      */
-    g_queue_find_custom(&s->conn_list, s,
+    g_queue_find_custom(&w->conn_list, w,
                         (GCompareFunc)colo_old_packet_check_one_conn);
 }
 
-static void colo_compare_packet(CompareState *s, Connection *conn,
+static void colo_compare_packet(CompareWorker *w, Connection *conn,
                                 int (*HandlePacket)(Packet *spkt,
                                 Packet *ppkt))
 {
@@ -677,7 +793,7 @@ static void colo_compare_packet(CompareState *s, Connection *conn,
                  pkt, (GCompareFunc)HandlePacket);
 
         if (result) {
-            colo_release_primary_pkt(s, pkt);
+            colo_release_primary_pkt(w, pkt);
             packet_destroy(result->data, NULL);
             g_queue_delete_link(&conn->secondary_list, result);
         } else {
@@ -690,7 +806,7 @@ static void colo_compare_packet(CompareState *s, Connection *conn,
             trace_colo_compare_main("packet different");
             g_queue_push_tail(&conn->primary_list, pkt);
 
-            colo_compare_inconsistency_notify(s);
+            colo_compare_worker_notify(w);
             break;
         }
     }
@@ -704,21 +820,21 @@ static void colo_compare_packet(CompareState *s, Connection *conn,
  */
 static void colo_compare_connection(void *opaque, void *user_data)
 {
-    CompareState *s = user_data;
+    CompareWorker *w = user_data;
     Connection *conn = opaque;
 
     switch (conn->ip_proto) {
     case IPPROTO_TCP:
-        colo_compare_tcp(s, conn);
+        colo_compare_tcp(w, conn);
         break;
     case IPPROTO_UDP:
-        colo_compare_packet(s, conn, colo_packet_compare_udp);
+        colo_compare_packet(w, conn, colo_packet_compare_udp);
         break;
     case IPPROTO_ICMP:
-        colo_compare_packet(s, conn, colo_packet_compare_icmp);
+        colo_compare_packet(w, conn, colo_packet_compare_icmp);
         break;
     default:
-        colo_compare_packet(s, conn, colo_packet_compare_other);
+        colo_compare_packet(w, conn, colo_packet_compare_other);
         break;
     }
 }
@@ -893,9 +1009,23 @@ static void compare_notify_chr(void *opaque, const uint8_t *buf, int size)
 static void check_old_packet_regular(void *opaque)
 {
     CompareState *s = opaque;
+    int i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        if (!w->threaded) {
+            /* if have old packet we will notify checkpoint */
+            colo_old_packet_check(w);
+            continue;
+        }
+
+        qemu_mutex_lock(&w->lock);
+        w->check_old = true;
+        qemu_cond_signal(&w->cond);
+        qemu_mutex_unlock(&w->lock);
+    }
 
-    /* if have old packet we will notify checkpoint */
-    colo_old_packet_check(s);
     timer_mod(s->packet_check_timer, qemu_clock_get_ms(QEMU_CLOCK_HOST) +
               s->expired_scan_cycle);
 }
@@ -947,13 +1077,81 @@ static void colo_compare_timer_del(CompareState *s)
 
 static void colo_flush_packets(void *opaque, void *user_data);
 
+/* Called from the iothread, sends what threaded workers released */
+static void colo_compare_release_packets(CompareState *s)
+{
+    GQueue list;
+    Packet *pkt;
+    bool notify;
+
+    qemu_mutex_lock(&s->release_lock);
+    list = s->release_list;
+    g_queue_init(&s->release_list);
+    notify = s->release_notify;
+    s->release_notify = false;
+    qemu_mutex_unlock(&s->release_lock);
+
+    while ((pkt = g_queue_pop_head(&list))) {
+        colo_send_primary_pkt(s, pkt);
+    }
+
+    if (notify) {
+        colo_compare_inconsistency_notify(s);
+    }
+}
+
+static void colo_compare_release_bh(void *opaque)
+{
+    colo_compare_release_packets(opaque);
+}
+
+/*
+ * Called from the iothread on checkpoints: every worker flushes its
+ * connections, and the primary packets are sent out before returning.
+ */
+static void colo_compare_flush_all(CompareState *s)
+{
+    int i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        if (!w->threaded) {
+            g_queue_foreach(&w->conn_list, colo_flush_packets, w);
+            continue;
+        }
+
+        qemu_mutex_lock(&w->lock);
+        w->flush = true;
+        qemu_cond_broadcast(&w->cond);
+        qemu_mutex_unlock(&w->lock);
+    }
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        qemu_mutex_lock(&w->lock);
+        while (w->flush) {
+            qemu_cond_wait(&w->cond, &w->lock);
+        }
+        qemu_mutex_unlock(&w->lock);
+    }
+
+    /* The checkpoint resolves any inconsistency reported until now */
+    qemu_mutex_lock(&s->release_lock);
+    s->release_notify = false;
+    qemu_mutex_unlock(&s->release_lock);
+
+    colo_compare_release_packets(s);
+}
+
 static void colo_compare_handle_event(void *opaque)
 {
     CompareState *s = opaque;
 
     switch (s->event) {
     case COLO_EVENT_CHECKPOINT:
-        g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+        colo_compare_flush_all(s);
         break;
     case COLO_EVENT_FAILOVER:
         break;
@@ -968,11 +1166,173 @@ static void colo_compare_handle_event(void *opaque)
     qemu_mutex_unlock(&event_mtx);
 }
 
+static void *colo_compare_worker_thread(void *opaque)
+{
+    CompareWorker *w = opaque;
+    CompareInput *input;
+
+    qemu_mutex_lock(&w->lock);
+    for (;;) {
+        GQueue list;
+        bool check_old, flush;
+
+        while (!w->quit && !w->check_old && !w->flush &&
+               g_queue_is_empty(&w->input_list)) {
+            qemu_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->quit) {
+            break;
+        }
+
+        list = w->input_list;
+        g_queue_init(&w->input_list);
+        check_old = w->check_old;
+        w->check_old = false;
+        flush = w->flush;
+        qemu_mutex_unlock(&w->lock);
+
+        while ((input = g_queue_pop_head(&list))) {
+            colo_compare_worker_enqueue(w, input->mode, input->pkt,
+                                        &input->key);
+            g_slice_free(CompareInput, input);
+        }
+        if (check_old) {
+            colo_old_packet_check(w);
+        }
+        if (flush) {
+            g_queue_foreach(&w->conn_list, colo_flush_packets, w);
+        }
+
+        qemu_mutex_lock(&w->lock);
+        w->connections = g_hash_table_size(w->connection_track_table);
+        if (flush) {
+            w->flush = false;
+            qemu_cond_broadcast(&w->cond);
+        }
+    }
+
+    /* Do not leave colo_compare_flush_all() waiting */
+    w->flush = false;
+    qemu_cond_broadcast(&w->cond);
+    qemu_mutex_unlock(&w->lock);
+
+    return NULL;
+}
+
+static void colo_compare_workers_init(CompareState *s)
+{
+    int i;
+
+    s->nr_shards = MAX(s->nr_workers, 1);
+    s->workers = g_new0(CompareWorker, s->nr_shards);
+
+    qemu_mutex_init(&s->release_lock);
+    g_queue_init(&s->release_list);
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        w->s = s;
+        w->threaded = s->nr_workers > 0;
+        g_queue_init(&w->conn_list);
+        w->connection_track_table = g_hash_table_new_full(connection_key_hash,
+                                                          connection_key_equal,
+                                                          g_free,
+                                                          connection_destroy);
+        qemu_mutex_init(&w->lock);
+        qemu_cond_init(&w->cond);
+        g_queue_init(&w->input_list);
+    }
+}
+
+static void colo_compare_workers_start(CompareState *s)
+{
+    int i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+        g_autofree char *name = NULL;
+
+        if (!w->threaded) {
+            continue;
+        }
+
+        name = g_strdup_printf("colo-compare-%d", i);
+        qemu_thread_create(&w->thread, name, colo_compare_worker_thread, w,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+/*
+ * Stop the worker threads.  Their connections are then handled from the
+ * caller's thread, see colo_compare_worker_drain().
+ */
+static void colo_compare_workers_stop(CompareState *s)
+{
+    int i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        if (!w->threaded) {
+            continue;
+        }
+
+        qemu_mutex_lock(&w->lock);
+        w->quit = true;
+        qemu_cond_broadcast(&w->cond);
+        qemu_mutex_unlock(&w->lock);
+
+        qemu_thread_join(&w->thread);
+        w->threaded = false;
+    }
+
+    qemu_mutex_lock(&s->release_lock);
+    s->release_notify = false;
+    qemu_mutex_unlock(&s->release_lock);
+}
+
+/* Release everything a stopped worker still holds, oldest first */
+static void colo_compare_worker_drain(CompareWorker *w)
+{
+    CompareInput *input;
+
+    g_queue_foreach(&w->conn_list, colo_flush_packets, w);
+
+    while ((input = g_queue_pop_head(&w->input_list))) {
+        if (input->mode == PRIMARY_IN) {
+            colo_send_primary_pkt(w->s, input->pkt);
+        } else {
+            packet_destroy(input->pkt, NULL);
+        }
+        g_slice_free(CompareInput, input);
+    }
+}
+
+static void colo_compare_workers_free(CompareState *s)
+{
+    int i;
+
+    for (i = 0; i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+
+        g_queue_clear(&w->conn_list);
+        g_hash_table_destroy(w->connection_track_table);
+        qemu_mutex_destroy(&w->lock);
+        qemu_cond_destroy(&w->cond);
+    }
+
+    qemu_mutex_destroy(&s->release_lock);
+    g_free(s->workers);
+    s->workers = NULL;
+}
+
 static void colo_compare_iothread(CompareState *s)
 {
     AioContext *ctx = iothread_get_aio_context(s->iothread);
     object_ref(OBJECT(s->iothread));
     s->worker_context = iothread_get_g_main_context(s->iothread);
+    s->release_bh = aio_bh_new(ctx, colo_compare_release_bh, s);
 
     qemu_chr_fe_set_handlers(&s->chr_pri_in, compare_chr_can_read,
                              compare_pri_chr_in, NULL, NULL,
@@ -1122,6 +1482,66 @@ static void compare_set_expired_scan_cycle(Object *obj, Visitor *v,
     s->expired_scan_cycle = value;
 }
 
+static void compare_get_workers(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    CompareState *s = COLO_COMPARE(obj);
+    uint32_t value = s->nr_workers;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void compare_set_workers(Object *obj, Visitor *v,
+                                const char *name, void *opaque,
+                                Error **errp)
+{
+    CompareState *s = COLO_COMPARE(obj);
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+    if (value > COLO_COMPARE_MAX_WORKERS) {
+        error_setg(errp, "Property '%s.%s' must be at most %d",
+                   object_get_typename(obj), name, COLO_COMPARE_MAX_WORKERS);
+        return;
+    }
+    s->nr_workers = value;
+}
+
+static void compare_get_worker_stats(Object *obj, Visitor *v,
+                                     const char *name, void *opaque,
+                                     Error **errp)
+{
+    CompareState *s = COLO_COMPARE(obj);
+    ColoCompareWorkerInfo *info = g_new0(ColoCompareWorkerInfo, 1);
+    ColoCompareWorkerStatsList **tail = &info->workers;
+    int i;
+
+    for (i = 0; s->workers && i < s->nr_shards; i++) {
+        CompareWorker *w = &s->workers[i];
+        ColoCompareWorkerStats *stats;
+
+        if (!w->threaded) {
+            continue;
+        }
+
+        stats = g_new0(ColoCompareWorkerStats, 1);
+        stats->worker = i;
+        qemu_mutex_lock(&w->lock);
+        stats->queue_depth = g_queue_get_length(&w->input_list);
+        stats->max_queue_depth = w->max_queue_depth;
+        stats->packets = w->packets;
+        stats->connections = w->connections;
+        qemu_mutex_unlock(&w->lock);
+        QAPI_LIST_APPEND(tail, stats);
+    }
+
+    visit_type_ColoCompareWorkerInfo(v, name, &info, errp);
+    qapi_free_ColoCompareWorkerInfo(info);
+}
+
 static void get_max_queue_size(Object *obj, Visitor *v,
                                const char *name, void *opaque,
                                Error **errp)
@@ -1156,9 +1576,8 @@ out:
 static void compare_pri_rs_finalize(SocketReadState *pri_rs)
 {
     CompareState *s = container_of(pri_rs, CompareState, pri_rs);
-    Connection *conn = NULL;
 
-    if (packet_enqueue(s, PRIMARY_IN, &conn)) {
+    if (packet_enqueue(s, PRIMARY_IN)) {
         trace_colo_compare_main("primary: unsupported packet in");
         compare_chr_send(s,
                          pri_rs->buf,
@@ -1166,22 +1585,15 @@ static void compare_pri_rs_finalize(SocketReadState *pri_rs)
                          pri_rs->vnet_hdr_len,
                          false,
                          false);
-    } else {
-        /* compare packet in the specified connection */
-        colo_compare_connection(conn, s);
     }
 }
 
 static void compare_sec_rs_finalize(SocketReadState *sec_rs)
 {
     CompareState *s = container_of(sec_rs, CompareState, sec_rs);
-    Connection *conn = NULL;
 
-    if (packet_enqueue(s, SECONDARY_IN, &conn)) {
+    if (packet_enqueue(s, SECONDARY_IN)) {
         trace_colo_compare_main("secondary: unsupported packet in");
-    } else {
-        /* compare packet in the specified connection */
-        colo_compare_connection(conn, s);
     }
 }
 
@@ -1203,7 +1615,7 @@ static void compare_notify_rs_finalize(SocketReadState *notify_rs)
                                   notify_rs->buf,
                                   notify_rs->packet_len)) {
         /* colo-compare do checkpoint, flush pri packet and remove sec packet */
-        g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+        colo_compare_flush_all(s);
     } else {
         error_report("COLO compare got unsupported instruction");
     }
@@ -1318,14 +1730,9 @@ static void colo_compare_complete(UserCreatable *uc, Error **errp)
         g_queue_init(&s->notify_sendco.send_list);
     }
 
-    g_queue_init(&s->conn_list);
-
-    s->connection_track_table = g_hash_table_new_full(connection_key_hash,
-                                                      connection_key_equal,
-                                                      g_free,
-                                                      connection_destroy);
-
+    colo_compare_workers_init(s);
     colo_compare_iothread(s);
+    colo_compare_workers_start(s);
 
     qemu_mutex_lock(&colo_compare_mutex);
     if (!colo_compare_active) {
@@ -1341,19 +1748,13 @@ static void colo_compare_complete(UserCreatable *uc, Error **errp)
 
 static void colo_flush_packets(void *opaque, void *user_data)
 {
-    CompareState *s = user_data;
+    CompareWorker *w = user_data;
     Connection *conn = opaque;
     Packet *pkt = NULL;
 
     while (!g_queue_is_empty(&conn->primary_list)) {
         pkt = g_queue_pop_tail(&conn->primary_list);
-        compare_chr_send(s,
-                         pkt->data,
-                         pkt->size,
-                         pkt->vnet_hdr_len,
-                         false,
-                         true);
-        packet_destroy_partial(pkt, NULL);
+        colo_output_primary_pkt(w, pkt);
     }
     while (!g_queue_is_empty(&conn->secondary_list)) {
         pkt = g_queue_pop_tail(&conn->secondary_list);
@@ -1398,6 +1799,13 @@ static void colo_compare_init(Object *obj)
                         get_max_queue_size,
                         set_max_queue_size, NULL, NULL);
 
+    object_property_add(obj, "workers", "uint32",
+                        compare_get_workers,
+                        compare_set_workers, NULL, NULL);
+
+    object_property_add(obj, "worker-stats", "ColoCompareWorkerInfo",
+                        compare_get_worker_stats, NULL, NULL, NULL);
+
     s->vnet_hdr = false;
     object_property_add_bool(obj, "vnet_hdr_support", compare_get_vnet_hdr,
                              compare_set_vnet_hdr);
@@ -1443,6 +1851,11 @@ static void colo_compare_finalize(Object *obj)
 
     qemu_bh_delete(s->event_bh);
 
+    if (s->workers) {
+        colo_compare_workers_stop(s);
+    }
+    qemu_bh_delete(s->release_bh);
+
     AioContext *ctx = iothread_get_aio_context(s->iothread);
     aio_context_acquire(ctx);
     AIO_WAIT_WHILE(ctx, !s->out_sendco.done);
@@ -1452,17 +1865,23 @@ static void colo_compare_finalize(Object *obj)
     aio_context_release(ctx);
 
     /* Release all unhandled packets after compare thead exited */
-    g_queue_foreach(&s->conn_list, colo_flush_packets, s);
+    if (s->workers) {
+        int i;
+
+        colo_compare_release_packets(s);
+        for (i = 0; i < s->nr_shards; i++) {
+            colo_compare_worker_drain(&s->workers[i]);
+        }
+    }
     AIO_WAIT_WHILE(NULL, !s->out_sendco.done);
 
-    g_queue_clear(&s->conn_list);
     g_queue_clear(&s->out_sendco.send_list);
     if (s->notify_dev) {
         g_queue_clear(&s->notify_sendco.send_list);
     }
 
-    if (s->connection_track_table) {
-        g_hash_table_destroy(s->connection_track_table);
+    if (s->workers) {
+        colo_compare_workers_free(s);
     }
 
     object_unref(OBJECT(s->iothread));
@@ -245,6 +245,12 @@ static void netfilter_complete(UserCreatable *uc, Error **errp)
         return;
     }
 
+    if (ncs[0]->aio_context) {
+        error_setg(errp, "netdev '%s' is in use by an IOThread",
+                   ncs[0]->name);
+        return;
+    }
+
     if (strcmp(nf->position, "head") && strcmp(nf->position, "tail")) {
         Object *container;
         Object *obj;
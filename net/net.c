@@ -381,6 +381,7 @@ void qemu_del_net_client(NetClientState *nc)
     NetClientState *ncs[MAX_QUEUE_NUM];
     int queues, i;
     NetFilterState *nf, *next;
+    AioContext *ctx;
 
     assert(nc->info->type != NET_CLIENT_DRIVER_NIC);
 
@@ -404,6 +405,12 @@ void qemu_del_net_client(NetClientState *nc)
         }
         nic->peer_deleted = true;
 
+        /* The NIC may still be sending from an IOThread */
+        ctx = nc->aio_context;
+        if (ctx) {
+            aio_context_acquire(ctx);
+        }
+
         for (i = 0; i < queues; i++) {
             ncs[i]->peer->link_down = true;
         }
@@ -416,6 +423,9 @@ void qemu_del_net_client(NetClientState *nc)
             qemu_cleanup_net_client(ncs[i]);
         }
 
+        if (ctx) {
+            aio_context_release(ctx);
+        }
         return;
     }
 
@@ -547,6 +557,42 @@ int qemu_set_vnet_be(NetClientState *nc, bool is_be)
 #endif
 }
 
+bool qemu_can_set_net_aio_context(NetClientState *nc)
+{
+    return nc && nc->info->set_aio_context;
+}
+
+/*
+ * Run @nc's I/O handlers in @ctx, or in the main loop if @ctx is NULL.
+ * The handlers then acquire @ctx instead of relying on the BQL, so the
+ * peer must serialize its own datapath on the same AioContext.
+ */
+void qemu_set_net_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    assert(qemu_can_set_net_aio_context(nc));
+    nc->info->set_aio_context(nc, ctx);
+    nc->aio_context = ctx;
+}
+
+/*
+ * Main loop code that sends through @nc or changes its state must hold the
+ * AioContext of its datapath, because the BQL does not stop an IOThread.
+ * Nothing to do for clients that run in the main loop.
+ */
+void qemu_net_datapath_lock(NetClientState *nc)
+{
+    if (nc->aio_context) {
+        aio_context_acquire(nc->aio_context);
+    }
+}
+
+void qemu_net_datapath_unlock(NetClientState *nc)
+{
+    if (nc->aio_context) {
+        aio_context_release(nc->aio_context);
+    }
+}
+
 int qemu_can_receive_packet(NetClientState *nc)
 {
     if (nc->receive_disabled) {
@@ -632,6 +678,7 @@ void qemu_purge_queued_packets(NetClientState *nc)
 
 void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
 {
+    qemu_net_datapath_lock(nc);
     nc->receive_disabled = 0;
 
     if (nc->peer && nc->peer->info->type == NET_CLIENT_DRIVER_HUBPORT) {
@@ -648,6 +695,7 @@ void qemu_flush_or_purge_queued_packets(NetClientState *nc, bool purge)
         /* Unable to empty the queue, purge remaining packets */
         qemu_net_queue_purge(nc->incoming_queue, nc->peer);
     }
+    qemu_net_datapath_unlock(nc);
 }
 
 void qemu_flush_queued_packets(NetClientState *nc)
@@ -698,6 +746,67 @@ ssize_t qemu_send_packet_async(NetClientState *sender,
                                              buf, size, sent_cb);
 }
 
+static int qemu_deliver_packet_batch(NetClientState *sender,
+                                     const struct iovec *pkts,
+                                     int count,
+                                     void *opaque)
+{
+    NetClientState *nc = opaque;
+    int ret;
+
+    if (nc->link_down) {
+        return count;
+    }
+
+    if (nc->receive_disabled) {
+        return 0;
+    }
+
+    ret = nc->info->receive_batch(nc, pkts, count);
+    if (ret < count) {
+        nc->receive_disabled = 1;
+    }
+
+    return ret;
+}
+
+/*
+ * Send @count frames, each described by a single iovec.  If the peer
+ * implements receive_batch and no filter or queued packet is in the way,
+ * the frames are delivered with a single call; the remaining ones go
+ * through qemu_send_packet_async().
+ *
+ * All frames are consumed.  Returns false if any of them had to be queued,
+ * in which case the caller must stop sending until @sent_cb is invoked.
+ */
+bool qemu_send_packet_batch_async(NetClientState *sender,
+                                  const struct iovec *pkts, int count,
+                                  NetPacketSent *sent_cb)
+{
+    NetClientState *peer = sender->peer;
+    bool blocked = false;
+    int i = 0;
+
+    if (sender->link_down || !peer) {
+        return true;
+    }
+
+    if (peer->info->receive_batch &&
+        QTAILQ_EMPTY(&sender->filters) && QTAILQ_EMPTY(&peer->filters)) {
+        i = qemu_net_queue_send_batch(peer->incoming_queue, sender,
+                                      pkts, count, qemu_deliver_packet_batch);
+    }
+
+    for (; i < count; i++) {
+        if (qemu_send_packet_async(sender, pkts[i].iov_base, pkts[i].iov_len,
+                                   sent_cb) == 0) {
+            blocked = true;
+        }
+    }
+
+    return !blocked;
+}
+
 ssize_t qemu_send_packet(NetClientState *nc, const uint8_t *buf, int size)
 {
     return qemu_send_packet_async(nc, buf, size, NULL);
@@ -1007,6 +1116,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1100,6 +1212,9 @@ void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
@@ -1369,6 +1484,13 @@ void qmp_set_link(const char *name, bool up, Error **errp)
     }
     nc = ncs[0];
 
+    for (i = 0; i < queues; i++) {
+        qemu_net_datapath_lock(ncs[i]);
+        if (ncs[i]->peer) {
+            qemu_net_datapath_lock(ncs[i]->peer);
+        }
+    }
+
     for (i = 0; i < queues; i++) {
         ncs[i]->link_down = !up;
     }
@@ -1395,6 +1517,13 @@ void qmp_set_link(const char *name, bool up, Error **errp)
             nc->peer->info->link_status_changed(nc->peer);
         }
     }
+
+    for (i = queues - 1; i >= 0; i--) {
+        if (ncs[i]->peer) {
+            qemu_net_datapath_unlock(ncs[i]->peer);
+        }
+        qemu_net_datapath_unlock(ncs[i]);
+    }
 }
 
 static void net_vm_change_state_handler(void *opaque, bool running,
@@ -1406,9 +1535,11 @@ static void net_vm_change_state_handler(void *opaque, bool running,
     QTAILQ_FOREACH_SAFE(nc, &net_clients, next, tmp) {
         if (running) {
             /* Flush queued packets and wake up backends. */
+            qemu_net_datapath_lock(nc);
             if (nc->peer && qemu_can_send_packet(nc)) {
                 qemu_flush_queued_packets(nc->peer);
             }
+            qemu_net_datapath_unlock(nc);
         } else {
             /* Complete all queued packets, to guarantee we don't modify
              * state later when VM is not running.
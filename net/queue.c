@@ -254,6 +254,32 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
     return ret;
 }
 
+/*
+ * Hand a batch of single-buffer frames to @deliver, but only if that cannot
+ * reorder them with packets queued earlier.  Frames that are not accepted
+ * are left to the caller, which must push them through
+ * qemu_net_queue_send() so that they are queued in order.
+ */
+int qemu_net_queue_send_batch(NetQueue *queue,
+                              NetClientState *sender,
+                              const struct iovec *pkts,
+                              int count,
+                              NetQueueDeliverBatchFunc *deliver)
+{
+    int ret;
+
+    if (queue->delivering || !QTAILQ_EMPTY(&queue->packets) ||
+        !qemu_can_send_packet(sender)) {
+        return 0;
+    }
+
+    queue->delivering = 1;
+    ret = deliver(sender, pkts, count, queue->opaque);
+    queue->delivering = 0;
+
+    return ret;
+}
+
 void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
 {
     NetPacket *packet, *next;
@@ -43,17 +43,24 @@ typedef struct NetSocketState {
     IOHandler *send_fn;           /* differs between SOCK_STREAM/SOCK_DGRAM */
     bool read_poll;               /* waiting to receive data? */
     bool write_poll;              /* waiting to transmit data? */
+    AioContext *ctx;              /* IOThread running the fd handlers, or NULL */
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
 static void net_socket_writable(void *opaque);
 
+/* The caller must hold s->ctx if it is set */
 static void net_socket_update_fd_handler(NetSocketState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll ? s->send_fn : NULL,
-                        s->write_poll ? net_socket_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll ? s->send_fn : NULL;
+    IOHandler *fd_write = s->write_poll ? net_socket_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, fd_read, fd_write,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void net_socket_read_poll(NetSocketState *s, bool enable)
@@ -71,10 +78,17 @@ static void net_socket_write_poll(NetSocketState *s, bool enable)
 static void net_socket_writable(void *opaque)
 {
     NetSocketState *s = opaque;
+    AioContext *ctx = s->ctx;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
     net_socket_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static ssize_t net_socket_receive(NetClientState *nc, const uint8_t *buf, size_t size)
@@ -157,11 +171,15 @@ static void net_socket_rs_finalize(SocketReadState *rs)
 static void net_socket_send(void *opaque)
 {
     NetSocketState *s = opaque;
+    AioContext *ctx = s->ctx;
     int size;
     int ret;
     uint8_t buf1[NET_BUFSIZE];
     const uint8_t *buf;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
     size = recv(s->fd, buf1, sizeof(buf1), 0);
     if (size < 0) {
         if (errno != EWOULDBLOCK)
@@ -181,7 +199,7 @@ static void net_socket_send(void *opaque)
         s->nc.link_down = true;
         memset(s->nc.info_str, 0, sizeof(s->nc.info_str));
 
-        return;
+        goto out;
     }
     buf = buf1;
 
@@ -190,26 +208,71 @@ static void net_socket_send(void *opaque)
     if (ret == -1) {
         goto eoc;
     }
+out:
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static void net_socket_send_dgram(void *opaque)
 {
     NetSocketState *s = opaque;
+    AioContext *ctx = s->ctx;
     int size;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
     size = recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
     if (size < 0)
-        return;
+        goto out;
     if (size == 0) {
         /* end of connection */
         net_socket_read_poll(s, false);
         net_socket_write_poll(s, false);
-        return;
+        goto out;
     }
     if (qemu_send_packet_async(&s->nc, s->rs.buf, size,
                                net_socket_send_completed) == 0) {
         net_socket_read_poll(s, false);
     }
+out:
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
+/*
+ * Connections that are still being set up keep their handlers in the main
+ * loop; net_socket_connect() moves them to s->ctx once they are up.
+ */
+static void net_socket_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    bool connected = s->fd != -1 && s->send_fn;
+
+    assert(nc->info->type == NET_CLIENT_DRIVER_SOCKET);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    /* Holding the old context makes sure the handlers are not running */
+    if (s->ctx) {
+        aio_context_acquire(s->ctx);
+        if (connected) {
+            aio_set_fd_handler(s->ctx, s->fd, false, NULL, NULL, NULL, NULL,
+                               NULL);
+        }
+        aio_context_release(s->ctx);
+    } else if (connected) {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+
+    s->ctx = ctx;
+    if (connected) {
+        net_socket_update_fd_handler(s);
+    }
 }
 
 static int net_socket_mcast_create(struct sockaddr_in *mcastaddr,
@@ -308,6 +371,8 @@ fail:
 static void net_socket_cleanup(NetClientState *nc)
 {
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    net_socket_set_aio_context(nc, NULL);
     if (s->fd != -1) {
         net_socket_read_poll(s, false);
         net_socket_write_poll(s, false);
@@ -326,6 +391,7 @@ static NetClientInfo net_dgram_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
@@ -409,8 +475,18 @@ err:
 static void net_socket_connect(void *opaque)
 {
     NetSocketState *s = opaque;
+    AioContext *ctx = s->ctx;
+
+    if (ctx) {
+        /* Move the fd from the main loop to the IOThread */
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+        aio_context_acquire(ctx);
+    }
     s->send_fn = net_socket_send;
     net_socket_read_poll(s, true);
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static NetClientInfo net_socket_info = {
@@ -418,6 +494,7 @@ static NetClientInfo net_socket_info = {
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
     .cleanup = net_socket_cleanup,
+    .set_aio_context = net_socket_set_aio_context,
 };
 
 static NetSocketState *net_socket_fd_init_stream(NetClientState *peer,
@@ -47,12 +47,20 @@
 
 #include "net/vhost_net.h"
 
+/*
+ * Frames are read back to back into one buffer for as long as a full-sized
+ * frame still fits, so that peers with a receive_batch callback get several
+ * of them per call.
+ */
+#define TAP_RECV_BUFSIZE (4 * NET_BUFSIZE)
+#define TAP_RECV_BATCH   32
+
 typedef struct TAPState {
     NetClientState nc;
     int fd;
     char down_script[1024];
     char down_script_arg[128];
-    uint8_t buf[NET_BUFSIZE];
+    uint8_t buf[TAP_RECV_BUFSIZE];
     bool read_poll;
     bool write_poll;
     bool using_vnet_hdr;
@@ -61,6 +69,8 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    /* IOThread that runs the fd handlers, NULL for the main loop */
+    AioContext *ctx;
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -69,12 +79,28 @@ static void launch_script(const char *setup_script, const char *ifname,
 static void tap_send(void *opaque);
 static void tap_writable(void *opaque);
 
+/*
+ * Outside the BQL a callback may process more packets before yielding, but
+ * it still has to leave room for the peer's own handlers in the IOThread.
+ */
+#define TAP_SEND_BUDGET         50
+#define TAP_SEND_BUDGET_IOTHREAD 256
+
+/*
+ * The caller must hold s->ctx if it is set: the read/write poll state is
+ * shared with the handlers that run in the IOThread.
+ */
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll && s->enabled ? tap_send : NULL;
+    IOHandler *fd_write = s->write_poll && s->enabled ? tap_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, fd_read, fd_write,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -92,10 +118,17 @@ static void tap_write_poll(TAPState *s, bool enable)
 static void tap_writable(void *opaque)
 {
     TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
     tap_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
@@ -181,18 +214,21 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
     tap_read_poll(s, true);
 }
 
-static void tap_send(void *opaque)
+/*
+ * Read up to @max frames into s->buf and describe them in @pkts.  Short
+ * frames are padded in place; a frame never exceeds NET_BUFSIZE, so there
+ * is always room for that.
+ */
+static int tap_read_batch(TAPState *s, struct iovec *pkts, int max)
 {
-    TAPState *s = opaque;
-    int size;
-    int packets = 0;
+    size_t offset = 0;
+    int count = 0;
 
-    while (true) {
-        uint8_t *buf = s->buf;
-        uint8_t min_pkt[ETH_ZLEN];
-        size_t min_pktsz = sizeof(min_pkt);
+    while (count < max && offset + NET_BUFSIZE <= sizeof(s->buf)) {
+        uint8_t *buf = s->buf + offset;
+        int size;
 
-        size = tap_read_packet(s->fd, s->buf, sizeof(s->buf));
+        size = tap_read_packet(s->fd, buf, NET_BUFSIZE);
         if (size <= 0) {
             break;
         }
@@ -202,34 +238,91 @@ static void tap_send(void *opaque)
             size -= s->host_vnet_hdr_len;
         }
 
-        if (net_peer_needs_padding(&s->nc)) {
-            if (eth_pad_short_frame(min_pkt, &min_pktsz, buf, size)) {
-                buf = min_pkt;
-                size = min_pktsz;
-            }
+        if (net_peer_needs_padding(&s->nc) && size < ETH_ZLEN) {
+            memset(buf + size, 0, ETH_ZLEN - size);
+            size = ETH_ZLEN;
         }
 
-        size = qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
-        if (size == 0) {
-            tap_read_poll(s, false);
-            break;
-        } else if (size < 0) {
+        pkts[count].iov_base = buf;
+        pkts[count].iov_len = size;
+        count++;
+        offset = ROUND_UP(buf + size - s->buf, sizeof(uint64_t));
+    }
+
+    return count;
+}
+
+static void tap_send(void *opaque)
+{
+    TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
+    int budget = ctx ? TAP_SEND_BUDGET_IOTHREAD : TAP_SEND_BUDGET;
+    int batch = 1;
+    int packets = 0;
+
+    /*
+     * Only read ahead for peers that take the whole batch at once; for the
+     * others, frames read ahead would just pile up in the queue.
+     */
+    if (s->nc.peer && s->nc.peer->info->receive_batch) {
+        batch = TAP_RECV_BATCH;
+    }
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+    /*
+     * When the host keeps receiving more packets while tap_send() is
+     * running we can hog the QEMU global mutex.  Limit the number of
+     * packets that are processed per tap_send() callback to prevent
+     * stalling the guest.
+     */
+    while (packets < budget) {
+        struct iovec pkts[TAP_RECV_BATCH];
+        int count;
+
+        count = tap_read_batch(s, pkts, MIN(batch, budget - packets));
+        if (count == 0) {
             break;
         }
 
-        /*
-         * When the host keeps receiving more packets while tap_send() is
-         * running we can hog the QEMU global mutex.  Limit the number of
-         * packets that are processed per tap_send() callback to prevent
-         * stalling the guest.
-         */
-        packets++;
-        if (packets >= 50) {
+        if (!qemu_send_packet_batch_async(&s->nc, pkts, count,
+                                          tap_send_completed)) {
+            tap_read_poll(s, false);
             break;
         }
+
+        packets += count;
+    }
+    if (ctx) {
+        aio_context_release(ctx);
     }
 }
 
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    assert(nc->info->type == NET_CLIENT_DRIVER_TAP);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    /* Holding the old context makes sure tap_send() is not running there */
+    if (s->ctx) {
+        aio_context_acquire(s->ctx);
+        aio_set_fd_handler(s->ctx, s->fd, false, NULL, NULL, NULL, NULL,
+                           NULL);
+        aio_context_release(s->ctx);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+
+    s->ctx = ctx;
+    tap_update_fd_handler(s);
+}
+
 static bool tap_has_ufo(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -333,6 +426,7 @@ static void tap_cleanup(NetClientState *nc)
     tap_exit_notify(&s->exit, NULL);
     qemu_remove_exit_notifier(&s->exit);
 
+    tap_set_aio_context(nc, NULL);
     tap_read_poll(s, false);
     tap_write_poll(s, false);
     close(s->fd);
@@ -380,6 +474,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
     .set_steering_ebpf = tap_set_steering_ebpf,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
@@ -34,6 +34,8 @@
 #include "qapi/qobject-output-visitor.h"
 #include "qapi/qmp/qjson.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qnum.h"
 #include "qemu/cutils.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
@@ -44,10 +46,13 @@
 #include "qemu/sockets.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/rcu.h"
 #include "qom/object_interfaces.h"
 #include "sysemu/block-backend.h"
 #include "block/block_int.h"
 #include "block/blockjob.h"
+#include "block/block-status-scan.h"
+#include "block/aio_task.h"
 #include "block/qapi.h"
 #include "crypto/init.h"
 #include "trace/control.h"
@@ -85,6 +90,9 @@ enum {
     OPTION_BITMAPS = 275,
     OPTION_FORCE = 276,
     OPTION_SKIP_BROKEN = 277,
+    OPTION_READ_PERCENT = 278,
+    OPTION_RANDOM = 279,
+    OPTION_IOTHREAD = 280,
 };
 
 typedef enum OutputFormat {
@@ -1337,9 +1345,9 @@ static int img_compare(int argc, char **argv)
     const char *fmt1 = NULL, *fmt2 = NULL, *cache, *filename1, *filename2;
     BlockBackend *blk1, *blk2;
     BlockDriverState *bs1, *bs2;
+    BlockStatusScan *scan1 = NULL, *scan2 = NULL;
     int64_t total_size1, total_size2;
     uint8_t *buf1 = NULL, *buf2 = NULL;
-    int64_t pnum1, pnum2;
     int allocated1, allocated2;
     int ret = 0; /* return value - 0 Ident, 1 Different, >1 Error */
     bool progress = false, quiet = false, strict = false;
@@ -1485,31 +1493,37 @@ static int img_compare(int argc, char **argv)
         goto out;
     }
 
+    /* Both images are queried ahead of the comparison, in parallel */
+    scan1 = block_status_scan_new(bs1, NULL, false, true, 0, total_size1,
+                                  BLOCK_STATUS_SCAN_DEFAULT_WORKERS,
+                                  NULL, NULL);
+    scan2 = block_status_scan_new(bs2, NULL, false, true, 0, total_size2,
+                                  BLOCK_STATUS_SCAN_DEFAULT_WORKERS,
+                                  NULL, NULL);
+
     while (offset < total_size) {
+        BlockStatusExtent ext1, ext2;
         int status1, status2;
 
-        status1 = bdrv_block_status_above(bs1, NULL, offset,
-                                          total_size1 - offset, &pnum1, NULL,
-                                          NULL);
-        if (status1 < 0) {
+        ret = block_status_scan_get(scan1, offset, &ext1);
+        if (ret < 0) {
             ret = 3;
             error_report("Sector allocation test failed for %s", filename1);
             goto out;
         }
+        status1 = ext1.status;
         allocated1 = status1 & BDRV_BLOCK_ALLOCATED;
 
-        status2 = bdrv_block_status_above(bs2, NULL, offset,
-                                          total_size2 - offset, &pnum2, NULL,
-                                          NULL);
-        if (status2 < 0) {
+        ret = block_status_scan_get(scan2, offset, &ext2);
+        if (ret < 0) {
             ret = 3;
             error_report("Sector allocation test failed for %s", filename2);
             goto out;
         }
+        status2 = ext2.status;
         allocated2 = status2 & BDRV_BLOCK_ALLOCATED;
 
-        assert(pnum1 && pnum2);
-        chunk = MIN(pnum1, pnum2);
+        chunk = MIN(ext1.bytes, ext2.bytes);
 
         if (strict) {
             if (status1 != status2) {
@@ -1569,21 +1583,24 @@ static int img_compare(int argc, char **argv)
 
     if (total_size1 != total_size2) {
         BlockBackend *blk_over;
+        BlockStatusScan *scan_over;
         const char *filename_over;
 
         qprintf(quiet, "Warning: Image size mismatch!\n");
         if (total_size1 > total_size2) {
             blk_over = blk1;
+            scan_over = scan1;
             filename_over = filename1;
         } else {
             blk_over = blk2;
+            scan_over = scan2;
             filename_over = filename2;
         }
 
         while (offset < progress_base) {
-            ret = bdrv_block_status_above(blk_bs(blk_over), NULL, offset,
-                                          progress_base - offset, &chunk,
-                                          NULL, NULL);
+            BlockStatusExtent ext;
+
+            ret = block_status_scan_get(scan_over, offset, &ext);
             if (ret < 0) {
                 ret = 3;
                 error_report("Sector allocation test failed for %s",
@@ -1591,7 +1608,9 @@ static int img_compare(int argc, char **argv)
                 goto out;
 
             }
-            if (ret & BDRV_BLOCK_ALLOCATED && !(ret & BDRV_BLOCK_ZERO)) {
+            chunk = ext.bytes;
+            if (ext.status & BDRV_BLOCK_ALLOCATED &&
+                !(ext.status & BDRV_BLOCK_ZERO)) {
                 chunk = MIN(chunk, IO_BUF_SIZE);
                 ret = check_empty_sectors(blk_over, offset, chunk,
                                           filename_over, buf1, quiet);
@@ -1608,6 +1627,8 @@ static int img_compare(int argc, char **argv)
     ret = 0;
 
 out:
+    block_status_scan_free(scan1);
+    block_status_scan_free(scan2);
     qemu_vfree(buf1);
     qemu_vfree(buf2);
     blk_unref(blk2);
@@ -1644,10 +1665,27 @@ enum ImgConvertBlockStatus {
 #define MAX_COROUTINES 16
 #define CONVERT_THROTTLE_GROUP "img_convert"
 
+/*
+ * A range of the image on its way from the read workers to the writer.
+ * Read workers fill buffers and queue them in sector order; the writer
+ * takes them off the queue and starts write tasks on them.
+ */
+typedef struct ConvertBuffer {
+    int64_t sector_num;
+    int nb_sectors;
+    enum ImgConvertBlockStatus status;
+    bool copy_range;
+    uint8_t *buf;
+    int refcnt;     /* write tasks that still use the buffer */
+    QTAILQ_ENTRY(ConvertBuffer) next;
+    QSLIST_ENTRY(ConvertBuffer) next_free;
+} ConvertBuffer;
+
 typedef struct ImgConvertState {
     BlockBackend **src;
     int64_t *src_sectors;
     int *src_alignment;
+    BlockStatusScan **status_scan;  /* per source, created on first use */
     int src_num;
     int64_t total_sectors;
     int64_t allocated_sectors;
@@ -1672,10 +1710,18 @@ typedef struct ImgConvertState {
     size_t buf_sectors;
     long num_coroutines;
     int running_coroutines;
-    Coroutine *co[MAX_COROUTINES];
-    int64_t wait_sector_num[MAX_COROUTINES];
+    int running_readers;
     CoMutex lock;
     int ret;
+
+    /* Buffers that have been read, in sector order */
+    QTAILQ_HEAD(, ConvertBuffer) ready;
+    CoQueue ready_wait;
+    /* Buffers that are not in use; at most max_bufs are allocated */
+    QSLIST_HEAD(, ConvertBuffer) free_bufs;
+    CoQueue free_wait;
+    int nb_bufs;
+    int max_bufs;
 } ImgConvertState;
 
 static void convert_select_part(ImgConvertState *s, int64_t sector_num,
@@ -1690,6 +1736,49 @@ static void convert_select_part(ImgConvertState *s, int64_t sector_num,
     }
 }
 
+static void convert_free_status_scans(ImgConvertState *s)
+{
+    int i;
+
+    for (i = 0; i < s->src_num; i++) {
+        block_status_scan_free(s->status_scan[i]);
+        s->status_scan[i] = NULL;
+    }
+}
+
+/*
+ * Look up the status at @offset of source @src_cur from a scan that runs
+ * ahead of the copy.  Offsets must not decrease until the scans are freed.
+ */
+static int convert_block_status(ImgConvertState *s, int src_cur,
+                                BlockDriverState *base, int64_t offset,
+                                int64_t *count)
+{
+    BlockStatusExtent ext;
+    int ret;
+
+    if (!s->status_scan[src_cur]) {
+        s->status_scan[src_cur] =
+            block_status_scan_new(blk_bs(s->src[src_cur]), base, false, true,
+                                  offset,
+                                  s->src_sectors[src_cur] * BDRV_SECTOR_SIZE -
+                                  offset,
+                                  BLOCK_STATUS_SCAN_DEFAULT_WORKERS,
+                                  NULL, NULL);
+    }
+
+    ret = block_status_scan_get(s->status_scan[src_cur], offset, &ext);
+    if (ret < 0) {
+        /* Start over behind the failing range next time */
+        block_status_scan_free(s->status_scan[src_cur]);
+        s->status_scan[src_cur] = NULL;
+        return ret;
+    }
+
+    *count = MIN(*count, ext.bytes);
+    return ext.status;
+}
+
 static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
 {
     int64_t src_cur_offset;
@@ -1724,34 +1813,35 @@ static int convert_iteration_sectors(ImgConvertState *s, int64_t sector_num)
             base = NULL;
         }
 
-        do {
-            count = n * BDRV_SECTOR_SIZE;
-
-            ret = bdrv_block_status_above(src_bs, base, offset, count, &count,
-                                          NULL, NULL);
+        count = n * BDRV_SECTOR_SIZE;
+        ret = convert_block_status(s, src_cur, base, offset, &count);
 
-            if (ret < 0) {
-                if (s->salvage) {
-                    if (n == 1) {
-                        if (!s->quiet) {
-                            warn_report("error while reading block status at "
-                                        "offset %" PRIu64 ": %s", offset,
-                                        strerror(-ret));
-                        }
-                        /* Just try to read the data, then */
-                        ret = BDRV_BLOCK_DATA;
-                        count = BDRV_SECTOR_SIZE;
-                    } else {
-                        /* Retry on a shorter range */
-                        n = DIV_ROUND_UP(n, 4);
+        /* Narrow down a failing range by querying it directly */
+        while (ret < 0) {
+            if (s->salvage) {
+                if (n == 1) {
+                    if (!s->quiet) {
+                        warn_report("error while reading block status at "
+                                    "offset %" PRIu64 ": %s", offset,
+                                    strerror(-ret));
                     }
-                } else {
-                    error_report("error while reading block status at offset "
-                                 "%" PRIu64 ": %s", offset, strerror(-ret));
-                    return ret;
+                    /* Just try to read the data, then */
+                    ret = BDRV_BLOCK_DATA;
+                    count = BDRV_SECTOR_SIZE;
+                    break;
                 }
+                /* Retry on a shorter range */
+                n = DIV_ROUND_UP(n, 4);
+            } else {
+                error_report("error while reading block status at offset "
+                             "%" PRIu64 ": %s", offset, strerror(-ret));
+                return ret;
             }
-        } while (ret < 0);
+
+            count = n * BDRV_SECTOR_SIZE;
+            ret = bdrv_block_status_above(src_bs, base, offset, count, &count,
+                                          NULL, NULL);
+        }
 
         n = DIV_ROUND_UP(count, BDRV_SECTOR_SIZE);
 
@@ -1945,39 +2035,104 @@ static int coroutine_fn convert_co_copy_range(ImgConvertState *s, int64_t sector
     return 0;
 }
 
-static void coroutine_fn convert_co_do_copy(void *opaque)
+/* Stop the pipeline; the first error is the one that is reported */
+static void coroutine_fn convert_co_fail(ImgConvertState *s, int ret)
 {
-    ImgConvertState *s = opaque;
-    uint8_t *buf = NULL;
-    int ret, i;
-    int index = -1;
+    if (s->ret == -EINPROGRESS) {
+        s->ret = ret;
+    }
+    qemu_co_queue_restart_all(&s->ready_wait);
+    qemu_co_queue_restart_all(&s->free_wait);
+}
 
-    for (i = 0; i < s->num_coroutines; i++) {
-        if (s->co[i] == qemu_coroutine_self()) {
-            index = i;
+/* Wait for a free buffer; return NULL once the copy has failed */
+static ConvertBuffer *coroutine_fn convert_co_get_buffer(ImgConvertState *s)
+{
+    ConvertBuffer *cbuf;
+
+    while (s->ret == -EINPROGRESS) {
+        cbuf = QSLIST_FIRST(&s->free_bufs);
+        if (cbuf) {
+            QSLIST_REMOVE_HEAD(&s->free_bufs, next_free);
+            return cbuf;
+        }
+        if (s->nb_bufs < s->max_bufs) {
+            cbuf = g_new0(ConvertBuffer, 1);
+            cbuf->buf = blk_blockalign(s->target,
+                                       s->buf_sectors * BDRV_SECTOR_SIZE);
+            s->nb_bufs++;
+            return cbuf;
+        }
+        qemu_co_queue_wait(&s->free_wait, NULL);
+    }
+
+    return NULL;
+}
+
+static void coroutine_fn convert_co_put_buffer(ImgConvertState *s,
+                                               ConvertBuffer *cbuf)
+{
+    QSLIST_INSERT_HEAD(&s->free_bufs, cbuf, next_free);
+    qemu_co_queue_next(&s->free_wait);
+}
+
+static void coroutine_fn convert_co_unref_buffer(ImgConvertState *s,
+                                                 ConvertBuffer *cbuf)
+{
+    assert(cbuf->refcnt > 0);
+    if (--cbuf->refcnt == 0) {
+        convert_co_put_buffer(s, cbuf);
+    }
+}
+
+/* Hand a buffer that has been read to the writer */
+static void coroutine_fn convert_co_queue_buffer(ImgConvertState *s,
+                                                 ConvertBuffer *cbuf)
+{
+    ConvertBuffer *prev;
+
+    if (s->ret != -EINPROGRESS) {
+        convert_co_put_buffer(s, cbuf);
+        return;
+    }
+
+    /* Reads mostly complete in order, so search from the tail */
+    QTAILQ_FOREACH_REVERSE(prev, &s->ready, next) {
+        if (prev->sector_num < cbuf->sector_num) {
             break;
         }
     }
-    assert(index >= 0);
+    if (prev) {
+        QTAILQ_INSERT_AFTER(&s->ready, prev, cbuf, next);
+    } else {
+        QTAILQ_INSERT_HEAD(&s->ready, cbuf, next);
+    }
+    qemu_co_queue_restart_all(&s->ready_wait);
+}
 
-    s->running_coroutines++;
-    buf = blk_blockalign(s->target, s->buf_sectors * BDRV_SECTOR_SIZE);
+static void coroutine_fn convert_co_read_worker(void *opaque)
+{
+    ImgConvertState *s = opaque;
+    ConvertBuffer *cbuf;
+    int ret;
 
-    while (1) {
+    /* Claim the buffer first so that claimed ranges can always be queued */
+    while ((cbuf = convert_co_get_buffer(s))) {
         int n;
         int64_t sector_num;
         enum ImgConvertBlockStatus status;
-        bool copy_range;
 
         qemu_co_mutex_lock(&s->lock);
         if (s->ret != -EINPROGRESS || s->sector_num >= s->total_sectors) {
             qemu_co_mutex_unlock(&s->lock);
+            convert_co_put_buffer(s, cbuf);
             break;
         }
         n = convert_iteration_sectors(s, s->sector_num);
         if (n < 0) {
             qemu_co_mutex_unlock(&s->lock);
-            s->ret = n;
+            convert_co_put_buffer(s, cbuf);
+            convert_co_fail(s, n);
             break;
         }
         /* save current sector and allocation status to local variables */
@@ -1997,71 +2152,157 @@ static void coroutine_fn convert_co_do_copy(void *opaque)
                                         s->allocated_sectors, 0);
         }
 
-retry:
-        copy_range = s->copy_range && s->status == BLK_DATA;
-        if (status == BLK_DATA && !copy_range) {
-            ret = convert_co_read(s, sector_num, n, buf);
+        cbuf->sector_num = sector_num;
+        cbuf->nb_sectors = n;
+        cbuf->copy_range = s->copy_range && status == BLK_DATA;
+        if (status == BLK_DATA && !cbuf->copy_range) {
+            ret = convert_co_read(s, sector_num, n, cbuf->buf);
             if (ret < 0) {
                 error_report("error while reading at byte %lld: %s",
                              sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
-                s->ret = ret;
+                convert_co_put_buffer(s, cbuf);
+                convert_co_fail(s, ret);
+                break;
             }
         } else if (!s->min_sparse && status == BLK_ZERO) {
             status = BLK_DATA;
-            memset(buf, 0x00, n * BDRV_SECTOR_SIZE);
+            memset(cbuf->buf, 0x00, n * BDRV_SECTOR_SIZE);
         }
+        cbuf->status = status;
 
-        if (s->wr_in_order) {
-            /* keep writes in order */
-            while (s->wr_offs != sector_num && s->ret == -EINPROGRESS) {
-                s->wait_sector_num[index] = sector_num;
-                qemu_coroutine_yield();
-            }
-            s->wait_sector_num[index] = -1;
-        }
+        convert_co_queue_buffer(s, cbuf);
+    }
 
-        if (s->ret == -EINPROGRESS) {
-            if (copy_range) {
-                ret = convert_co_copy_range(s, sector_num, n);
-                if (ret) {
-                    s->copy_range = false;
-                    goto retry;
-                }
-            } else {
-                ret = convert_co_write(s, sector_num, n, buf, status);
-            }
+    s->running_readers--;
+    s->running_coroutines--;
+    /* The writer may be waiting for the last reader */
+    qemu_co_queue_restart_all(&s->ready_wait);
+}
+
+typedef struct ConvertWriteTask {
+    AioTask task;
+    ImgConvertState *s;
+    ConvertBuffer *cbuf;
+    int64_t sector_num;
+    int nb_sectors;
+    uint8_t *buf;
+} ConvertWriteTask;
+
+static int coroutine_fn convert_co_write_task(AioTask *task)
+{
+    ConvertWriteTask *t = container_of(task, ConvertWriteTask, task);
+    ImgConvertState *s = t->s;
+    int ret = 0;
+
+    if (s->ret != -EINPROGRESS) {
+        goto out;
+    }
+
+    if (t->cbuf->copy_range) {
+        ret = convert_co_copy_range(s, t->sector_num, t->nb_sectors);
+        if (ret) {
+            /* Fall back to reading and writing from now on */
+            s->copy_range = false;
+            ret = convert_co_read(s, t->sector_num, t->nb_sectors, t->buf);
             if (ret < 0) {
-                error_report("error while writing at byte %lld: %s",
-                             sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
-                s->ret = ret;
+                error_report("error while reading at byte %lld: %s",
+                             t->sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
+                convert_co_fail(s, ret);
+                goto out;
             }
+            ret = convert_co_write(s, t->sector_num, t->nb_sectors, t->buf,
+                                   BLK_DATA);
         }
+    } else {
+        ret = convert_co_write(s, t->sector_num, t->nb_sectors, t->buf,
+                               t->cbuf->status);
+    }
+    if (ret < 0) {
+        error_report("error while writing at byte %lld: %s",
+                     t->sector_num * BDRV_SECTOR_SIZE, strerror(-ret));
+        convert_co_fail(s, ret);
+    }
 
-        if (s->wr_in_order) {
-            /* reenter the coroutine that might have waited
-             * for this write to complete */
-            s->wr_offs = sector_num + n;
-            for (i = 0; i < s->num_coroutines; i++) {
-                if (s->co[i] && s->wait_sector_num[i] == s->wr_offs) {
-                    /*
-                     * A -> B -> A cannot occur because A has
-                     * s->wait_sector_num[i] == -1 during A -> B.  Therefore
-                     * B will never enter A during this time window.
-                     */
-                    qemu_coroutine_enter(s->co[i]);
-                    break;
-                }
-            }
+out:
+    convert_co_unref_buffer(s, t->cbuf);
+    return ret;
+}
+
+/*
+ * Start the write tasks for a buffer.  Compressed clusters are written by
+ * separate tasks, so that the format driver can compress several of them
+ * in its thread pool at once.  This waits while @pool is full.
+ */
+static void coroutine_fn convert_co_start_writes(ImgConvertState *s,
+                                                 AioTaskPool *pool,
+                                                 ConvertBuffer *cbuf)
+{
+    int64_t sector_num = cbuf->sector_num;
+    int nb_sectors = cbuf->nb_sectors;
+    uint8_t *buf = cbuf->buf;
+    int step = nb_sectors;
+
+    if (s->compressed && cbuf->status == BLK_DATA) {
+        step = s->cluster_sectors;
+    }
+
+    /* Keep the buffer until all tasks are started */
+    cbuf->refcnt = 1;
+    while (nb_sectors > 0 && s->ret == -EINPROGRESS) {
+        ConvertWriteTask *t = g_new(ConvertWriteTask, 1);
+        int n = MIN(step, nb_sectors);
+
+        *t = (ConvertWriteTask) {
+            .task.func = convert_co_write_task,
+            .s = s,
+            .cbuf = cbuf,
+            .sector_num = sector_num,
+            .nb_sectors = n,
+            .buf = buf,
+        };
+        cbuf->refcnt++;
+        aio_task_pool_start_task(pool, &t->task);
+
+        sector_num += n;
+        nb_sectors -= n;
+        buf += n * BDRV_SECTOR_SIZE;
+    }
+    convert_co_unref_buffer(s, cbuf);
+}
+
+static void coroutine_fn convert_co_writer(void *opaque)
+{
+    ImgConvertState *s = opaque;
+    AioTaskPool *pool;
+    ConvertBuffer *cbuf;
+
+    /* In-order writes are done one at a time, which keeps them in order */
+    pool = aio_task_pool_new(s->wr_in_order ? 1 : s->num_coroutines);
+
+    while (s->ret == -EINPROGRESS) {
+        cbuf = QTAILQ_FIRST(&s->ready);
+        if (!cbuf && !s->running_readers) {
+            break;
+        }
+        if (!cbuf || (s->wr_in_order && cbuf->sector_num != s->wr_offs)) {
+            qemu_co_queue_wait(&s->ready_wait, NULL);
+            continue;
         }
+
+        QTAILQ_REMOVE(&s->ready, cbuf, next);
+        s->wr_offs = cbuf->sector_num + cbuf->nb_sectors;
+        convert_co_start_writes(s, pool, cbuf);
     }
 
-    qemu_vfree(buf);
-    s->co[index] = NULL;
-    s->running_coroutines--;
-    if (!s->running_coroutines && s->ret == -EINPROGRESS) {
-        /* the convert job finished successfully */
-        s->ret = 0;
+    aio_task_pool_wait_all(pool);
+    aio_task_pool_free(pool);
+
+    /* Only left over after an error */
+    while ((cbuf = QTAILQ_FIRST(&s->ready))) {
+        QTAILQ_REMOVE(&s->ready, cbuf, next);
+        convert_co_put_buffer(s, cbuf);
     }
+    s->running_coroutines--;
 }
 
 static int convert_do_copy(ImgConvertState *s)
@@ -2075,14 +2316,14 @@ static int convert_do_copy(ImgConvertState *s)
         s->has_zero_init = bdrv_has_zero_init(blk_bs(s->target));
     }
 
-    /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+    /* Compressed images are written cluster by cluster, so make the buffers
+     * hold whole clusters. */
     if (s->compressed) {
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        s->buf_sectors = QEMU_ALIGN_DOWN(s->buf_sectors, s->cluster_sectors);
     }
 
     while (sector_num < s->total_sectors) {
@@ -2097,20 +2338,51 @@ static int convert_do_copy(ImgConvertState *s)
         sector_num += n;
     }
 
+    /* The copy starts over at offset 0 */
+    convert_free_status_scans(s);
+
     /* Do the copy */
     s->sector_next_status = 0;
     s->ret = -EINPROGRESS;
 
+    /*
+     * The copy is a pipeline: read workers fill buffers from the source, and
+     * the writer writes them to the target.  Reads can get ahead of the
+     * writes by at most max_bufs buffers.
+     */
     qemu_co_mutex_init(&s->lock);
+    QTAILQ_INIT(&s->ready);
+    qemu_co_queue_init(&s->ready_wait);
+    QSLIST_INIT(&s->free_bufs);
+    qemu_co_queue_init(&s->free_wait);
+    s->max_bufs = s->num_coroutines * 2;
+
+    s->running_readers = s->num_coroutines;
+    s->running_coroutines = s->num_coroutines + 1;
+    qemu_coroutine_enter(qemu_coroutine_create(convert_co_writer, s));
     for (i = 0; i < s->num_coroutines; i++) {
-        s->co[i] = qemu_coroutine_create(convert_co_do_copy, s);
-        s->wait_sector_num[i] = -1;
-        qemu_coroutine_enter(s->co[i]);
+        qemu_coroutine_enter(qemu_coroutine_create(convert_co_read_worker, s));
     }
 
     while (s->running_coroutines) {
         main_loop_wait(false);
     }
+    convert_free_status_scans(s);
+
+    if (s->ret == -EINPROGRESS) {
+        /* the convert job finished successfully */
+        s->ret = 0;
+    }
+
+    while (!QSLIST_EMPTY(&s->free_bufs)) {
+        ConvertBuffer *cbuf = QSLIST_FIRST(&s->free_bufs);
+
+        QSLIST_REMOVE_HEAD(&s->free_bufs, next_free);
+        qemu_vfree(cbuf->buf);
+        g_free(cbuf);
+        s->nb_bufs--;
+    }
+    assert(s->nb_bufs == 0);
 
     if (s->compressed && !s->ret) {
         /* signal EOF to align */
@@ -2454,6 +2726,7 @@ static int img_convert(int argc, char **argv)
     s.src = g_new0(BlockBackend *, s.src_num);
     s.src_sectors = g_new(int64_t, s.src_num);
     s.src_alignment = g_new(int, s.src_num);
+    s.status_scan = g_new0(BlockStatusScan *, s.src_num);
 
     for (bs_i = 0; bs_i < s.src_num; bs_i++) {
         BlockDriverState *src_bs;
@@ -2765,6 +3038,10 @@ out:
     qemu_opts_free(create_opts);
     qobject_unref(open_opts);
     blk_unref(s.target);
+    if (s.status_scan) {
+        convert_free_status_scans(&s);
+        g_free(s.status_scan);
+    }
     if (s.src) {
         for (bs_i = 0; bs_i < s.src_num; bs_i++) {
             blk_unref(s.src[bs_i]);
@@ -3073,20 +3350,15 @@ static int dump_map_entry(OutputFormat output_format, MapEntry *e,
     return 0;
 }
 
-static int get_block_status(BlockDriverState *bs, int64_t offset,
-                            int64_t bytes, MapEntry *e)
+/* BlockStatusScanFunc for img_map(); runs in several coroutines at once */
+static int coroutine_fn get_block_status(void *opaque, int64_t offset,
+                                         int64_t bytes, BlockStatusExtent *ext)
 {
-    int ret;
-    int depth;
+    BlockDriverState *bs = opaque;
     BlockDriverState *file;
-    bool has_offset;
     int64_t map;
-    char *filename = NULL;
-
-    /* As an optimization, we could cache the current range of unallocated
-     * clusters in each file of the chain, and avoid querying the same
-     * range repeatedly.
-     */
+    int depth;
+    int ret;
 
     depth = 0;
     for (;;) {
@@ -3108,27 +3380,40 @@ static int get_block_status(BlockDriverState *bs, int64_t offset,
         depth++;
     }
 
-    has_offset = !!(ret & BDRV_BLOCK_OFFSET_VALID);
+    *ext = (BlockStatusExtent) {
+        .offset = offset,
+        .bytes = bytes,
+        .status = ret,
+        .map = map,
+        .file = file,
+        .depth = depth,
+    };
+
+    return 0;
+}
 
-    if (file && has_offset) {
-        bdrv_refresh_filename(file);
-        filename = file->filename;
+static void map_entry_from_extent(const BlockStatusExtent *ext, MapEntry *e)
+{
+    bool has_offset = !!(ext->status & BDRV_BLOCK_OFFSET_VALID);
+    char *filename = NULL;
+
+    if (ext->file && has_offset) {
+        bdrv_refresh_filename(ext->file);
+        filename = ext->file->filename;
     }
 
     *e = (MapEntry) {
-        .start = offset,
-        .length = bytes,
-        .data = !!(ret & BDRV_BLOCK_DATA),
-        .zero = !!(ret & BDRV_BLOCK_ZERO),
-        .offset = map,
+        .start = ext->offset,
+        .length = ext->bytes,
+        .data = !!(ext->status & BDRV_BLOCK_DATA),
+        .zero = !!(ext->status & BDRV_BLOCK_ZERO),
+        .offset = ext->map,
         .has_offset = has_offset,
-        .depth = depth,
-        .present = !!(ret & BDRV_BLOCK_ALLOCATED),
+        .depth = ext->depth,
+        .present = !!(ext->status & BDRV_BLOCK_ALLOCATED),
         .has_filename = filename,
         .filename = filename,
     };
-
-    return 0;
 }
 
 static inline bool entry_mergeable(const MapEntry *curr, const MapEntry *next)
@@ -3159,6 +3444,7 @@ static int img_map(int argc, char **argv)
     OutputFormat output_format = OFORMAT_HUMAN;
     BlockBackend *blk;
     BlockDriverState *bs;
+    BlockStatusScan *scan = NULL;
     const char *filename, *fmt, *output;
     int64_t length;
     MapEntry curr = { .length = 0 }, next;
@@ -3262,16 +3548,24 @@ static int img_map(int argc, char **argv)
         length = MIN(start_offset + max_length, length);
     }
 
+    if (start_offset < length) {
+        scan = block_status_scan_new(bs, NULL, false, true, start_offset,
+                                     length - start_offset,
+                                     BLOCK_STATUS_SCAN_DEFAULT_WORKERS,
+                                     get_block_status, bs);
+    }
+
     curr.start = start_offset;
     while (curr.start + curr.length < length) {
         int64_t offset = curr.start + curr.length;
-        int64_t n = length - offset;
+        BlockStatusExtent ext;
 
-        ret = get_block_status(bs, offset, n, &next);
+        ret = block_status_scan_get(scan, offset, &ext);
         if (ret < 0) {
             error_report("Could not read file metadata: %s", strerror(-ret));
             goto out;
         }
+        map_entry_from_extent(&ext, &next);
 
         if (entry_mergeable(&curr, &next)) {
             curr.length += next.length;
@@ -3293,6 +3587,7 @@ static int img_map(int argc, char **argv)
     }
 
 out:
+    block_status_scan_free(scan);
     blk_unref(blk);
     return ret < 0;
 }
@@ -4254,23 +4549,77 @@ out_no_progress:
     return 0;
 }
 
-typedef struct BenchData {
+typedef struct BenchData BenchData;
+
+typedef struct BenchRequest {
+    BenchData *b;
+    QEMUIOVector qiov;
+    BlockAcctCookie acct;
+} BenchRequest;
+
+struct BenchData {
     BlockBackend *blk;
     uint64_t image_size;
-    bool write;
+    int read_percent;
+    bool random;
     int bufsize;
     int step;
     int nrreq;
     int n;
+    int n_total;
     int flush_interval;
     bool drain_on_flush;
     uint8_t *buf;
-    QEMUIOVector *qiov;
+    BenchRequest *reqs;
+    BenchRequest **free_reqs;
+    int nr_free;
 
     int in_flight;
     bool in_flush;
+    uint64_t start_offset;
     uint64_t offset;
-} BenchData;
+    uint64_t nr_blocks;         /* random offsets are picked from these */
+    uint64_t rand_state;
+
+    BlockAcctStats stats;
+    uint64_t max_latency_ns[BLOCK_MAX_IOTYPE];
+
+    /* Only used with --iothread */
+    AioContext *ctx;
+    QemuThread thread;
+    QemuEvent done_ev;
+    bool stopping;
+};
+
+/* xorshift64*: cheap, and reproducible between runs and releases */
+static uint64_t bench_rand(BenchData *b)
+{
+    b->rand_state ^= b->rand_state >> 12;
+    b->rand_state ^= b->rand_state << 25;
+    b->rand_state ^= b->rand_state >> 27;
+    return b->rand_state * 0x2545f4914f6cdd1dULL;
+}
+
+static int64_t bench_next_offset(BenchData *b)
+{
+    int64_t offset = b->offset;
+
+    if (b->random) {
+        return b->start_offset + bench_rand(b) % b->nr_blocks * b->bufsize;
+    }
+
+    b->offset += b->step;
+    b->offset %= b->image_size;
+    return offset;
+}
+
+static bool bench_next_is_write(BenchData *b)
+{
+    if (b->read_percent == 0 || b->read_percent == 100) {
+        return b->read_percent == 0;
+    }
+    return bench_rand(b) % 100 >= b->read_percent;
+}
 
 static void bench_undrained_flush_cb(void *opaque, int ret)
 {
@@ -4280,6 +4629,8 @@ static void bench_undrained_flush_cb(void *opaque, int ret)
     }
 }
 
+static void bench_request_cb(void *opaque, int ret);
+
 static void bench_cb(void *opaque, int ret)
 {
     BenchData *b = opaque;
@@ -4300,6 +4651,10 @@ static void bench_cb(void *opaque, int ret)
         b->n--;
         b->in_flight--;
 
+        if (b->n == 0 && b->ctx) {
+            qemu_event_set(&b->done_ev);
+        }
+
         /* Time for flush? Drain queue if requested, then flush */
         if (b->flush_interval && remaining % b->flush_interval == 0) {
             if (!b->in_flight || !b->drain_on_flush) {
@@ -4325,18 +4680,23 @@ static void bench_cb(void *opaque, int ret)
     }
 
     while (b->n > b->in_flight && b->in_flight < b->nrreq) {
-        int64_t offset = b->offset;
+        BenchRequest *req = b->free_reqs[--b->nr_free];
+        int64_t offset = bench_next_offset(b);
+        bool write = bench_next_is_write(b);
+
         /* blk_aio_* might look for completed I/Os and kick bench_cb
          * again, so make sure this operation is counted by in_flight
          * and b->offset is ready for the next submission.
          */
         b->in_flight++;
-        b->offset += b->step;
-        b->offset %= b->image_size;
-        if (b->write) {
-            acb = blk_aio_pwritev(b->blk, offset, b->qiov, 0, bench_cb, b);
+        block_acct_start(&b->stats, &req->acct, b->bufsize,
+                         write ? BLOCK_ACCT_WRITE : BLOCK_ACCT_READ);
+        if (write) {
+            acb = blk_aio_pwritev(b->blk, offset, &req->qiov, 0,
+                                  bench_request_cb, req);
         } else {
-            acb = blk_aio_preadv(b->blk, offset, b->qiov, 0, bench_cb, b);
+            acb = blk_aio_preadv(b->blk, offset, &req->qiov, 0,
+                                 bench_request_cb, req);
         }
         if (!acb) {
             error_report("Failed to issue request");
@@ -4345,6 +4705,163 @@ static void bench_cb(void *opaque, int ret)
     }
 }
 
+static void bench_request_cb(void *opaque, int ret)
+{
+    BenchRequest *req = opaque;
+    BenchData *b = req->b;
+    enum BlockAcctType type = req->acct.type;
+    int64_t latency_ns;
+
+    if (ret < 0) {
+        error_report("Failed request: %s", strerror(-ret));
+        exit(EXIT_FAILURE);
+    }
+
+    latency_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                 req->acct.start_time_ns;
+    b->max_latency_ns[type] = MAX(b->max_latency_ns[type], latency_ns);
+    block_acct_done(&b->stats, &req->acct);
+
+    b->free_reqs[b->nr_free++] = req;
+    bench_cb(b, 0);
+}
+
+static void bench_start_bh(void *opaque)
+{
+    bench_cb(opaque, 0);
+}
+
+static void *bench_iothread_run(void *opaque)
+{
+    BenchData *b = opaque;
+
+    rcu_register_thread();
+    qemu_set_current_aio_context(b->ctx);
+    while (!qatomic_read(&b->stopping)) {
+        aio_poll(b->ctx, true);
+    }
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void bench_stop_bh(void *opaque)
+{
+    BenchData *b = opaque;
+
+    qatomic_set(&b->stopping, true);
+}
+
+/* 1-2-5 steps from 1 microsecond to 10 seconds */
+static uint64List *bench_histogram_boundaries(void)
+{
+    uint64List *list = NULL;
+    uint64_t max = 10 * NANOSECONDS_PER_SECOND;
+    uint64_t decade;
+
+    for (decade = max; decade >= SCALE_US; decade /= 10) {
+        if (decade < max) {
+            QAPI_LIST_PREPEND(list, decade * 5);
+            QAPI_LIST_PREPEND(list, decade * 2);
+        }
+        QAPI_LIST_PREPEND(list, decade);
+    }
+    return list;
+}
+
+static const double bench_percentiles[] = { 50, 90, 99, 99.9 };
+
+static void bench_dump_human(BenchData *b, enum BlockAcctType type,
+                             const char *name, double seconds)
+{
+    BlockAcctStats *stats = &b->stats;
+    uint64_t ops = stats->nr_ops[type];
+    int i;
+
+    if (!ops) {
+        return;
+    }
+
+    printf("%s: %" PRIu64 " ops, %.1f IOPS, %.2f MiB/s\n", name, ops,
+           ops / seconds, stats->nr_bytes[type] / seconds / MiB);
+    printf("%s latency (us): mean %.1f", name,
+           (double)stats->total_time_ns[type] / ops / SCALE_US);
+    for (i = 0; i < ARRAY_SIZE(bench_percentiles); i++) {
+        printf(", p%g <= %.0f", bench_percentiles[i],
+               (double)block_latency_histogram_percentile(
+                   &stats->latency_histogram[type], bench_percentiles[i]) /
+               SCALE_US);
+    }
+    printf(", max %.1f\n", (double)b->max_latency_ns[type] / SCALE_US);
+}
+
+static QDict *bench_type_to_qdict(BenchData *b, enum BlockAcctType type,
+                                  double seconds)
+{
+    BlockAcctStats *stats = &b->stats;
+    BlockLatencyHistogram *hist = &stats->latency_histogram[type];
+    uint64_t ops = stats->nr_ops[type];
+    QDict *dict = qdict_new();
+    QDict *latency = qdict_new();
+    QDict *histogram = qdict_new();
+    QList *boundaries = qlist_new();
+    QList *bins = qlist_new();
+    char key[32];
+    int i;
+
+    qdict_put_int(dict, "ops", ops);
+    qdict_put_int(dict, "bytes", stats->nr_bytes[type]);
+    qdict_put(dict, "iops", qnum_from_double(ops / seconds));
+    qdict_put(dict, "bytes-per-second",
+              qnum_from_double(stats->nr_bytes[type] / seconds));
+
+    qdict_put_int(latency, "mean",
+                  ops ? stats->total_time_ns[type] / ops : 0);
+    qdict_put_int(latency, "max", b->max_latency_ns[type]);
+    for (i = 0; i < ARRAY_SIZE(bench_percentiles); i++) {
+        snprintf(key, sizeof(key), "p%g", bench_percentiles[i]);
+        qdict_put_int(latency, key,
+                      block_latency_histogram_percentile(
+                          hist, bench_percentiles[i]));
+    }
+    qdict_put(dict, "latency-ns", latency);
+
+    for (i = 0; i < hist->nbins - 1; i++) {
+        qlist_append_int(boundaries, hist->boundaries[i]);
+    }
+    for (i = 0; i < hist->nbins; i++) {
+        qlist_append_int(bins, hist->bins[i]);
+    }
+    qdict_put(histogram, "boundaries", boundaries);
+    qdict_put(histogram, "bins", bins);
+    qdict_put(dict, "histogram", histogram);
+
+    return dict;
+}
+
+static void bench_dump_json(BenchData *b, double seconds)
+{
+    QDict *dict = qdict_new();
+    GString *str;
+
+    qdict_put_int(dict, "requests", b->n_total);
+    qdict_put_int(dict, "depth", b->nrreq);
+    qdict_put_int(dict, "buffer-size", b->bufsize);
+    qdict_put_int(dict, "step-size", b->step);
+    qdict_put_int(dict, "read-percent", b->read_percent);
+    qdict_put_str(dict, "access", b->random ? "random" : "sequential");
+    qdict_put_bool(dict, "iothread", b->ctx != NULL);
+    qdict_put(dict, "seconds", qnum_from_double(seconds));
+    qdict_put(dict, "read",
+              bench_type_to_qdict(b, BLOCK_ACCT_READ, seconds));
+    qdict_put(dict, "write",
+              bench_type_to_qdict(b, BLOCK_ACCT_WRITE, seconds));
+
+    str = qobject_to_json_pretty(QOBJECT(dict), true);
+    printf("%s\n", str->str);
+    g_string_free(str, true);
+    qobject_unref(dict);
+}
+
 static int img_bench(int argc, char **argv)
 {
     int c, ret = 0;
@@ -4352,6 +4869,11 @@ static int img_bench(int argc, char **argv)
     bool quiet = false;
     bool image_opts = false;
     bool is_write = false;
+    int read_percent = -1;
+    bool random_access = false;
+    bool use_iothread = false;
+    OutputFormat output_format = OFORMAT_HUMAN;
+    const char *output = NULL;
     int count = 75000;
     int depth = 64;
     int64_t offset = 0;
@@ -4366,9 +4888,11 @@ static int img_bench(int argc, char **argv)
     int flags = 0;
     bool writethrough = false;
     struct timeval t1, t2;
+    double seconds;
     int i;
     bool force_share = false;
     size_t buf_size;
+    uint64List *boundaries;
 
     for (;;) {
         static const struct option long_options[] = {
@@ -4377,6 +4901,10 @@ static int img_bench(int argc, char **argv)
             {"image-opts", no_argument, 0, OPTION_IMAGE_OPTS},
             {"pattern", required_argument, 0, OPTION_PATTERN},
             {"no-drain", no_argument, 0, OPTION_NO_DRAIN},
+            {"read-percent", required_argument, 0, OPTION_READ_PERCENT},
+            {"random", no_argument, 0, OPTION_RANDOM},
+            {"iothread", no_argument, 0, OPTION_IOTHREAD},
+            {"output", required_argument, 0, OPTION_OUTPUT},
             {"force-share", no_argument, 0, 'U'},
             {0, 0, 0, 0}
         };
@@ -4508,18 +5036,55 @@ static int img_bench(int argc, char **argv)
         case OPTION_NO_DRAIN:
             drain_on_flush = false;
             break;
+        case OPTION_READ_PERCENT:
+        {
+            unsigned long res;
+
+            if (qemu_strtoul(optarg, NULL, 0, &res) < 0 || res > 100) {
+                error_report("Invalid read percentage specified");
+                return 1;
+            }
+            read_percent = res;
+            break;
+        }
+        case OPTION_RANDOM:
+            random_access = true;
+            break;
+        case OPTION_IOTHREAD:
+            use_iothread = true;
+            break;
+        case OPTION_OUTPUT:
+            output = optarg;
+            break;
         case OPTION_IMAGE_OPTS:
             image_opts = true;
             break;
         }
     }
 
+    if (output && !strcmp(output, "json")) {
+        output_format = OFORMAT_JSON;
+    } else if (output && !strcmp(output, "human")) {
+        output_format = OFORMAT_HUMAN;
+    } else if (output) {
+        error_report("--output must be used with human or json as argument.");
+        return 1;
+    }
+
+    /* -w alone means writes only; --read-percent mixes in reads */
+    if (read_percent < 0) {
+        read_percent = is_write ? 0 : 100;
+    }
+    if (read_percent < 100) {
+        flags |= BDRV_O_RDWR;
+    }
+
     if (optind != argc - 1) {
         error_exit("Expecting one image file name");
     }
     filename = argv[argc - 1];
 
-    if (!is_write && flush_interval) {
+    if (read_percent == 100 && flush_interval) {
         error_report("--flush-interval is only available in write tests");
         ret = -1;
         goto out;
@@ -4550,49 +5115,147 @@ static int img_bench(int argc, char **argv)
         .step           = step ?: bufsize,
         .nrreq          = depth,
         .n              = count,
+        .n_total        = count,
+        .start_offset   = offset,
         .offset         = offset,
-        .write          = is_write,
+        .read_percent   = read_percent,
+        .random         = random_access,
+        .rand_state     = 0x9e3779b97f4a7c15ULL,
         .flush_interval = flush_interval,
         .drain_on_flush = drain_on_flush,
     };
-    printf("Sending %d %s requests, %d bytes each, %d in parallel "
-           "(starting at offset %" PRId64 ", step size %d)\n",
-           data.n, data.write ? "write" : "read", data.bufsize, data.nrreq,
-           data.offset, data.step);
-    if (flush_interval) {
-        printf("Sending flush every %d requests\n", flush_interval);
+
+    if (random_access) {
+        if (!bufsize || offset >= image_size) {
+            data.nr_blocks = 0;
+        } else {
+            data.nr_blocks = (image_size - offset) / bufsize;
+        }
+        if (!data.nr_blocks) {
+            error_report("No room for random requests of %zu bytes after "
+                         "offset %" PRId64, bufsize, offset);
+            ret = -1;
+            goto out;
+        }
+    }
+
+    if (output_format == OFORMAT_HUMAN) {
+        if (read_percent == 0 || read_percent == 100) {
+            printf("Sending %d %s %s requests, %d bytes each, %d in parallel "
+                   "(starting at offset %" PRId64 ", step size %d)\n",
+                   data.n, random_access ? "random" : "sequential",
+                   read_percent ? "read" : "write", data.bufsize, data.nrreq,
+                   data.offset, data.step);
+        } else {
+            printf("Sending %d %s requests (%d%% reads), %d bytes each, "
+                   "%d in parallel (starting at offset %" PRId64
+                   ", step size %d)\n",
+                   data.n, random_access ? "random" : "sequential",
+                   read_percent, data.bufsize, data.nrreq, data.offset,
+                   data.step);
+        }
+        if (flush_interval) {
+            printf("Sending flush every %d requests\n", flush_interval);
+        }
     }
 
+    block_acct_init(&data.stats);
+    boundaries = bench_histogram_boundaries();
+    block_latency_histogram_set(&data.stats, BLOCK_ACCT_READ, boundaries);
+    block_latency_histogram_set(&data.stats, BLOCK_ACCT_WRITE, boundaries);
+    qapi_free_uint64List(boundaries);
+
     buf_size = data.nrreq * data.bufsize;
     data.buf = blk_blockalign(blk, buf_size);
     memset(data.buf, pattern, data.nrreq * data.bufsize);
 
     blk_register_buf(blk, data.buf, buf_size);
 
-    data.qiov = g_new(QEMUIOVector, data.nrreq);
+    data.reqs = g_new0(BenchRequest, data.nrreq);
+    data.free_reqs = g_new(BenchRequest *, data.nrreq);
     for (i = 0; i < data.nrreq; i++) {
-        qemu_iovec_init(&data.qiov[i], 1);
-        qemu_iovec_add(&data.qiov[i],
+        data.reqs[i].b = &data;
+        qemu_iovec_init(&data.reqs[i].qiov, 1);
+        qemu_iovec_add(&data.reqs[i].qiov,
                        data.buf + i * data.bufsize, data.bufsize);
+        data.free_reqs[i] = &data.reqs[i];
+    }
+    data.nr_free = data.nrreq;
+
+    if (use_iothread) {
+        Error *local_err = NULL;
+
+        /*
+         * Like an iothread in the emulator, a separate thread polls the
+         * image's AioContext and the main loop stays out of the way.
+         */
+        data.ctx = aio_context_new(&local_err);
+        if (!data.ctx) {
+            error_report_err(local_err);
+            ret = -1;
+            goto out;
+        }
+        qemu_event_init(&data.done_ev, false);
+        qemu_thread_create(&data.thread, "bench-iothread",
+                           bench_iothread_run, &data, QEMU_THREAD_JOINABLE);
+        if (blk_set_aio_context(blk, data.ctx, &local_err) < 0) {
+            error_report_err(local_err);
+            ret = -1;
+            goto out;
+        }
     }
 
     gettimeofday(&t1, NULL);
-    bench_cb(&data, 0);
+    if (data.ctx) {
+        if (data.n > 0) {
+            aio_bh_schedule_oneshot(data.ctx, bench_start_bh, &data);
+            qemu_event_wait(&data.done_ev);
+        }
+    } else {
+        bench_cb(&data, 0);
 
-    while (data.n > 0) {
-        main_loop_wait(false);
+        while (data.n > 0) {
+            main_loop_wait(false);
+        }
     }
     gettimeofday(&t2, NULL);
 
-    printf("Run completed in %3.3f seconds.\n",
-           (t2.tv_sec - t1.tv_sec)
-           + ((double)(t2.tv_usec - t1.tv_usec) / 1000000));
+    seconds = (t2.tv_sec - t1.tv_sec)
+              + ((double)(t2.tv_usec - t1.tv_usec) / 1000000);
+
+    if (output_format == OFORMAT_JSON) {
+        bench_dump_json(&data, seconds);
+    } else {
+        printf("Run completed in %3.3f seconds.\n", seconds);
+        bench_dump_human(&data, BLOCK_ACCT_READ, "read", seconds);
+        bench_dump_human(&data, BLOCK_ACCT_WRITE, "write", seconds);
+    }
 
 out:
+    if (data.ctx) {
+        if (blk_get_aio_context(blk) == data.ctx) {
+            aio_context_acquire(data.ctx);
+            blk_set_aio_context(blk, qemu_get_aio_context(), &error_abort);
+            aio_context_release(data.ctx);
+        }
+        aio_bh_schedule_oneshot(data.ctx, bench_stop_bh, &data);
+        qemu_thread_join(&data.thread);
+        qemu_event_destroy(&data.done_ev);
+        aio_context_unref(data.ctx);
+    }
     if (data.buf) {
         blk_unregister_buf(blk, data.buf);
     }
     qemu_vfree(data.buf);
+    if (data.reqs) {
+        for (i = 0; i < data.nrreq; i++) {
+            qemu_iovec_destroy(&data.reqs[i].qiov);
+        }
+        block_latency_histograms_clear(&data.stats);
+        block_acct_cleanup(&data.stats);
+    }
+    g_free(data.reqs);
+    g_free(data.free_reqs);
     blk_unref(blk);
 
     if (ret) {
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+#
+# Benchmark NBD server read throughput with and without zero-copy sends
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+
+import sys
+import os
+import subprocess
+import re
+import json
+import time
+
+import simplebench
+from results_to_text import results_to_text
+
+
+IMAGE_SIZE = 1024 * 1024 * 1024
+
+
+def qemu_img_bench(args):
+    p = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                       universal_newlines=True)
+
+    if p.returncode == 0:
+        try:
+            m = re.search(r'Run completed in (\d+.\d+) seconds.', p.stdout)
+            return {'seconds': float(m.group(1))}
+        except Exception:
+            return {'error': f'failed to parse qemu-img output: {p.stdout}'}
+    else:
+        return {'error': f'qemu-img failed: {p.returncode}: {p.stdout}'}
+
+
+def start_qemu_nbd(env, case, sock):
+    try:
+        os.remove(sock)
+    except OSError:
+        pass
+
+    args = [env['qemu-nbd-binary'], '-k', sock, '-f', 'raw', '-r', '-t',
+            '-e', '16']
+    if env['zero-copy']:
+        args.append('--zero-copy')
+    args.append(case['image'])
+
+    nbd = subprocess.Popen(args, stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+    for _ in range(100):
+        if os.path.exists(sock):
+            return nbd
+        time.sleep(0.05)
+
+    nbd.kill()
+    nbd.wait()
+    return None
+
+
+def bench_func(env, case):
+    sock = f"{case['dir']}/nbd-read-test.sock"
+    nbd = start_qemu_nbd(env, case, sock)
+    if nbd is None:
+        return {'error': 'qemu-nbd did not start'}
+
+    try:
+        count = IMAGE_SIZE // case['block-size'] * case['passes']
+        res = qemu_img_bench([env['qemu-img-binary'], 'bench', '-c',
+                              str(count), '-d', str(case['depth']), '-s',
+                              str(case['block-size']), '-t', 'none',
+                              '--image-opts',
+                              'driver=nbd,server.type=unix,'
+                              f'server.path={sock}'])
+    finally:
+        nbd.terminate()
+        nbd.wait()
+        os.remove(sock)
+
+    if 'seconds' in res:
+        res['MiB/s'] = count * case['block-size'] / res['seconds'] / 1024 ** 2
+    return res
+
+
+if __name__ == '__main__':
+    if len(sys.argv) < 3:
+        print(f'USAGE: {sys.argv[0]} <qemu-img binary> <qemu-nbd binary> '
+              'DISK_NAME:DIR_PATH ...')
+        exit(1)
+
+    qemu_img = sys.argv[1]
+    qemu_nbd = sys.argv[2]
+
+    envs = [
+        {
+            'id': 'copy',
+            'qemu-img-binary': qemu_img,
+            'qemu-nbd-binary': qemu_nbd,
+            'zero-copy': False
+        },
+        {
+            'id': 'zero-copy',
+            'qemu-img-binary': qemu_img,
+            'qemu-nbd-binary': qemu_nbd,
+            'zero-copy': True
+        }
+    ]
+
+    cases = []
+
+    for disk in sys.argv[3:]:
+        name, path = disk.split(':')
+        image = f'{path}/nbd-read-test.raw'
+
+        # Fill the image with data, so that sparse reads do not turn the
+        # benchmark into a test of hole reporting.
+        with open(image, 'wb') as f:
+            block = os.urandom(1024 * 1024)
+            for _ in range(IMAGE_SIZE // len(block)):
+                f.write(block)
+
+        for bs, depth in ((64 * 1024, 16), (1024 * 1024, 16),
+                          (4 * 1024 * 1024, 4)):
+            cases.append({
+                'id': f'{name}, {bs // 1024}k x {depth}',
+                'block-size': bs,
+                'depth': depth,
+                'passes': 4,
+                'dir': path,
+                'image': image
+            })
+
+    result = simplebench.bench(bench_func, envs, cases, count=3)
+    print(results_to_text(result))
+    with open('results.json', 'w') as f:
+        json.dump(result, f, indent=4)
+
+    for disk in sys.argv[3:]:
+        os.remove(f"{disk.split(':')[1]}/nbd-read-test.raw")
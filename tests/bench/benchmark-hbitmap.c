@@ -0,0 +1,164 @@
+/*
+ * HBitmap scanning and counting benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/bitmap.h"
+#include "qemu/hbitmap.h"
+
+/* A 16 TiB disk tracked at 64 KiB granularity, i.e. 256M bits.  */
+#define DISK_SIZE   (16 * TiB)
+#define GRANULARITY 16
+#define CHUNK       (64 * KiB)
+
+typedef struct HBitmapBenchOpts {
+    const char *name;
+    /* One dirty run of run_chunks chunks every stride_chunks chunks.  */
+    uint64_t run_chunks;
+    uint64_t stride_chunks;
+} HBitmapBenchOpts;
+
+static HBitmap *bench_bitmap_new(const HBitmapBenchOpts *opts)
+{
+    HBitmap *hb = hbitmap_alloc(DISK_SIZE, GRANULARITY);
+    uint64_t off;
+
+    for (off = 0; off < DISK_SIZE; off += opts->stride_chunks * CHUNK) {
+        hbitmap_set(hb, off, MIN(opts->run_chunks * CHUNK, DISK_SIZE - off));
+    }
+    return hb;
+}
+
+static void test_hbitmap_extents_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    HBitmapExtent extents[256];
+    uint64_t nr_extents = 0;
+    int64_t start = 0;
+    size_t n;
+
+    g_test_timer_start();
+    do {
+        n = hbitmap_get_dirty_extents(hb, start, DISK_SIZE, extents,
+                                      ARRAY_SIZE(extents));
+        if (n) {
+            start = extents[n - 1].start + extents[n - 1].count;
+        }
+        nr_extents += n;
+    } while (n == ARRAY_SIZE(extents));
+    g_test_timer_elapsed();
+
+    g_test_message("extents(%s): %" PRIu64 " extents in %.3f ms",
+                   opts->name, nr_extents, g_test_timer_last() * 1000);
+    hbitmap_free(hb);
+}
+
+static void test_hbitmap_next_zero_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    uint64_t nr_runs = 0;
+    int64_t off = 0;
+
+    /* Walk the clean gaps, the inverse of what an incremental backup does */
+    g_test_timer_start();
+    while ((off = hbitmap_next_zero(hb, off, INT64_MAX)) >= 0) {
+        nr_runs++;
+        off = hbitmap_next_dirty(hb, off, INT64_MAX);
+        if (off < 0) {
+            break;
+        }
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("next_zero(%s): %" PRIu64 " runs in %.3f ms",
+                   opts->name, nr_runs, g_test_timer_last() * 1000);
+    hbitmap_free(hb);
+}
+
+static void test_hbitmap_count_speed(const void *opaque)
+{
+    const HBitmapBenchOpts *opts = opaque;
+    HBitmap *hb = bench_bitmap_new(opts);
+    HBitmap *result = hbitmap_alloc(DISK_SIZE, GRANULARITY);
+    const int iterations = 16;
+    int i;
+
+    /* hbitmap_merge() recounts the whole result bitmap each time */
+    g_test_timer_start();
+    for (i = 0; i < iterations; i++) {
+        hbitmap_merge(hb, result, result);
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("merge+count(%s): %.3f ms per merge, %" PRIu64 " dirty",
+                   opts->name, g_test_timer_last() * 1000 / iterations,
+                   hbitmap_count(result));
+    hbitmap_free(result);
+    hbitmap_free(hb);
+}
+
+static void test_bitmap_count_words_speed(void)
+{
+    const size_t nr = 32 * MiB / sizeof(unsigned long);
+    unsigned long *words = g_new(unsigned long, nr);
+    const int iterations = 16;
+    uint64_t count;
+    size_t i;
+    int j;
+
+    for (i = 0; i < nr; i++) {
+        words[i] = g_test_rand_int();
+    }
+
+    do {
+        count = 0;
+        g_test_timer_start();
+        for (j = 0; j < iterations; j++) {
+            count += bitmap_count_words(words, nr);
+        }
+        g_test_timer_elapsed();
+
+        g_test_message("count_words: %.2f MB/sec (%" PRIu64 ")",
+                       nr * sizeof(unsigned long) * iterations / MiB /
+                       g_test_timer_last(), count);
+    } while (test_bitmap_accel_next());
+
+    g_free(words);
+}
+
+int main(int argc, char **argv)
+{
+    static const HBitmapBenchOpts opts[] = {
+        { .name = "sparse", .run_chunks = 1, .stride_chunks = 4096 },
+        { .name = "clustered", .run_chunks = 64, .stride_chunks = 1024 },
+        { .name = "fragmented", .run_chunks = 1, .stride_chunks = 17 },
+        { .name = "dense", .run_chunks = 1000, .stride_chunks = 1001 },
+    };
+    char name[64];
+    size_t i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        snprintf(name, sizeof(name), "/hbitmap/benchmark/extents/%s",
+                 opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_hbitmap_extents_speed);
+        snprintf(name, sizeof(name), "/hbitmap/benchmark/next_zero/%s",
+                 opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_hbitmap_next_zero_speed);
+        snprintf(name, sizeof(name), "/hbitmap/benchmark/count/%s",
+                 opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_hbitmap_count_speed);
+    }
+    /* Last, because it cycles through the accelerators */
+    g_test_add_func("/bitmap/benchmark/count_words",
+                    test_bitmap_count_words_speed);
+
+    return g_test_run();
+}
@@ -0,0 +1,102 @@
+/*
+ * Virtqueue element pool benchmark
+ *
+ * Replays the allocation pattern of virtqueue_pop()/virtqueue_push() for a
+ * device that keeps a full queue in flight and completes requests out of
+ * order, with and without an element pool.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "hw/virtio/virtio-element-pool.h"
+
+#define QUEUE_SIZE  256
+#define ITERATIONS  (4 * 1024 * 1024)
+
+/* Roughly a VirtIOBlockReq, plus one hwaddr and one iovec per descriptor */
+#define REQ_SIZE    512
+#define DESC_SIZE   (sizeof(uint64_t) + sizeof(struct iovec))
+#define POOL_SG     34
+
+typedef struct ElementBenchOpts {
+    const char *name;
+    bool use_pool;
+    /* Chains have between 3 and max_sg descriptors */
+    unsigned int max_sg;
+} ElementBenchOpts;
+
+static void test_element_pool_speed(const void *opaque)
+{
+    const ElementBenchOpts *opts = opaque;
+    VirtQueueElementPool *pool = NULL;
+    void *inflight[QUEUE_SIZE];
+    unsigned int i, slot;
+
+    if (opts->use_pool) {
+        pool = virtqueue_element_pool_new(REQ_SIZE + POOL_SG * DESC_SIZE,
+                                          QUEUE_SIZE);
+    }
+    memset(inflight, 0, sizeof(inflight));
+
+    g_test_timer_start();
+    for (i = 0; i < ITERATIONS; i++) {
+        size_t size = REQ_SIZE +
+            g_test_rand_int_range(3, opts->max_sg + 1) * DESC_SIZE;
+        void *elem;
+
+        /* Complete a random request, then pop a new one in its place */
+        slot = g_test_rand_int_range(0, QUEUE_SIZE);
+        if (pool) {
+            if (inflight[slot]) {
+                virtqueue_element_pool_free(pool, inflight[slot]);
+            }
+            elem = virtqueue_element_pool_alloc(pool, size);
+            assert(elem);
+        } else {
+            g_free(inflight[slot]);
+            elem = g_malloc(size);
+        }
+        /* Touch the element like virtqueue_pop() fills it in */
+        memset(elem, 0, 64);
+        inflight[slot] = elem;
+    }
+    g_test_timer_elapsed();
+
+    for (slot = 0; slot < QUEUE_SIZE; slot++) {
+        if (pool && inflight[slot]) {
+            virtqueue_element_pool_free(pool, inflight[slot]);
+        } else {
+            g_free(inflight[slot]);
+        }
+    }
+    if (pool) {
+        virtqueue_element_pool_unref(pool);
+    }
+
+    g_test_message("%s: %.2f Mops/sec", opts->name,
+                   ITERATIONS / g_test_timer_last() / 1e6);
+}
+
+int main(int argc, char **argv)
+{
+    static const ElementBenchOpts opts[] = {
+        { .name = "malloc/small", .use_pool = false, .max_sg = 4 },
+        { .name = "pool/small", .use_pool = true, .max_sg = 4 },
+        { .name = "malloc/large", .use_pool = false, .max_sg = POOL_SG },
+        { .name = "pool/large", .use_pool = true, .max_sg = POOL_SG },
+    };
+    char name[64];
+    size_t i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    for (i = 0; i < ARRAY_SIZE(opts); i++) {
+        snprintf(name, sizeof(name), "/virtio/element-pool/benchmark/%s",
+                 opts[i].name);
+        g_test_add_data_func(name, &opts[i], test_element_pool_speed);
+    }
+
+    return g_test_run();
+}
@@ -0,0 +1,273 @@
+/*
+ * QTest testcase for colo-compare
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * later.  See the COPYING file in the top-level directory.
+ *
+ * The test plays both guests and the client: it sends UDP packets of
+ * several connections to primary_in and secondary_in, and reads the
+ * primary packets that colo-compare releases from outdev.
+ *
+ * qemu side                          | test side
+ *                                    |
+ *               +-------+            |  +-----+
+ *               |  pri  <---------------+ pri |
+ * +---------+   +-------+            |  +-----+
+ * | compare |   +-------+            |  +-----+
+ * |         <---+  sec  <---------------+ sec |
+ * +----+----+   +-------+            |  +-----+
+ *      |        +-------+            |  +-----+
+ *      +-------->  out  +---------------> out |
+ *               +-------+            |  +-----+
+ */
+
+#include "qemu/osdep.h"
+#include "libqos/libqtest.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qemu/iov.h"
+#include "qemu/sockets.h"
+#include "net/eth.h"
+
+#define NUM_CONNS       16
+#define PKTS_PER_CONN   4
+#define PAYLOAD_LEN     64
+#define PKT_LEN         (sizeof(struct eth_header) + \
+                         sizeof(struct ip_header) + \
+                         sizeof(struct udp_header) + PAYLOAD_LEN)
+
+typedef struct TestColo {
+    QTestState *qts;
+    char *tmpdir;
+    char *path[3];
+    int pri, sec, out;
+} TestColo;
+
+static int test_colo_connect(TestColo *t, int i, const char *label)
+{
+    QDict *resp;
+    int fd;
+
+    fd = unix_connect(t->path[i], NULL);
+    g_assert_cmpint(fd, !=, -1);
+
+    /* The chardev accepts the connection in the iothread; wait for it */
+    for (;;) {
+        QListEntry *e;
+        bool connected = false;
+
+        resp = qtest_qmp(t->qts, "{ 'execute': 'query-chardev' }");
+        QLIST_FOREACH_ENTRY(qdict_get_qlist(resp, "return"), e) {
+            QDict *info = qobject_to(QDict, qlist_entry_obj(e));
+
+            if (!strcmp(qdict_get_str(info, "label"), label)) {
+                connected = !g_str_has_prefix(qdict_get_str(info, "filename"),
+                                              "disconnected:");
+            }
+        }
+        qobject_unref(resp);
+        if (connected) {
+            return fd;
+        }
+        g_usleep(1000);
+    }
+}
+
+static void test_colo_init(TestColo *t, int workers)
+{
+    int i;
+
+    t->tmpdir = g_dir_make_tmp("colo-compare-test-XXXXXX", NULL);
+    g_assert_nonnull(t->tmpdir);
+    for (i = 0; i < 3; i++) {
+        t->path[i] = g_strdup_printf("%s/sock%d", t->tmpdir, i);
+    }
+
+    t->qts = qtest_initf(
+        "-object iothread,id=iothread0 "
+        "-chardev socket,id=pri,path=%s,server=on,wait=off "
+        "-chardev socket,id=sec,path=%s,server=on,wait=off "
+        "-chardev socket,id=out,path=%s,server=on,wait=off "
+        "-object colo-compare,id=comp0,primary_in=pri,secondary_in=sec,"
+        "outdev=out,iothread=iothread0,workers=%d",
+        t->path[0], t->path[1], t->path[2], workers);
+
+    /* Connect outdev first, so that no released packet is lost */
+    t->out = test_colo_connect(t, 2, "out");
+    t->pri = test_colo_connect(t, 0, "pri");
+    t->sec = test_colo_connect(t, 1, "sec");
+}
+
+static void test_colo_cleanup(TestColo *t)
+{
+    int i;
+
+    close(t->pri);
+    close(t->sec);
+    close(t->out);
+    qtest_quit(t->qts);
+    for (i = 0; i < 3; i++) {
+        unlink(t->path[i]);
+        g_free(t->path[i]);
+    }
+    rmdir(t->tmpdir);
+    g_free(t->tmpdir);
+}
+
+/* A UDP packet of connection @conn whose payload is filled with @id */
+static void make_packet(uint8_t *buf, int conn, uint8_t id)
+{
+    struct eth_header *eth = (struct eth_header *)buf;
+    struct ip_header *ip = (struct ip_header *)(eth + 1);
+    struct udp_header *udp = (struct udp_header *)(ip + 1);
+
+    memset(buf, 0, PKT_LEN);
+    memset(eth->h_dest, 0x52, ETH_ALEN);
+    memset(eth->h_source, 0x54, ETH_ALEN);
+    eth->h_proto = cpu_to_be16(ETH_P_IP);
+
+    ip->ip_ver_len = (IP_HEADER_VERSION_4 << 4) | (sizeof(*ip) >> 2);
+    ip->ip_len = cpu_to_be16(PKT_LEN - sizeof(*eth));
+    ip->ip_ttl = 64;
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_src = cpu_to_be32(0x0a000001);
+    ip->ip_dst = cpu_to_be32(0x0a000002);
+
+    udp->uh_sport = cpu_to_be16(1000 + conn);
+    udp->uh_dport = cpu_to_be16(5000);
+    udp->uh_ulen = cpu_to_be16(sizeof(*udp) + PAYLOAD_LEN);
+    memset(udp + 1, id, PAYLOAD_LEN);
+}
+
+static void send_packet(int fd, int conn, uint8_t id)
+{
+    uint8_t buf[PKT_LEN];
+    uint32_t len = cpu_to_be32(PKT_LEN);
+    struct iovec iov[] = {
+        { .iov_base = &len, .iov_len = sizeof(len) },
+        { .iov_base = buf, .iov_len = sizeof(buf) },
+    };
+    ssize_t ret;
+
+    make_packet(buf, conn, id);
+    ret = iov_send(fd, iov, 2, 0, sizeof(len) + sizeof(buf));
+    g_assert_cmpint(ret, ==, sizeof(len) + sizeof(buf));
+}
+
+/* Receive a released packet and return its id */
+static uint8_t recv_packet(int fd)
+{
+    uint8_t buf[PKT_LEN], expected[PKT_LEN];
+    uint32_t len;
+    ssize_t ret;
+
+    ret = recv(fd, &len, sizeof(len), MSG_WAITALL);
+    g_assert_cmpint(ret, ==, sizeof(len));
+    g_assert_cmpuint(be32_to_cpu(len), ==, PKT_LEN);
+    ret = recv(fd, buf, sizeof(buf), MSG_WAITALL);
+    g_assert_cmpint(ret, ==, sizeof(buf));
+
+    /* Everything but the payload follows from the source port */
+    make_packet(expected, lduw_be_p(buf + sizeof(struct eth_header) +
+                                    sizeof(struct ip_header)) - 1000,
+                buf[PKT_LEN - 1]);
+    g_assert_cmpmem(buf, sizeof(buf), expected, sizeof(expected));
+    return buf[PKT_LEN - 1];
+}
+
+static bool out_has_data(int fd, int timeout_ms)
+{
+    GPollFD pfd = { .fd = fd, .events = G_IO_IN };
+
+    return g_poll(&pfd, 1, timeout_ms) > 0;
+}
+
+/*
+ * Sum up the "worker-stats" counters.  Returns the number of workers that
+ * report them.
+ */
+static int worker_stats(TestColo *t, uint64_t *packets,
+                        uint64_t *connections)
+{
+    QListEntry *e;
+    QDict *resp;
+    int n = 0;
+
+    *packets = *connections = 0;
+    resp = qtest_qmp(t->qts, "{ 'execute': 'qom-get', 'arguments': "
+                     "{ 'path': '/objects/comp0', "
+                     "'property': 'worker-stats' } }");
+    QLIST_FOREACH_ENTRY(qdict_get_qlist(qdict_get_qdict(resp, "return"),
+                                        "workers"), e) {
+        QDict *stats = qobject_to(QDict, qlist_entry_obj(e));
+
+        *packets += qdict_get_int(stats, "packets");
+        *connections += qdict_get_int(stats, "connections");
+        n++;
+    }
+    qobject_unref(resp);
+
+    return n;
+}
+
+static void test_colo_compare(const void *opaque)
+{
+    int workers = GPOINTER_TO_INT(opaque);
+    bool seen[NUM_CONNS * PKTS_PER_CONN] = { false };
+    uint64_t packets, connections;
+    TestColo t;
+    int conn, i;
+
+    test_colo_init(&t, workers);
+
+    /* Identical packets on both sides are released */
+    for (i = 0; i < PKTS_PER_CONN; i++) {
+        for (conn = 0; conn < NUM_CONNS; conn++) {
+            uint8_t id = conn * PKTS_PER_CONN + i;
+
+            send_packet(t.pri, conn, id);
+            send_packet(t.sec, conn, id);
+        }
+    }
+
+    /* A different payload on one more connection is held back */
+    send_packet(t.pri, NUM_CONNS, 0xaa);
+    send_packet(t.sec, NUM_CONNS, 0xbb);
+
+    for (i = 0; i < NUM_CONNS * PKTS_PER_CONN; i++) {
+        uint8_t id = recv_packet(t.out);
+
+        g_assert_cmpuint(id, <, ARRAY_SIZE(seen));
+        g_assert_false(seen[id]);
+        seen[id] = true;
+    }
+    g_assert_false(out_has_data(t.out, 100));
+
+    /* Without workers, the comparison runs in the iothread: no stats */
+    g_assert_cmpint(worker_stats(&t, &packets, &connections), ==, workers);
+
+    /* The held packets may still be on their way to a worker */
+    while (workers && (connections < NUM_CONNS + 1 ||
+                       packets < 2 * (NUM_CONNS * PKTS_PER_CONN + 1))) {
+        g_usleep(1000);
+        worker_stats(&t, &packets, &connections);
+    }
+    if (workers) {
+        g_assert_cmpuint(packets, ==, 2 * (NUM_CONNS * PKTS_PER_CONN + 1));
+        g_assert_cmpuint(connections, ==, NUM_CONNS + 1);
+    }
+
+    test_colo_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    qtest_add_data_func("/netfilter/colo-compare/iothread",
+                        GINT_TO_POINTER(0), test_colo_compare);
+    qtest_add_data_func("/netfilter/colo-compare/workers-1",
+                        GINT_TO_POINTER(1), test_colo_compare);
+    qtest_add_data_func("/netfilter/colo-compare/workers-4",
+                        GINT_TO_POINTER(4), test_colo_compare);
+    return g_test_run();
+}
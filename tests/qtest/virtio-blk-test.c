@@ -12,6 +12,9 @@
 #include "libqtest-single.h"
 #include "qemu/bswap.h"
 #include "qemu/module.h"
+#include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
+#include "qapi/qmp/qstring.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
@@ -717,6 +720,149 @@ static void pci_hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
     qpci_unplug_acpi_device_test(qts, "drv1", PCI_SLOT_HP);
 }
 
+#define IOTHREAD_VQ_MAPPING_NUM_QUEUES 4
+
+/* Write @sector on @vq, or read it back and compare it with @pattern */
+static void iothread_vq_mapping_rw(QTestState *qts, QGuestAllocator *alloc,
+                                   QVirtioDevice *dev, QVirtQueue *vq,
+                                   bool is_write, uint64_t sector,
+                                   const char *pattern)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint32_t free_head;
+    char *data;
+
+    req.type = is_write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(512);
+    if (is_write) {
+        strcpy(req.data, pattern);
+    }
+
+    req_addr = virtio_blk_request(alloc, dev, &req, 512);
+
+    g_free(req.data);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 512, !is_write, true);
+    qvirtqueue_add(qts, vq, req_addr + 528, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    g_assert_cmpint(qtest_readb(qts, req_addr + 528), ==, 0);
+
+    if (!is_write) {
+        data = g_malloc0(512);
+        qtest_memread(qts, req_addr + 16, data, 512);
+        g_assert_cmpstr(data, ==, pattern);
+        g_free(data);
+    }
+
+    guest_free(alloc, req_addr);
+}
+
+/*
+ * Hotplug a multiqueue disk with iothread-vq-mapping and check that
+ * requests complete on all of its virtqueues.
+ */
+static void iothread_vq_mapping(void *obj, void *data,
+                                QGuestAllocator *t_alloc)
+{
+    QVirtioPCIDevice *dev1 = obj;
+    QVirtioPCIDevice *pdev;
+    QVirtioDevice *dev;
+    QTestState *qts = dev1->pdev->bus->qts;
+    QVirtQueue *vqs[IOTHREAD_VQ_MAPPING_NUM_QUEUES];
+    uint64_t features;
+    QDict *resp;
+    QList *list;
+    int i;
+
+    resp = qtest_qmp(qts, "{'execute': 'device_add', 'arguments': {"
+                     " 'driver': 'virtio-blk-pci', 'id': 'drv1',"
+                     " 'drive': 'drive1', 'num-queues': 4,"
+                     " 'iothread-vq-mapping': ['nonexistent']"
+                     " } }");
+    g_assert(qdict_haskey(resp, "error"));
+    qobject_unref(resp);
+
+    resp = qtest_qmp(qts, "{'execute': 'device_add', 'arguments': {"
+                     " 'driver': 'virtio-blk-pci', 'id': 'drv1',"
+                     " 'drive': 'drive1', 'iothread': 'iothread0',"
+                     " 'iothread-vq-mapping': ['iothread1'] } }");
+    g_assert(qdict_haskey(resp, "error"));
+    qobject_unref(resp);
+
+    /* All virtqueues are serviced by the BlockBackend's IOThread for now */
+    resp = qtest_qmp(qts, "{'execute': 'device_add', 'arguments': {"
+                     " 'driver': 'virtio-blk-pci', 'id': 'drv1',"
+                     " 'drive': 'drive1', 'num-queues': 4,"
+                     " 'iothread-vq-mapping': ['iothread0', 'iothread1']"
+                     " } }");
+    g_assert(qdict_haskey(resp, "error"));
+    qobject_unref(resp);
+
+    qtest_qmp_device_add(qts, "virtio-blk-pci", "drv2",
+                         "{'addr': %s, 'drive': 'drive2', 'num-queues': %d, "
+                         "'iothread-vq-mapping': ['iothread1']}",
+                         stringify(PCI_SLOT_HP) ".0",
+                         IOTHREAD_VQ_MAPPING_NUM_QUEUES);
+
+    resp = qtest_qmp(qts, "{'execute': 'qom-get', 'arguments': {"
+                     " 'path': '/machine/peripheral/drv2',"
+                     " 'property': 'iothread-vq-mapping' } }");
+    list = qdict_get_qlist(resp, "return");
+    g_assert_cmpint(qlist_size(list), ==, 1);
+    g_assert_cmpstr(qstring_get_str(qobject_to(QString, qlist_peek(list))),
+                    ==, "iothread1");
+    qobject_unref(resp);
+
+    pdev = virtio_pci_new(dev1->pdev->bus,
+                          &(QPCIAddress) {
+                              .devfn = QPCI_DEVFN(PCI_SLOT_HP, 0)
+                          });
+    g_assert_nonnull(pdev);
+    dev = &pdev->vdev;
+    qvirtio_pci_device_enable(pdev);
+    qvirtio_start_device(dev);
+
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    for (i = 0; i < IOTHREAD_VQ_MAPPING_NUM_QUEUES; i++) {
+        vqs[i] = qvirtqueue_setup(dev, t_alloc, i);
+    }
+    qvirtio_set_driver_ok(dev);
+
+    /* Read back each sector through a different virtqueue */
+    for (i = 0; i < IOTHREAD_VQ_MAPPING_NUM_QUEUES; i++) {
+        g_autofree char *pattern = g_strdup_printf("TEST%d", i);
+
+        iothread_vq_mapping_rw(qts, t_alloc, dev, vqs[i], true, i, pattern);
+    }
+    for (i = 0; i < IOTHREAD_VQ_MAPPING_NUM_QUEUES; i++) {
+        g_autofree char *pattern = g_strdup_printf("TEST%d", i);
+        QVirtQueue *vq = vqs[(i + 1) % IOTHREAD_VQ_MAPPING_NUM_QUEUES];
+
+        iothread_vq_mapping_rw(qts, t_alloc, dev, vq, false, i, pattern);
+    }
+
+    for (i = 0; i < IOTHREAD_VQ_MAPPING_NUM_QUEUES; i++) {
+        qvirtqueue_cleanup(dev->bus, vqs[i], t_alloc);
+    }
+    qvirtio_pci_device_disable(pdev);
+    qos_object_destroy((QOSGraphObject *)pdev);
+
+    qpci_unplug_acpi_device_test(qts, "drv2", PCI_SLOT_HP);
+}
+
 /*
  * Check that setting the vring addr on a non-existent virtqueue does
  * not crash.
@@ -780,11 +926,28 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_iothread_test_setup(GString *cmd_line, void *arg)
+{
+    char *tmp_path = drive_create();
+
+    g_string_append_printf(cmd_line,
+                           " -object iothread,id=iothread0"
+                           " -object iothread,id=iothread1"
+                           " -drive if=none,id=drive2,file=%s,"
+                           "format=raw,auto-read-only=off ",
+                           tmp_path);
+
+    return virtio_blk_test_setup(cmd_line, arg);
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
         .before = virtio_blk_test_setup,
     };
+    QOSGraphTestOptions iothread_opts = {
+        .before = virtio_blk_iothread_test_setup,
+    };
 
     qos_add_test("indirect", "virtio-blk", indirect, &opts);
     qos_add_test("config", "virtio-blk", config, &opts);
@@ -797,6 +960,8 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+    qos_add_test("iothread-vq-mapping", "virtio-blk-pci",
+                 iothread_vq_mapping, &iothread_opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -165,6 +165,39 @@ static void stop_cont_test(void *obj, void *data, QGuestAllocator *t_alloc)
     rx_stop_cont_test(dev, t_alloc, rx, sv[0]);
 }
 
+static void iothread_test(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNet *net_if = obj;
+    QVirtioDevice *dev = net_if->vdev;
+    QVirtQueue *rx = net_if->queues[0];
+    QVirtQueue *tx = net_if->queues[1];
+    int *sv = data;
+    QDict *rsp;
+
+    rx_test(dev, t_alloc, rx, sv[0]);
+    tx_test(dev, t_alloc, tx, sv[0]);
+
+    /* Filters cannot be added while the netdev is serviced by the IOThread */
+    rsp = qmp("{ 'execute': 'object-add',"
+              " 'arguments': { 'qom-type': 'filter-buffer', 'id': 'fb0',"
+              " 'netdev': 'hs0', 'interval': 1000 } }");
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    /* Link changes from the main loop while the datapath is running */
+    rsp = qmp("{ 'execute': 'set_link',"
+              " 'arguments': { 'name': 'hs0', 'up': false } }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+    rsp = qmp("{ 'execute': 'set_link',"
+              " 'arguments': { 'name': 'hs0', 'up': true } }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    rx_test(dev, t_alloc, rx, sv[0]);
+    tx_test(dev, t_alloc, tx, sv[0]);
+}
+
 #endif
 
 static void hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
@@ -281,6 +314,12 @@ static void *virtio_net_test_setup(GString *cmd_line, void *arg)
     return sv;
 }
 
+static void *virtio_net_iothread_test_setup(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread,id=iothread0 ");
+    return virtio_net_test_setup(cmd_line, arg);
+}
+
 static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioNet *dev = obj;
@@ -325,6 +364,17 @@ static void register_virtio_net_test(void)
 #endif
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
 
+    opts.before = virtio_net_iothread_test_setup;
+    opts.edge.extra_device_opts = "iothread=iothread0";
+#ifndef _WIN32
+    qos_add_test("iothread/basic", "virtio-net", iothread_test, &opts);
+    qos_add_test("iothread/rx_stop_cont", "virtio-net", stop_cont_test,
+                 &opts);
+#endif
+    qos_add_test("iothread/announce-self", "virtio-net", announce_self,
+                 &opts);
+    opts.edge.extra_device_opts = NULL;
+
     /* These tests do not need a loopback backend.  */
     opts.before = virtio_net_test_setup_nosocket;
     opts.arg = (gpointer)UINT_MAX;
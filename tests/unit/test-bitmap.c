@@ -123,6 +123,61 @@ static void check_bitmap_set(void)
     bitmap_set_case(bitmap_set_atomic);
 }
 
+#define SCAN_WORDS 300
+
+static void bitmap_scan_case(void)
+{
+    const unsigned long patterns[] = { 0, -1ul };
+    unsigned long *words = g_new0(unsigned long, SCAN_WORDS);
+    unsigned long pattern;
+    size_t start, i, p;
+    uint64_t count;
+
+    for (p = 0; p < ARRAY_SIZE(patterns); p++) {
+        pattern = patterns[p];
+        for (i = 0; i < SCAN_WORDS; i++) {
+            words[i] = pattern;
+        }
+        for (start = 0; start < 40; start++) {
+            g_assert_cmpuint(bitmap_find_word_not(words, start, SCAN_WORDS,
+                                                  pattern), ==, SCAN_WORDS);
+            g_assert_cmpuint(bitmap_find_word_not(words, start, start,
+                                                  pattern), ==, start);
+            for (i = start; i < SCAN_WORDS; i += 7) {
+                words[i] ^= 1ul << (i % BITS_PER_LONG);
+                g_assert_cmpuint(bitmap_find_word_not(words, start, SCAN_WORDS,
+                                                      pattern), ==, i);
+                /* A limit before the odd word hides it */
+                g_assert_cmpuint(bitmap_find_word_not(words, start, i,
+                                                      pattern), ==, i);
+                words[i] = pattern;
+            }
+        }
+    }
+
+    for (i = 0; i < SCAN_WORDS; i++) {
+        words[i] = (i * 0x9e3779b97f4a7c15ull) ^ (i << 7);
+    }
+    for (i = 0; i <= SCAN_WORDS; i++) {
+        g_assert_cmpint(bitmap_count_words(words, i), ==,
+                        bitmap_count_one(words, i * BITS_PER_LONG));
+        count = 0;
+        for (start = 0; start < i; start++) {
+            count += ctpopl(words[start]);
+        }
+        g_assert_cmpuint(bitmap_count_words(words, i), ==, count);
+    }
+
+    g_free(words);
+}
+
+static void check_bitmap_scan(void)
+{
+    do {
+        bitmap_scan_case();
+    } while (test_bitmap_accel_next());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -131,6 +186,8 @@ int main(int argc, char **argv)
                     check_bitmap_copy_with_offset);
     g_test_add_func("/bitmap/bitmap_set",
                     check_bitmap_set);
+    g_test_add_func("/bitmap/bitmap_scan",
+                    check_bitmap_scan);
 
     g_test_run();
 
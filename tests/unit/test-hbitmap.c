@@ -1042,6 +1042,80 @@ static void test_hbitmap_next_dirty_area_after_truncate(TestHBitmapData *data,
     test_hbitmap_next_dirty_area_check(data, 0, INT64_MAX);
 }
 
+static void test_hbitmap_dirty_extents_check(TestHBitmapData *data,
+                                             int64_t start, int64_t end,
+                                             size_t max_extents)
+{
+    g_autofree HBitmapExtent *extents = g_new(HBitmapExtent, max_extents);
+    int64_t off = start;
+    int64_t len, pos;
+    size_t i, n;
+
+    do {
+        n = hbitmap_get_dirty_extents(data->hb, start, end, extents,
+                                      max_extents);
+        g_assert_cmpint(n, <=, max_extents);
+        for (i = 0; i < n; i++) {
+            /* Everything between the previous extent and this one is clean */
+            for (pos = off; pos < extents[i].start; pos++) {
+                g_assert_false(hbitmap_get(data->hb, pos));
+            }
+            g_assert_cmpint(extents[i].count, >, 0);
+            for (len = 0; len < extents[i].count; len++) {
+                g_assert_true(hbitmap_get(data->hb, extents[i].start + len));
+            }
+            off = extents[i].start + extents[i].count;
+            g_assert_cmpint(off, <=, end);
+            /* Extents are maximal */
+            g_assert_true(off == end || !hbitmap_get(data->hb, off));
+        }
+        start = off;
+    } while (n == max_extents);
+
+    for (pos = off; pos < end; pos++) {
+        g_assert_false(hbitmap_get(data->hb, pos));
+    }
+}
+
+static void test_hbitmap_dirty_extents(TestHBitmapData *data,
+                                       const void *unused)
+{
+    hbitmap_test_init(data, L3, 0);
+    test_hbitmap_dirty_extents_check(data, 0, L3, 4);
+
+    hbitmap_test_set(data, 0, 1);
+    hbitmap_test_set(data, L1 - 1, 2);
+    hbitmap_test_set(data, L2 - 3, L1 * 3);
+    hbitmap_test_set(data, L2 * 7, L2 * 3 + 5);
+    hbitmap_test_set(data, L3 - 1, 1);
+
+    test_hbitmap_dirty_extents_check(data, 0, L3, 1);
+    test_hbitmap_dirty_extents_check(data, 0, L3, 2);
+    test_hbitmap_dirty_extents_check(data, 0, L3, 64);
+    test_hbitmap_dirty_extents_check(data, 1, L1, 64);
+    test_hbitmap_dirty_extents_check(data, L2, L2 * 8 + 1, 3);
+    test_hbitmap_dirty_extents_check(data, L2 * 10, L3 - 1, 3);
+}
+
+/* Mix sparse and dense areas, so that counting takes every path.  */
+static void test_hbitmap_count_accel(TestHBitmapData *data,
+                                     const void *unused)
+{
+    uint64_t i;
+
+    do {
+        hbitmap_test_init(data, L2 * 8, 0);
+        hbitmap_test_set(data, 3, L1 * 40);
+        for (i = L2; i < L2 * 2; i += L1 * 3 + 3) {
+            hbitmap_test_set(data, i, 1);
+        }
+        hbitmap_test_set(data, L2 * 5 + 1, L2 * 2);
+        hbitmap_test_reset(data, L2 * 6, L1 * 17);
+        hbitmap_test_reset(data, L1 * 2, L2 * 2);
+        hbitmap_test_teardown(data, NULL);
+    } while (test_bitmap_accel_next());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -1113,6 +1187,9 @@ int main(int argc, char **argv)
     hbitmap_test_add("/hbitmap/next_dirty_area/next_dirty_area_after_truncate",
                      test_hbitmap_next_dirty_area_after_truncate);
 
+    hbitmap_test_add("/hbitmap/dirty_extents", test_hbitmap_dirty_extents);
+    hbitmap_test_add("/hbitmap/count/accel", test_hbitmap_count_accel);
+
     g_test_run();
 
     return 0;
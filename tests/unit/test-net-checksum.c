@@ -0,0 +1,97 @@
+/*
+ * Internet checksum tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/checksum.h"
+
+static uint8_t buffer[256 * 1024];
+
+/* The straightforward byte-wise sum that the implementations must match */
+static uint16_t ref_checksum(const uint8_t *buf, size_t len, int seq)
+{
+    uint64_t sum = 0;
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        sum += (uint64_t)buf[i] << (((i + seq) & 1) ? 0 : 8);
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return net_checksum_finish(sum);
+}
+
+static void check(size_t offset, size_t len, int seq)
+{
+    uint32_t sum = net_checksum_add_cont(len, buffer + offset, seq);
+
+    g_assert_cmphex(net_checksum_finish(sum), ==,
+                    ref_checksum(buffer + offset, len, seq));
+}
+
+static void test_checksum_pattern(void)
+{
+    size_t a, s;
+    int seq;
+
+    for (a = 0; a < 64; a++) {
+        for (s = 0; s < 1024; s++) {
+            for (seq = 0; seq < 2; seq++) {
+                check(a, s, seq);
+            }
+        }
+    }
+    for (s = sizeof(buffer) - 64; s < sizeof(buffer) - 1; s++) {
+        check(1, s, 0);
+    }
+}
+
+static void test_checksum(void)
+{
+    size_t i;
+
+    do {
+        /* Random data, then the corner cases for carries and zero sums */
+        for (i = 0; i < sizeof(buffer); i++) {
+            buffer[i] = g_test_rand_int_range(0, 256);
+        }
+        test_checksum_pattern();
+        memset(buffer, 0xff, sizeof(buffer));
+        test_checksum_pattern();
+        memset(buffer, 0, sizeof(buffer));
+        test_checksum_pattern();
+    } while (test_net_checksum_next_accel());
+}
+
+static void test_checksum_iov(void)
+{
+    struct iovec iov[3];
+    size_t i;
+
+    for (i = 0; i < sizeof(buffer); i++) {
+        buffer[i] = g_test_rand_int_range(0, 256);
+    }
+
+    /* Odd-sized chunks start each following chunk at an odd offset */
+    iov[0] = (struct iovec) { .iov_base = buffer, .iov_len = 1001 };
+    iov[1] = (struct iovec) { .iov_base = buffer + 1001, .iov_len = 333 };
+    iov[2] = (struct iovec) { .iov_base = buffer + 1334, .iov_len = 4000 };
+
+    g_assert_cmphex(net_checksum_finish(net_checksum_add_iov(iov, 3, 7,
+                                                             5000, 0)), ==,
+                    ref_checksum(buffer + 7, 5000, 0));
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/net/checksum/add", test_checksum);
+    g_test_add_func("/net/checksum/iov", test_checksum_iov);
+
+    return g_test_run();
+}
@@ -671,6 +671,52 @@ static void test_accounting(void)
                                 (64.0 / 13)));
 }
 
+static void test_credit(void)
+{
+    ThrottleConfig cfg;
+    uint64_t bytes;
+    double units;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_BPS_TOTAL].avg = 4000;
+    cfg.buckets[THROTTLE_BPS_WRITE].avg = 2000;
+    cfg.buckets[THROTTLE_OPS_READ].avg = 100;
+
+    throttle_init(&ts);
+    throttle_timers_init(tt, ctx, QEMU_CLOCK_VIRTUAL,
+                         read_timer_cb, write_timer_cb, &ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* Half a second shared by two: the lowest limit, divided by four */
+    throttle_compute_credit(&ts, true, NANOSECONDS_PER_SECOND / 2, 2,
+                            &bytes, &units);
+    g_assert_cmpint(bytes, ==, 500);
+    g_assert(isinf(units));
+
+    throttle_compute_credit(&ts, false, NANOSECONDS_PER_SECOND / 2, 2,
+                            &bytes, &units);
+    g_assert_cmpint(bytes, ==, 1000);
+    g_assert(double_cmp(units, 25));
+
+    /* The credit is accounted up front, unlimited amounts are not */
+    throttle_account_credit(&ts, false, bytes, units);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 1000));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 25));
+    throttle_account_credit(&ts, true, 500, INFINITY);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 1500));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_WRITE].level, 0));
+
+    /* Unused parts are given back, but the buckets never go negative */
+    throttle_refund_credit(&ts, false, 400, 10);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_TOTAL].level, 1100));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 15));
+    throttle_refund_credit(&ts, false, 2000, 100);
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_BPS_READ].level, 0));
+    g_assert(double_cmp(ts.cfg.buckets[THROTTLE_OPS_READ].level, 0));
+
+    throttle_timers_destroy(tt);
+}
+
 static void test_groups(void)
 {
     ThrottleConfig cfg1, cfg2;
@@ -764,6 +810,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/credit",             test_credit);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
@@ -0,0 +1,502 @@
+/*
+ * virtio-net GRO stage tests
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "net/checksum.h"
+#include "net/eth.h"
+#include "hw/virtio/virtio-net-gro.h"
+
+#define MSS             1000
+#define IP4_L4_OFF      (sizeof(struct eth_header) + sizeof(struct ip_header))
+#define IP6_L4_OFF      (sizeof(struct eth_header) + sizeof(struct ip6_header))
+#define MAX_FRAME       (IP6_L4_OFF + sizeof(struct tcp_header) + MSS)
+#define MAX_DELIVERED   16
+
+typedef struct TestFrame {
+    uint8_t buf[MAX_FRAME];
+    size_t size;
+} TestFrame;
+
+typedef struct TestDelivered {
+    struct virtio_net_hdr hdr;
+    uint8_t *buf;
+    size_t size;
+} TestDelivered;
+
+typedef struct TestGro {
+    VirtioNetGro *gro;
+    TestDelivered delivered[MAX_DELIVERED];
+    int num_delivered;
+    int room;           /* Frames the guest can still take, -1 for any */
+} TestGro;
+
+static ssize_t test_deliver(void *opaque, const struct virtio_net_hdr *hdr,
+                            const uint8_t *buf, size_t size)
+{
+    TestGro *t = opaque;
+    TestDelivered *d;
+
+    if (t->room == 0) {
+        return 0;
+    }
+    if (t->room > 0) {
+        t->room--;
+    }
+
+    g_assert_cmpint(t->num_delivered, <, MAX_DELIVERED);
+    d = &t->delivered[t->num_delivered++];
+    d->hdr = *hdr;
+    d->buf = g_memdup2(buf, size);
+    d->size = size;
+    return size;
+}
+
+static void test_gro_init(TestGro *t)
+{
+    memset(t, 0, sizeof(*t));
+    t->room = -1;
+    t->gro = virtio_net_gro_new(test_deliver, t);
+    virtio_net_gro_set_offloads(t->gro, true, true);
+}
+
+static void test_gro_cleanup(TestGro *t)
+{
+    int i;
+
+    for (i = 0; i < t->num_delivered; i++) {
+        g_free(t->delivered[i].buf);
+    }
+    virtio_net_gro_free(t->gro);
+}
+
+static VirtioNetGroStats test_gro_stats(TestGro *t)
+{
+    VirtioNetGroStats stats;
+
+    virtio_net_gro_get_stats(t->gro, &stats);
+    return stats;
+}
+
+static size_t frame_l4_off(const uint8_t *buf)
+{
+    return lduw_be_p(&PKT_GET_ETH_HDR(buf)->h_proto) == ETH_P_IP ?
+           IP4_L4_OFF : IP6_L4_OFF;
+}
+
+/* The TCP checksum over the pseudo header and the whole segment */
+static uint16_t tcp_csum(uint8_t *buf, size_t size)
+{
+    uint8_t *l3 = buf + sizeof(struct eth_header);
+    size_t l4_off = frame_l4_off(buf);
+    uint16_t tcp_len = size - l4_off;
+    uint32_t cso, sum;
+
+    if (l4_off == IP4_L4_OFF) {
+        sum = eth_calc_ip4_pseudo_hdr_csum((struct ip_header *)l3,
+                                           tcp_len, &cso);
+    } else {
+        sum = eth_calc_ip6_pseudo_hdr_csum((struct ip6_header *)l3,
+                                           tcp_len, IPPROTO_TCP, &cso);
+    }
+    return net_checksum_finish(sum + net_checksum_add(tcp_len, buf + l4_off));
+}
+
+/*
+ * Build a TCP segment of @sport with @len bytes of payload, which are
+ * numbered by their sequence number so that merged data can be checked.
+ */
+static void make_frame(TestFrame *f, bool ipv6, uint16_t sport,
+                       uint32_t seq, uint8_t flags, uint16_t len)
+{
+    struct eth_header *eth = (struct eth_header *)f->buf;
+    uint8_t *l3 = f->buf + sizeof(struct eth_header);
+    size_t l4_off = ipv6 ? IP6_L4_OFF : IP4_L4_OFF;
+    struct tcp_header *tcp = (struct tcp_header *)(f->buf + l4_off);
+    uint8_t *payload = (uint8_t *)(tcp + 1);
+    int i;
+
+    memset(f->buf, 0, sizeof(f->buf));
+    f->size = l4_off + sizeof(*tcp) + len;
+    memset(eth->h_dest, 0x52, ETH_ALEN);
+    memset(eth->h_source, 0x54, ETH_ALEN);
+
+    if (ipv6) {
+        struct ip6_header *ip6 = (struct ip6_header *)l3;
+
+        eth->h_proto = cpu_to_be16(ETH_P_IPV6);
+        ip6->ip6_ctlun.ip6_un1.ip6_un1_flow = cpu_to_be32(6 << 28);
+        ip6->ip6_ctlun.ip6_un1.ip6_un1_plen = cpu_to_be16(sizeof(*tcp) + len);
+        ip6->ip6_ctlun.ip6_un1.ip6_un1_nxt = IPPROTO_TCP;
+        ip6->ip6_ctlun.ip6_un1.ip6_un1_hlim = 64;
+        ip6->ip6_src.__in6_u.__u6_addr8[0] = 0xfd;
+        ip6->ip6_src.__in6_u.__u6_addr8[15] = 1;
+        ip6->ip6_dst.__in6_u.__u6_addr8[0] = 0xfd;
+        ip6->ip6_dst.__in6_u.__u6_addr8[15] = 2;
+    } else {
+        struct ip_header *ip = (struct ip_header *)l3;
+
+        eth->h_proto = cpu_to_be16(ETH_P_IP);
+        ip->ip_ver_len = (IP_HEADER_VERSION_4 << 4) | (sizeof(*ip) >> 2);
+        ip->ip_len = cpu_to_be16(sizeof(*ip) + sizeof(*tcp) + len);
+        ip->ip_ttl = 64;
+        ip->ip_p = IPPROTO_TCP;
+        ip->ip_src = cpu_to_be32(0x0a000001);
+        ip->ip_dst = cpu_to_be32(0x0a000002);
+        eth_fix_ip4_checksum(ip, sizeof(*ip));
+    }
+
+    tcp->th_sport = cpu_to_be16(sport);
+    tcp->th_dport = cpu_to_be16(80);
+    tcp->th_seq = cpu_to_be32(seq);
+    tcp->th_ack = cpu_to_be32(1);
+    tcp->th_offset_flags = cpu_to_be16((sizeof(*tcp) >> 2) << 12 |
+                                       TH_ACK | flags);
+    tcp->th_win = cpu_to_be16(512);
+    for (i = 0; i < len; i++) {
+        payload[i] = (seq + i) & 0xff;
+    }
+    tcp->th_sum = cpu_to_be16(tcp_csum(f->buf, f->size));
+}
+
+static VirtioNetGroResult offer(TestGro *t, TestFrame *f)
+{
+    return virtio_net_gro_receive(t->gro, NULL, f->buf, f->size);
+}
+
+static void offer_held(TestGro *t, bool ipv6, uint16_t sport,
+                       uint32_t seq, uint8_t flags, uint16_t len)
+{
+    TestFrame f;
+
+    make_frame(&f, ipv6, sport, seq, flags, len);
+    g_assert_cmpint(offer(t, &f), ==, VIRTIO_NET_GRO_HELD);
+}
+
+static struct tcp_header *delivered_tcp(TestDelivered *d)
+{
+    return (struct tcp_header *)(d->buf + frame_l4_off(d->buf));
+}
+
+/*
+ * Check a delivered frame: @segs segments of @sport starting at @seq, with
+ * @len bytes of payload in total, and a header that describes it.
+ */
+static void check_delivered(TestDelivered *d, uint16_t sport, uint32_t seq,
+                            uint16_t len, uint16_t segs)
+{
+    size_t l4_off = frame_l4_off(d->buf);
+    bool ipv6 = l4_off == IP6_L4_OFF;
+    struct tcp_header *tcp = delivered_tcp(d);
+    uint8_t *payload = (uint8_t *)(tcp + 1);
+    int i;
+
+    g_assert_cmpuint(d->size, ==, l4_off + sizeof(*tcp) + len);
+    g_assert_cmpuint(be16_to_cpu(tcp->th_sport), ==, sport);
+    g_assert_cmpuint(be32_to_cpu(tcp->th_seq), ==, seq);
+    for (i = 0; i < len; i++) {
+        g_assert_cmpuint(payload[i], ==, (seq + i) & 0xff);
+    }
+
+    if (ipv6) {
+        struct ip6_header *ip6 =
+            (struct ip6_header *)(d->buf + sizeof(struct eth_header));
+
+        g_assert_cmpuint(be16_to_cpu(ip6->ip6_ctlun.ip6_un1.ip6_un1_plen),
+                         ==, sizeof(*tcp) + len);
+    } else {
+        struct ip_header *ip =
+            (struct ip_header *)(d->buf + sizeof(struct eth_header));
+
+        g_assert_cmpuint(be16_to_cpu(ip->ip_len), ==,
+                         sizeof(*ip) + sizeof(*tcp) + len);
+        g_assert_cmpuint(net_raw_checksum((uint8_t *)ip, sizeof(*ip)), ==, 0);
+    }
+
+    if (segs == 1) {
+        g_assert_cmpuint(d->hdr.gso_type, ==, VIRTIO_NET_HDR_GSO_NONE);
+        g_assert_cmpuint(d->hdr.flags, ==, VIRTIO_NET_HDR_F_DATA_VALID);
+        g_assert_cmpuint(tcp_csum(d->buf, d->size), ==, 0);
+        return;
+    }
+
+    g_assert_cmpuint(d->hdr.gso_type, ==,
+                     ipv6 ? VIRTIO_NET_HDR_GSO_TCPV6 : VIRTIO_NET_HDR_GSO_TCPV4);
+    g_assert_cmpuint(d->hdr.gso_size, ==, MSS);
+    g_assert_cmpuint(d->hdr.hdr_len, ==, l4_off + sizeof(*tcp));
+    g_assert_cmpuint(d->hdr.flags, ==, VIRTIO_NET_HDR_F_NEEDS_CSUM);
+    g_assert_cmpuint(d->hdr.csum_start, ==, l4_off);
+    g_assert_cmpuint(d->hdr.csum_offset, ==,
+                     offsetof(struct tcp_header, th_sum));
+
+    /* Complete the checksum the way the guest does; the result is valid */
+    tcp->th_sum = cpu_to_be16(net_raw_checksum(d->buf + l4_off,
+                                               d->size - l4_off));
+    g_assert_cmpuint(tcp_csum(d->buf, d->size), ==, 0);
+}
+
+static void test_gro_in_order(void)
+{
+    TestGro t;
+    VirtioNetGroStats stats;
+    int i;
+
+    test_gro_init(&t);
+
+    for (i = 0; i < 4; i++) {
+        offer_held(&t, false, 1000, i * MSS, 0, MSS);
+    }
+    g_assert_cmpint(t.num_delivered, ==, 0);
+    g_assert_true(virtio_net_gro_pending(t.gro));
+
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_false(virtio_net_gro_pending(t.gro));
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, 4 * MSS, 4);
+
+    stats = test_gro_stats(&t);
+    g_assert_cmpuint(stats.received, ==, 4);
+    g_assert_cmpuint(stats.coalesced, ==, 3);
+    g_assert_cmpuint(stats.flushed, ==, 1);
+    g_assert_cmpuint(stats.bypassed, ==, 0);
+
+    /* A lone segment keeps its own checksum and no GSO type */
+    offer_held(&t, false, 1000, 4 * MSS, 0, MSS);
+    g_assert_true(virtio_net_gro_flush(t.gro, true));
+    g_assert_cmpint(t.num_delivered, ==, 2);
+    check_delivered(&t.delivered[1], 1000, 4 * MSS, MSS, 1);
+    g_assert_cmpuint(test_gro_stats(&t).timer_flushes, ==, 1);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_out_of_order(void)
+{
+    TestGro t;
+
+    test_gro_init(&t);
+
+    /* A gap in the sequence numbers delivers what is held */
+    offer_held(&t, false, 1000, 0, 0, MSS);
+    offer_held(&t, false, 1000, MSS, 0, MSS);
+    offer_held(&t, false, 1000, 3 * MSS, 0, MSS);
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, 2 * MSS, 2);
+
+    /* So does a retransmission of older data */
+    offer_held(&t, false, 1000, MSS, 0, MSS);
+    g_assert_cmpint(t.num_delivered, ==, 2);
+    check_delivered(&t.delivered[1], 1000, 3 * MSS, MSS, 1);
+
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_cmpint(t.num_delivered, ==, 3);
+    check_delivered(&t.delivered[2], 1000, MSS, MSS, 1);
+    g_assert_cmpuint(test_gro_stats(&t).coalesced, ==, 1);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_boundaries(void)
+{
+    TestGro t;
+    TestFrame f;
+
+    test_gro_init(&t);
+
+    /* FIN and RST are passed through after what is held for the flow */
+    offer_held(&t, false, 1000, 0, 0, MSS);
+    make_frame(&f, false, 1000, MSS, TH_FIN, MSS);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BYPASS);
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, MSS, 1);
+
+    offer_held(&t, false, 2000, 0, 0, MSS);
+    offer_held(&t, false, 2000, MSS, 0, MSS);
+    make_frame(&f, false, 2000, 2 * MSS, TH_RST, 0);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BYPASS);
+    g_assert_cmpint(t.num_delivered, ==, 2);
+    check_delivered(&t.delivered[1], 2000, 0, 2 * MSS, 2);
+
+    /* Pure ACKs, too */
+    offer_held(&t, false, 3000, 0, 0, MSS);
+    make_frame(&f, false, 3000, MSS, 0, 0);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BYPASS);
+    g_assert_cmpint(t.num_delivered, ==, 3);
+    g_assert_false(virtio_net_gro_pending(t.gro));
+
+    /* PSH ends the super-frame and delivers it at once, with PSH set */
+    offer_held(&t, false, 4000, 0, 0, MSS);
+    offer_held(&t, false, 4000, MSS, TH_PUSH, MSS);
+    g_assert_cmpint(t.num_delivered, ==, 4);
+    check_delivered(&t.delivered[3], 4000, 0, 2 * MSS, 2);
+    g_assert_cmpuint(TCP_HEADER_FLAGS(delivered_tcp(&t.delivered[3])) &
+                     TH_PUSH, ==, TH_PUSH);
+    g_assert_false(virtio_net_gro_pending(t.gro));
+
+    /* So does a segment shorter than the first one */
+    offer_held(&t, false, 5000, 0, 0, MSS);
+    offer_held(&t, false, 5000, MSS, 0, MSS / 2);
+    g_assert_cmpint(t.num_delivered, ==, 5);
+    g_assert_cmpuint(t.delivered[4].hdr.gso_size, ==, MSS);
+    g_assert_false(virtio_net_gro_pending(t.gro));
+
+    g_assert_cmpuint(test_gro_stats(&t).bypassed, ==, 3);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_bad_csum(void)
+{
+    struct virtio_net_hdr valid = { .flags = VIRTIO_NET_HDR_F_DATA_VALID };
+    struct tcp_header *tcp;
+    TestGro t;
+    TestFrame f;
+
+    test_gro_init(&t);
+
+    /* The guest gets to see the bad segment, after the good ones */
+    offer_held(&t, false, 1000, 0, 0, MSS);
+    make_frame(&f, false, 1000, MSS, 0, MSS);
+    tcp = (struct tcp_header *)(f.buf + IP4_L4_OFF);
+    tcp->th_sum ^= cpu_to_be16(0x1234);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BYPASS);
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    g_assert_false(virtio_net_gro_pending(t.gro));
+    g_assert_cmpuint(test_gro_stats(&t).csum_errors, ==, 1);
+
+    /* A checksum that the backend validated is not looked at */
+    g_assert_cmpint(virtio_net_gro_receive(t.gro, &valid, f.buf, f.size),
+                    ==, VIRTIO_NET_GRO_HELD);
+    g_assert_cmpuint(test_gro_stats(&t).csum_errors, ==, 1);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_ipv6(void)
+{
+    TestGro t;
+    TestFrame f;
+
+    test_gro_init(&t);
+
+    offer_held(&t, true, 1000, 0, 0, MSS);
+    offer_held(&t, true, 1000, MSS, 0, MSS);
+    offer_held(&t, true, 1000, 2 * MSS, 0, MSS);
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, 3 * MSS, 3);
+
+    /* IPv4 and IPv6 flows are never mixed up */
+    offer_held(&t, false, 1000, 3 * MSS, 0, MSS);
+    offer_held(&t, true, 1000, 3 * MSS, 0, MSS);
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_cmpint(t.num_delivered, ==, 3);
+    g_assert_cmpuint(frame_l4_off(t.delivered[1].buf), ==, IP4_L4_OFF);
+    g_assert_cmpuint(frame_l4_off(t.delivered[2].buf), ==, IP6_L4_OFF);
+
+    /* Without TSO6 in the guest, IPv6 is not coalesced */
+    virtio_net_gro_set_offloads(t.gro, true, false);
+    make_frame(&f, true, 1000, 4 * MSS, 0, MSS);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BYPASS);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_eviction(void)
+{
+    VirtioNetGroStats stats;
+    TestGro t;
+    int i;
+
+    test_gro_init(&t);
+
+    /* One flow more than there are slots: the oldest one goes first */
+    for (i = 0; i < 9; i++) {
+        offer_held(&t, false, 1000 + i, 0, 0, MSS);
+    }
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, MSS, 1);
+
+    /* The others are still held and are delivered in arrival order */
+    offer_held(&t, false, 1001, MSS, 0, MSS);
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_cmpint(t.num_delivered, ==, 9);
+    check_delivered(&t.delivered[1], 1001, 0, 2 * MSS, 2);
+    for (i = 2; i < 9; i++) {
+        check_delivered(&t.delivered[i], 1000 + i, 0, MSS, 1);
+    }
+
+    stats = test_gro_stats(&t);
+    g_assert_cmpuint(stats.evictions, ==, 1);
+    g_assert_cmpuint(stats.flushed, ==, 9);
+
+    test_gro_cleanup(&t);
+}
+
+static void test_gro_blocked(void)
+{
+    struct virtio_net_hdr gso = { .gso_type = VIRTIO_NET_HDR_GSO_TCPV4 };
+    VirtioNetGroStats stats;
+    TestGro t;
+    TestFrame f;
+
+    test_gro_init(&t);
+    t.room = 0;
+
+    offer_held(&t, false, 1000, 0, 0, MSS);
+    offer_held(&t, false, 2000, 0, 0, MSS);
+
+    /* Nothing can be delivered: the frames stay held, in order */
+    g_assert_false(virtio_net_gro_flush(t.gro, false));
+    g_assert_true(virtio_net_gro_pending(t.gro));
+
+    /* Frames that need older ones delivered first are refused */
+    make_frame(&f, false, 1000, 2 * MSS, 0, MSS);
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_BLOCKED);
+    g_assert_cmpint(virtio_net_gro_receive(t.gro, &gso, f.buf, f.size),
+                    ==, VIRTIO_NET_GRO_BLOCKED);
+
+    /* Room for one frame only: flushing stops after it */
+    t.room = 1;
+    g_assert_false(virtio_net_gro_flush(t.gro, false));
+    g_assert_cmpint(t.num_delivered, ==, 1);
+    check_delivered(&t.delivered[0], 1000, 0, MSS, 1);
+
+    /* Once the guest has buffers again, everything goes out */
+    t.room = -1;
+    g_assert_true(virtio_net_gro_flush(t.gro, false));
+    g_assert_false(virtio_net_gro_pending(t.gro));
+    g_assert_cmpint(t.num_delivered, ==, 2);
+    check_delivered(&t.delivered[1], 2000, 0, MSS, 1);
+
+    /* And the refused frame is accepted when offered again */
+    g_assert_cmpint(offer(&t, &f), ==, VIRTIO_NET_GRO_HELD);
+
+    stats = test_gro_stats(&t);
+    g_assert_cmpuint(stats.blocked, ==, 4);
+    g_assert_cmpuint(stats.dropped, ==, 0);
+
+    /* A reset drops what is held */
+    virtio_net_gro_purge(t.gro);
+    g_assert_false(virtio_net_gro_pending(t.gro));
+    g_assert_cmpuint(test_gro_stats(&t).dropped, ==, 1);
+
+    test_gro_cleanup(&t);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/virtio-net-gro/in-order", test_gro_in_order);
+    g_test_add_func("/virtio-net-gro/out-of-order", test_gro_out_of_order);
+    g_test_add_func("/virtio-net-gro/boundaries", test_gro_boundaries);
+    g_test_add_func("/virtio-net-gro/bad-csum", test_gro_bad_csum);
+    g_test_add_func("/virtio-net-gro/ipv6", test_gro_ipv6);
+    g_test_add_func("/virtio-net-gro/eviction", test_gro_eviction);
+    g_test_add_func("/virtio-net-gro/blocked", test_gro_blocked);
+    return g_test_run();
+}
@@ -0,0 +1,247 @@
+/*
+ * Word scanning and population count over long bitmaps
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/bitmap.h"
+#include "qemu/host-utils.h"
+
+static size_t
+find_word_not_int(const unsigned long *words, size_t start, size_t end,
+                  unsigned long pattern)
+{
+    size_t i = start;
+
+    /* Check four words at a time, then find the exact one below.  */
+    for (; i + 4 <= end; i += 4) {
+        if ((words[i] ^ pattern) | (words[i + 1] ^ pattern) |
+            (words[i + 2] ^ pattern) | (words[i + 3] ^ pattern)) {
+            break;
+        }
+    }
+    for (; i < end; i++) {
+        if (words[i] != pattern) {
+            return i;
+        }
+    }
+    return end;
+}
+
+static uint64_t
+count_words_int(const unsigned long *words, size_t nr)
+{
+    uint64_t count = 0;
+    size_t i;
+
+    for (i = 0; i < nr; i++) {
+        count += ctpopl(words[i]);
+    }
+    return count;
+}
+
+/*
+ * The vector kernels treat the bitmap as an array of 64-bit words, so they
+ * are only built for hosts with 64-bit longs.
+ */
+#if defined(CONFIG_AVX2_OPT) && HOST_LONG_BITS == 64
+/* See bufferiszero.c for why the includes are within the target regions.  */
+#pragma GCC push_options
+#pragma GCC target("popcnt")
+
+static uint64_t
+count_words_popcnt(const unsigned long *words, size_t nr)
+{
+    uint64_t c0 = 0, c1 = 0, c2 = 0, c3 = 0;
+    size_t i = 0;
+
+    for (; i + 4 <= nr; i += 4) {
+        c0 += __builtin_popcountl(words[i]);
+        c1 += __builtin_popcountl(words[i + 1]);
+        c2 += __builtin_popcountl(words[i + 2]);
+        c3 += __builtin_popcountl(words[i + 3]);
+    }
+    for (; i < nr; i++) {
+        c0 += __builtin_popcountl(words[i]);
+    }
+    return c0 + c1 + c2 + c3;
+}
+
+#pragma GCC pop_options
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static size_t
+find_word_not_avx2(const unsigned long *words, size_t start, size_t end,
+                   unsigned long pattern)
+{
+    __m256i pat = _mm256_set1_epi64x(pattern);
+    size_t i = start;
+
+    /* Compare 64 bytes per iteration; the scalar loop finds the word.  */
+    for (; i + 8 <= end; i += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)&words[i]);
+        __m256i b = _mm256_loadu_si256((const __m256i *)&words[i + 4]);
+        __m256i eq = _mm256_and_si256(_mm256_cmpeq_epi64(a, pat),
+                                      _mm256_cmpeq_epi64(b, pat));
+
+        if (unlikely(_mm256_movemask_epi8(eq) != -1)) {
+            break;
+        }
+    }
+    for (; i < end; i++) {
+        if (words[i] != pattern) {
+            return i;
+        }
+    }
+    return end;
+}
+
+/*
+ * Nibble lookup table popcount: split each byte into two nibbles, look up
+ * their bit counts with vpshufb, and sum the bytes of each 64-bit lane with
+ * vpsadbw.
+ */
+static uint64_t
+count_words_avx2(const unsigned long *words, size_t nr)
+{
+    const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4,
+                                            0, 1, 1, 2, 1, 2, 2, 3,
+                                            1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc = zero;
+    uint64_t lanes[4];
+    uint64_t count;
+    size_t i = 0;
+
+    for (; i + 4 <= nr; i += 4) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)&words[i]);
+        __m256i lo = _mm256_and_si256(v, low_mask);
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+        __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, lo),
+                                      _mm256_shuffle_epi8(lookup, hi));
+
+        acc = _mm256_add_epi64(acc, _mm256_sad_epu8(cnt, zero));
+    }
+
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    for (; i < nr; i++) {
+        count += ctpopl(words[i]);
+    }
+    return count;
+}
+
+#pragma GCC pop_options
+
+/*
+ * Note that for test_bitmap_accel_next, the most preferred ISA must have
+ * the least significant bit.
+ */
+#define CACHE_AVX2    1
+#define CACHE_POPCNT  2
+
+static unsigned cpuid_cache;
+static size_t (*find_word_not_accel)(const unsigned long *, size_t, size_t,
+                                     unsigned long) = find_word_not_int;
+static uint64_t (*count_words_accel)(const unsigned long *, size_t) =
+    count_words_int;
+
+static void init_accel(unsigned cache)
+{
+    find_word_not_accel = find_word_not_int;
+    count_words_accel = count_words_int;
+
+    if (cache & CACHE_POPCNT) {
+        count_words_accel = count_words_popcnt;
+    }
+    if (cache & CACHE_AVX2) {
+        find_word_not_accel = find_word_not_avx2;
+        count_words_accel = count_words_avx2;
+    }
+}
+
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    unsigned max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+        if (c & bit_POPCNT) {
+            cache |= CACHE_POPCNT;
+        }
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+
+bool test_bitmap_accel_next(void)
+{
+    /* If no bits set, we just tested the integer versions.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+/* Below this many words, the setup cost of the vector loops dominates.  */
+#define ACCEL_MIN_WORDS 16
+
+size_t bitmap_find_word_not(const unsigned long *words, size_t start,
+                            size_t end, unsigned long pattern)
+{
+    if (end - start >= ACCEL_MIN_WORDS) {
+        return find_word_not_accel(words, start, end, pattern);
+    }
+    return find_word_not_int(words, start, end, pattern);
+}
+
+uint64_t bitmap_count_words(const unsigned long *words, size_t nr)
+{
+    if (nr >= ACCEL_MIN_WORDS) {
+        return count_words_accel(words, nr);
+    }
+    return count_words_int(words, nr);
+}
+
+#else
+
+bool test_bitmap_accel_next(void)
+{
+    return false;
+}
+
+size_t bitmap_find_word_not(const unsigned long *words, size_t start,
+                            size_t end, unsigned long pattern)
+{
+    return find_word_not_int(words, start, end, pattern);
+}
+
+uint64_t bitmap_count_words(const unsigned long *words, size_t nr)
+{
+    return count_words_int(words, nr);
+}
+
+#endif
@@ -358,11 +358,9 @@ int slow_bitmap_intersects(const unsigned long *bitmap1,
 
 long slow_bitmap_count_one(const unsigned long *bitmap, long nbits)
 {
-    long k, lim = nbits / BITS_PER_LONG, result = 0;
+    long k = nbits / BITS_PER_LONG, result;
 
-    for (k = 0; k < lim; k++) {
-        result += ctpopl(bitmap[k]);
-    }
+    result = bitmap_count_words(bitmap, k);
 
     if (nbits % BITS_PER_LONG) {
         result += ctpopl(bitmap[k] & BITMAP_LAST_WORD_MASK(nbits));
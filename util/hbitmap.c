@@ -11,6 +11,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/hbitmap.h"
+#include "qemu/bitmap.h"
 #include "qemu/host-utils.h"
 #include "trace.h"
 #include "crypto/hash.h"
@@ -197,7 +198,8 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 {
     HBitmapIter hbi;
     int64_t first_dirty_off;
-    uint64_t end;
+    uint64_t end, pos;
+    unsigned long cur;
 
     assert(start >= 0 && count >= 0);
 
@@ -207,6 +209,16 @@ int64_t hbitmap_next_dirty(const HBitmap *hb, int64_t start, int64_t count)
 
     end = count > hb->orig_size - start ? hb->orig_size : start + count;
 
+    /* Fast path: the next dirty bit is in the same word as @start.  */
+    pos = start >> hb->granularity;
+    cur = hb->levels[HBITMAP_LEVELS - 1][pos >> BITS_PER_LEVEL] &
+          BITMAP_FIRST_WORD_MASK(pos);
+    if (cur) {
+        first_dirty_off = ((pos & ~(uint64_t)(BITS_PER_LONG - 1)) + ctzl(cur))
+                          << hb->granularity;
+        return first_dirty_off < end ? MAX(start, first_dirty_off) : -1;
+    }
+
     hbitmap_iter_init(&hbi, hb, start);
     first_dirty_off = hbitmap_iter_next(&hbi);
 
@@ -245,10 +257,7 @@ int64_t hbitmap_next_zero(const HBitmap *hb, int64_t start, int64_t count)
     assert((start >> hb->granularity) < hb->size);
 
     if (cur == (unsigned long)-1) {
-        do {
-            pos++;
-        } while (pos < sz && last_lev[pos] == (unsigned long)-1);
-
+        pos = bitmap_find_word_not(last_lev, pos + 1, sz, (unsigned long)-1);
         if (pos >= sz) {
             return -1;
         }
@@ -301,6 +310,24 @@ bool hbitmap_next_dirty_area(const HBitmap *hb, int64_t start, int64_t end,
     return true;
 }
 
+size_t hbitmap_get_dirty_extents(const HBitmap *hb, int64_t start, int64_t end,
+                                 HBitmapExtent *extents, size_t max_extents)
+{
+    int64_t dirty_start, dirty_count;
+    size_t n = 0;
+
+    while (n < max_extents &&
+           hbitmap_next_dirty_area(hb, start, end, INT64_MAX,
+                                   &dirty_start, &dirty_count)) {
+        extents[n].start = dirty_start;
+        extents[n].count = dirty_count;
+        n++;
+        start = dirty_start + dirty_count;
+    }
+
+    return n;
+}
+
 bool hbitmap_status(const HBitmap *hb, int64_t start, int64_t count,
                     int64_t *pnum)
 {
@@ -349,60 +376,55 @@ uint64_t hbitmap_count(const HBitmap *hb)
     return hb->count << hb->granularity;
 }
 
-/**
- * hbitmap_iter_next_word:
- * @hbi: HBitmapIter to operate on.
- * @p_cur: Location where to store the next non-zero word.
+/* Count the number of set bits between start and end, not accounting for
+ * the granularity.
  *
- * Return the index of the next nonzero word that is set in @hbi's
- * associated HBitmap, and set *p_cur to the content of that word
- * (bits before the index that was passed to hbitmap_iter_init are
- * trimmed on the first call).  Return -1, and set *p_cur to zero,
- * if all remaining words are zero.
+ * Whole words are counted in runs with bitmap_count_words().  Runs of zero
+ * words are skipped by scanning the 2nd-last level, where bit N is set iff
+ * word N of the last level is nonzero; that level is BITS_PER_LONG times
+ * smaller, so sparse bitmaps are still cheap to count.
  */
-static size_t hbitmap_iter_next_word(HBitmapIter *hbi, unsigned long *p_cur)
+static uint64_t hb_count_between(HBitmap *hb, uint64_t start, uint64_t last)
 {
-    unsigned long cur = hbi->cur[HBITMAP_LEVELS - 1];
+    const unsigned long *words = hb->levels[HBITMAP_LEVELS - 1];
+    const unsigned long *groups = hb->levels[HBITMAP_LEVELS - 2];
+    uint64_t end = last + 1;
+    size_t pos = start >> BITS_PER_LEVEL;
+    size_t end_pos = end >> BITS_PER_LEVEL;
+    size_t groups_end = DIV_ROUND_UP(end_pos, BITS_PER_LONG);
+    uint64_t count;
 
-    if (cur == 0) {
-        cur = hbitmap_iter_skip_words(hbi);
-        if (cur == 0) {
-            *p_cur = 0;
-            return -1;
-        }
+    if (pos == end_pos) {
+        return ctpopl(words[pos] & BITMAP_FIRST_WORD_MASK(start) &
+                      ~BITMAP_FIRST_WORD_MASK(end));
     }
 
-    /* The next call will resume work from the next word.  */
-    hbi->cur[HBITMAP_LEVELS - 1] = 0;
-    *p_cur = cur;
-    return hbi->pos;
-}
+    count = ctpopl(words[pos] & BITMAP_FIRST_WORD_MASK(start));
+    pos++;
 
-/* Count the number of set bits between start and end, not accounting for
- * the granularity.  Also an example of how to use hbitmap_iter_next_word.
- */
-static uint64_t hb_count_between(HBitmap *hb, uint64_t start, uint64_t last)
-{
-    HBitmapIter hbi;
-    uint64_t count = 0;
-    uint64_t end = last + 1;
-    unsigned long cur;
-    size_t pos;
+    while (pos < end_pos) {
+        size_t group = pos >> BITS_PER_LEVEL;
+        unsigned long cur = groups[group] & BITMAP_FIRST_WORD_MASK(pos);
+        size_t group_end;
 
-    hbitmap_iter_init(&hbi, hb, start << hb->granularity);
-    for (;;) {
-        pos = hbitmap_iter_next_word(&hbi, &cur);
-        if (pos >= (end >> BITS_PER_LEVEL)) {
-            break;
+        if (!cur) {
+            group = bitmap_find_word_not(groups, group + 1, groups_end, 0);
+            pos = (size_t)group << BITS_PER_LEVEL;
+            continue;
+        }
+
+        /* Start at the first nonzero word in this group.  */
+        pos = ((size_t)group << BITS_PER_LEVEL) + ctzl(cur);
+        group_end = MIN(((size_t)group + 1) << BITS_PER_LEVEL, end_pos);
+        if (pos < group_end) {
+            count += bitmap_count_words(words + pos, group_end - pos);
         }
-        count += ctpopl(cur);
+        pos = group_end;
     }
 
-    if (pos == (end >> BITS_PER_LEVEL)) {
+    if (end & (BITS_PER_LONG - 1)) {
         /* Drop bits representing the END-th and subsequent items.  */
-        int bit = end & (BITS_PER_LONG - 1);
-        cur &= (1UL << bit) - 1;
-        count += ctpopl(cur);
+        count += ctpopl(words[end_pos] & ~BITMAP_FIRST_WORD_MASK(end));
     }
 
     return count;
@@ -885,16 +907,20 @@ bool hbitmap_can_merge(const HBitmap *a, const HBitmap *b)
  */
 static void hbitmap_sparse_merge(HBitmap *dst, const HBitmap *src)
 {
-    int64_t offset;
-    int64_t count;
+    HBitmapExtent extents[64];
+    int64_t offset = 0;
+    size_t i, n;
 
-    for (offset = 0;
-         hbitmap_next_dirty_area(src, offset, src->orig_size, INT64_MAX,
-                                 &offset, &count);
-         offset += count)
-    {
-        hbitmap_set(dst, offset, count);
-    }
+    do {
+        n = hbitmap_get_dirty_extents(src, offset, src->orig_size, extents,
+                                      ARRAY_SIZE(extents));
+        for (i = 0; i < n; i++) {
+            hbitmap_set(dst, extents[i].start, extents[i].count);
+        }
+        if (n) {
+            offset = extents[n - 1].start + extents[n - 1].count;
+        }
+    } while (n == ARRAY_SIZE(extents));
 }
 
 /**
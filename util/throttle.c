@@ -23,6 +23,7 @@
  */
 
 #include "qemu/osdep.h"
+#include <math.h>
 #include "qapi/error.h"
 #include "qemu/throttle.h"
 #include "qemu/timer.h"
@@ -444,12 +445,12 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
-/* do the accounting for this operation
- *
- * @is_write: the type of operation (read/write)
- * @size:     the size of the operation
+/* Add @size bytes and @units operations to the buckets that limit requests
+ * of one type.  Negative amounts are taken out again, but no bucket goes
+ * below zero.
  */
-void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+static void throttle_do_account(ThrottleState *ts, bool is_write,
+                                double size, double units)
 {
     const BucketType bucket_types_size[2][2] = {
         { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
@@ -459,31 +460,100 @@ void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
         { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
     };
-    double units = 1.0;
     unsigned i;
 
-    /* if cfg.op_size is defined and smaller than size we compute unit count */
-    if (ts->cfg.op_size && size > ts->cfg.op_size) {
-        units = (double) size / ts->cfg.op_size;
-    }
-
     for (i = 0; i < 2; i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[is_write][i]];
-        bkt->level += size;
+        bkt->level = MAX(bkt->level + size, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+            bkt->burst_level = MAX(bkt->burst_level + size, 0);
         }
 
         bkt = &ts->cfg.buckets[bucket_types_units[is_write][i]];
-        bkt->level += units;
+        bkt->level = MAX(bkt->level + units, 0);
         if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+            bkt->burst_level = MAX(bkt->burst_level + units, 0);
         }
     }
 }
 
+/* do the accounting for this operation
+ *
+ * @is_write: the type of operation (read/write)
+ * @size:     the size of the operation
+ */
+void throttle_account(ThrottleState *ts, bool is_write, uint64_t size)
+{
+    double units = 1.0;
+
+    /* if cfg.op_size is defined and smaller than size we compute unit count */
+    if (ts->cfg.op_size && size > ts->cfg.op_size) {
+        units = (double) size / ts->cfg.op_size;
+    }
+
+    throttle_do_account(ts, is_write, size, units);
+}
+
+/* Compute a credit: the bytes and operations of one type that one of
+ * @shares equal users may do in @period_ns at the average rates.  An
+ * amount that no bucket limits is returned as UINT64_MAX or INFINITY.
+ *
+ * @is_write:  the type of operation (read/write)
+ * @period_ns: the time that the credit is for
+ * @shares:    the number of users that share the limits
+ * @bytes:     the number of bytes is written here
+ * @units:     the number of operations is written here
+ */
+void throttle_compute_credit(ThrottleState *ts, bool is_write,
+                             int64_t period_ns, unsigned shares,
+                             uint64_t *bytes, double *units)
+{
+    const BucketType to_check[2][4] = {
+        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ,
+          THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE,
+          THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+    };
+    double amount[2] = { INFINITY, INFINITY };
+    int i;
+
+    assert(shares > 0);
+    for (i = 0; i < 4; i++) {
+        LeakyBucket *bkt = &ts->cfg.buckets[to_check[is_write][i]];
+        double n;
+
+        if (!bkt->avg) {
+            continue;
+        }
+        n = (double) bkt->avg * period_ns / NANOSECONDS_PER_SECOND / shares;
+        amount[i / 2] = MIN(amount[i / 2], n);
+    }
+
+    *bytes = isinf(amount[0]) ? UINT64_MAX : (uint64_t) amount[0];
+    *units = amount[1];
+}
+
+/* Reserve a credit computed by throttle_compute_credit() in the buckets.
+ * Unlimited amounts are not accounted.
+ */
+void throttle_account_credit(ThrottleState *ts, bool is_write,
+                             uint64_t bytes, double units)
+{
+    throttle_do_account(ts, is_write, bytes == UINT64_MAX ? 0 : bytes,
+                        isinf(units) ? 0 : units);
+}
+
+/* Give back the part of a credit that was not used */
+void throttle_refund_credit(ThrottleState *ts, bool is_write,
+                            uint64_t bytes, double units)
+{
+    throttle_do_account(ts, is_write,
+                        bytes == UINT64_MAX ? 0 : -(double) bytes,
+                        isinf(units) ? 0 : -units);
+}
+
 /* return a ThrottleConfig based on the options in a ThrottleLimits
  *
  * @arg:    the ThrottleLimits object to read from